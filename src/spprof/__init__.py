@@ -11,19 +11,31 @@ Example usage:
 
 from __future__ import annotations
 
+import atexit
+import contextlib
+import contextvars
 import functools
+import os
 import platform
 import sys
 import threading
+import warnings
+from array import array
+from collections.abc import Iterable, Iterator, Mapping, Sequence
 from dataclasses import dataclass
 from datetime import datetime
 from pathlib import Path
-from typing import TYPE_CHECKING, Any, Callable, Literal, TypeVar
+from types import MappingProxyType
+from typing import TYPE_CHECKING, Any, Callable, Literal, TypeVar, overload
 
 
 if TYPE_CHECKING:
-    from collections.abc import Sequence
+    import asyncio
 
+    from spprof.heavy_hitters import HeavyHitters
+    from spprof.shared import SharedArena
+    from spprof.tasks import TaskTracker
+    from spprof.timeline import Timeline
 
 __version__ = "0.1.0"
 
@@ -71,6 +83,9 @@ class Sample:
     thread_id: int
     thread_name: str | None
     frames: Sequence[Frame]  # Bottom to top
+    weight: int = 1  # Timer expirations this sample stands for (1 + overruns)
+    cpu_time_ns: int | None = None  # Thread CPU time since its previous sample
+    labels: Mapping[str, str] | None = None  # spprof.labels() in effect, if any
 
 
 @dataclass
@@ -81,6 +96,8 @@ class ProfilerStats:
     dropped_samples: int
     duration_ms: float
     overhead_estimate_pct: float
+    interval_scale: int = 1  # Interval multiplier chosen by the overhead budget
+    validation_drops: int = 0  # Free-threaded samples rejected as inconsistent
 
 
 @dataclass(frozen=True)
@@ -90,9 +107,10 @@ class StackTrace:
     frames: tuple[Frame, ...]  # Immutable tuple for hashing
     thread_id: int
     thread_name: str | None = None
+    labels: tuple[tuple[str, str], ...] = ()  # Sorted label pairs
 
     def __hash__(self) -> int:
-        return hash((self.frames, self.thread_id))
+        return hash((self.frames, self.thread_id, self.labels))
 
 
 @dataclass
@@ -103,6 +121,14 @@ class AggregatedStack:
     thread_id: int
     thread_name: str | None
     count: int  # Number of times this exact stack was sampled
+    weight: int | None = None  # Sum of sample weights; defaults to count
+    cpu_time_ns: int | None = None  # Sum of measured CPU time, if available
+    weight_error: int = 0  # Heavy-hitter mode: weight possibly missed before tracking
+    labels: Mapping[str, str] | None = None  # spprof.labels() in effect, if any
+
+    def __post_init__(self) -> None:
+        if self.weight is None:
+            self.weight = self.count
 
 
 @dataclass
@@ -122,18 +148,24 @@ class AggregatedProfile:
 
     start_time: datetime
     end_time: datetime
-    interval_ms: int
+    interval_ms: float
     stacks: list[AggregatedStack]  # Unique stacks with counts
     total_samples: int  # Original sample count
     dropped_count: int
     python_version: str
     platform: str
+    error_bound: int = 0  # Heavy-hitter mode: max weight of any stack not listed
 
     @property
     def unique_stack_count(self) -> int:
         """Number of unique stacks."""
         return len(self.stacks)
 
+    @property
+    def total_weight(self) -> int:
+        """Timer expirations represented by all stacks (counts overruns)."""
+        return sum(stack.weight or 0 for stack in self.stacks)
+
     @property
     def compression_ratio(self) -> float:
         """Ratio of original samples to unique stacks (higher = more compression)."""
@@ -161,14 +193,32 @@ class AggregatedProfile:
         return aggregated_to_collapsed(self)
 
     def save(
-        self, path: Path | str, format: Literal["speedscope", "collapsed"] = "speedscope"
+        self,
+        path: Path | str,
+        format: Literal["speedscope", "collapsed", "pprof"] = "speedscope",
     ) -> None:
         """Save aggregated profile to file."""
         import json
 
         output_path = Path(path)
 
-        if format == "speedscope":
+        if format == "pprof":
+            samples = (
+                Sample(
+                    timestamp_ns=0,
+                    thread_id=stack.thread_id,
+                    thread_name=stack.thread_name,
+                    frames=stack.frames,
+                    weight=stack.weight if stack.weight is not None else stack.count,
+                    cpu_time_ns=stack.cpu_time_ns,
+                    labels=stack.labels,
+                )
+                for stack in self.stacks
+            )
+            _save_pprof(output_path, _SampleColumns.from_samples(samples), self)
+        elif format in ("perfetto", "perf"):
+            raise ValueError(f"{format} output needs timestamps; save the Profile instead")
+        elif format == "speedscope":
             speedscope_data = self.to_speedscope()
             output_path.write_text(json.dumps(speedscope_data, indent=2))
         elif format == "collapsed":
@@ -184,8 +234,8 @@ class Profile:
 
     start_time: datetime
     end_time: datetime
-    interval_ms: int
-    samples: list[Sample]
+    interval_ms: float  # Fractional in high-frequency mode
+    samples: Sequence[Sample]  # Lazily materialized when filled by the native drain
     dropped_count: int
     python_version: str
     platform: str
@@ -201,6 +251,20 @@ class Profile:
         delta = self.end_time - self.start_time
         return delta.total_seconds() * 1000
 
+    @property
+    def total_weight(self) -> int:
+        """Timer expirations represented by all samples (counts overruns)."""
+        if isinstance(self.samples, _SampleColumns):
+            return sum(self.samples.weights)
+        return sum(sample.weight for sample in self.samples)
+
+    @property
+    def total_cpu_time_ns(self) -> int:
+        """Measured thread CPU time across samples (0 if not measured)."""
+        if isinstance(self.samples, _SampleColumns):
+            return self.samples.total_cpu_time_ns()
+        return sum(sample.cpu_time_ns or 0 for sample in self.samples)
+
     @property
     def effective_rate_hz(self) -> float:
         """Effective sampling rate in Hz (samples per second)."""
@@ -225,10 +289,26 @@ class Profile:
             >>> print(f"Compression: {agg.compression_ratio:.1f}x")
             >>> print(f"Memory reduction: {agg.memory_reduction_pct:.1f}%")
         """
+        if isinstance(self.samples, _SampleColumns):
+            columns = self.samples
+            aggregated_stacks = columns.aggregated_stacks(columns.aggregate_rows())
+            return AggregatedProfile(
+                start_time=self.start_time,
+                end_time=self.end_time,
+                interval_ms=self.interval_ms,
+                stacks=aggregated_stacks,
+                total_samples=self.sample_count,
+                dropped_count=self.dropped_count,
+                python_version=self.python_version,
+                platform=self.platform,
+            )
+
         from collections import Counter
 
-        # Count unique stacks
+        # Count unique stacks, tracking overrun weights alongside raw counts
         stack_counter: Counter[StackTrace] = Counter()
+        stack_weights: Counter[StackTrace] = Counter()
+        stack_cpu: dict[StackTrace, int] = {}
 
         for sample in self.samples:
             # Convert frames list to immutable tuple for hashing
@@ -236,8 +316,12 @@ class Profile:
                 frames=tuple(sample.frames),
                 thread_id=sample.thread_id,
                 thread_name=sample.thread_name,
+                labels=tuple(sorted(sample.labels.items())) if sample.labels else (),
             )
             stack_counter[stack] += 1
+            stack_weights[stack] += sample.weight
+            if sample.cpu_time_ns is not None:
+                stack_cpu[stack] = stack_cpu.get(stack, 0) + sample.cpu_time_ns
 
         # Convert to AggregatedStack list
         aggregated_stacks = [
@@ -246,6 +330,9 @@ class Profile:
                 thread_id=stack.thread_id,
                 thread_name=stack.thread_name,
                 count=count,
+                weight=stack_weights[stack],
+                cpu_time_ns=stack_cpu.get(stack),
+                labels=dict(stack.labels) if stack.labels else None,
             )
             for stack, count in stack_counter.items()
         ]
@@ -274,13 +361,59 @@ class Profile:
         return to_collapsed(self)
 
     def save(
-        self, path: Path | str, format: Literal["speedscope", "collapsed"] = "speedscope"
+        self,
+        path: Path | str,
+        format: Literal["speedscope", "collapsed", "pprof", "perfetto", "perf"] = "speedscope",
     ) -> None:
-        """Save profile to file."""
+        """Save profile to file.
+
+        Profiles returned by the native extension are streamed to disk by C
+        writers straight from their columns; the document is equivalent to
+        the one built by to_speedscope()/to_collapsed().
+
+        ``format="pprof"`` writes a gzip-compressed profile.proto for
+        ``go tool pprof`` and other pprof consumers (native extension only).
+
+        ``format="perfetto"`` writes a Perfetto protobuf trace with one track
+        per thread, for ui.perfetto.dev or trace_processor (native extension
+        only).
+
+        ``format="perf"`` writes ``perf script`` text with mixed Python and
+        native callchains, plus a ``perf-<pid>.map`` file next to it that
+        defines the synthetic Python symbols (native extension only).
+        """
         import json
 
         output_path = Path(path)
 
+        if format in ("pprof", "perfetto", "perf"):
+            columns = (
+                self.samples
+                if isinstance(self.samples, _SampleColumns)
+                else _SampleColumns.from_samples(self.samples)
+            )
+            if format == "pprof":
+                _save_pprof(output_path, columns, self)
+            elif format == "perfetto":
+                _save_perfetto(output_path, columns, self)
+            else:
+                _save_perf_script(output_path, columns, self)
+            return
+
+        if (
+            format in ("speedscope", "collapsed")
+            and isinstance(self.samples, _SampleColumns)
+            and hasattr(_native, "_write_speedscope")
+        ):
+            with output_path.open("wb") as f:
+                if format == "speedscope":
+                    _native._write_speedscope(
+                        f.fileno(), self.samples, float(self.interval_ms), f"spprof {__version__}"
+                    )
+                else:
+                    _native._write_collapsed(f.fileno(), self.samples)
+            return
+
         if format == "speedscope":
             speedscope_data = self.to_speedscope()
             output_path.write_text(json.dumps(speedscope_data, indent=2))
@@ -296,9 +429,139 @@ class Profile:
 _profiler_lock = threading.Lock()
 _is_active = False
 _start_time: datetime | None = None
-_interval_ms: int = 10
+_interval_ms: float = 10
 _samples: list[Sample] = []
 _output_path: Path | str | None = None
+_is_paused = False
+_burst_scheduler: _BurstScheduler | None = None
+_window_exporter: _WindowExporter | None = None
+_window_start: datetime | None = None  # Start of the window snapshot() returns next
+_window_dropped = 0  # Dropped-sample count already reported by earlier windows
+_heavy_hitters: HeavyHitters | None = None
+_timeline: Timeline | None = None
+
+# Interned spprof.labels() sets; id 0 stands for "no labels"
+_labels_lock = threading.Lock()
+_label_ids: dict[tuple[tuple[str, str], ...], int] = {}
+_label_sets: dict[int, Mapping[str, str]] = {}
+# The current set's id as 4 native-endian bytes: the signal handler reads it
+# straight from the sampled thread's Context without touching int internals
+_current_label: contextvars.ContextVar[bytes] = contextvars.ContextVar("spprof_label")
+_NO_LABEL = bytes(4)
+if _HAS_NATIVE and hasattr(_native, "_set_label_var"):
+    _native._set_label_var(_current_label)
+
+# Slots of a processes= session, shared with forked children
+_shared: SharedArena | None = None
+
+# Spawn paths of asyncio tasks, set by track_asyncio_tasks()
+_task_tracker: TaskTracker | None = None
+
+# How often top_k/timeline sessions without an export drain the ring buffer
+_SESSION_DRAIN_S = 1.0
+
+# Per-process stack budget of processes= sessions without top_k
+_PROCESSES_TOP_K = 1000
+
+
+class _BurstScheduler(threading.Thread):
+    """Duty-cycles the native timers: sample for burst_s, then idle until
+    the next period starts. Timers are fully disarmed while idle."""
+
+    def __init__(self, burst_s: float, period_s: float) -> None:
+        super().__init__(name="spprof-burst", daemon=True)
+        self._burst_s = burst_s
+        self._idle_s = period_s - burst_s
+        self._stop_event = threading.Event()
+
+    def run(self) -> None:
+        # Timers are armed by start(), so the first burst is already running
+        while not self._stop_event.wait(self._burst_s):
+            _native._pause()
+            if self._stop_event.wait(self._idle_s):
+                break
+            _native._resume()
+
+    def stop(self) -> None:
+        self._stop_event.set()
+        self.join()
+
+
+class _WindowExporter(threading.Thread):
+    """Writes a snapshot() window to path every interval_s while sampling
+    continues.
+
+    Output is double-buffered: the ring buffer keeps filling while the
+    drained window is written to a hidden sibling file, which is then
+    renamed over path. Readers only ever see complete windows. With
+    keep > 1 the previous windows are rotated to path.1, path.2, ...
+
+    With path None windows are only drained; top_k and timeline sessions
+    use this to keep the ring buffer empty while snapshot() folds each
+    window in.
+    """
+
+    def __init__(
+        self,
+        path: Path | None,
+        interval_s: float,
+        format: Literal["speedscope", "collapsed", "pprof"],
+        keep: int,
+    ) -> None:
+        super().__init__(name="spprof-export", daemon=True)
+        self._template = path
+        self._path = _expand_pid(path) if path is not None else None
+        self._interval_s = interval_s
+        self._format: Literal["speedscope", "collapsed", "pprof"] = format
+        self._keep = keep
+        self._stop_event = threading.Event()
+
+    def run(self) -> None:
+        while not self._stop_event.wait(self._interval_s):
+            try:
+                self.export()
+            except Exception as e:  # noqa: BLE001 - keep exporting later windows
+                warnings.warn(f"spprof: window export failed: {e}", RuntimeWarning, stacklevel=1)
+
+    def export(self) -> None:
+        if self._path is None:
+            snapshot(aggregate=_timeline is None)
+            return
+        window = snapshot(aggregate=True)
+        staging = self._path.with_name(f".{self._path.name}.tmp")
+        window.save(staging, format=self._format)
+        for index in range(self._keep - 1, 0, -1):
+            older = self._rotated(index - 1)
+            if older.exists():
+                os.replace(older, self._rotated(index))
+        os.replace(staging, self._path)
+
+    def _rotated(self, index: int) -> Path:
+        assert self._path is not None
+        return self._path if index == 0 else self._path.with_name(f"{self._path.name}.{index}")
+
+    def stop(self) -> None:
+        self._stop_event.set()
+        self.join()
+
+    def for_child(self) -> _WindowExporter | None:
+        """A replacement for a forked child, where this thread does not exist.
+
+        Only paths with {pid} are written from children. Otherwise a child
+        keeps draining for its top_k/timeline store, or leaves its samples
+        for stop().
+        """
+        path = self._template
+        if path is not None and "{pid}" not in str(path):
+            if _heavy_hitters is None and _timeline is None:
+                return None
+            path = None
+        return _WindowExporter(path, self._interval_s, self._format, self._keep)
+
+
+def _expand_pid(path: Path | str) -> Path:
+    """Substitute this process's pid for "{pid}" in an output path."""
+    return Path(str(path).replace("{pid}", str(os.getpid())))
 
 
 # --- Core API ---
@@ -308,6 +571,17 @@ def start(
     interval_ms: int = 10,
     output_path: Path | str | None = None,
     memory_limit_mb: int = 100,
+    overhead_budget_pct: float | None = None,
+    interval_us: int | None = None,
+    burst_s: float | None = None,
+    burst_period_s: float | None = None,
+    export_path: Path | str | None = None,
+    export_interval_s: float = 60.0,
+    export_format: Literal["speedscope", "collapsed", "pprof"] = "speedscope",
+    export_keep: int = 1,
+    top_k: int | None = None,
+    timeline_samples: int | None = None,
+    processes: int | None = None,
 ) -> None:
     """
     Start CPU profiling.
@@ -316,13 +590,81 @@ def start(
         interval_ms: Sampling interval in milliseconds. Default 10ms.
                     Minimum 1ms. Lower values = higher overhead.
         output_path: Optional path to write profile on stop().
-                    If None, profile returned from stop().
+                    If None, profile returned from stop(). "{pid}" in the
+                    path is replaced with the process id (see Forking).
         memory_limit_mb: Maximum memory usage in MB. Default 100MB.
+        overhead_budget_pct: Optional cap on the share of process CPU time
+                    spent in the sampling handler (e.g. 1.0 for 1%). Linux
+                    only. interval_ms becomes the fastest allowed rate and
+                    timers are slowed down as needed; samples are weighted
+                    so the profile stays unbiased.
+        interval_us: Sampling interval in microseconds; overrides
+                    interval_ms. Values below 1000 select high-frequency
+                    mode (Linux only, minimum 20us): only the calling thread
+                    is sampled, on a wall-clock timer, keeping the innermost
+                    32 Python frames. Use Sample.cpu_time_ns to separate
+                    on-CPU time from waiting.
+        burst_s: Duty-cycled sampling: sample for burst_s seconds at the
+                    start of every burst_period_s, with timers disarmed in
+                    between. Requires burst_period_s. The native extension
+                    is required.
+        burst_period_s: Length of one burst cycle in seconds (> burst_s).
+        export_path: Continuous profiling: every export_interval_s a
+                    background thread writes the window since the previous
+                    one (see snapshot()) to this file, aggregated, in
+                    export_format. Each file is written to a temporary
+                    sibling and renamed into place. stop() returns only the
+                    samples after the last exported window.
+        export_interval_s: Seconds per exported window. Default 60.
+        export_format: "speedscope", "collapsed" or "pprof".
+        export_keep: Number of windows kept on disk; older windows are
+                    rotated to export_path.1, export_path.2, ...
+                    "{pid}" in export_path is replaced as in output_path.
+        top_k: Bounded-memory session for always-on profiling: windows are
+                    drained in the background (every export_interval_s
+                    with export_path, else every second) and folded into a
+                    Space-Saving table of at most top_k stacks, merged
+                    across threads. Rarer stacks spill into per-leaf-function
+                    "[other stacks]" buckets. stop() then returns an
+                    AggregatedProfile of the whole session, whatever
+                    aggregate says, with error bounds (see
+                    spprof.heavy_hitters).
+        timeline_samples: Bounded-memory timeline: windows are drained in
+                    the background as for top_k and each thread keeps up to
+                    this many samples in time order. Past that, older
+                    regions are decimated pairwise, halving their density
+                    step by step with age while preserving weights.
+                    stop() then returns the whole session's timeline (see
+                    spprof.timeline). Cannot be combined with top_k.
+        processes: Profile this process and its forked children as one
+                    (Linux). Up to this many processes, this one included,
+                    each keep a top_k table (top_k, default 1000 stacks)
+                    and publish it to a shared-memory slot after every
+                    drained window. stop() in this process then returns one
+                    AggregatedProfile of every process, each stack labeled
+                    {"pid": ...} (see spprof.shared). stop() in a child
+                    returns that child's own profile. Cannot be combined
+                    with timeline_samples.
 
     Raises:
-        RuntimeError: If profiling is already active.
-        ValueError: If interval_ms < 1.
-        PermissionError: If output_path is not writable.
+        RuntimeError: If profiling is already active, or a budget or
+                    high-frequency mode is requested off Linux.
+        ValueError: If interval_ms < 1, interval_us < 20,
+                    overhead_budget_pct not in (0, 100], or the burst
+                    settings are incomplete or not 0 < burst_s < burst_period_s,
+                    the export settings are invalid, top_k < 1,
+                    timeline_samples < 16, or both are given, or
+                    processes < 1 or combined with timeline_samples.
+        PermissionError: If output_path or export_path is not writable.
+
+    Forking:
+        On Linux a session survives os.fork(): each child drops the samples
+        it inherited and keeps sampling its own main thread with the same
+        settings, from the fork on. Children write only to paths containing
+        "{pid}"; with such an output_path a child that never calls stop()
+        saves its profile at interpreter exit. Pre-fork servers (gunicorn,
+        uwsgi) can start the profiler in the master with
+        export_path="profile.{pid}.json" and get one profile per worker.
 
     Example:
         >>> import spprof
@@ -331,9 +673,36 @@ def start(
         >>> profile = spprof.stop()
     """
     global _is_active, _start_time, _interval_ms, _samples, _output_path
+    global _is_paused, _burst_scheduler, _window_exporter, _window_start, _window_dropped
+    global _heavy_hitters, _timeline, _shared
 
     if interval_ms < 1:
         raise ValueError("interval_ms must be >= 1")
+    if interval_us is not None and interval_us < 20:
+        raise ValueError("interval_us must be >= 20")
+    if (burst_s is None) != (burst_period_s is None):
+        raise ValueError("burst_s and burst_period_s must be given together")
+    if burst_s is not None and not 0 < burst_s < burst_period_s:  # type: ignore[operator]
+        raise ValueError("burst_s must satisfy 0 < burst_s < burst_period_s")
+    if overhead_budget_pct is not None and not 0 < overhead_budget_pct <= 100:
+        raise ValueError("overhead_budget_pct must be in (0, 100]")
+    if export_path is not None:
+        if export_interval_s <= 0:
+            raise ValueError("export_interval_s must be > 0")
+        if export_keep < 1:
+            raise ValueError("export_keep must be >= 1")
+        if export_format not in ("speedscope", "collapsed", "pprof"):
+            raise ValueError(f"Unknown format: {export_format}")
+    if top_k is not None and top_k < 1:
+        raise ValueError("top_k must be >= 1")
+    if timeline_samples is not None and timeline_samples < 16:
+        raise ValueError("timeline_samples must be >= 16")
+    if top_k is not None and timeline_samples is not None:
+        raise ValueError("top_k and timeline_samples cannot be combined")
+    if processes is not None and processes < 1:
+        raise ValueError("processes must be >= 1")
+    if processes is not None and timeline_samples is not None:
+        raise ValueError("processes and timeline_samples cannot be combined")
 
     with _profiler_lock:
         if _is_active:
@@ -342,56 +711,187 @@ def start(
         if output_path is not None:
             # Verify path is writable
             output_path = Path(output_path)
+            resolved = _expand_pid(output_path)
             try:
-                output_path.parent.mkdir(parents=True, exist_ok=True)
+                resolved.parent.mkdir(parents=True, exist_ok=True)
                 # Test write
-                output_path.touch()
+                resolved.touch()
             except (OSError, PermissionError) as e:
-                raise PermissionError(f"Cannot write to {output_path}: {e}") from e
+                raise PermissionError(f"Cannot write to {resolved}: {e}") from e
+
+        if export_path is not None:
+            export_path = Path(export_path)
+            resolved = _expand_pid(export_path)
+            try:
+                resolved.parent.mkdir(parents=True, exist_ok=True)
+            except OSError as e:
+                raise PermissionError(f"Cannot write to {resolved}: {e}") from e
+            if not os.access(resolved.parent, os.W_OK):
+                raise PermissionError(f"Cannot write to {resolved}")
+
+        interval_ns = interval_ms * 1_000_000 if interval_us is None else interval_us * 1_000
+        high_frequency = interval_ns < 1_000_000
+
+        if _HAS_NATIVE:
+            options: dict[str, Any] = {}
+            if overhead_budget_pct is not None:
+                options["overhead_budget_pct"] = overhead_budget_pct
+            if high_frequency:
+                options["high_frequency"] = True
+            _native._start(interval_ns=interval_ns, **options)
+        elif high_frequency:
+            raise RuntimeError("High-frequency mode requires the native extension")
+        elif burst_s is not None:
+            raise RuntimeError("Burst sampling requires the native extension")
 
         _output_path = output_path
-        _interval_ms = interval_ms
+        _interval_ms = interval_ns / 1_000_000 if interval_us is not None else interval_ms
         _samples = []
         _start_time = datetime.now()
+        _window_start = _start_time
+        _window_dropped = 0
+        _is_paused = False
 
-        if _HAS_NATIVE:
-            interval_ns = interval_ms * 1_000_000
-            _native._start(interval_ns=interval_ns)
+        if burst_s is not None:
+            _burst_scheduler = _BurstScheduler(burst_s, burst_period_s)  # type: ignore[arg-type]
+            _burst_scheduler.start()
 
         _is_active = True
 
+        if processes is not None:
+            from spprof.shared import SharedArena
+
+            _shared = SharedArena(processes)
+            top_k = top_k or _PROCESSES_TOP_K
+        if top_k is not None:
+            from spprof.heavy_hitters import HeavyHitters
+
+            _heavy_hitters = HeavyHitters(top_k)
+        if timeline_samples is not None:
+            from spprof.timeline import Timeline
+
+            _timeline = Timeline(timeline_samples)
+        session_store = top_k is not None or timeline_samples is not None
+        if session_store and export_path is None:
+            export_interval_s = _SESSION_DRAIN_S
+
+        if export_path is not None or session_store:
+            _window_exporter = _WindowExporter(
+                export_path, export_interval_s, export_format, export_keep
+            )
+            _window_exporter.start()
+
+
+@overload
+def stop(aggregate: Literal[False] = ..., *, capture: None = ...) -> Profile: ...
+
+
+@overload
+def stop(aggregate: Literal[True], *, capture: None = ...) -> AggregatedProfile: ...
+
 
-def stop() -> Profile:
+@overload
+def stop(aggregate: bool = ..., *, capture: Path | str) -> Path: ...
+
+
+def stop(
+    aggregate: bool = False, *, capture: Path | str | None = None
+) -> Profile | AggregatedProfile | Path:
     """
     Stop CPU profiling and return results.
 
+    Args:
+        aggregate: Return an AggregatedProfile of unique (thread, stack)
+                   counts instead of individual samples. The native
+                   extension aggregates while draining, so no per-sample
+                   data is ever kept. Timestamps are not available.
+        capture: Write the raw samples to this .spprof file instead of
+                 resolving them, and return its path. Load it later (on
+                 any machine) with spprof.capture.load(). Requires the
+                 native extension; aggregate is ignored.
+
     Returns:
-        Profile object containing all collected samples.
+        Profile object containing all samples collected since start() (or
+        the last snapshot()), an AggregatedProfile if aggregate is True or
+        the session was started with top_k, or the capture path. top_k and
+        timeline_samples sessions cover the whole session.
 
     Raises:
-        RuntimeError: If profiling is not active.
+        RuntimeError: If profiling is not active, or capture is requested
+                      without the native extension or in a top_k or
+                      timeline session.
 
     Example:
         >>> profile = spprof.stop()
         >>> print(f"Collected {len(profile.samples)} samples")
         >>> profile.save("profile.json")
     """
-    global _is_active, _samples
+    global _is_active, _samples, _burst_scheduler, _window_exporter, _heavy_hitters, _timeline
+    global _shared
+
+    # The exporter takes the lock for each window, so join it first
+    exporter = _window_exporter
+    if exporter is not None:
+        exporter.stop()
 
     with _profiler_lock:
+        _window_exporter = None
         if not _is_active:
             raise RuntimeError("Profiler not running")
+        if capture is not None and (_heavy_hitters is not None or _timeline is not None):
+            raise RuntimeError("Binary capture is not available in top_k or timeline sessions")
+        if capture is not None and not hasattr(_native, "_capture_samples"):
+            raise RuntimeError("Binary capture requires the native extension")
 
         end_time = datetime.now()
+        # The last window is folded into a session store like the others
+        drain_aggregate = (aggregate or _heavy_hitters is not None) and _timeline is None
+        aggregated_stacks: list[AggregatedStack] | None = None
+        python_version, platform_name = _environment()
+
+        # No pause/resume may race with timer teardown
+        if _burst_scheduler is not None:
+            _burst_scheduler.stop()
+            _burst_scheduler = None
+
+        if capture is not None:
+            from spprof.capture import write as write_capture
+
+            final_stats = _native._get_stats()
+            _native._stop_timer()
+            try:
+                write_capture(
+                    capture,
+                    start_time=_window_start,  # type: ignore
+                    end_time=end_time,
+                    interval_ms=_interval_ms,
+                    dropped_count=_dropped_total(final_stats) - _window_dropped,
+                    python_version=python_version,
+                    platform=platform_name,
+                    thread_names=_get_thread_names(),
+                    label_sets=_label_sets,
+                )
+            finally:
+                _native._finalize_stop()
+                _is_active = False
+                _samples = []
+            return Path(capture)
 
         if _HAS_NATIVE:
             # Get final stats before stopping (includes dropped_samples)
             final_stats = _native._get_stats()
-            dropped_count = final_stats.get("dropped_samples", 0) if final_stats else 0
+            dropped_count = _dropped_total(final_stats) - _window_dropped
+            samples: Sequence[Sample]
 
+            # Columnar drain: interned tables instead of one dict per frame;
+            # Sample/Frame objects are only built if someone reads them
+            if hasattr(_native, "_drain_columnar"):
+                _native._stop_timer()
+                samples, aggregated_stacks = _drain_columns(drain_aggregate)
+                _native._finalize_stop()
             # Use streaming API to avoid OOM for long profiling sessions
             # Stop the timer first, then drain in chunks
-            if hasattr(_native, "_stop_timer") and hasattr(_native, "_drain_buffer"):
+            elif hasattr(_native, "_stop_timer") and hasattr(_native, "_drain_buffer"):
                 _native._stop_timer()
 
                 # Drain samples in chunks to avoid memory spike
@@ -414,24 +914,187 @@ def stop() -> Profile:
             samples = _samples
             dropped_count = 0
 
-        profile = Profile(
-            start_time=_start_time,  # type: ignore
-            end_time=end_time,
-            interval_ms=_interval_ms,
-            samples=samples,
-            dropped_count=dropped_count,
-            python_version=f"{sys.version_info.major}.{sys.version_info.minor}.{sys.version_info.micro}",
-            platform=f"{platform.system()}-{platform.release()}-{platform.machine()}",
-        )
+        result = _make_result(end_time, samples, dropped_count, drain_aggregate, aggregated_stacks)
+        store = _heavy_hitters or _timeline
+        if store is not None:
+            _fold_window(result)
+            result = store.to_profile()
+            _heavy_hitters = None
+            _timeline = None
+        if _shared is not None:
+            # _fold_window() published this process's final table
+            if os.getpid() == _shared.owner_pid:
+                result = _shared.collect(end_time)
+                _shared.close()
+            _shared = None
+        if aggregate and isinstance(result, Profile):
+            result = result.aggregate()
 
         _is_active = False
         _samples = []
 
         # Auto-save if output path was specified
         if _output_path is not None:
-            profile.save(_output_path)
+            result.save(_expand_pid(_output_path))
+
+        return result
 
-        return profile
+
+@overload
+def snapshot(aggregate: Literal[False] = ...) -> Profile: ...
+
+
+@overload
+def snapshot(aggregate: Literal[True]) -> AggregatedProfile: ...
+
+
+def snapshot(aggregate: bool = False) -> Profile | AggregatedProfile:
+    """
+    Return the samples collected since the previous snapshot() (or start())
+    without stopping the profiler.
+
+    Timers stay armed while the ring buffer is drained, so consecutive
+    windows have no gap; stop() then returns only what came after the last
+    snapshot. Each window's start_time/end_time and dropped_count cover
+    that window alone.
+
+    Args:
+        aggregate: Return an AggregatedProfile, as stop(aggregate=True).
+
+    Returns:
+        Profile (or AggregatedProfile) for the window.
+
+    Raises:
+        RuntimeError: If profiling is not active, or the native extension
+                      predates the columnar drain.
+
+    Example:
+        >>> spprof.start()
+        >>> while serving:
+        ...     time.sleep(60)
+        ...     spprof.snapshot(aggregate=True).save("last-minute.json")
+    """
+    global _samples, _window_start, _window_dropped
+
+    with _profiler_lock:
+        if not _is_active:
+            raise RuntimeError("Profiler not running")
+
+        end_time = datetime.now()
+        drain_aggregate = aggregate and _timeline is None
+        aggregated_stacks: list[AggregatedStack] | None = None
+        samples: Sequence[Sample]
+        if _HAS_NATIVE:
+            if not hasattr(_native, "_drain_columnar"):
+                raise RuntimeError("snapshot() requires a native extension with _drain_columnar")
+            # The ring buffer is single-consumer; the lock keeps it that way
+            dropped_total = _dropped_total(_native._get_stats())
+            samples, aggregated_stacks = _drain_columns(drain_aggregate)
+        else:
+            samples, _samples = _samples, []
+            dropped_total = 0
+
+        result = _make_result(
+            end_time, samples, dropped_total - _window_dropped, drain_aggregate, aggregated_stacks
+        )
+        _fold_window(result)
+        if aggregate and isinstance(result, Profile):
+            result = result.aggregate()
+        _window_start = end_time
+        _window_dropped = dropped_total
+        return result
+
+
+def _fold_window(window: Profile | AggregatedProfile) -> None:
+    """Feed a drained window to the session's top_k or timeline store."""
+    if _timeline is not None and isinstance(window, Profile):
+        _timeline.add(window)
+    if _heavy_hitters is not None:
+        _heavy_hitters.add(window if isinstance(window, AggregatedProfile) else window.aggregate())
+        if _shared is not None:
+            _shared.publish(_heavy_hitters.to_profile())
+
+
+def _environment() -> tuple[str, str]:
+    """Python version and platform strings recorded in every profile."""
+    python_version = ".".join(str(part) for part in sys.version_info[:3])
+    return python_version, f"{platform.system()}-{platform.release()}-{platform.machine()}"
+
+
+def _dropped_total(raw_stats: dict[str, Any] | None) -> int:
+    return int(raw_stats.get("dropped_samples", 0)) if raw_stats else 0
+
+
+def _drain_columns(aggregate: bool) -> tuple[_SampleColumns, list[AggregatedStack] | None]:
+    """Drain the native ring buffer into columns (and aggregated stacks).
+
+    Samples of tracked asyncio tasks get their spawn path stitched in.
+    """
+    tracker = _task_tracker
+    contexts, suffixes = tracker.snapshot() if tracker is not None else ({}, {})
+    try:
+        columns = _native._drain_columnar(aggregate=aggregate, tasks=contexts or None)
+    finally:
+        if tracker is not None:
+            tracker.release_retired()
+    samples = _SampleColumns(columns, _get_thread_names(), _label_sets)
+    if not aggregate:
+        if suffixes:
+            samples.stack_ids = samples.stitch_tasks(
+                samples.stack_ids, _column("I", columns["task_ids"]), suffixes
+            )
+        return samples, None
+    stack_ids = _column("I", columns["aggregate_stack_ids"])
+    if suffixes:
+        stack_ids = samples.stitch_tasks(
+            stack_ids, _column("I", columns["aggregate_task_ids"]), suffixes
+        )
+    rows: Iterable[tuple[int, int, int, int, int, int]] = zip(
+        _column("Q", columns["aggregate_thread_ids"]),
+        stack_ids,
+        _column("I", columns["aggregate_label_ids"]),
+        _column("Q", columns["aggregate_counts"]),
+        _column("Q", columns["aggregate_weights"]),
+        _column("Q", columns["aggregate_cpu_times"]),
+    )
+    if suffixes:
+        # Tasks whose stacks had nothing to stitch onto fall back together
+        rows = _merge_rows(rows)
+    return samples, samples.aggregated_stacks(rows)
+
+
+def _make_result(
+    end_time: datetime,
+    samples: Sequence[Sample],
+    dropped_count: int,
+    aggregate: bool,
+    aggregated_stacks: list[AggregatedStack] | None,
+) -> Profile | AggregatedProfile:
+    """Build the stop()/snapshot() result for the window ending at end_time."""
+    python_version, platform_name = _environment()
+    profile = Profile(
+        start_time=_window_start,  # type: ignore
+        end_time=end_time,
+        interval_ms=_interval_ms,
+        samples=samples,
+        dropped_count=dropped_count,
+        python_version=python_version,
+        platform=platform_name,
+    )
+    if aggregated_stacks is not None:
+        return AggregatedProfile(
+            start_time=profile.start_time,
+            end_time=profile.end_time,
+            interval_ms=profile.interval_ms,
+            stacks=aggregated_stacks,
+            total_samples=sum(stack.count for stack in aggregated_stacks),
+            dropped_count=profile.dropped_count,
+            python_version=profile.python_version,
+            platform=profile.platform,
+        )
+    if aggregate:
+        return profile.aggregate()
+    return profile
 
 
 def is_active() -> bool:
@@ -446,6 +1109,67 @@ def is_active() -> bool:
     return _is_active
 
 
+def pause() -> None:
+    """
+    Disarm the sampling timers without ending the session.
+
+    Samples captured so far are kept and stop() still returns them.
+    Pausing an already paused profiler is a no-op.
+
+    Raises:
+        RuntimeError: If profiling is not active, or burst sampling
+                    (which pauses and resumes on its own) is running.
+
+    Example:
+        >>> spprof.start()
+        >>> warm_up()
+        >>> spprof.pause()
+        >>> uninteresting_work()
+        >>> spprof.resume()
+    """
+    global _is_paused
+
+    with _profiler_lock:
+        if not _is_active:
+            raise RuntimeError("Profiler not running")
+        if _burst_scheduler is not None:
+            raise RuntimeError("pause() is not available during burst sampling")
+        if _HAS_NATIVE:
+            _native._pause()
+        _is_paused = True
+
+
+def resume() -> None:
+    """
+    Re-arm sampling timers disarmed by pause().
+
+    Resuming a running profiler is a no-op.
+
+    Raises:
+        RuntimeError: If profiling is not active, or burst sampling is running.
+    """
+    global _is_paused
+
+    with _profiler_lock:
+        if not _is_active:
+            raise RuntimeError("Profiler not running")
+        if _burst_scheduler is not None:
+            raise RuntimeError("resume() is not available during burst sampling")
+        if _HAS_NATIVE:
+            _native._resume()
+        _is_paused = False
+
+
+def is_paused() -> bool:
+    """
+    Check if profiling is active but paused via pause().
+
+    Returns:
+        True if paused, False otherwise (including when not profiling).
+    """
+    return _is_active and _is_paused
+
+
 def stats() -> ProfilerStats | None:
     """
     Get current profiling statistics.
@@ -461,12 +1185,15 @@ def stats() -> ProfilerStats | None:
         collected = raw_stats.get("collected_samples", 0)
         duration_ms = raw_stats.get("duration_ns", 0) / 1_000_000
 
-        # Estimate overhead: (samples * avg_handler_time_us) / duration
-        # Using 25μs per sample as conservative estimate (includes frame walking,
-        # ring buffer write, and signal dispatch overhead)
-        avg_handler_time_ms = 0.025  # 25 microseconds in milliseconds
+        # Prefer the handler time measured inside the signal handler. Otherwise
+        # estimate (samples * avg_handler_time_us) / duration, using 25μs per
+        # sample as a conservative figure (frame walking, ring buffer write,
+        # and signal dispatch overhead)
+        handler_ms = raw_stats.get("handler_ns", 0) / 1_000_000
+        if not handler_ms:
+            handler_ms = collected * 0.025  # 25 microseconds in milliseconds
         if duration_ms > 0:
-            overhead_estimate_pct = (collected * avg_handler_time_ms) / duration_ms * 100
+            overhead_estimate_pct = handler_ms / duration_ms * 100
         else:
             overhead_estimate_pct = 0.0
 
@@ -475,6 +1202,8 @@ def stats() -> ProfilerStats | None:
             dropped_samples=raw_stats.get("dropped_samples", 0),
             duration_ms=duration_ms,
             overhead_estimate_pct=overhead_estimate_pct,
+            interval_scale=raw_stats.get("interval_scale", 1),
+            validation_drops=raw_stats.get("validation_drops", 0),
         )
 
     return ProfilerStats(
@@ -579,6 +1308,189 @@ class ThreadProfiler:
         unregister_thread()
 
 
+# --- Sample Labels ---
+
+
+@contextlib.contextmanager
+def labels(**values: object) -> Iterator[None]:
+    """Tag the samples taken inside the block with key=value labels.
+
+    Labels nest: an inner block adds to (or overrides) the labels of the
+    enclosing one. Values are converted with str(). Each distinct label set
+    is interned once into a small id, and entering a block only publishes
+    that id where the signal handler reads it, so tagging every request is
+    cheap. Keep label cardinality bounded (endpoint, tenant): every distinct
+    set stays interned for the life of the process.
+
+    Labels follow contextvars: concurrent asyncio tasks on one thread keep
+    their own labels across awaits, and a task created inside the block
+    inherits its labels, as does a thread running copy_context().run() or
+    asyncio.to_thread(). A plain threading.Thread starts with none.
+
+    Samples carry the labels as Sample.labels. pprof output attaches them
+    as sample labels, and speedscope output gets one profile per
+    (thread, label set). Labels are recorded by the Linux signal sampler;
+    on macOS and Windows samples carry none.
+
+    Example:
+        >>> with spprof.labels(endpoint="/users", tenant="acme"):
+        ...     handle_request()
+    """
+    outer = int.from_bytes(_current_label.get(_NO_LABEL), sys.byteorder)
+    merged = dict(_label_sets.get(outer, {}))
+    merged.update((key, str(value)) for key, value in values.items())
+    label_id = _intern_labels(merged) if merged else 0
+
+    token = _current_label.set(label_id.to_bytes(4, sys.byteorder))
+    try:
+        yield
+    finally:
+        # A generator closed by the garbage collector runs this in whatever
+        # Context is current then; that Context never saw the set() above
+        with contextlib.suppress(ValueError):
+            _current_label.reset(token)
+
+
+def _intern_labels(values: Mapping[str, str]) -> int:
+    """Return the process-wide id of a label set, assigning the next one if new."""
+    key = tuple(sorted(values.items()))
+    with _labels_lock:
+        label_id = _label_ids.get(key)
+        if label_id is None:
+            label_id = _label_ids[key] = len(_label_ids) + 1
+            _label_sets[label_id] = MappingProxyType(dict(key))
+    return label_id
+
+
+# --- asyncio Tasks ---
+
+
+def track_asyncio_tasks(loop: asyncio.AbstractEventLoop | None = None) -> None:
+    """Show asyncio tasks under the coroutine that spawned them.
+
+    Installs a task factory on loop (default: the running loop) that
+    records where each new task is created. Samples taken in a tracked
+    task then get its spawn path stitched in below the task's own frames:
+    a "[task NAME]" frame, the creating coroutine's frames at
+    create_task() time, and so on up through parent tasks. Unnamed tasks
+    are shown by their coroutine's name. Without tracking, every task's
+    stack starts at the event loop and the caller is lost.
+
+    Tasks created before the call are not tracked. Calling again for the
+    same loop does nothing. Stitching needs the Linux signal sampler and
+    Python 3.11+; captures (stop(capture=...)) are not stitched.
+
+    Raises:
+        RuntimeError: On Python < 3.11, or if loop is None outside a
+                      running event loop.
+
+    Example:
+        >>> async def main():
+        ...     spprof.track_asyncio_tasks()
+        ...     await asyncio.gather(fetch("a"), fetch("b"))
+    """
+    global _task_tracker
+    import asyncio
+
+    from spprof.tasks import TaskTracker
+
+    if loop is None:
+        loop = asyncio.get_running_loop()
+    with _profiler_lock:
+        if _task_tracker is None:
+            _task_tracker = TaskTracker()
+        tracker = _task_tracker
+    tracker.install(loop)
+
+
+# --- Fork Handling ---
+
+
+_fork_holds_lock = False  # _before_fork() took _profiler_lock
+
+
+def _before_fork() -> None:
+    # Fork at a point where no window is half drained. Forks outside a
+    # session (subprocess, multiprocessing) skip the lock unless a start()
+    # or stop() holds it right now.
+    global _fork_holds_lock
+    _fork_holds_lock = _is_active or _profiler_lock.locked()
+    if _fork_holds_lock:
+        _profiler_lock.acquire()
+
+
+def _after_fork_parent() -> None:
+    if _fork_holds_lock:
+        _profiler_lock.release()
+
+
+def _after_fork_child() -> None:
+    """Carry an active session into a forked child (Linux native sampler).
+
+    The child drops what it inherited and profiles itself from the fork on.
+    Background threads did not survive the fork, so they are restarted.
+    """
+    global _is_active, _start_time, _samples, _is_paused, _burst_scheduler, _window_exporter
+    global _window_start, _window_dropped, _heavy_hitters, _timeline, _profiler_lock
+
+    if _fork_holds_lock:
+        _profiler_lock.release()
+    else:
+        # Another thread may have taken it after the check; it is gone now
+        _profiler_lock = threading.Lock()
+    if not _is_active or not _HAS_NATIVE or not hasattr(_native, "_after_fork_child"):
+        return
+    burst, exporter = _burst_scheduler, _window_exporter
+    _burst_scheduler = _window_exporter = None
+    try:
+        _native._after_fork_child()
+    except OSError as e:
+        _is_active = False
+        _heavy_hitters = _timeline = None
+        warnings.warn(
+            f"spprof: profiling stopped in forked child: {e}", RuntimeWarning, stacklevel=1
+        )
+        return
+
+    _start_time = _window_start = datetime.now()
+    _window_dropped = 0
+    _samples = []
+    _is_paused = False
+    if _heavy_hitters is not None:
+        from spprof.heavy_hitters import HeavyHitters
+
+        _heavy_hitters = HeavyHitters(_heavy_hitters.capacity)
+    if _timeline is not None:
+        from spprof.timeline import Timeline
+
+        _timeline = Timeline(_timeline.budget)
+    if burst is not None:
+        burst_s = burst._burst_s
+        _burst_scheduler = _BurstScheduler(burst_s, burst_s + burst._idle_s)
+        _burst_scheduler.start()
+    if exporter is not None:
+        _window_exporter = exporter.for_child()
+        if _window_exporter is not None:
+            _window_exporter.start()
+    # A processes= child publishes its last window on the way out
+    if _shared is not None or (_output_path is not None and "{pid}" in str(_output_path)):
+        atexit.register(_stop_at_exit)
+
+
+def _stop_at_exit() -> None:
+    """Stop a forked child's session: saves {pid} paths, publishes processes= slots."""
+    if _is_active:
+        stop()
+
+
+if hasattr(os, "register_at_fork"):
+    os.register_at_fork(
+        before=_before_fork,
+        after_in_parent=_after_fork_parent,
+        after_in_child=_after_fork_child,
+    )
+
+
 # --- Native Unwinding API ---
 
 
@@ -651,6 +1563,34 @@ def native_unwinding_enabled() -> bool:
     return False
 
 
+def set_symbol_cache_dir(path: Path | str | None) -> None:
+    """
+    Cache parsed native symbol tables in a directory, or stop doing so.
+
+    With a directory, native frames are named from the ELF symbol table of
+    their library, parsed once and stored there as ``<build-id>.sym``.
+    Later runs map the stored table instead of re-parsing the library, so
+    jobs that profile on every run pay for symbolization only once per
+    library version. Without one, native frames are named with dladdr().
+
+    Only ELF platforms (Linux) use the cache; elsewhere this has no effect.
+
+    Args:
+        path: Directory to use (``~`` is expanded and the directory is
+            created if missing), or None to disable the cache.
+
+    Example:
+        >>> spprof.set_symbol_cache_dir("~/.cache/spprof")
+        >>> spprof.set_native_unwinding(True)
+        >>> spprof.start()
+    """
+    if path is not None:
+        path = Path(path).expanduser()
+        path.mkdir(parents=True, exist_ok=True)
+    if _HAS_NATIVE and hasattr(_native, "_set_symbol_cache_dir"):
+        _native._set_symbol_cache_dir(None if path is None else os.fspath(path))
+
+
 def capture_native_stack() -> list[NativeFrame]:
     """
     Capture the current native (C/C++) call stack.
@@ -707,17 +1647,24 @@ class Profiler:
         interval_ms: int = 10,
         output_path: Path | str | None = None,
         memory_limit_mb: int = 100,
+        overhead_budget_pct: float | None = None,
+        interval_us: int | None = None,
     ) -> None:
         self._interval_ms = interval_ms
         self._output_path = output_path
         self._memory_limit_mb = memory_limit_mb
+        self._overhead_budget_pct = overhead_budget_pct
+        self._interval_us = interval_us
         self._profile: Profile | None = None
+        self._stats: ProfilerStats | None = None
 
     def __enter__(self) -> Profiler:
         start(
             interval_ms=self._interval_ms,
             output_path=None,  # Don't auto-save; let user call save()
             memory_limit_mb=self._memory_limit_mb,
+            overhead_budget_pct=self._overhead_budget_pct,
+            interval_us=self._interval_us,
         )
         return self
 
@@ -727,6 +1674,7 @@ class Profiler:
         exc_val: BaseException | None,
         exc_tb: Any,
     ) -> None:
+        self._stats = stats()
         self._profile = stop()
         if self._output_path is not None:
             self._profile.save(self._output_path)
@@ -736,6 +1684,22 @@ class Profiler:
         """Profile result after exiting context. None while profiling."""
         return self._profile
 
+    def stats(self) -> dict[str, Any]:
+        """Sampler counters: live while profiling, final after exiting.
+
+        Keys: samples_captured, dropped_samples, validation_drops (samples
+        the free-threaded sampler rejected as inconsistent), duration_ms.
+        """
+        current = stats() if self._profile is None else self._stats
+        if current is None:
+            current = ProfilerStats(0, 0, 0.0, 0.0)
+        return {
+            "samples_captured": current.collected_samples,
+            "dropped_samples": current.dropped_samples,
+            "validation_drops": current.validation_drops,
+            "duration_ms": current.duration_ms,
+        }
+
 
 # --- Decorator API ---
 
@@ -791,18 +1755,422 @@ def _convert_raw_samples(raw_samples: list[dict[str, Any]]) -> list[Sample]:
             thread_id=thread_id,
             thread_name=thread_names.get(thread_id),
             frames=frames,
+            weight=raw.get("weight", 1),
+            cpu_time_ns=raw.get("cpu_time_ns"),
         )
         samples.append(sample)
 
     return samples
 
 
+# Marks an unmeasured entry in the native cpu_times column
+_CPU_TIME_UNKNOWN = 2**64 - 1
+
+
+def _column(typecode: str, data: bytes) -> array[Any]:
+    """Load a native-endian column returned by _drain_columnar()."""
+    column: array[Any] = array(typecode)
+    column.frombytes(data)
+    return column
+
+
+def _save_pprof(
+    path: Path, columns: _SampleColumns, profile: Profile | AggregatedProfile
+) -> None:
+    """Write columns as a pprof profile with the session's timing metadata."""
+    if not hasattr(_native, "_write_pprof"):
+        raise RuntimeError("pprof output requires the native extension")
+    duration = profile.end_time - profile.start_time
+    with path.open("wb") as f:
+        _native._write_pprof(
+            f.fileno(),
+            columns,
+            float(profile.interval_ms),
+            int(profile.start_time.timestamp() * 1_000_000_000),
+            max(0, int(duration.total_seconds() * 1_000_000_000)),
+        )
+
+
+def _process_name() -> str:
+    """Name of this process for trace output: the script's file name."""
+    return Path(sys.argv[0]).name if sys.argv and sys.argv[0] else "python"
+
+
+def _save_perfetto(path: Path, columns: _SampleColumns, profile: Profile) -> None:
+    """Write columns as a Perfetto trace on this process's tracks."""
+    import time
+
+    if not hasattr(_native, "_write_perfetto"):
+        raise RuntimeError("Perfetto output requires the native extension")
+    # Samples carry CLOCK_MONOTONIC on Linux; Perfetto's trace clock is
+    # CLOCK_BOOTTIME, so shift them to line up with system traces
+    offset_ns = 0
+    if sys.platform == "linux":
+        before = time.monotonic_ns()
+        boottime = time.clock_gettime_ns(time.CLOCK_BOOTTIME)
+        after = time.monotonic_ns()
+        offset_ns = max(0, boottime - (before + after) // 2)
+    with path.open("wb") as f:
+        _native._write_perfetto(
+            f.fileno(),
+            columns,
+            float(profile.interval_ms),
+            os.getpid(),
+            _process_name(),
+            offset_ns,
+        )
+
+
+def _save_perf_script(path: Path, columns: _SampleColumns, profile: Profile) -> None:
+    """Write columns as perf script text, with perf-<pid>.map beside it."""
+    if not hasattr(_native, "_write_perf_script"):
+        raise RuntimeError("perf script output requires the native extension")
+    pid = os.getpid()
+    with path.open("wb") as f, (path.parent / f"perf-{pid}.map").open("wb") as map_file:
+        _native._write_perf_script(
+            f.fileno(),
+            map_file.fileno(),
+            columns,
+            float(profile.interval_ms),
+            pid,
+            _process_name(),
+            # What perf prints as the dso of symbols from a perf map
+            f"/tmp/perf-{pid}.map",
+        )
+
+
+def _merge_rows(
+    rows: Iterable[tuple[int, int, int, int, int, int]],
+) -> list[tuple[int, int, int, int, int, int]]:
+    """Sum (thread, stack, label, count, weight, cpu) rows that share a key."""
+    merged: dict[tuple[int, int, int], list[int]] = {}
+    for thread_id, stack_id, label_id, count, weight, cpu_time in rows:
+        row = merged.get((thread_id, stack_id, label_id))
+        if row is None:
+            merged[(thread_id, stack_id, label_id)] = [count, weight, cpu_time]
+            continue
+        row[0] += count
+        row[1] += weight
+        if cpu_time != _CPU_TIME_UNKNOWN:
+            row[2] = cpu_time if row[2] == _CPU_TIME_UNKNOWN else row[2] + cpu_time
+    return [(*key, count, weight, cpu) for key, (count, weight, cpu) in merged.items()]
+
+
+class _SampleColumns(Sequence[Sample]):
+    """Samples kept in the native columnar layout, materialized on access.
+
+    Holds the interned string, frame and stack tables returned by
+    ``_native._drain_columnar()`` plus one entry per sample in each column.
+    A Frame is built once per unique frame and a frame tuple once per unique
+    stack, so the Sample objects produced by indexing share them.
+    """
+
+    def __init__(
+        self,
+        raw: dict[str, Any],
+        thread_names: dict[int, str],
+        label_sets: Mapping[int, Mapping[str, str]] | None = None,
+    ) -> None:
+        self.strings: list[str] = raw["strings"]
+        self.frame_functions = _column("I", raw["frame_functions"])
+        self.frame_filenames = _column("I", raw["frame_filenames"])
+        self.frame_linenos = _column("i", raw["frame_linenos"])
+        self.frame_is_native: bytes = raw["frame_is_native"]
+        self.frame_addresses = _column("Q", raw["frame_addresses"])
+        self.stack_offsets = _column("I", raw["stack_offsets"])
+        self.stack_frames = _column("I", raw["stack_frames"])
+        self.timestamps = _column("Q", raw["timestamps"])
+        self.thread_ids = _column("Q", raw["thread_ids"])
+        self.cpu_times = _column("Q", raw["cpu_times"])
+        self.weights = _column("I", raw["weights"])
+        self.stack_ids = _column("I", raw["stack_ids"])
+        self.label_ids = (
+            _column("I", raw["label_ids"])
+            if "label_ids" in raw
+            else array("I", bytes(4 * len(self.stack_ids)))
+        )
+        self.thread_names = thread_names
+        # Label set of each id in label_ids (read by the native writers)
+        self.label_sets: dict[int, Mapping[str, str]] = dict(label_sets or {})
+        self._frames: list[Frame] | None = None
+        self._stacks: list[tuple[Frame, ...] | None] = [None] * (len(self.stack_offsets) - 1)
+
+    @classmethod
+    def from_samples(cls, samples: Iterable[Sample]) -> _SampleColumns:
+        """Intern already-materialized samples into the columnar layout.
+
+        Lets the native writers serve profiles built in Python. Frames carry
+        no native addresses on this path.
+        """
+        strings: dict[str, int] = {}
+        frame_ids: dict[Frame, int] = {}
+        stack_ids: dict[tuple[Frame, ...], int] = {}
+        thread_names: dict[int, str] = {}
+        label_ids: dict[tuple[tuple[str, str], ...], int] = {}
+        label_sets: dict[int, Mapping[str, str]] = {}
+        functions, filenames, linenos = array("I"), array("I"), array("i")
+        frame_is_native = bytearray()
+        stack_offsets, stack_frames = array("I", [0]), array("I")
+        timestamps, thread_ids, cpu_times = array("Q"), array("Q"), array("Q")
+        weights, sample_stacks, sample_labels = array("I"), array("I"), array("I")
+
+        for sample in samples:
+            frames = tuple(sample.frames)
+            stack_id = stack_ids.get(frames)
+            if stack_id is None:
+                stack_id = stack_ids[frames] = len(stack_ids)
+                for frame in frames:
+                    frame_id = frame_ids.get(frame)
+                    if frame_id is None:
+                        frame_id = frame_ids[frame] = len(frame_ids)
+                        functions.append(strings.setdefault(frame.function_name, len(strings)))
+                        filenames.append(strings.setdefault(frame.filename, len(strings)))
+                        linenos.append(frame.lineno)
+                        frame_is_native.append(1 if frame.is_native else 0)
+                    stack_frames.append(frame_id)
+                stack_offsets.append(len(stack_frames))
+            timestamps.append(sample.timestamp_ns)
+            thread_ids.append(sample.thread_id)
+            cpu_times.append(
+                _CPU_TIME_UNKNOWN if sample.cpu_time_ns is None else sample.cpu_time_ns
+            )
+            weights.append(sample.weight)
+            sample_stacks.append(stack_id)
+            label_id = 0
+            if sample.labels:
+                pairs = tuple(sorted(sample.labels.items()))
+                label_id = label_ids.get(pairs, 0)
+                if label_id == 0:
+                    label_id = label_ids[pairs] = len(label_ids) + 1
+                    label_sets[label_id] = dict(pairs)
+            sample_labels.append(label_id)
+            if sample.thread_name is not None:
+                thread_names[sample.thread_id] = sample.thread_name
+
+        raw = {
+            "strings": list(strings),
+            "frame_functions": functions.tobytes(),
+            "frame_filenames": filenames.tobytes(),
+            "frame_linenos": linenos.tobytes(),
+            "frame_is_native": bytes(frame_is_native),
+            "frame_addresses": bytes(8 * len(frame_ids)),
+            "stack_offsets": stack_offsets.tobytes(),
+            "stack_frames": stack_frames.tobytes(),
+            "timestamps": timestamps.tobytes(),
+            "thread_ids": thread_ids.tobytes(),
+            "cpu_times": cpu_times.tobytes(),
+            "weights": weights.tobytes(),
+            "stack_ids": sample_stacks.tobytes(),
+            "label_ids": sample_labels.tobytes(),
+        }
+        return cls(raw, thread_names, label_sets)
+
+    def frame(self, frame_id: int) -> Frame:
+        """Return the shared Frame object for an interned frame id."""
+        if self._frames is None:
+            strings = self.strings
+            self._frames = [
+                Frame(
+                    function_name=strings[function],
+                    filename=strings[filename],
+                    lineno=lineno,
+                    is_native=bool(is_native),
+                )
+                for function, filename, lineno, is_native in zip(
+                    self.frame_functions,
+                    self.frame_filenames,
+                    self.frame_linenos,
+                    self.frame_is_native,
+                )
+            ]
+        return self._frames[frame_id]
+
+    def stack(self, stack_id: int) -> tuple[Frame, ...]:
+        """Return the shared frame tuple (leaf first) for an interned stack id."""
+        frames = self._stacks[stack_id]
+        if frames is None:
+            start = self.stack_offsets[stack_id]
+            end = self.stack_offsets[stack_id + 1]
+            frames = tuple(self.frame(f) for f in self.stack_frames[start:end])
+            self._stacks[stack_id] = frames
+        return frames
+
+    def stitch_tasks(
+        self,
+        stack_ids: Iterable[int],
+        task_ids: Iterable[int],
+        suffixes: Mapping[int, Sequence[Frame]],
+    ) -> array[Any]:
+        """Stack ids with each task's spawn path stitched in (see spprof.tasks).
+
+        The path goes just below the event loop's Handle._run frame. New
+        strings, frames and stacks are appended to the tables. A stack
+        with no tracked task, or no Handle._run frame, keeps its id.
+        """
+        from spprof.tasks import RUN_FILENAME, RUN_FUNCTION
+
+        string_ids = {string: i for i, string in enumerate(self.strings)}
+        run_function = string_ids.get(RUN_FUNCTION)
+        run_filename = string_ids.get(RUN_FILENAME)
+        if run_function is None or run_filename is None:
+            return array("I", stack_ids)
+
+        frame_ids = {
+            key: i
+            for i, key in enumerate(
+                zip(self.frame_functions, self.frame_filenames, self.frame_linenos)
+            )
+            if not self.frame_is_native[i]
+        }
+        new_frames = 0
+
+        def intern_frame(frame: Frame) -> int:
+            nonlocal new_frames
+            key = tuple(
+                string_ids.setdefault(s, len(string_ids))
+                for s in (frame.function_name, frame.filename)
+            ) + (frame.lineno,)
+            frame_id = frame_ids.get(key)
+            if frame_id is None:
+                frame_id = frame_ids[key] = len(self.frame_linenos)
+                self.frame_functions.append(key[0])
+                self.frame_filenames.append(key[1])
+                self.frame_linenos.append(frame.lineno)
+                self.frame_addresses.append(0)
+                new_frames += 1
+            return frame_id
+
+        suffix_frames = {
+            task_id: [intern_frame(frame) for frame in frames]
+            for task_id, frames in suffixes.items()
+        }
+        self.strings.extend(list(string_ids)[len(self.strings) :])
+        self.frame_is_native += bytes(new_frames)
+
+        stitched: dict[tuple[int, int], int] = {}
+        result = array("I")
+        for stack_id, task_id in zip(stack_ids, task_ids):
+            suffix = suffix_frames.get(task_id)
+            if suffix is None:
+                result.append(stack_id)
+                continue
+            new_id = stitched.get((stack_id, task_id))
+            if new_id is None:
+                frames = self.stack_frames[
+                    self.stack_offsets[stack_id] : self.stack_offsets[stack_id + 1]
+                ]
+                cut = next(
+                    (
+                        i
+                        for i, frame_id in enumerate(frames)
+                        if self.frame_functions[frame_id] == run_function
+                        and self.frame_filenames[frame_id] == run_filename
+                    ),
+                    None,
+                )
+                new_id = stack_id
+                if cut is not None:
+                    self.stack_frames.extend(frames[:cut])
+                    self.stack_frames.extend(suffix)
+                    self.stack_frames.extend(frames[cut:])
+                    self.stack_offsets.append(len(self.stack_frames))
+                    self._stacks.append(None)
+                    new_id = len(self._stacks) - 1
+                stitched[(stack_id, task_id)] = new_id
+            result.append(new_id)
+        self._frames = None
+        return result
+
+    def total_cpu_time_ns(self) -> int:
+        """Sum of measured CPU time, skipping unmeasured samples."""
+        return sum(t for t in self.cpu_times if t != _CPU_TIME_UNKNOWN)
+
+    def aggregate_rows(self) -> list[tuple[int, int, int, int, int, int]]:
+        """Group samples by (thread, stack, label set) without building Sample objects.
+
+        Returns (thread_id, stack_id, label_id, count, weight, cpu_time) rows
+        in order of first appearance, in the same shape as the native
+        aggregate columns (cpu_time is _CPU_TIME_UNKNOWN if none was measured).
+        """
+        rows: dict[tuple[int, int, int], list[int]] = {}
+        for thread_id, stack_id, label_id, weight, cpu_time in zip(
+            self.thread_ids, self.stack_ids, self.label_ids, self.weights, self.cpu_times
+        ):
+            row = rows.get((thread_id, stack_id, label_id))
+            if row is None:
+                row = rows[(thread_id, stack_id, label_id)] = [0, 0, _CPU_TIME_UNKNOWN]
+            row[0] += 1
+            row[1] += weight
+            if cpu_time != _CPU_TIME_UNKNOWN:
+                row[2] = cpu_time if row[2] == _CPU_TIME_UNKNOWN else row[2] + cpu_time
+        return [(*key, count, weight, cpu) for key, (count, weight, cpu) in rows.items()]
+
+    def aggregated_stacks(
+        self, rows: Iterable[tuple[int, int, int, int, int, int]]
+    ) -> list[AggregatedStack]:
+        """Build AggregatedStacks from (thread, stack, label, count, weight, cpu) rows."""
+        return [
+            AggregatedStack(
+                frames=self.stack(stack_id),
+                thread_id=thread_id,
+                thread_name=self.thread_names.get(thread_id),
+                count=count,
+                weight=weight,
+                cpu_time_ns=None if cpu_time == _CPU_TIME_UNKNOWN else cpu_time,
+                labels=self.label_sets.get(label_id) if label_id else None,
+            )
+            for thread_id, stack_id, label_id, count, weight, cpu_time in rows
+        ]
+
+    def _sample(self, i: int) -> Sample:
+        thread_id = self.thread_ids[i]
+        cpu_time = self.cpu_times[i]
+        label_id = self.label_ids[i]
+        return Sample(
+            timestamp_ns=self.timestamps[i],
+            thread_id=thread_id,
+            thread_name=self.thread_names.get(thread_id),
+            frames=self.stack(self.stack_ids[i]),
+            weight=self.weights[i],
+            cpu_time_ns=None if cpu_time == _CPU_TIME_UNKNOWN else cpu_time,
+            labels=self.label_sets.get(label_id) if label_id else None,
+        )
+
+    def __len__(self) -> int:
+        return len(self.stack_ids)
+
+    @overload
+    def __getitem__(self, index: int) -> Sample: ...
+
+    @overload
+    def __getitem__(self, index: slice) -> list[Sample]: ...
+
+    def __getitem__(self, index: int | slice) -> Sample | list[Sample]:
+        if isinstance(index, slice):
+            return [self._sample(i) for i in range(*index.indices(len(self)))]
+        return self._sample(range(len(self))[index])
+
+    def __iter__(self) -> Iterator[Sample]:
+        for i in range(len(self)):
+            yield self._sample(i)
+
+    def __repr__(self) -> str:
+        return f"<{len(self)} samples, {len(self._stacks)} unique stacks>"
+
+
 def _get_thread_names() -> dict[int, str]:
-    """Get mapping of thread IDs to names."""
+    """Get mapping of thread IDs to names.
+
+    Keys include both threading idents and OS thread ids (native_id), which
+    is what the native sampler records.
+    """
     names = {}
     for thread in threading.enumerate():
         if hasattr(thread, "ident") and thread.ident is not None:
             names[thread.ident] = thread.name
+        native_id = getattr(thread, "native_id", None)
+        if native_id is not None:
+            names[native_id] = thread.name
     return names
 
 
@@ -824,17 +2192,24 @@ __all__ = [
     "__version__",
     "capture_native_stack",
     "is_active",
+    "is_paused",
+    "labels",
     # Native unwinding
     "native_unwinding_available",
     "native_unwinding_enabled",
+    "pause",
     # Decorator
     "profile",
     # Thread management
     "register_thread",
+    "resume",
     "set_native_unwinding",
+    "set_symbol_cache_dir",
+    "snapshot",
     # Core API
     "start",
     "stats",
     "stop",
+    "track_asyncio_tasks",
     "unregister_thread",
 ]
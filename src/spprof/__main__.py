@@ -0,0 +1,45 @@
+"""
+Command line entry point.
+
+    $ python -m spprof attach PID [--duration S] [--interval MS] [-o OUTPUT]
+"""
+
+from __future__ import annotations
+
+
+def main(argv: list[str] | None = None) -> int:
+    """Run a spprof subcommand."""
+    import argparse
+
+    parser = argparse.ArgumentParser(prog="python -m spprof", description="spprof profiler.")
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    attach = commands.add_parser(
+        "attach", help="sample a running Python process without restarting it"
+    )
+    attach.add_argument("pid", type=int, help="process to sample (same Python version)")
+    attach.add_argument(
+        "-d", "--duration", type=float, default=None, help="seconds to sample (default: Ctrl-C)"
+    )
+    attach.add_argument(
+        "-i", "--interval", type=float, default=10.0, help="sampling interval in ms"
+    )
+    attach.add_argument("-o", "--output", default="profile.json", help="output file")
+    attach.add_argument(
+        "--format", choices=("speedscope", "collapsed", "pprof"), default="speedscope"
+    )
+    args = parser.parse_args(argv)
+
+    from spprof.attach import attach as attach_process
+
+    try:
+        profile = attach_process(args.pid, duration_s=args.duration, interval_ms=args.interval)
+    except (OSError, RuntimeError) as e:
+        parser.exit(1, f"spprof: {e}\n")
+    profile.save(args.output, format=args.format)
+    print(f"spprof: {profile.sample_count} samples of process {args.pid} -> {args.output}")
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
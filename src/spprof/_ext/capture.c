@@ -0,0 +1,351 @@
+/**
+ * capture.c - Unresolved binary capture (.spprof) writer
+ *
+ * See capture.h for the file layout.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <Python.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define capture_sys_write(fd, buf, n) _write((fd), (buf), (unsigned int)(n))
+#else
+#include <unistd.h>
+#define capture_sys_write(fd, buf, n) write((fd), (buf), (n))
+#endif
+
+#ifdef SPPROF_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+#include "capture.h"
+#include "resolver.h"
+#include "code_registry.h"
+
+/* Fixed part of a SAMPLES record, before its frames */
+#define CAPTURE_RECORD_HEADER 40
+
+/* Raw SAMPLES bytes gathered before a chunk is compressed and written */
+#define CAPTURE_CHUNK_TARGET (1024 * 1024)
+
+/* Initial code index size (power of 2) */
+#define CAPTURE_CODE_SLOTS 1024
+
+/* ============================================================================
+ * Output
+ * ============================================================================ */
+
+static int write_fully(int fd, const void* data, size_t len) {
+    const char* cursor = (const char*)data;
+    while (len > 0) {
+        size_t chunk = len > (1U << 30) ? (1U << 30) : len;
+        ptrdiff_t written = (ptrdiff_t)capture_sys_write(fd, cursor, chunk);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        cursor += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+int capture_write_chunk(int fd, uint32_t type, const void* data, size_t len) {
+    if (len > UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint32_t header[4] = {type, SPPROF_CAPTURE_CODEC_NONE, (uint32_t)len, (uint32_t)len};
+    const void* payload = data;
+    void* compressed = NULL;
+
+#ifdef SPPROF_HAS_ZLIB
+    /* Fastest level: capture runs on the profiled box, analysis does not */
+    uLongf compressed_len = compressBound((uLong)len);
+    compressed = malloc(compressed_len);
+    if (compressed != NULL &&
+        compress2((Bytef*)compressed, &compressed_len, (const Bytef*)data, (uLong)len,
+                  Z_BEST_SPEED) == Z_OK &&
+        compressed_len < len) {
+        header[1] = SPPROF_CAPTURE_CODEC_ZLIB;
+        header[2] = (uint32_t)compressed_len;
+        payload = compressed;
+    }
+#endif
+
+    int rc = write_fully(fd, header, sizeof(header));
+    if (rc == 0) {
+        rc = write_fully(fd, payload, header[2]);
+    }
+    free(compressed);
+    return rc;
+}
+
+/* ============================================================================
+ * Code table
+ * ============================================================================ */
+
+static size_t pointer_slot(uintptr_t code, size_t mask) {
+    uint64_t x = (uint64_t)code;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x & mask;
+}
+
+int capture_code_table_init(CaptureCodeTable* table) {
+    memset(table, 0, sizeof(*table));
+    table->slot_keys = (uintptr_t*)calloc(CAPTURE_CODE_SLOTS, sizeof(uintptr_t));
+    table->slot_ids = (uint32_t*)calloc(CAPTURE_CODE_SLOTS, sizeof(uint32_t));
+    if (table->slot_keys == NULL || table->slot_ids == NULL) {
+        capture_code_table_free(table);
+        errno = ENOMEM;
+        return -1;
+    }
+    table->slot_mask = CAPTURE_CODE_SLOTS - 1;
+    return 0;
+}
+
+void capture_code_table_free(CaptureCodeTable* table) {
+    free(table->codes);
+    free(table->slot_keys);
+    free(table->slot_ids);
+    memset(table, 0, sizeof(*table));
+}
+
+static int code_table_find(const CaptureCodeTable* table, uintptr_t code, uint32_t* id) {
+    size_t pos = pointer_slot(code, table->slot_mask);
+    while (table->slot_ids[pos] != 0) {
+        if (table->slot_keys[pos] == code) {
+            *id = table->slot_ids[pos] - 1;
+            return 1;
+        }
+        pos = (pos + 1) & table->slot_mask;
+    }
+    return 0;
+}
+
+static int code_table_add(CaptureCodeTable* table, uintptr_t code, uint32_t* id) {
+    if (table->count >= UINT32_MAX - 1) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (table->count >= table->capacity) {
+        size_t capacity = table->capacity > 0 ? table->capacity * 2 : 256;
+        uintptr_t* grown = (uintptr_t*)realloc(table->codes, capacity * sizeof(uintptr_t));
+        if (grown == NULL) {
+            errno = ENOMEM;
+            return -1;
+        }
+        table->codes = grown;
+        table->capacity = capacity;
+    }
+
+    /* Keep the index at most half full */
+    if ((table->count + 1) * 2 > table->slot_mask + 1) {
+        size_t mask = table->slot_mask * 2 + 1;
+        uintptr_t* keys = (uintptr_t*)calloc(mask + 1, sizeof(uintptr_t));
+        uint32_t* ids = (uint32_t*)calloc(mask + 1, sizeof(uint32_t));
+        if (keys == NULL || ids == NULL) {
+            free(keys);
+            free(ids);
+            errno = ENOMEM;
+            return -1;
+        }
+        for (size_t i = 0; i < table->count; i++) {
+            size_t pos = pointer_slot(table->codes[i], mask);
+            while (ids[pos] != 0) {
+                pos = (pos + 1) & mask;
+            }
+            keys[pos] = table->codes[i];
+            ids[pos] = (uint32_t)i + 1;
+        }
+        free(table->slot_keys);
+        free(table->slot_ids);
+        table->slot_keys = keys;
+        table->slot_ids = ids;
+        table->slot_mask = mask;
+    }
+
+    size_t pos = pointer_slot(code, table->slot_mask);
+    while (table->slot_ids[pos] != 0) {
+        pos = (pos + 1) & table->slot_mask;
+    }
+    *id = (uint32_t)table->count;
+    table->slot_keys[pos] = code;
+    table->slot_ids[pos] = *id + 1;
+    table->codes[table->count++] = code;
+    return 0;
+}
+
+int capture_code_table_seed(CaptureCodeTable* table, uintptr_t code) {
+    uint32_t id;
+    int rc = code_table_add(table, code, &id);
+    table->first_new = table->count;
+    return rc;
+}
+
+/* ============================================================================
+ * Samples
+ * ============================================================================ */
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t capacity;
+} CaptureBuffer;
+
+static int buffer_reserve(CaptureBuffer* buffer, size_t extra) {
+    if (buffer->len + extra <= buffer->capacity) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity > 0 ? buffer->capacity : CAPTURE_CHUNK_TARGET * 2;
+    while (capacity < buffer->len + extra) {
+        capacity *= 2;
+    }
+    uint8_t* grown = (uint8_t*)realloc(buffer->data, capacity);
+    if (grown == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static void put_u32(uint8_t* out, uint32_t value) {
+    memcpy(out, &value, sizeof(value));
+}
+
+static void put_u64(uint8_t* out, uint64_t value) {
+    memcpy(out, &value, sizeof(value));
+}
+
+/**
+ * Append one record for a raw sample.
+ *
+ * @return 1 if written, 0 if no frames were left, -1 on error.
+ */
+static int append_record(CaptureBuffer* buffer, const RawSample* raw,
+                         CaptureCodeTable* codes, CaptureStats* stats) {
+    int python_depth = raw->depth < SPPROF_MAX_STACK_DEPTH ? raw->depth : SPPROF_MAX_STACK_DEPTH;
+    int native_depth = raw->native_depth < SPPROF_MAX_STACK_DEPTH ? raw->native_depth
+                                                                  : SPPROF_MAX_STACK_DEPTH;
+    if (python_depth < 0) {
+        python_depth = 0;
+    }
+    if (native_depth < 0) {
+        native_depth = 0;
+    }
+    if (buffer_reserve(buffer, CAPTURE_RECORD_HEADER + 8 * (size_t)python_depth +
+                               8 * (size_t)native_depth) < 0) {
+        return -1;
+    }
+
+    uint8_t* record = buffer->data + buffer->len;
+    uint8_t* cursor = record + CAPTURE_RECORD_HEADER;
+    uint16_t written = 0;
+
+    for (int i = 0; i < python_depth; i++) {
+        uintptr_t code = raw->frames[i];
+        uint32_t id;
+        if (code == 0) {
+            continue;
+        }
+        int known = code_table_find(codes, code, &id);
+        if (known && code_registry_died_since(code, raw->code_generation)) {
+            /* The table's object took the address of one that died */
+            stats->invalid_frames++;
+            continue;
+        }
+        if (!known) {
+            /* A code object destroyed since capture cannot be kept alive
+             * for load(); its frame is dropped like any invalid one */
+            if (code_registry_validate_at(code, raw->code_generation, NULL) != CODE_VALID) {
+                stats->invalid_frames++;
+                continue;
+            }
+            if (code_table_add(codes, code, &id) < 0) {
+                return -1;
+            }
+            Py_INCREF((PyObject*)code);
+        }
+        int offset = raw->instr_ptrs[i] != 0 ? resolver_code_offset(code, raw->instr_ptrs[i]) : -1;
+        put_u32(cursor, id);
+        put_u32(cursor + 4, offset >= 0 ? (uint32_t)offset : UINT32_MAX);
+        cursor += 8;
+        written++;
+    }
+    for (int i = 0; i < native_depth; i++) {
+        uintptr_t pc = raw->native_pcs[i];
+#if defined(__arm64__) || defined(__aarch64__)
+        /* Strip pointer authentication bits, as the resolver does */
+        pc &= 0x0000007FFFFFFFFFULL;
+#endif
+        put_u64(cursor, (uint64_t)pc);
+        cursor += 8;
+    }
+
+    if (written == 0 && native_depth == 0) {
+        stats->empty_samples++;
+        return 0;
+    }
+
+    uint16_t native_count = (uint16_t)native_depth;
+    put_u64(record, raw->timestamp);
+    put_u64(record + 8, raw->thread_id);
+    put_u64(record + 16, raw->cpu_time_ns);
+    put_u32(record + 24, raw->weight > 0 ? raw->weight : 1);
+    memcpy(record + 28, &written, sizeof(written));
+    memcpy(record + 30, &native_count, sizeof(native_count));
+    put_u32(record + 32, raw->label_id);
+    put_u32(record + 36, 0);
+    buffer->len = (size_t)(cursor - buffer->data);
+    stats->samples++;
+    return 1;
+}
+
+int capture_drain_samples(int fd, CaptureCodeTable* codes, CaptureStats* stats) {
+    CaptureBuffer buffer = {NULL, 0, 0};
+    RawSample raw;
+    int result = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    codes->first_new = codes->count;
+
+    while (resolver_next_raw_sample(&raw)) {
+        int rc = append_record(&buffer, &raw, codes, stats);
+
+        /* Same release the resolver does once a sample's frames are used */
+        if (raw.depth > 0) {
+            code_registry_release_refs_batch(raw.frames, (size_t)raw.depth);
+        }
+        if (rc < 0) {
+            result = -1;
+            break;
+        }
+        if (buffer.len >= CAPTURE_CHUNK_TARGET) {
+            if (capture_write_chunk(fd, SPPROF_CAPTURE_CHUNK_SAMPLES, buffer.data, buffer.len) < 0) {
+                result = -1;
+                break;
+            }
+            buffer.len = 0;
+        }
+    }
+
+    if (result == 0 && buffer.len > 0) {
+        result = capture_write_chunk(fd, SPPROF_CAPTURE_CHUNK_SAMPLES, buffer.data, buffer.len);
+    }
+    free(buffer.data);
+    resolver_release_retired();
+    return result;
+}
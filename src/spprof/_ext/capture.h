@@ -0,0 +1,138 @@
+/**
+ * capture.h - Unresolved binary capture (.spprof) writer
+ *
+ * Instead of resolving every sample at stop(), a capture records the raw
+ * sampler output - code object ids, bytecode offsets and native PCs - into
+ * an append-only, chunked, block-compressed file. Names, line tables and
+ * the module map are written once as metadata chunks, and spprof.capture
+ * resolves and aggregates the file offline.
+ *
+ * FILE LAYOUT (all integers in the writer's byte order; see header):
+ *
+ *   header (16 bytes):
+ *     char     magic[8]       "SPPROF\0\0"
+ *     uint32   version        SPPROF_CAPTURE_VERSION
+ *     uint32   byte_order     0x01020304 as written by the producer
+ *
+ *   chunk* (each a 16-byte header followed by stored_size bytes):
+ *     uint32   type           SPPROF_CAPTURE_CHUNK_*
+ *     uint32   codec          SPPROF_CAPTURE_CODEC_*
+ *     uint32   stored_size    Payload bytes in the file
+ *     uint32   raw_size       Payload bytes once decompressed
+ *
+ *   A chunk cut short by a crash is ignored by the reader, so everything
+ *   before it stays readable.
+ *
+ * SAMPLES payload: back-to-back records, every field 8-byte aligned:
+ *     uint64   timestamp
+ *     uint64   thread_id
+ *     uint64   cpu_time       UINT64_MAX if not measured
+ *     uint32   weight
+ *     uint16   python_depth
+ *     uint16   native_depth
+ *     uint32   label_id       spprof.labels() set (INFO "labels"), 0 if none
+ *     uint32   reserved       0
+ *     { uint32 code_id; uint32 offset; } [python_depth]   leaf first;
+ *                             offset UINT32_MAX if unknown
+ *     uint64   native_pcs[native_depth]                   leaf first
+ *
+ * Version 1 records end at native_depth (32-byte header, no label).
+ *
+ * CODES, MODULES and INFO payloads are UTF-8 JSON written by the Python
+ * side (see spprof/capture.py).
+ *
+ * THREAD SAFETY:
+ *   Requires the GIL (code objects are validated and referenced).
+ *
+ * ERROR HANDLING:
+ *   POSIX-style (Pattern 1): 0 on success, -1 on error with errno set.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPPROF_CAPTURE_H
+#define SPPROF_CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SPPROF_CAPTURE_VERSION 2
+
+#define SPPROF_CAPTURE_CHUNK_SAMPLES 1
+#define SPPROF_CAPTURE_CHUNK_CODES   2
+#define SPPROF_CAPTURE_CHUNK_MODULES 3
+#define SPPROF_CAPTURE_CHUNK_INFO    4
+
+#define SPPROF_CAPTURE_CODEC_NONE 0
+#define SPPROF_CAPTURE_CODEC_ZLIB 1
+
+/**
+ * CaptureCodeTable - Code object pointer to capture id
+ *
+ * Ids are dense and stable for the life of a capture file. Code objects
+ * first seen by a drain are referenced (Py_INCREF) so their pointers cannot
+ * be reused before their metadata is written.
+ */
+typedef struct {
+    uintptr_t* codes;       /* Pointer of each id */
+    size_t count;
+    size_t capacity;
+    size_t first_new;       /* codes[first_new..count) were added (and referenced) by the last drain */
+    uintptr_t* slot_keys;   /* Open-addressed pointer index */
+    uint32_t* slot_ids;     /* id + 1, 0 for an empty slot */
+    size_t slot_mask;
+} CaptureCodeTable;
+
+/**
+ * CaptureStats - Counters from one drain
+ */
+typedef struct {
+    uint64_t samples;           /* Records written */
+    uint64_t empty_samples;     /* Samples with no frames left, skipped */
+    uint64_t invalid_frames;    /* Python frames whose code object was gone */
+} CaptureStats;
+
+/**
+ * Initialize an empty code table.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int capture_code_table_init(CaptureCodeTable* table);
+
+/**
+ * Register a code object under the next id without referencing it (used
+ * to continue a capture whose earlier ids are owned elsewhere).
+ *
+ * @return 0 on success, -1 on error.
+ */
+int capture_code_table_seed(CaptureCodeTable* table, uintptr_t code);
+
+/**
+ * Free the table's memory. References taken for new ids are NOT released;
+ * the caller takes them over.
+ */
+void capture_code_table_free(CaptureCodeTable* table);
+
+/**
+ * Write one chunk, zlib-compressing the payload when built with zlib.
+ *
+ * @param fd Destination file descriptor.
+ * @param type SPPROF_CAPTURE_CHUNK_* value.
+ * @param data Payload.
+ * @param len Payload size (must fit in 32 bits).
+ * @return 0 on success, -1 on error.
+ */
+int capture_write_chunk(int fd, uint32_t type, const void* data, size_t len);
+
+/**
+ * Drain the ring buffer into SAMPLES chunks without resolving anything.
+ *
+ * @param fd Destination file descriptor.
+ * @param codes Code table; new code objects are added and referenced.
+ * @param stats Receives the drain's counters.
+ * @return 0 on success, -1 on error.
+ */
+int capture_drain_samples(int fd, CaptureCodeTable* codes, CaptureStats* stats);
+
+#endif /* SPPROF_CAPTURE_H */
@@ -0,0 +1,446 @@
+/**
+ * code_cache.c - Sharded code object id cache for the resolver
+ *
+ * See code_cache.h for the design. Slots are 32 bytes, so the whole table
+ * (16 shards of 1024 slots) is 512 KB and a probe window fits in four
+ * cache lines. Readers follow the usual seqlock protocol: read the shard
+ * sequence, copy the fields they need with relaxed loads, then check the
+ * sequence did not move. Writers hold the shard mutex and make the
+ * sequence odd while they change slots.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <string.h>
+#include <stdlib.h>
+
+#if defined(__APPLE__) || defined(__linux__)
+#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "code_cache.h"
+
+/*
+ * =============================================================================
+ * Layout
+ * =============================================================================
+ */
+
+#define SHARD_BITS 4
+#define SHARD_COUNT (1u << SHARD_BITS)
+#define SLOT_BITS 10
+#define SLOT_COUNT (1u << SLOT_BITS)
+#define SLOT_MASK (SLOT_COUNT - 1)
+
+/* Slots searched from an address's home slot */
+#define PROBE_LENGTH 8
+
+/* Evicted slots a shard remembers, so an object inserted again keeps its id */
+#define EVICTED_LENGTH 16
+
+/* Ids live in fixed chunks so readers never see a table being moved */
+#define INFO_CHUNK_BITS 10
+#define INFO_CHUNK_SIZE (1u << INFO_CHUNK_BITS)
+#define INFO_MAX_CHUNKS 4096
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SPPROF_SEQLOCK 1
+#define LOAD_RELAXED(p)     __atomic_load_n((p), __ATOMIC_RELAXED)
+#define LOAD_ACQUIRE(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELAXED(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+/* Readers take the shard mutex, which orders everything */
+#define LOAD_RELAXED(p)     (*(p))
+#define LOAD_ACQUIRE(p)     (*(p))
+#define STORE_RELAXED(p, v) (*(p) = (v))
+#define STORE_RELEASE(p, v) (*(p) = (v))
+#endif
+
+#if defined(__APPLE__) || defined(__linux__)
+typedef pthread_mutex_t CacheMutex;
+#define MUTEX_INIT(m)   pthread_mutex_init((m), NULL)
+#define MUTEX_LOCK(m)   pthread_mutex_lock(m)
+#define MUTEX_UNLOCK(m) pthread_mutex_unlock(m)
+#elif defined(_WIN32)
+typedef CRITICAL_SECTION CacheMutex;
+#define MUTEX_INIT(m)   InitializeCriticalSection(m)
+#define MUTEX_LOCK(m)   EnterCriticalSection(m)
+#define MUTEX_UNLOCK(m) LeaveCriticalSection(m)
+#else
+/* Fallback: no locking (single-threaded only) */
+typedef int CacheMutex;
+#define MUTEX_INIT(m)   ((void)(m))
+#define MUTEX_LOCK(m)   ((void)(m))
+#define MUTEX_UNLOCK(m) ((void)(m))
+#endif
+
+/**
+ * CacheSlot - The object alive at `key` during generations [lo, hi)
+ */
+typedef struct {
+    uintptr_t key;  /* Code object address, 0 if empty */
+    uint64_t lo;
+    uint64_t hi;
+    uint32_t id;
+} CacheSlot;
+
+typedef struct {
+    unsigned int seq;       /* Odd while a writer changes slots */
+    unsigned int victim;    /* Round-robin eviction cursor (under lock) */
+    uint64_t collisions;    /* Evictions (under lock) */
+    uint64_t reinserts;     /* Evicted objects inserted again (under lock) */
+    CacheMutex lock;
+    CacheSlot slots[SLOT_COUNT];
+    /* Writers only (under lock); lookups never read these */
+    CacheSlot evicted[EVICTED_LENGTH];
+    unsigned int evicted_next;
+} CacheShard;
+
+static CacheShard g_shards[SHARD_COUNT];
+static CodeInfo** g_info_chunks[INFO_MAX_CHUNKS];
+static uint32_t g_info_count = 0;
+static CacheMutex g_info_lock;
+static int g_locks_initialized = 0;
+
+/* Multiplicative hash; the top bits pick the shard, the next ones the slot */
+static inline uint32_t slot_hash(uintptr_t addr) {
+    uint64_t h = ((uint64_t)addr >> 4) * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(h >> (64 - SHARD_BITS - SLOT_BITS));
+}
+
+static inline CacheShard* shard_for(uint32_t hash) {
+    return &g_shards[hash >> SLOT_BITS];
+}
+
+/* Bracket slot changes; the shard mutex must be held */
+static void seq_begin(CacheShard* shard) {
+    STORE_RELAXED(&shard->seq, LOAD_RELAXED(&shard->seq) + 1);
+#ifdef SPPROF_SEQLOCK
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+}
+
+static void seq_end(CacheShard* shard) {
+    STORE_RELEASE(&shard->seq, LOAD_RELAXED(&shard->seq) + 1);
+}
+
+/*
+ * =============================================================================
+ * Code Info
+ * =============================================================================
+ */
+
+/**
+ * Copy a code object's fields into a new CodeInfo and assign its id.
+ *
+ * @return Id, or CODE_ID_NONE if out of memory or ids.
+ */
+static uint32_t info_create(const char* name, const char* filename,
+                            const uint8_t* linetable, size_t linetable_len,
+                            Py_ssize_t code_units, int firstlineno) {
+    size_t name_len = strlen(name);
+    size_t filename_len = strlen(filename);
+    if (linetable == NULL) {
+        linetable_len = 0;
+    }
+
+    /* One block: the struct, then both strings, then the line table */
+    CodeInfo* info = (CodeInfo*)malloc(sizeof(CodeInfo) + name_len + 1 + filename_len + 1 +
+                                       linetable_len);
+    if (info == NULL) {
+        return CODE_ID_NONE;
+    }
+    char* data = (char*)(info + 1);
+    memcpy(data, name, name_len + 1);
+    info->function_name = data;
+    info->function_name_len = name_len;
+    data += name_len + 1;
+    memcpy(data, filename, filename_len + 1);
+    info->filename = data;
+    info->filename_len = filename_len;
+    data += filename_len + 1;
+    if (linetable_len > 0) {
+        memcpy(data, linetable, linetable_len);
+        info->linetable = (const uint8_t*)data;
+    } else {
+        info->linetable = NULL;
+    }
+    info->linetable_len = linetable_len;
+    info->code_units = code_units;
+    info->firstlineno = firstlineno;
+
+    MUTEX_LOCK(&g_info_lock);
+    uint32_t id = g_info_count;
+    uint32_t chunk = id >> INFO_CHUNK_BITS;
+    if (chunk >= INFO_MAX_CHUNKS) {
+        MUTEX_UNLOCK(&g_info_lock);
+        free(info);
+        return CODE_ID_NONE;
+    }
+    if (g_info_chunks[chunk] == NULL) {
+        CodeInfo** entries = (CodeInfo**)calloc(INFO_CHUNK_SIZE, sizeof(CodeInfo*));
+        if (entries == NULL) {
+            MUTEX_UNLOCK(&g_info_lock);
+            free(info);
+            return CODE_ID_NONE;
+        }
+        STORE_RELEASE(&g_info_chunks[chunk], entries);
+    }
+    STORE_RELEASE(&g_info_chunks[chunk][id & (INFO_CHUNK_SIZE - 1)], info);
+    g_info_count = id + 1;
+    MUTEX_UNLOCK(&g_info_lock);
+    return id;
+}
+
+const CodeInfo* code_cache_info(uint32_t id) {
+    CodeInfo** entries = LOAD_ACQUIRE(&g_info_chunks[id >> INFO_CHUNK_BITS]);
+    return LOAD_ACQUIRE(&entries[id & (INFO_CHUNK_SIZE - 1)]);
+}
+
+/*
+ * =============================================================================
+ * Public API
+ * =============================================================================
+ */
+
+int code_cache_init(void) {
+    if (!g_locks_initialized) {
+        for (uint32_t i = 0; i < SHARD_COUNT; i++) {
+            MUTEX_INIT(&g_shards[i].lock);
+        }
+        MUTEX_INIT(&g_info_lock);
+        g_locks_initialized = 1;
+    }
+    code_cache_reset();
+    return 0;
+}
+
+void code_cache_reset(void) {
+    if (!g_locks_initialized) {
+        return;
+    }
+    code_cache_clear();
+
+    MUTEX_LOCK(&g_info_lock);
+    for (uint32_t chunk = 0; chunk < INFO_MAX_CHUNKS && g_info_chunks[chunk] != NULL; chunk++) {
+        for (uint32_t i = 0; i < INFO_CHUNK_SIZE; i++) {
+            free(g_info_chunks[chunk][i]);
+        }
+        free(g_info_chunks[chunk]);
+        g_info_chunks[chunk] = NULL;
+    }
+    g_info_count = 0;
+    MUTEX_UNLOCK(&g_info_lock);
+
+    for (uint32_t i = 0; i < SHARD_COUNT; i++) {
+        g_shards[i].collisions = 0;
+        g_shards[i].reinserts = 0;
+    }
+}
+
+void code_cache_clear(void) {
+    if (!g_locks_initialized) {
+        return;
+    }
+    for (uint32_t i = 0; i < SHARD_COUNT; i++) {
+        CacheShard* shard = &g_shards[i];
+        MUTEX_LOCK(&shard->lock);
+        seq_begin(shard);
+        for (uint32_t s = 0; s < SLOT_COUNT; s++) {
+            STORE_RELAXED(&shard->slots[s].key, (uintptr_t)0);
+        }
+        seq_end(shard);
+        memset(shard->evicted, 0, sizeof(shard->evicted));
+        MUTEX_UNLOCK(&shard->lock);
+    }
+}
+
+/* Scan the probe window of a shard; the caller keeps it consistent */
+static uint32_t probe(const CacheShard* shard, uint32_t home, uintptr_t code_addr,
+                      uint64_t generation) {
+    for (uint32_t i = 0; i < PROBE_LENGTH; i++) {
+        const CacheSlot* slot = &shard->slots[(home + i) & SLOT_MASK];
+        if (LOAD_RELAXED(&slot->key) == code_addr &&
+            LOAD_RELAXED(&slot->lo) <= generation &&
+            generation < LOAD_RELAXED(&slot->hi)) {
+            return LOAD_RELAXED(&slot->id);
+        }
+    }
+    return CODE_ID_NONE;
+}
+
+uint32_t code_cache_lookup(uintptr_t code_addr, uint64_t generation) {
+    if (code_addr == 0) {
+        return CODE_ID_NONE;
+    }
+    uint32_t hash = slot_hash(code_addr);
+    CacheShard* shard = shard_for(hash);
+    uint32_t home = hash & SLOT_MASK;
+
+#ifdef SPPROF_SEQLOCK
+    for (;;) {
+        unsigned int seq = LOAD_ACQUIRE(&shard->seq);
+        if (seq & 1) {
+            /* A writer is active: wait for it rather than spin */
+            MUTEX_LOCK(&shard->lock);
+            MUTEX_UNLOCK(&shard->lock);
+            continue;
+        }
+        uint32_t id = probe(shard, home, code_addr, generation);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (LOAD_RELAXED(&shard->seq) == seq) {
+            return id;
+        }
+    }
+#else
+    MUTEX_LOCK(&shard->lock);
+    uint32_t id = probe(shard, home, code_addr, generation);
+    MUTEX_UNLOCK(&shard->lock);
+    return id;
+#endif
+}
+
+/**
+ * Slot to evict from a full probe window; the shard mutex must be held.
+ *
+ * Dead objects go first, the longest dead first: only samples captured
+ * before their death still look them up. Live ones are taken round-robin.
+ */
+static CacheSlot* choose_victim(CacheShard* shard, uint32_t home) {
+    CacheSlot* victim = NULL;
+    for (uint32_t i = 0; i < PROBE_LENGTH; i++) {
+        CacheSlot* slot = &shard->slots[(home + i) & SLOT_MASK];
+        if (slot->hi != CODE_GENERATION_LIVE && (victim == NULL || slot->hi < victim->hi)) {
+            victim = slot;
+        }
+    }
+    if (victim == NULL) {
+        victim = &shard->slots[(home + shard->victim++ % PROBE_LENGTH) & SLOT_MASK];
+    }
+    return victim;
+}
+
+uint32_t code_cache_insert(uintptr_t code_addr, uint64_t lo, uint64_t hi,
+                           const char* name, const char* filename,
+                           const uint8_t* linetable, size_t linetable_len,
+                           Py_ssize_t code_units, int firstlineno) {
+    if (code_addr == 0 || lo >= hi) {
+        return CODE_ID_NONE;
+    }
+    uint32_t hash = slot_hash(code_addr);
+    CacheShard* shard = shard_for(hash);
+    uint32_t home = hash & SLOT_MASK;
+
+    MUTEX_LOCK(&shard->lock);
+
+    /* The same object seen from an earlier sample: widen its range */
+    CacheSlot* empty = NULL;
+    for (uint32_t i = 0; i < PROBE_LENGTH; i++) {
+        CacheSlot* slot = &shard->slots[(home + i) & SLOT_MASK];
+        if (slot->key == code_addr && slot->hi == hi) {
+            if (lo < slot->lo) {
+                seq_begin(shard);
+                STORE_RELAXED(&slot->lo, lo);
+                seq_end(shard);
+            }
+            uint32_t id = slot->id;
+            MUTEX_UNLOCK(&shard->lock);
+            return id;
+        }
+        if (slot->key == 0 && empty == NULL) {
+            empty = slot;
+        }
+    }
+
+    /* Evicted earlier and needed again: bring it back under its old id */
+    uint32_t id = CODE_ID_NONE;
+    for (uint32_t i = 0; i < EVICTED_LENGTH; i++) {
+        CacheSlot* old = &shard->evicted[i];
+        if (old->key == code_addr && old->hi == hi) {
+            id = old->id;
+            lo = old->lo < lo ? old->lo : lo;
+            old->key = 0;
+            shard->reinserts++;
+            break;
+        }
+    }
+    if (id == CODE_ID_NONE) {
+        id = info_create(name, filename, linetable, linetable_len, code_units, firstlineno);
+    }
+    if (id == CODE_ID_NONE) {
+        MUTEX_UNLOCK(&shard->lock);
+        return CODE_ID_NONE;
+    }
+
+    CacheSlot* slot = empty != NULL ? empty : choose_victim(shard, home);
+    if (slot != empty) {
+        shard->evicted[shard->evicted_next++ % EVICTED_LENGTH] = *slot;
+        shard->collisions++;
+    }
+    seq_begin(shard);
+    STORE_RELAXED(&slot->key, code_addr);
+    STORE_RELAXED(&slot->lo, lo);
+    STORE_RELAXED(&slot->hi, hi);
+    STORE_RELAXED(&slot->id, id);
+    seq_end(shard);
+
+    MUTEX_UNLOCK(&shard->lock);
+    return id;
+}
+
+void code_cache_note_death(uintptr_t code_addr, uint64_t generation) {
+    if (!g_locks_initialized || code_addr == 0) {
+        return;
+    }
+    uint32_t hash = slot_hash(code_addr);
+    CacheShard* shard = shard_for(hash);
+    uint32_t home = hash & SLOT_MASK;
+
+    MUTEX_LOCK(&shard->lock);
+    for (uint32_t i = 0; i < PROBE_LENGTH; i++) {
+        CacheSlot* slot = &shard->slots[(home + i) & SLOT_MASK];
+        if (slot->key == code_addr && slot->hi == CODE_GENERATION_LIVE) {
+            seq_begin(shard);
+            STORE_RELAXED(&slot->hi, generation);
+            seq_end(shard);
+            break;
+        }
+    }
+    /* An evicted live slot must not hand its id to the address's next object */
+    for (uint32_t i = 0; i < EVICTED_LENGTH; i++) {
+        CacheSlot* old = &shard->evicted[i];
+        if (old->key == code_addr && old->hi == CODE_GENERATION_LIVE) {
+            old->hi = generation;
+        }
+    }
+    MUTEX_UNLOCK(&shard->lock);
+}
+
+void code_cache_get_stats(uint64_t* codes, uint64_t* collisions, uint64_t* reinserts) {
+    if (!g_locks_initialized) {
+        if (codes != NULL) *codes = 0;
+        if (collisions != NULL) *collisions = 0;
+        if (reinserts != NULL) *reinserts = 0;
+        return;
+    }
+    if (codes != NULL) {
+        MUTEX_LOCK(&g_info_lock);
+        *codes = g_info_count;
+        MUTEX_UNLOCK(&g_info_lock);
+    }
+    uint64_t evicted = 0;
+    uint64_t returned = 0;
+    for (uint32_t i = 0; i < SHARD_COUNT; i++) {
+        MUTEX_LOCK(&g_shards[i].lock);
+        evicted += g_shards[i].collisions;
+        returned += g_shards[i].reinserts;
+        MUTEX_UNLOCK(&g_shards[i].lock);
+    }
+    if (collisions != NULL) *collisions = evicted;
+    if (reinserts != NULL) *reinserts = returned;
+}
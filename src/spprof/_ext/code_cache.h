@@ -0,0 +1,149 @@
+/**
+ * code_cache.h - Sharded code object id cache for the resolver
+ *
+ * Maps a sampled PyCodeObject* address, at the code generation a sample
+ * was captured at, to a small id. Each id names an immutable CodeInfo
+ * holding the name, filename and line table copied from the code object,
+ * so frames can be built from it without the GIL.
+ *
+ * An address can hold different code objects over time, so a cache slot
+ * covers the generations [lo, hi) during which its object was alive:
+ * hi is UINT64_MAX while it lives and is set by code_cache_note_death()
+ * when it is destroyed (see code_registry_set_death_hook()).
+ *
+ * CONCURRENCY:
+ *   The table is split into shards, each with a writer mutex and a
+ *   sequence counter. Lookups take no lock: they copy a probe window and
+ *   retry if a writer changed the shard meanwhile. With compilers that
+ *   lack the atomic builtins (MSVC), lookups take the shard mutex.
+ *   CodeInfo entries are never moved or freed until code_cache_reset(),
+ *   so a pointer from code_cache_info() stays valid until then.
+ *
+ * ERROR HANDLING:
+ *   code_cache_init() is POSIX-style (Pattern 1). Lookups and inserts
+ *   return CODE_ID_NONE on a miss or allocation failure.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPPROF_CODE_CACHE_H
+#define SPPROF_CODE_CACHE_H
+
+#include <Python.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Returned for a miss; never a valid id */
+#define CODE_ID_NONE UINT32_MAX
+
+/* Generation bound of an object that is still alive */
+#define CODE_GENERATION_LIVE UINT64_MAX
+
+/**
+ * CodeInfo - Everything frame building needs from one code object
+ */
+typedef struct {
+    const char* function_name;  /* co_name, UTF-8 */
+    const char* filename;       /* co_filename, UTF-8 */
+    size_t function_name_len;
+    size_t filename_len;
+    const uint8_t* linetable;   /* 3.11+ co_linetable bytes, NULL if unused */
+    size_t linetable_len;
+    Py_ssize_t code_units;      /* Bytecode length in code units */
+    int firstlineno;            /* co_firstlineno */
+} CodeInfo;
+
+/**
+ * Initialize the cache. Idempotent.
+ *
+ * Thread safety: NOT thread-safe. Call from the control thread.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int code_cache_init(void);
+
+/**
+ * Drop every slot and free every CodeInfo.
+ *
+ * Thread safety: NOT thread-safe. No lookup may be running and no id may
+ * be used afterwards.
+ */
+void code_cache_reset(void);
+
+/**
+ * Drop every slot. CodeInfo entries (and ids already handed out) stay
+ * valid.
+ *
+ * Thread safety: SAFE to call concurrently with lookups and inserts.
+ */
+void code_cache_clear(void);
+
+/**
+ * Find the id of the object that lived at an address at a generation.
+ *
+ * Async-signal-unsafe but lock-free; needs no GIL.
+ *
+ * @param code_addr  Sampled PyCodeObject* address.
+ * @param generation code_registry_generation() read before the capture.
+ * @return Id, or CODE_ID_NONE on a miss.
+ */
+uint32_t code_cache_lookup(uintptr_t code_addr, uint64_t generation);
+
+/**
+ * Record the object alive at an address during [lo, hi).
+ *
+ * A slot for the same object (same address and hi) is widened to the
+ * earlier lo and keeps its id. Otherwise a new CodeInfo is created from
+ * the arguments, which are copied.
+ *
+ * When the address's probe window is full, a dead object's slot is
+ * evicted before a live one's. Each shard remembers its last evicted
+ * slots, so an evicted object inserted again gets its old id back rather
+ * than a second CodeInfo.
+ *
+ * @param code_addr   PyCodeObject* address.
+ * @param lo          First generation the object is known alive at.
+ * @param hi          Generation it was destroyed at, or CODE_GENERATION_LIVE.
+ * @param name        co_name (UTF-8).
+ * @param filename    co_filename (UTF-8).
+ * @param linetable   Location table bytes, or NULL.
+ * @param linetable_len Length of linetable.
+ * @param code_units  Bytecode length in code units.
+ * @param firstlineno co_firstlineno.
+ * @return Id of the object, or CODE_ID_NONE on allocation failure.
+ */
+uint32_t code_cache_insert(uintptr_t code_addr, uint64_t lo, uint64_t hi,
+                           const char* name, const char* filename,
+                           const uint8_t* linetable, size_t linetable_len,
+                           Py_ssize_t code_units, int firstlineno);
+
+/**
+ * Close the live slot of an address: its object was destroyed.
+ *
+ * Matches CodeDeathHook (code_registry.h).
+ *
+ * @param code_addr  Address of the destroyed object.
+ * @param generation Generation it was destroyed at.
+ */
+void code_cache_note_death(uintptr_t code_addr, uint64_t generation);
+
+/**
+ * Info for an id from code_cache_lookup() or code_cache_insert().
+ *
+ * @param id Valid id.
+ * @return Borrowed info, valid until code_cache_reset().
+ */
+const CodeInfo* code_cache_info(uint32_t id);
+
+/**
+ * Cache statistics.
+ *
+ * @param codes      Number of CodeInfo entries (can be NULL).
+ * @param collisions Slots evicted to make room (can be NULL).
+ * @param reinserts  Evicted objects inserted again under their old id
+ *                   (can be NULL).
+ */
+void code_cache_get_stats(uint64_t* codes, uint64_t* collisions, uint64_t* reinserts);
+
+#endif /* SPPROF_CODE_CACHE_H */
@@ -8,6 +8,18 @@
  * For signal-handler captured samples (Linux), we can't INCREF, so we
  * track the GC epoch and validate at resolution time.
  *
+ * On free-threaded builds the resolver pins each code object it resolves
+ * (code_registry_pin()) until the session ends, and a mutex replaces the
+ * GIL as the guard of the table.
+ *
+ * On Python 3.12+ a code watcher records every code object destruction
+ * in a second table: the object's address, the generation it died at and
+ * a snapshot of what the resolver reads from it. A sample captured at
+ * generation G refers to a destroyed object exactly when its address has
+ * a death recorded after G; otherwise the object is still alive. Python
+ * references are never dropped with the registry lock held, because the
+ * resulting deallocation re-enters the watcher.
+ *
  * Copyright (c) 2024 spprof contributors
  * SPDX-License-Identifier: MIT
  */
@@ -17,6 +29,12 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <stdatomic.h>
+#endif
+
 #include "code_registry.h"
 #include "uthash.h"  /* Header-only hash table */
 
@@ -34,9 +52,29 @@ typedef struct {
     uint32_t refcount;          /* Number of samples referencing this code */
     uint64_t capture_epoch;     /* GC epoch when first captured */
     int has_python_ref;         /* 1 if we hold a Python reference (INCREF'd) */
+    int pinned;                 /* 1 if refcount includes a session-long pin */
     UT_hash_handle hh;          /* uthash handle */
 } CodeEntry;
 
+/**
+ * One recorded destruction of a code object.
+ */
+typedef struct {
+    uint64_t generation;        /* Generation the object was destroyed at */
+    CodeSnapshot snapshot;      /* Name, file and line table (references held) */
+} RetiredCode;
+
+/**
+ * Hash table entry for the destructions recorded at one address.
+ */
+typedef struct {
+    uintptr_t code_addr;        /* Key: address the objects lived at */
+    RetiredCode* deaths;        /* Oldest first */
+    size_t count;
+    size_t capacity;
+    UT_hash_handle hh;          /* uthash handle */
+} RetiredEntry;
+
 /*
  * =============================================================================
  * Global State
@@ -59,6 +97,37 @@ static int g_initialized = 0;
 /* Safe mode flag - when enabled, reject unregistered code pointers */
 static int g_safe_mode = 0;
 
+/* Destructions recorded by the code watcher, by address */
+static RetiredEntry* g_retired_table = NULL;
+static size_t g_retired_count = 0;
+static uint64_t g_retired_resolved = 0;
+
+/* 1 while every code object destruction is being recorded */
+static int g_tracking = 0;
+static int g_watcher_id = -1;
+static CodeDeathHook g_death_hook = NULL;
+
+/* Bumped once per code object destruction; read by the signal handler */
+#ifdef _WIN32
+static volatile LONG64 g_generation = 0;
+#define GENERATION_LOAD() ((uint64_t)ReadAcquire64(&g_generation))
+#define GENERATION_BUMP() ((uint64_t)InterlockedIncrement64(&g_generation))
+#else
+static _Atomic uint64_t g_generation = 0;
+#define GENERATION_LOAD() atomic_load_explicit(&g_generation, memory_order_acquire)
+#define GENERATION_BUMP() (atomic_fetch_add_explicit(&g_generation, 1, memory_order_acq_rel) + 1)
+#endif
+
+/* Without a GIL, resolver and capture paths can reach the table at once */
+#ifdef Py_GIL_DISABLED
+static PyMutex g_registry_mutex = {0};
+#define REGISTRY_LOCK()   PyMutex_Lock(&g_registry_mutex)
+#define REGISTRY_UNLOCK() PyMutex_Unlock(&g_registry_mutex)
+#else
+#define REGISTRY_LOCK()   ((void)0)
+#define REGISTRY_UNLOCK() ((void)0)
+#endif
+
 /*
  * =============================================================================
  * GC Epoch Tracking
@@ -99,6 +168,327 @@ uint64_t code_registry_get_gc_epoch(void) {
     return epoch;
 }
 
+/*
+ * =============================================================================
+ * Lifetime Tracking
+ * =============================================================================
+ */
+
+void code_snapshot_release(CodeSnapshot* snapshot) {
+    if (snapshot == NULL) {
+        return;
+    }
+    Py_XDECREF(snapshot->name);
+    Py_XDECREF(snapshot->filename);
+    Py_XDECREF(snapshot->linetable);
+    memset(snapshot, 0, sizeof(*snapshot));
+}
+
+#if PY_VERSION_HEX >= 0x030C0000
+/**
+ * Record that co, at code_addr, was destroyed at generation.
+ *
+ * @return 1 on success, 0 if out of memory. The registry lock must be held.
+ */
+static int retire_locked(uintptr_t code_addr, uint64_t generation, PyCodeObject* co) {
+    RetiredEntry* entry = NULL;
+    HASH_FIND(hh, g_retired_table, &code_addr, sizeof(code_addr), entry);
+    if (entry == NULL) {
+        entry = (RetiredEntry*)calloc(1, sizeof(RetiredEntry));
+        if (entry == NULL) {
+            return 0;
+        }
+        entry->code_addr = code_addr;
+        HASH_ADD(hh, g_retired_table, code_addr, sizeof(code_addr), entry);
+    }
+
+    if (entry->count == entry->capacity) {
+        size_t capacity = entry->capacity > 0 ? entry->capacity * 2 : 2;
+        RetiredCode* deaths = (RetiredCode*)realloc(entry->deaths,
+                                                    capacity * sizeof(RetiredCode));
+        if (deaths == NULL) {
+            return 0;
+        }
+        entry->deaths = deaths;
+        entry->capacity = capacity;
+    }
+
+    /* Generations only grow, so appending keeps deaths oldest first */
+    RetiredCode* death = &entry->deaths[entry->count++];
+    death->generation = generation;
+    death->snapshot.generation = generation;
+    death->snapshot.name = Py_XNewRef(co->co_name);
+    death->snapshot.filename = Py_XNewRef(co->co_filename);
+    death->snapshot.linetable = Py_XNewRef(co->co_linetable);
+    death->snapshot.firstlineno = co->co_firstlineno;
+    death->snapshot.code_units = Py_SIZE(co);
+    g_retired_count++;
+    return 1;
+}
+
+/**
+ * Code watcher: snapshot each code object as it is destroyed.
+ *
+ * Runs inside the object's deallocation with the GIL held (an attached
+ * thread on free-threaded builds). Must not fail.
+ */
+static int code_watcher(PyCodeEvent event, PyCodeObject* co) {
+    if (event != PY_CODE_EVENT_DESTROY) {
+        return 0;
+    }
+
+    REGISTRY_LOCK();
+    uint64_t generation = GENERATION_BUMP();
+    if (g_tracking && !retire_locked((uintptr_t)co, generation, co)) {
+        /* A missing record would make a dead address look alive; fall
+         * back to validating every unheld pointer instead. */
+        g_tracking = 0;
+    }
+    CodeDeathHook hook = g_death_hook;
+    REGISTRY_UNLOCK();
+
+    if (hook != NULL) {
+        hook((uintptr_t)co, generation);
+    }
+    return 0;
+}
+#endif
+
+void code_registry_set_death_hook(CodeDeathHook hook) {
+    REGISTRY_LOCK();
+    g_death_hook = hook;
+    REGISTRY_UNLOCK();
+}
+
+/**
+ * Find the first death at code_addr after generation.
+ *
+ * @return The record, or NULL if the object captured at generation is
+ *         still alive. The registry lock must be held.
+ */
+static const RetiredCode* find_death_locked(uintptr_t code_addr, uint64_t generation) {
+    RetiredEntry* entry = NULL;
+    HASH_FIND(hh, g_retired_table, &code_addr, sizeof(code_addr), entry);
+    if (entry == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < entry->count; i++) {
+        if (entry->deaths[i].generation > generation) {
+            return &entry->deaths[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Start recording code object destructions.
+ *
+ * Requires the GIL. Leaves tracking off (and the registry usable) when
+ * the interpreter is older than 3.12 or has no free watcher slot.
+ */
+static void install_watcher(void) {
+#if PY_VERSION_HEX >= 0x030C0000
+    if (g_watcher_id >= 0) {
+        return;
+    }
+    int id = PyCode_AddWatcher(code_watcher);
+    if (id < 0) {
+        PyErr_Clear();
+        return;
+    }
+    REGISTRY_LOCK();
+    g_watcher_id = id;
+    g_tracking = 1;
+    REGISTRY_UNLOCK();
+#endif
+}
+
+/**
+ * Stop recording destructions and drop every snapshot.
+ *
+ * Requires the GIL.
+ */
+static void remove_watcher(void) {
+#if PY_VERSION_HEX >= 0x030C0000
+    if (g_watcher_id >= 0) {
+        if (PyCode_ClearWatcher(g_watcher_id) < 0) {
+            PyErr_Clear();
+        }
+    }
+#endif
+    REGISTRY_LOCK();
+    g_watcher_id = -1;
+    g_tracking = 0;
+    RetiredEntry* table = g_retired_table;
+    g_retired_table = NULL;
+    g_retired_count = 0;
+    REGISTRY_UNLOCK();
+
+    RetiredEntry* entry;
+    RetiredEntry* tmp;
+    HASH_ITER(hh, table, entry, tmp) {
+        HASH_DEL(table, entry);
+        for (size_t i = 0; i < entry->count; i++) {
+            code_snapshot_release(&entry->deaths[i].snapshot);
+        }
+        free(entry->deaths);
+        free(entry);
+    }
+}
+
+uint64_t code_registry_generation(void) {
+    return GENERATION_LOAD();
+}
+
+int code_registry_tracks_lifetimes(void) {
+    return g_tracking;
+}
+
+int code_registry_died_since(uintptr_t code_addr, uint64_t generation) {
+    if (!g_tracking) {
+        return 0;
+    }
+    REGISTRY_LOCK();
+    int died = find_death_locked(code_addr, generation) != NULL;
+    REGISTRY_UNLOCK();
+    return died;
+}
+
+void code_registry_release_retired(uint64_t generation) {
+    RetiredCode* dropped = NULL;
+    size_t dropped_count = 0;
+
+    REGISTRY_LOCK();
+    if (g_retired_count > 0) {
+        dropped = (RetiredCode*)malloc(g_retired_count * sizeof(RetiredCode));
+    }
+    if (dropped == NULL) {
+        REGISTRY_UNLOCK();
+        return;
+    }
+
+    RetiredEntry* entry;
+    RetiredEntry* tmp;
+    HASH_ITER(hh, g_retired_table, entry, tmp) {
+        size_t keep = 0;
+        while (keep < entry->count && entry->deaths[keep].generation <= generation) {
+            dropped[dropped_count++] = entry->deaths[keep];
+            keep++;
+        }
+        entry->count -= keep;
+        memmove(entry->deaths, entry->deaths + keep, entry->count * sizeof(RetiredCode));
+        if (entry->count == 0) {
+            HASH_DEL(g_retired_table, entry);
+            free(entry->deaths);
+            free(entry);
+        }
+    }
+    g_retired_count -= dropped_count;
+    REGISTRY_UNLOCK();
+
+    for (size_t i = 0; i < dropped_count; i++) {
+        code_snapshot_release(&dropped[i].snapshot);
+    }
+    free(dropped);
+}
+
+size_t code_registry_retired_count(void) {
+    return g_retired_count;
+}
+
+void code_registry_get_lifetime_stats(uint64_t* retired_held, uint64_t* retired_resolved) {
+    if (retired_held) {
+        *retired_held = g_retired_count;
+    }
+    if (retired_resolved) {
+        *retired_resolved = g_retired_resolved;
+    }
+}
+
+/**
+ * Read an unsigned location table varint (6 bits per byte, 0x40 = more).
+ *
+ * @return 1 on success, 0 if the table ends early.
+ */
+static int read_varint(const uint8_t* table, size_t len, size_t* pos, unsigned int* out) {
+    unsigned int value = 0;
+    for (int shift = 0; *pos < len && shift < 32; shift += 6) {
+        uint8_t byte = table[(*pos)++];
+        value |= (unsigned int)(byte & 0x3F) << shift;
+        if ((byte & 0x40) == 0) {
+            *out = value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int code_snapshot_line(const CodeSnapshot* snapshot, int byte_offset) {
+    if (snapshot == NULL) {
+        return 0;
+    }
+    if (snapshot->linetable == NULL || !PyBytes_Check(snapshot->linetable)) {
+        return snapshot->firstlineno;
+    }
+    return code_linetable_line((const uint8_t*)PyBytes_AS_STRING(snapshot->linetable),
+                               (size_t)PyBytes_GET_SIZE(snapshot->linetable),
+                               snapshot->firstlineno, byte_offset);
+}
+
+int code_linetable_line(const uint8_t* table, size_t len, int firstlineno, int byte_offset) {
+    int line = firstlineno;
+    if (table == NULL || byte_offset < 0) {
+        return firstlineno;
+    }
+
+    /*
+     * 3.11+ location table (Objects/locations.md): one entry per run of
+     * code units. The first byte has bit 7 set, the entry kind in bits
+     * 3-6 and the run length minus one in bits 0-2.
+     */
+    size_t pos = 0;
+    int target = byte_offset / 2;
+    int unit = 0;
+
+    while (pos < len) {
+        uint8_t first = table[pos++];
+        if ((first & 0x80) == 0) {
+            break;  /* Not at an entry start: malformed */
+        }
+        int kind = (first >> 3) & 0x0F;
+        int length = (first & 0x07) + 1;
+        int has_line = 1;
+        unsigned int value = 0;
+
+        if (kind == 15) {
+            has_line = 0;                       /* No location */
+        } else if (kind == 14 || kind == 13) {  /* Long form / no columns */
+            if (!read_varint(table, len, &pos, &value)) {
+                break;
+            }
+            line += (value & 1) ? -(int)(value >> 1) : (int)(value >> 1);
+            if (kind == 14) {                   /* End line, column, end column */
+                for (int i = 0; i < 3; i++) {
+                    if (!read_varint(table, len, &pos, &value)) {
+                        return firstlineno;
+                    }
+                }
+            }
+        } else if (kind >= 10) {                /* One-line form: two column bytes */
+            line += kind - 10;
+            pos += 2;
+        } else {                                /* Short form: one column byte */
+            pos += 1;
+        }
+
+        if (target < unit + length) {
+            return has_line ? line : firstlineno;
+        }
+        unit += length;
+    }
+    return firstlineno;
+}
+
 /*
  * =============================================================================
  * Initialization / Cleanup
@@ -118,7 +508,13 @@ int code_registry_init(void) {
     g_safe_mode_rejects = 0;
     /* Note: g_safe_mode is preserved across init/cleanup cycles
      * to maintain user configuration. Reset explicitly if needed. */
+    g_retired_resolved = 0;
     g_initialized = 1;
+
+    /* Before any sample is taken, so no destruction goes unrecorded */
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    install_watcher();
+    PyGILState_Release(gstate);
     
     return 0;
 }
@@ -130,6 +526,10 @@ void code_registry_cleanup(void) {
     
     /* Release all held references */
     code_registry_clear_all();
+
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    remove_watcher();
+    PyGILState_Release(gstate);
     
     g_initialized = 0;
 }
@@ -145,8 +545,14 @@ void code_registry_clear_all(void) {
     CodeEntry* entry;
     CodeEntry* tmp;
     
-    HASH_ITER(hh, g_code_table, entry, tmp) {
-        HASH_DEL(g_code_table, entry);
+    /* Detach the table first: the DECREFs below may run the code watcher */
+    REGISTRY_LOCK();
+    CodeEntry* table = g_code_table;
+    g_code_table = NULL;
+    REGISTRY_UNLOCK();
+
+    HASH_ITER(hh, table, entry, tmp) {
+        HASH_DEL(table, entry);
         
         /* Release Python reference if we hold one */
         if (entry->has_python_ref && entry->code_addr != 0) {
@@ -160,8 +566,6 @@ void code_registry_clear_all(void) {
         free(entry);
     }
     
-    g_code_table = NULL;
-    
     PyGILState_Release(gstate);
 }
 
@@ -171,11 +575,46 @@ void code_registry_clear_all(void) {
  * =============================================================================
  */
 
+static CodeEntry* add_ref_locked(uintptr_t code_addr, uint64_t gc_epoch);
+
 int code_registry_add_ref(uintptr_t code_addr, uint64_t gc_epoch) {
     if (!g_initialized || code_addr == 0) {
         return 0;
     }
     
+    REGISTRY_LOCK();
+    CodeEntry* entry = add_ref_locked(code_addr, gc_epoch);
+    REGISTRY_UNLOCK();
+    return entry != NULL;
+}
+
+int code_registry_pin(uintptr_t code_addr) {
+    if (!g_initialized || code_addr == 0) {
+        return 0;
+    }
+
+    REGISTRY_LOCK();
+    CodeEntry* entry = NULL;
+    HASH_FIND(hh, g_code_table, &code_addr, sizeof(code_addr), entry);
+    if (entry == NULL || !entry->pinned) {
+        entry = add_ref_locked(code_addr, 0);
+        if (entry != NULL) {
+            entry->pinned = 1;
+        }
+    }
+    REGISTRY_UNLOCK();
+    return entry != NULL;
+}
+
+/**
+ * Take one reference on code_addr, tracking it first if needed.
+ *
+ * @param code_addr Raw PyCodeObject* pointer.
+ * @param gc_epoch  GC epoch recorded for a new entry.
+ * @return The entry, or NULL if code_addr is not a code object or
+ *         allocation failed. The registry lock must be held.
+ */
+static CodeEntry* add_ref_locked(uintptr_t code_addr, uint64_t gc_epoch) {
     /* Check if already tracked */
     CodeEntry* entry = NULL;
     HASH_FIND(hh, g_code_table, &code_addr, sizeof(code_addr), entry);
@@ -184,25 +623,26 @@ int code_registry_add_ref(uintptr_t code_addr, uint64_t gc_epoch) {
         /* Already tracking - increment count */
         entry->refcount++;
         g_refs_added++;
-        return 1;
+        return entry;
     }
     
     /* Validate it's actually a code object before INCREF */
     PyObject* obj = (PyObject*)code_addr;
     if (!PyCode_Check(obj)) {
-        return 0;
+        return NULL;
     }
     
     /* Create new entry */
     entry = (CodeEntry*)malloc(sizeof(CodeEntry));
     if (entry == NULL) {
-        return 0;
+        return NULL;
     }
     
     entry->code_addr = code_addr;
     entry->refcount = 1;
     entry->capture_epoch = gc_epoch;
     entry->has_python_ref = 1;
+    entry->pinned = 0;
     
     /* INCREF to hold reference */
     Py_INCREF(obj);
@@ -211,7 +651,7 @@ int code_registry_add_ref(uintptr_t code_addr, uint64_t gc_epoch) {
     HASH_ADD(hh, g_code_table, code_addr, sizeof(code_addr), entry);
     
     g_refs_added++;
-    return 1;
+    return entry;
 }
 
 int code_registry_add_refs_batch(uintptr_t* code_addrs, size_t count, uint64_t gc_epoch) {
@@ -234,29 +674,34 @@ void code_registry_release_ref(uintptr_t code_addr) {
         return;
     }
     
+    REGISTRY_LOCK();
     CodeEntry* entry = NULL;
     HASH_FIND(hh, g_code_table, &code_addr, sizeof(code_addr), entry);
     
     if (entry == NULL) {
+        REGISTRY_UNLOCK();
         return;  /* Not tracked */
     }
     
     entry->refcount--;
     g_refs_released++;
     
-    if (entry->refcount == 0) {
-        /* Remove from table */
-        HASH_DEL(g_code_table, entry);
-        
-        /* Release Python reference */
-        if (entry->has_python_ref) {
-            PyObject* obj = (PyObject*)code_addr;
-            /* The object should still be valid since we hold a reference */
-            Py_DECREF(obj);
-        }
-        
-        free(entry);
+    if (entry->refcount > 0) {
+        REGISTRY_UNLOCK();
+        return;
+    }
+
+    /* Remove from table */
+    HASH_DEL(g_code_table, entry);
+    REGISTRY_UNLOCK();
+
+    /* Release Python reference outside the lock: it may run the code watcher */
+    if (entry->has_python_ref) {
+        PyObject* obj = (PyObject*)code_addr;
+        /* The object should still be valid since we hold a reference */
+        Py_DECREF(obj);
     }
+    free(entry);
 }
 
 void code_registry_release_refs_batch(const uintptr_t* code_addrs, size_t count) {
@@ -310,9 +755,12 @@ CodeValidationResult code_registry_validate(uintptr_t code_addr, uint64_t captur
     
     /* If we're tracking this object, it's guaranteed valid */
     CodeEntry* entry = NULL;
+    REGISTRY_LOCK();
     HASH_FIND(hh, g_code_table, &code_addr, sizeof(code_addr), entry);
+    int held = entry != NULL && entry->has_python_ref;
+    REGISTRY_UNLOCK();
     
-    if (entry != NULL && entry->has_python_ref) {
+    if (held) {
         /* We hold a reference, so it's valid */
         return CODE_VALID;
     }
@@ -373,15 +821,75 @@ CodeValidationResult code_registry_validate(uintptr_t code_addr, uint64_t captur
     return CODE_VALID;
 }
 
+CodeValidationResult code_registry_validate_at(uintptr_t code_addr, uint64_t generation,
+                                               CodeSnapshot* snapshot) {
+    if (!g_tracking) {
+        return code_registry_validate(code_addr, 0);
+    }
+
+    g_validations++;
+    if (!is_pointer_valid(code_addr)) {
+        g_invalid_count++;
+        return CODE_INVALID_NULL;
+    }
+
+    REGISTRY_LOCK();
+
+    /*
+     * A death recorded after capture means the captured object is gone,
+     * even if the address is held now: it can only hold a newer object.
+     */
+    const RetiredCode* death = find_death_locked(code_addr, generation);
+    if (death != NULL) {
+        if (snapshot != NULL) {
+            *snapshot = death->snapshot;
+            Py_XINCREF(snapshot->name);
+            Py_XINCREF(snapshot->filename);
+            Py_XINCREF(snapshot->linetable);
+        }
+        g_retired_resolved++;
+        REGISTRY_UNLOCK();
+        return CODE_RETIRED;
+    }
+
+    /* No death since capture: the captured object is alive */
+    CodeEntry* entry = NULL;
+    HASH_FIND(hh, g_code_table, &code_addr, sizeof(code_addr), entry);
+    if (entry != NULL && entry->has_python_ref) {
+        REGISTRY_UNLOCK();
+        return CODE_VALID;
+    }
+
+    /* Still guards against pointers that never were code objects */
+    if (!PyCode_Check((PyObject*)code_addr)) {
+        g_invalid_count++;
+        REGISTRY_UNLOCK();
+        return CODE_INVALID_TYPE;
+    }
+
+#ifdef Py_GIL_DISABLED
+    /* Another thread may drop the last reference as soon as we unlock */
+    entry = add_ref_locked(code_addr, 0);
+    if (entry != NULL) {
+        entry->pinned = 1;
+    }
+#endif
+    REGISTRY_UNLOCK();
+    return CODE_VALID;
+}
+
 int code_registry_is_held(uintptr_t code_addr) {
     if (!g_initialized || code_addr == 0) {
         return 0;
     }
     
     CodeEntry* entry = NULL;
+    REGISTRY_LOCK();
     HASH_FIND(hh, g_code_table, &code_addr, sizeof(code_addr), entry);
+    int held = entry != NULL && entry->has_python_ref;
+    REGISTRY_UNLOCK();
     
-    return (entry != NULL && entry->has_python_ref);
+    return held;
 }
 
 /*
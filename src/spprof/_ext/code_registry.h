@@ -15,11 +15,17 @@
  *   - For signal handler (no GIL):
  *     Track pointers and validate at resolution time using GC epoch
  *   - Add safe memory validation before PyCode_Check
+ *   - On Python 3.12+, watch code object destruction (PyCode_AddWatcher):
+ *     each destroyed object leaves a snapshot of its name, file and line
+ *     table, stamped with a generation number. Samples record the
+ *     generation they were captured at, so the resolver can tell a live
+ *     object from one destroyed (and its address possibly reused) since
+ *     capture, and never dereferences the latter.
  *
  * Usage:
  *   1. Call code_registry_init() at profiler startup
  *   2. When capturing (with GIL): code_registry_add_ref() for each code object
- *   3. When resolving: code_registry_validate() before accessing
+ *   3. When resolving: code_registry_validate_at() before accessing
  *   4. After resolving: code_registry_release_ref() to decrement
  *   5. Call code_registry_cleanup() at profiler shutdown
  *
@@ -60,8 +66,32 @@ typedef enum {
     CODE_INVALID_TYPE,        /* Not a PyCodeObject (PyCode_Check failed) */
     CODE_INVALID_GC_STALE,    /* GC ran since capture, may be invalid */
     CODE_INVALID_NOT_HELD,    /* Not held by registry, discarded in safe mode */
+    CODE_RETIRED,             /* Destroyed since capture; resolve from its snapshot */
 } CodeValidationResult;
 
+/**
+ * CodeSnapshot - What the resolver needs of a destroyed code object.
+ *
+ * Filled by code_registry_validate_at() for CODE_RETIRED. Holds new
+ * references; release with code_snapshot_release().
+ */
+typedef struct {
+    PyObject* name;         /* co_name (str) */
+    PyObject* filename;     /* co_filename (str) */
+    PyObject* linetable;    /* co_linetable (bytes) */
+    int firstlineno;        /* co_firstlineno */
+    Py_ssize_t code_units;  /* Bytecode length in code units */
+    uint64_t generation;    /* Generation the object was destroyed at */
+} CodeSnapshot;
+
+/**
+ * Callback for code object destructions (see code_registry_set_death_hook()).
+ *
+ * @param code_addr  Address of the destroyed object.
+ * @param generation Generation it was destroyed at.
+ */
+typedef void (*CodeDeathHook)(uintptr_t code_addr, uint64_t generation);
+
 /**
  * Check if a CodeValidationResult indicates success.
  *
@@ -86,6 +116,7 @@ static inline const char* code_validation_str(CodeValidationResult result) {
         case CODE_INVALID_TYPE:    return "not a code object (PyCode_Check failed)";
         case CODE_INVALID_GC_STALE: return "GC ran since capture, may be invalid";
         case CODE_INVALID_NOT_HELD: return "not held by registry (safe mode)";
+        case CODE_RETIRED:          return "destroyed since capture (snapshot kept)";
         default:                    return "unknown validation result";
     }
 }
@@ -142,6 +173,26 @@ int code_registry_add_ref(uintptr_t code_addr, uint64_t gc_epoch);
  */
 int code_registry_add_refs_batch(uintptr_t* code_addrs, size_t count, uint64_t gc_epoch);
 
+/**
+ * Pin a code object until the registry is cleared (REQUIRES GIL).
+ *
+ * Call after resolving a signal-captured code pointer. The held reference
+ * keeps the object, and so its address, from being reclaimed while the
+ * session runs: later samples of the same code validate as held instead
+ * of going through PyCode_Check on memory that may have been freed.
+ * Pinning an already pinned object is a no-op. Pins are dropped by
+ * code_registry_clear_all().
+ *
+ * Thread safety: Requires GIL (an attached thread on free-threaded builds).
+ * Async-signal safety: NO.
+ *
+ * Error handling: Boolean success (Pattern 2 from error.h)
+ *
+ * @param code_addr Raw PyCodeObject* pointer, already validated.
+ * @return 1 if the object is pinned, 0 on failure.
+ */
+int code_registry_pin(uintptr_t code_addr);
+
 /**
  * Release a reference to a code object (REQUIRES GIL).
  *
@@ -187,6 +238,133 @@ void code_registry_release_refs_batch(const uintptr_t* code_addrs, size_t count)
  */
 CodeValidationResult code_registry_validate(uintptr_t code_addr, uint64_t capture_epoch);
 
+/**
+ * Validate a code object pointer captured at a known generation (REQUIRES GIL).
+ *
+ * With lifetime tracking (code_registry_tracks_lifetimes()), the answer
+ * never involves reading code_addr unless the object is known to be
+ * alive:
+ *   - CODE_VALID: held by the registry, or no object at code_addr has
+ *     been destroyed since generation, so the captured object is alive.
+ *     On free-threaded builds the object is also pinned before the
+ *     registry lock is dropped (see code_registry_pin()).
+ *   - CODE_RETIRED: the captured object has been destroyed. If snapshot
+ *     is not NULL it receives the object's snapshot.
+ * Safe mode rejects nothing in this case.
+ *
+ * Without lifetime tracking (Python < 3.12, or the watcher could not be
+ * installed) this is code_registry_validate(code_addr, 0).
+ *
+ * Thread safety: Requires GIL (an attached thread on free-threaded builds).
+ * Async-signal safety: NO.
+ *
+ * @param code_addr  Raw PyCodeObject* pointer.
+ * @param generation code_registry_generation() read before the capture.
+ * @param snapshot   Receives new references for CODE_RETIRED; may be NULL.
+ * @return CodeValidationResult.
+ */
+CodeValidationResult code_registry_validate_at(uintptr_t code_addr, uint64_t generation,
+                                               CodeSnapshot* snapshot);
+
+/**
+ * Release the references held by a snapshot and clear it.
+ *
+ * @param snapshot Snapshot filled by code_registry_validate_at().
+ */
+void code_snapshot_release(CodeSnapshot* snapshot);
+
+/**
+ * Line number for a bytecode offset of a destroyed code object.
+ *
+ * Decodes the snapshot's location table (the 3.11+ format) without a
+ * code object. Requires the GIL.
+ *
+ * @param snapshot    Snapshot of the code object.
+ * @param byte_offset Offset into the bytecode in bytes.
+ * @return Line number, or co_firstlineno if the offset has none.
+ */
+int code_snapshot_line(const CodeSnapshot* snapshot, int byte_offset);
+
+/**
+ * Line number for a bytecode offset, from a raw 3.11+ location table.
+ *
+ * Pure computation on the bytes: needs no GIL and no code object.
+ *
+ * @param table       co_linetable bytes (may be NULL).
+ * @param len         Length of table.
+ * @param firstlineno co_firstlineno.
+ * @param byte_offset Offset into the bytecode in bytes.
+ * @return Line number, or firstlineno if the offset has none.
+ */
+int code_linetable_line(const uint8_t* table, size_t len, int firstlineno, int byte_offset);
+
+/**
+ * Install a callback run on every recorded code object destruction.
+ *
+ * The hook runs inside the object's deallocation, with the GIL held and
+ * outside the registry lock. It must not call back into Python. Pass
+ * NULL to remove it.
+ *
+ * @param hook Callback, or NULL.
+ */
+void code_registry_set_death_hook(CodeDeathHook hook);
+
+/**
+ * Current code object generation - ASYNC-SIGNAL-SAFE.
+ *
+ * Incremented each time a code object is destroyed. Samplers read it
+ * before capturing frames and store it with the sample.
+ *
+ * @return Current generation (0 until the first destruction).
+ */
+uint64_t code_registry_generation(void);
+
+/**
+ * Check if code object destruction is being tracked.
+ *
+ * @return 1 on Python 3.12+ while the code watcher is installed, 0 otherwise.
+ */
+int code_registry_tracks_lifetimes(void);
+
+/**
+ * Check if an object at code_addr was destroyed after generation.
+ *
+ * Lets caches keyed by address detect that the entry's object died and
+ * the address may now hold another one. Always 0 without lifetime
+ * tracking. Requires the GIL.
+ *
+ * @param code_addr  Raw PyCodeObject* pointer.
+ * @param generation Generation the cached data was produced at.
+ * @return 1 if a destruction at code_addr was recorded after generation.
+ */
+int code_registry_died_since(uintptr_t code_addr, uint64_t generation);
+
+/**
+ * Drop snapshots of objects destroyed at or before generation (REQUIRES GIL).
+ *
+ * Only call when no sample captured at or before generation is still
+ * waiting to be resolved, and after clearing any cache that relies on
+ * code_registry_died_since().
+ *
+ * @param generation Newest generation to drop.
+ */
+void code_registry_release_retired(uint64_t generation);
+
+/**
+ * Number of snapshots currently kept.
+ *
+ * @return Snapshot count.
+ */
+size_t code_registry_retired_count(void);
+
+/**
+ * Get lifetime tracking statistics.
+ *
+ * @param retired_held     Output: snapshots currently kept.
+ * @param retired_resolved Output: frames resolved from a snapshot.
+ */
+void code_registry_get_lifetime_stats(uint64_t* retired_held, uint64_t* retired_resolved);
+
 /**
  * Check if a code object is currently held by the registry.
  *
@@ -263,6 +441,10 @@ void code_registry_clear_all(void);
  *   - Enabled: Signal-handler samples on Linux may be discarded, but
  *              guaranteed memory safety
  *
+ * On Python 3.12+ lifetime tracking gives the same guarantee without
+ * discarding anything (see code_registry_validate_at()), so safe mode
+ * only rejects samples when tracking is unavailable.
+ *
  * Note: Darwin/Mach sampler holds the GIL during capture and INCREFs
  * code objects, so safe mode has no effect on Darwin samples.
  *
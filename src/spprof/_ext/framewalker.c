@@ -180,6 +180,11 @@ int framewalker_capture_raw(uintptr_t* frame_ptrs, int max_depth) {
     return _spprof_capture_frames_unsafe(frame_ptrs, max_depth);
 }
 
+uintptr_t framewalker_current_context(void) {
+    PyThreadState* tstate = _spprof_tstate_get();
+    return tstate != NULL ? (uintptr_t)tstate->context : 0;
+}
+
 /**
  * Capture frames with full frame info
  *
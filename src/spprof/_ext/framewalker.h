@@ -80,6 +80,15 @@ int framewalker_capture(RawFrameInfo* frames, int max_depth);
  */
 int framewalker_capture_raw(uintptr_t* frame_ptrs, int max_depth);
 
+/**
+ * Current contextvars.Context of the calling thread.
+ *
+ * Async-signal safety: YES (a thread state read).
+ *
+ * @return The Context pointer, 0 if the thread has none yet.
+ */
+uintptr_t framewalker_current_context(void);
+
 /**
  * Get Python version information string.
  *
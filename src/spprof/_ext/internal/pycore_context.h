@@ -0,0 +1,308 @@
+/**
+ * internal/pycore_context.h - contextvars lookups from a signal handler
+ *
+ * A contextvars.Context keeps its variables in a HAMT, an immutable
+ * persistent map: ContextVar.set() builds a new HAMT and swaps it into the
+ * Context. The HAMT a thread's current Context points at therefore cannot
+ * change while that thread is interrupted, and a lookup is a few plain
+ * pointer reads. These structures mirror CPython's layout, which has not
+ * changed since 3.7:
+ *
+ *   - Include/internal/pycore_context.h (PyContext)
+ *   - Include/internal/pycore_hamt.h (PyHamtObject)
+ *   - Python/hamt.c (bitmap, array and collision nodes)
+ *
+ * The node types are not exported, so _spprof_hamt_learn_types() finds
+ * them by building small HAMTs at startup and checks their names.
+ *
+ * ASYNC-SIGNAL-SAFETY:
+ *   _spprof_context_lookup() is async-signal-safe: no Python C API calls,
+ *   no allocation, no locks, a bounded number of reads.
+ *   _spprof_hamt_learn_types() needs the GIL.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPPROF_INTERNAL_PYCORE_CONTEXT_H
+#define SPPROF_INTERNAL_PYCORE_CONTEXT_H
+
+#include <Python.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pycore_tstate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * =============================================================================
+ * Structure Mirrors
+ * =============================================================================
+ */
+
+/* Bits of the hash consumed per tree level, and the resulting fan-out */
+#define SPPROF_HAMT_BITS 5
+#define SPPROF_HAMT_ARRAY_SIZE 32
+
+/* Levels a 32-bit hash spans, plus one for a collision node */
+#define SPPROF_HAMT_MAX_DEPTH 8
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *h_root;
+    PyObject *h_weakreflist;
+    Py_ssize_t h_count;
+} _spprof_PyHamtObject;
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *ctx_prev;
+    _spprof_PyHamtObject *ctx_vars;
+    PyObject *ctx_weakreflist;
+    int ctx_entered;
+} _spprof_PyContext;
+
+/* Key/value pairs; a NULL key means the value is a subtree */
+typedef struct {
+    PyObject_VAR_HEAD
+    uint32_t b_bitmap;
+    PyObject *b_array[1];
+} _spprof_HamtBitmapNode;
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *a_array[SPPROF_HAMT_ARRAY_SIZE];
+    Py_ssize_t a_count;
+} _spprof_HamtArrayNode;
+
+/* Key/value pairs whose keys share one 32-bit hash */
+typedef struct {
+    PyObject_VAR_HEAD
+    int32_t c_hash;
+    PyObject *c_array[1];
+} _spprof_HamtCollisionNode;
+
+/**
+ * _spprof_HamtTypes - The three HAMT node types, learned at startup
+ */
+typedef struct {
+    PyTypeObject *bitmap;
+    PyTypeObject *array;
+    PyTypeObject *collision;
+} _spprof_HamtTypes;
+
+/*
+ * =============================================================================
+ * Lookup (async-signal-safe)
+ * =============================================================================
+ */
+
+static inline uint32_t
+_spprof_popcount32(uint32_t v) {
+    v = v - ((v >> 1) & 0x55555555U);
+    v = (v & 0x33333333U) + ((v >> 2) & 0x33333333U);
+    return (((v + (v >> 4)) & 0x0F0F0F0FU) * 0x01010101U) >> 24;
+}
+
+/**
+ * Fold a Python hash into the 32-bit hash the HAMT indexes by.
+ *
+ * Mirrors hamt_hash() in Python/hamt.c. Not signal-safe callers compute
+ * it once from PyObject_Hash().
+ */
+static inline int32_t
+_spprof_hamt_hash(Py_hash_t hash) {
+#if SIZEOF_PY_HASH_T <= 4
+    return (int32_t)hash;
+#else
+    int32_t xored = (int32_t)(hash & 0xffffffffl) ^ (int32_t)(hash >> 32);
+    return xored == -1 ? -2 : xored;
+#endif
+}
+
+/**
+ * Find a key in a HAMT by identity.
+ *
+ * Keys of a Context's HAMT are ContextVars, which compare by identity, so
+ * pointer equality matches CPython's own lookup.
+ *
+ * @param types Node types from _spprof_hamt_learn_types()
+ * @param node  Root node (PyHamtObject.h_root)
+ * @param key   Key object
+ * @param hash  _spprof_hamt_hash() of the key
+ * @return The value (borrowed), or NULL if absent or the tree looks wrong
+ */
+static inline PyObject *
+_spprof_hamt_find(const _spprof_HamtTypes *types, PyObject *node,
+                  PyObject *key, int32_t hash) {
+    uint32_t shift = 0;
+
+    for (int level = 0; level < SPPROF_HAMT_MAX_DEPTH; level++) {
+        if (!_spprof_ptr_valid(node)) {
+            return NULL;
+        }
+        PyTypeObject *type = Py_TYPE(node);
+
+        if (type == types->collision) {
+            const _spprof_HamtCollisionNode *c = (const _spprof_HamtCollisionNode *)node;
+            Py_ssize_t size = Py_SIZE(node);
+            for (Py_ssize_t i = 0; i + 1 < size; i += 2) {
+                if (c->c_array[i] == key) {
+                    return c->c_array[i + 1];
+                }
+            }
+            return NULL;
+        }
+
+        /* Only collision nodes sit below the last 5-bit slice */
+        if (shift >= 32) {
+            return NULL;
+        }
+        uint32_t index = ((uint32_t)hash >> shift) & (SPPROF_HAMT_ARRAY_SIZE - 1);
+
+        if (type == types->array) {
+            node = ((const _spprof_HamtArrayNode *)node)->a_array[index];
+        } else if (type == types->bitmap) {
+            const _spprof_HamtBitmapNode *b = (const _spprof_HamtBitmapNode *)node;
+            uint32_t bit = 1U << index;
+            if (!(b->b_bitmap & bit)) {
+                return NULL;
+            }
+            uint32_t slot = 2 * _spprof_popcount32(b->b_bitmap & (bit - 1));
+            if ((Py_ssize_t)slot + 1 >= Py_SIZE(node)) {
+                return NULL;
+            }
+            PyObject *entry_key = b->b_array[slot];
+            if (entry_key != NULL) {
+                return entry_key == key ? b->b_array[slot + 1] : NULL;
+            }
+            node = b->b_array[slot + 1];
+        } else {
+            return NULL;
+        }
+        shift += SPPROF_HAMT_BITS;
+    }
+    return NULL;
+}
+
+/**
+ * Read a ContextVar's value in a Context.
+ *
+ * @param types   Node types from _spprof_hamt_learn_types()
+ * @param context Context (PyThreadState.context), may be NULL
+ * @param var     The ContextVar
+ * @param hash    _spprof_hamt_hash() of the ContextVar
+ * @return The value (borrowed), or NULL if the variable is not set
+ */
+static inline PyObject *
+_spprof_context_lookup(const _spprof_HamtTypes *types, PyObject *context,
+                       PyObject *var, int32_t hash) {
+    if (!_spprof_ptr_valid(context)) {
+        return NULL;
+    }
+    const _spprof_PyHamtObject *vars = ((const _spprof_PyContext *)context)->ctx_vars;
+    if (!_spprof_ptr_valid(vars)) {
+        return NULL;
+    }
+    return _spprof_hamt_find(types, vars->h_root, var, hash);
+}
+
+/*
+ * =============================================================================
+ * Node Type Discovery (GIL required)
+ * =============================================================================
+ */
+
+/* Calls hamt.set(key, None) and drops the reference to the old HAMT */
+static inline PyObject *
+_spprof_hamt_set_long(PyObject *hamt, long key) {
+    PyObject *next = PyObject_CallMethod(hamt, "set", "lO", key, Py_None);
+    Py_DECREF(hamt);
+    return next;
+}
+
+static inline int
+_spprof_type_named(PyTypeObject *type, const char *name) {
+    return type != NULL && strcmp(type->tp_name, name) == 0;
+}
+
+/**
+ * Learn the HAMT node types.
+ *
+ * Starts from a fresh Context's empty HAMT, whose root is a bitmap node.
+ * Adding -1 and -2 (which hash alike) to it puts a collision node right
+ * under the root; adding 40 integer keys turns the root into an array
+ * node. No other keys are present, so neither shape depends on hash
+ * randomization.
+ *
+ * @param out Receives the types
+ * @return 1 if all three were found, 0 if the layout is not as expected
+ *         (no exception set), -1 with an exception set
+ */
+static inline int
+_spprof_hamt_learn_types(_spprof_HamtTypes *out) {
+    memset(out, 0, sizeof(*out));
+
+    PyObject *context = PyContext_New();
+    if (context == NULL) {
+        return -1;
+    }
+
+    PyObject *hamt = (PyObject *)((_spprof_PyContext *)context)->ctx_vars;
+    if (!_spprof_type_named(Py_TYPE(context), "_contextvars.Context") ||
+        !_spprof_type_named(Py_TYPE(hamt), "hamt")) {
+        Py_DECREF(context);
+        return 0;
+    }
+    Py_INCREF(hamt);
+    Py_DECREF(context);
+
+    out->bitmap = Py_TYPE(((_spprof_PyHamtObject *)hamt)->h_root);
+
+    /* hash(-1) == hash(-2): their pair moves into a collision node */
+    PyObject *collide = hamt;
+    Py_INCREF(collide);
+    collide = collide ? _spprof_hamt_set_long(collide, -1) : NULL;
+    collide = collide ? _spprof_hamt_set_long(collide, -2) : NULL;
+    if (collide != NULL) {
+        PyObject *root = ((_spprof_PyHamtObject *)collide)->h_root;
+        if (Py_TYPE(root) == out->bitmap) {
+            const _spprof_HamtBitmapNode *b = (const _spprof_HamtBitmapNode *)root;
+            for (Py_ssize_t i = 0; i + 1 < Py_SIZE(root); i += 2) {
+                if (b->b_array[i] == NULL) {
+                    out->collision = Py_TYPE(b->b_array[i + 1]);
+                }
+            }
+        }
+        Py_DECREF(collide);
+    }
+
+    /* More than 16 keys in one bitmap node turn it into an array node */
+    for (long key = 0; key < 40 && hamt != NULL; key++) {
+        hamt = _spprof_hamt_set_long(hamt, key);
+    }
+    if (hamt != NULL) {
+        out->array = Py_TYPE(((_spprof_PyHamtObject *)hamt)->h_root);
+        Py_DECREF(hamt);
+    }
+
+    if (PyErr_Occurred()) {
+        return -1;
+    }
+    if (!_spprof_type_named(out->bitmap, "hamt_bitmap_node") ||
+        !_spprof_type_named(out->array, "hamt_array_node") ||
+        !_spprof_type_named(out->collision, "hamt_collision_node")) {
+        memset(out, 0, sizeof(*out));
+        return 0;
+    }
+    return 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPPROF_INTERNAL_PYCORE_CONTEXT_H */
@@ -102,7 +102,8 @@ extern "C" {
  *
  * For now, we detect free-threaded builds and:
  *    - Darwin/Mach: Allow profiling (thread suspension is safe)
- *    - Linux/SIGPROF: Disable profiling with clear error message
+ *    - Linux/SIGPROF: Speculative capture with validation (pycore_tstate.h)
+ *    - Other platforms: Disable profiling with clear error message
  */
 
 /* Detect free-threaded builds */
@@ -93,7 +93,11 @@ extern "C" {
  * is associated with the current thread. Callers must handle NULL.
  *
  * Version-specific behavior:
- *   - Python 3.9-3.12: PyThreadState_GET() is a direct TLS read (safe)
+ *   - Python 3.9-3.11: PyGILState_GetThisThreadState() reads this thread's
+ *     TSS slot. PyThreadState_GET() is NOT usable here: outside the core it
+ *     expands to PyThreadState_Get(), which returns the *GIL holder* and
+ *     aborts the process with a fatal error when the GIL is released.
+ *   - Python 3.12: _PyThreadState_UncheckedGet() reads _Py_tss_tstate (TLS)
  *   - Python 3.13+: PyThreadState_GetUnchecked() avoids locks (safe)
  *
  * ASYNC-SIGNAL-SAFE: Direct TLS read on all versions.
@@ -110,14 +114,21 @@ _spprof_tstate_get(void) {
      * if no thread state exists (rather than raising an exception).
      */
     return PyThreadState_GetUnchecked();
+#elif PY_VERSION_HEX >= 0x030C0000
+    /*
+     * Python 3.12: the current thread state lives in _Py_tss_tstate, and
+     * _PyThreadState_UncheckedGet() is a plain TLS read returning NULL
+     * when this thread has no thread state.
+     */
+    return _PyThreadState_UncheckedGet();
 #else
     /*
-     * Python 3.9-3.12: PyThreadState_GET() reads from _Py_tss_tstate
-     * This is async-signal-safe as it's a direct TLS access.
-     *
-     * Note: PyThreadState_GET() is a macro that expands to a TLS read.
+     * Python 3.9-3.11: the "current" thread state is the GIL holder, not the
+     * interrupted thread. The interrupted thread's own state is found via
+     * its GILState TSS key (pthread_getspecific, no locks or allocation).
+     * Its frame chain is stable while we run: only this thread mutates it.
      */
-    return PyThreadState_GET();
+    return PyGILState_GetThisThreadState();
 #endif
 }
 
@@ -318,6 +329,12 @@ _spprof_capture_frames_unsafe(uintptr_t *frames, int max_frames) {
             break;
         }
         
+        /* Skip shim frames (C-stack) */
+        if (_spprof_frame_is_shim(frame)) {
+            frame = _spprof_frame_get_previous(frame);
+            continue;
+        }
+        
         /* Get code object pointer */
         PyCodeObject *code = _spprof_frame_get_code(frame);
         if (_spprof_ptr_valid(code)) {
@@ -903,18 +920,28 @@ static inline int _spprof_looks_like_code(PyObject *obj) {
 }
 
 /**
- * Capture Python frames speculatively with validation - ASYNC-SIGNAL-SAFE
- *
- * For use in signal handlers on free-threaded Python builds.
- * Validates each pointer before dereferencing and detects cycles.
- *
- * @param frames Output array for code object pointers
- * @param max_frames Maximum frames to capture (must be <= SPPROF_MAX_STACK_DEPTH)
- * @return Number of valid frames captured, or 0 if validation failed
+ * Walk the frame chain speculatively with validation - ASYNC-SIGNAL-SAFE
+ *
+ * Other threads keep running while we walk, so any pointer we load may be
+ * stale. The walk stops normally at a NULL previous pointer or once
+ * max_frames code objects are recorded. A sample is dropped (return 0,
+ * _spprof_samples_dropped_validation incremented) when the chain:
+ *   - holds a non-NULL pointer outside the user address range or
+ *     misaligned (torn or freed memory)
+ *   - revisits one of the last SPPROF_CYCLE_WINDOW_SIZE frames (cycle)
+ *   - is still going after SPPROF_FRAME_WALK_LIMIT frames (longer cycle)
+ *
+ * Frames whose f_executable is not a code object (shims, frames being
+ * set up) are skipped rather than dropping the sample.
+ *
+ * @param code_ptrs  Output array for code object pointers
+ * @param instr_ptrs Output array for instruction pointers, or NULL
+ * @param max_frames Maximum frames to capture
+ * @return Number of frames captured, or 0 if the sample was dropped
  */
 static inline int
-_spprof_capture_frames_speculative(uintptr_t *frames, int max_frames) {
-    if (!_spprof_speculative_initialized || frames == NULL || max_frames <= 0) {
+_spprof_walk_speculative(uintptr_t *code_ptrs, uintptr_t *instr_ptrs, int max_frames) {
+    if (!_spprof_speculative_initialized || code_ptrs == NULL || max_frames <= 0) {
         return 0;
     }
 
@@ -926,49 +953,49 @@ _spprof_capture_frames_speculative(uintptr_t *frames, int max_frames) {
 
     int depth = 0;
     uintptr_t seen[SPPROF_CYCLE_WINDOW_SIZE] = {0};
-    int seen_idx = 0;
-    int safety_limit = SPPROF_FRAME_WALK_LIMIT;
+    int walked = 0;
 
     /* Get current frame with appropriate memory ordering */
     _spprof_InterpreterFrame *frame =
         (_spprof_InterpreterFrame *)SPPROF_ATOMIC_LOAD_PTR(&tstate->current_frame);
 
-    while (depth < max_frames && safety_limit-- > 0) {
-        /* 1. Validate frame pointer */
-        if (!_spprof_ptr_valid_speculative(frame)) {
-            break;
+    while (frame != NULL && depth < max_frames) {
+        /* 1. Bounds: a non-NULL frame must look like a heap pointer */
+        if (!_spprof_ptr_valid_speculative(frame) || walked >= SPPROF_FRAME_WALK_LIMIT) {
+            goto drop;
         }
 
-        /* 2. Cycle detection - check against recent frames */
-        for (int i = 0; i < SPPROF_CYCLE_WINDOW_SIZE && i < depth; i++) {
+        /* 2. Cycle detection against the frames walked most recently,
+         * shims included, so a shim-only loop is caught too */
+        int window = walked < SPPROF_CYCLE_WINDOW_SIZE ? walked : SPPROF_CYCLE_WINDOW_SIZE;
+        for (int i = 0; i < window; i++) {
             if (seen[i] == (uintptr_t)frame) {
-                /* Cycle detected - drop sample and increment counter */
-                atomic_fetch_add_explicit(
-                    &_spprof_samples_dropped_validation, 1,
-                    memory_order_relaxed);
-                return 0;
+                goto drop;
             }
         }
-        /* Record this frame in rolling window */
-        seen[seen_idx++ & (SPPROF_CYCLE_WINDOW_SIZE - 1)] = (uintptr_t)frame;
+        seen[walked++ & (SPPROF_CYCLE_WINDOW_SIZE - 1)] = (uintptr_t)frame;
 
         /* 3. Skip shim frames (owned by C stack) */
-        if (frame->owner == SPPROF_FRAME_OWNED_BY_CSTACK) {
-            frame = (_spprof_InterpreterFrame *)
-                SPPROF_ATOMIC_LOAD_PTR(&frame->previous);
-            continue;
-        }
-
-        /* 4. Extract code object (handle tagged pointers for Python 3.14) */
+        if (frame->owner != SPPROF_FRAME_OWNED_BY_CSTACK) {
+            /* 4. Extract code object (handle tagged pointers for Python 3.14) */
 #if SPPROF_PY314
-        PyObject *code = (PyObject *)(frame->f_executable.bits & ~SPPROF_STACKREF_TAG_MASK);
+            PyObject *code =
+                (PyObject *)(frame->f_executable.bits & ~SPPROF_STACKREF_TAG_MASK);
 #else
-        PyObject *code = frame->f_executable;
+            PyObject *code = frame->f_executable;
 #endif
 
-        /* 5. Validate code object using cached type pointer */
-        if (_spprof_looks_like_code(code)) {
-            frames[depth++] = (uintptr_t)code;
+            /* 5. Validate code object using cached type pointer. The
+             * resolver bounds-checks instruction pointers against it. */
+            if (_spprof_looks_like_code(code)) {
+                code_ptrs[depth] = (uintptr_t)code;
+                if (instr_ptrs != NULL) {
+                    void *instr = _spprof_frame_get_instr_ptr(frame);
+                    instr_ptrs[depth] = _spprof_ptr_valid_speculative(instr)
+                        ? (uintptr_t)instr : 0;
+                }
+                depth++;
+            }
         }
 
         /* 6. Move to previous frame with memory ordering */
@@ -977,6 +1004,25 @@ _spprof_capture_frames_speculative(uintptr_t *frames, int max_frames) {
     }
 
     return depth;
+
+drop:
+    atomic_fetch_add_explicit(&_spprof_samples_dropped_validation, 1, memory_order_relaxed);
+    return 0;
+}
+
+/**
+ * Capture Python frames speculatively with validation - ASYNC-SIGNAL-SAFE
+ *
+ * For use in signal handlers on free-threaded Python builds.
+ * See _spprof_walk_speculative() for the checks applied.
+ *
+ * @param frames Output array for code object pointers
+ * @param max_frames Maximum frames to capture (must be <= SPPROF_MAX_STACK_DEPTH)
+ * @return Number of valid frames captured, or 0 if validation failed
+ */
+static inline int
+_spprof_capture_frames_speculative(uintptr_t *frames, int max_frames) {
+    return _spprof_walk_speculative(frames, NULL, max_frames);
 }
 
 /**
@@ -988,7 +1034,7 @@ _spprof_capture_frames_speculative(uintptr_t *frames, int max_frames) {
  * @param code_ptrs Output array for code object pointers
  * @param instr_ptrs Output array for instruction pointers (parallel)
  * @param max_frames Maximum frames to capture
- * @return Number of valid frames captured
+ * @return Number of valid frames captured, or 0 if validation failed
  */
 static inline int
 _spprof_capture_frames_with_instr_speculative(
@@ -996,75 +1042,10 @@ _spprof_capture_frames_with_instr_speculative(
     uintptr_t *instr_ptrs,
     int max_frames
 ) {
-    if (!_spprof_speculative_initialized || code_ptrs == NULL ||
-        instr_ptrs == NULL || max_frames <= 0) {
+    if (instr_ptrs == NULL) {
         return 0;
     }
-
-    /* Get thread state from TLS */
-    PyThreadState *tstate = _spprof_tstate_get();
-    if (!_spprof_ptr_valid_speculative(tstate)) {
-        return 0;
-    }
-
-    int depth = 0;
-    uintptr_t seen[SPPROF_CYCLE_WINDOW_SIZE] = {0};
-    int seen_idx = 0;
-    int safety_limit = SPPROF_FRAME_WALK_LIMIT;
-
-    /* Get current frame with appropriate memory ordering */
-    _spprof_InterpreterFrame *frame =
-        (_spprof_InterpreterFrame *)SPPROF_ATOMIC_LOAD_PTR(&tstate->current_frame);
-
-    while (depth < max_frames && safety_limit-- > 0) {
-        /* 1. Validate frame pointer */
-        if (!_spprof_ptr_valid_speculative(frame)) {
-            break;
-        }
-
-        /* 2. Cycle detection */
-        for (int i = 0; i < SPPROF_CYCLE_WINDOW_SIZE && i < depth; i++) {
-            if (seen[i] == (uintptr_t)frame) {
-                atomic_fetch_add_explicit(
-                    &_spprof_samples_dropped_validation, 1,
-                    memory_order_relaxed);
-                return 0;
-            }
-        }
-        seen[seen_idx++ & (SPPROF_CYCLE_WINDOW_SIZE - 1)] = (uintptr_t)frame;
-
-        /* 3. Skip shim frames */
-        if (frame->owner == SPPROF_FRAME_OWNED_BY_CSTACK) {
-            frame = (_spprof_InterpreterFrame *)
-                SPPROF_ATOMIC_LOAD_PTR(&frame->previous);
-            continue;
-        }
-
-        /* 4. Extract code object */
-#if SPPROF_PY314
-        PyObject *code = (PyObject *)(frame->f_executable.bits & ~SPPROF_STACKREF_TAG_MASK);
-#else
-        PyObject *code = frame->f_executable;
-#endif
-
-        /* 5. Validate and store code object and instruction pointer */
-        if (_spprof_looks_like_code(code)) {
-            code_ptrs[depth] = (uintptr_t)code;
-
-            /* Get instruction pointer for line number resolution */
-            void *instr = _spprof_frame_get_instr_ptr(frame);
-            instr_ptrs[depth] = _spprof_ptr_valid_speculative(instr)
-                ? (uintptr_t)instr : 0;
-
-            depth++;
-        }
-
-        /* 6. Move to previous frame */
-        frame = (_spprof_InterpreterFrame *)
-            SPPROF_ATOMIC_LOAD_PTR(&frame->previous);
-    }
-
-    return depth;
+    return _spprof_walk_speculative(code_ptrs, instr_ptrs, max_frames);
 }
 
 #endif /* SPPROF_FREE_THREADED && __linux__ */
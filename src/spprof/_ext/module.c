@@ -31,6 +31,13 @@
 #include "platform/platform.h"
 #include "signal_handler.h"
 #include "code_registry.h"
+#include "code_cache.h"
+#include "stack_table.h"
+#include "output_writer.h"
+#include "module_map.h"
+#include "native_symbols.h"
+#include "capture.h"
+#include "remote.h"
 
 /*
  * Include internal headers for free-threading detection.
@@ -57,7 +64,24 @@ static int g_module_initialized = 0;
 static void spprof_cleanup(void);
 
 /**
- * _start(interval_ns) - Start profiling
+ * Convert a sample's CPU delta to a Python int, or None when the producer
+ * could not read a thread CPU clock (SPPROF_CPU_TIME_UNKNOWN).
+ */
+static PyObject* cpu_time_to_py(uint64_t cpu_time_ns) {
+    if (cpu_time_ns == SPPROF_CPU_TIME_UNKNOWN) {
+        Py_RETURN_NONE;
+    }
+    return PyLong_FromUnsignedLongLong(cpu_time_ns);
+}
+
+/**
+ * _start(interval_ns, overhead_budget_pct, high_frequency) - Start profiling
+ *
+ * overhead_budget_pct (Linux only) caps the share of process CPU time spent
+ * in the signal handler; 0 disables the cap.
+ *
+ * high_frequency (Linux only) samples just the calling thread and accepts
+ * intervals down to SPPROF_HF_MIN_INTERVAL_NS.
  *
  * Internal function. Use spprof.start() from Python.
  */
@@ -74,26 +98,32 @@ static PyObject* spprof_start(PyObject* self, PyObject* args, PyObject* kwargs)
 #pragma GCC diagnostic ignored "-Wwrite-strings"
 #pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
 #endif
-    static char* kwlist[] = {"interval_ns", NULL};
+    static char* kwlist[] = {"interval_ns", "overhead_budget_pct", "high_frequency", NULL};
 #if defined(__clang__)
 #pragma clang diagnostic pop
 #elif defined(__GNUC__)
 #pragma GCC diagnostic pop
 #endif
     uint64_t interval_ns = 10000000;  /* Default 10ms */
+    double overhead_budget_pct = 0.0;  /* Default: no budget */
+    int high_frequency = 0;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|K", kwlist, &interval_ns)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|Kdp", kwlist,
+                                     &interval_ns, &overhead_budget_pct,
+                                     &high_frequency)) {
         return NULL;
     }
 
     /*
      * FREE-THREADING SAFETY CHECK
      *
-     * On free-threaded Python builds (Py_GIL_DISABLED), signal-based sampling
-     * is unsafe because the GIL is not there to protect frame chain consistency.
+     * On free-threaded Python builds (Py_GIL_DISABLED), a plain frame walk
+     * from a signal handler is unsafe because no GIL keeps the frame chain
+     * consistent.
      *
      * Darwin/macOS uses Mach-based sampling (thread suspension) which IS safe.
-     * Linux/other platforms use SIGPROF which is NOT safe for free-threading.
+     * Linux walks speculatively with validation (see pycore_tstate.h).
+     * Other platforms have neither.
      *
      * We check SPPROF_FREE_THREADING_SAFE at compile time and fail early
      * with a clear error message if the configuration is unsafe.
@@ -116,11 +146,43 @@ static PyObject* spprof_start(PyObject* self, PyObject* args, PyObject* kwargs)
     }
 
     /* Validate interval */
-    if (interval_ns < 1000000) {  /* Minimum 1ms */
+    if (high_frequency) {
+        if (interval_ns < SPPROF_HF_MIN_INTERVAL_NS) {
+            PyErr_SetString(PyExc_ValueError,
+                "interval_ns must be >= 20000 (20us) in high-frequency mode");
+            return NULL;
+        }
+        if (overhead_budget_pct > 0.0) {
+            PyErr_SetString(PyExc_ValueError,
+                "overhead_budget_pct cannot be combined with high-frequency mode");
+            return NULL;
+        }
+    } else if (interval_ns < 1000000) {  /* Minimum 1ms */
         PyErr_SetString(PyExc_ValueError, "interval_ns must be >= 1000000 (1ms)");
         return NULL;
     }
 
+    /* Validate overhead budget */
+    if (!(overhead_budget_pct >= 0.0 && overhead_budget_pct <= 100.0)) {
+        PyErr_SetString(PyExc_ValueError, "overhead_budget_pct must be in [0, 100]");
+        return NULL;
+    }
+#ifdef SPPROF_PLATFORM_LINUX
+    platform_set_overhead_budget(overhead_budget_pct / 100.0);
+    platform_set_high_frequency(high_frequency);
+#else
+    if (overhead_budget_pct > 0.0) {
+        PyErr_SetString(PyExc_RuntimeError,
+            "overhead_budget_pct is only supported on Linux");
+        return NULL;
+    }
+    if (high_frequency) {
+        PyErr_SetString(PyExc_RuntimeError,
+            "high-frequency mode is only supported on Linux");
+        return NULL;
+    }
+#endif
+
     /* Create ring buffer if needed */
     if (g_ringbuffer == NULL) {
         g_ringbuffer = ringbuffer_create();
@@ -184,6 +246,54 @@ static PyObject* spprof_finalize_stop(PyObject* self, PyObject* args) {
     Py_RETURN_NONE;
 }
 
+#ifdef SPPROF_PLATFORM_LINUX
+/**
+ * _after_fork_child() - Resume sampling in a forked child
+ *
+ * The platform's pthread_atfork child handler has already forgotten the
+ * parent's timers. This drops the samples inherited from the parent and
+ * re-arms the timer on the child's only thread, with the same interval,
+ * overhead budget and high-frequency setting. Call from the child's
+ * after-fork hook with the GIL held.
+ *
+ * Returns True if sampling resumed, False if the profiler was not active.
+ * Raises OSError (and leaves the profiler stopped) if the timer cannot be
+ * created.
+ */
+static PyObject* spprof_after_fork_child(PyObject* self, PyObject* args) {
+    if (!ATOMIC_LOAD(&g_is_active)) {
+        Py_RETURN_FALSE;
+    }
+
+    /* Uninstalls the handler and replays any high-frequency buffer */
+    platform_timer_destroy();
+
+    /* The parent's samples hold code references; release them unread */
+    RawSample* raw = (RawSample*)malloc(sizeof(RawSample));
+    if (raw == NULL) {
+        ATOMIC_STORE(&g_is_active, 0);
+        resolver_shutdown();
+        return PyErr_NoMemory();
+    }
+    while (resolver_next_raw_sample(raw)) {
+        if (raw->depth > 0) {
+            code_registry_release_refs_batch(raw->frames, (size_t)raw->depth);
+        }
+    }
+    free(raw);
+    ringbuffer_reset(g_ringbuffer);
+
+    if (platform_timer_create(g_interval_ns) < 0) {
+        ATOMIC_STORE(&g_is_active, 0);
+        resolver_shutdown();
+        PyErr_SetString(PyExc_OSError, "Failed to create profiling timer in forked child");
+        return NULL;
+    }
+    g_start_time = platform_monotonic_ns();
+    Py_RETURN_TRUE;
+}
+#endif
+
 /**
  * _stop() - Stop profiling and return raw samples (legacy API)
  *
@@ -195,6 +305,8 @@ static PyObject* spprof_finalize_stop(PyObject* self, PyObject* args) {
  * Returns a list of dicts, each containing:
  *   - 'timestamp': int (nanoseconds)
  *   - 'thread_id': int
+ *   - 'weight': int (timer expirations represented, >= 1)
+ *   - 'cpu_time_ns': int or None (thread CPU time since its previous sample)
  *   - 'frames': list of dicts with 'function', 'filename', 'lineno', 'is_native'
  */
 static PyObject* spprof_stop(PyObject* self, PyObject* args) {
@@ -261,9 +373,11 @@ static PyObject* spprof_stop(PyObject* self, PyObject* args) {
 
         /* Create sample dict */
         PyObject* sample_dict = Py_BuildValue(
-            "{s:K, s:K, s:O}",
+            "{s:K, s:K, s:I, s:N, s:O}",
             "timestamp", sample->timestamp,
             "thread_id", sample->thread_id,
+            "weight", sample->weight,
+            "cpu_time_ns", cpu_time_to_py(sample->cpu_time_ns),
             "frames", frames_list
         );
 
@@ -295,6 +409,45 @@ static PyObject* spprof_is_active(PyObject* self, PyObject* args) {
     Py_RETURN_FALSE;
 }
 
+/**
+ * _pause() - Disarm sampling timers without ending the session
+ *
+ * Samples already captured stay in the buffer. Pausing twice is a no-op.
+ */
+static PyObject* spprof_pause(PyObject* self, PyObject* args) {
+    if (!ATOMIC_LOAD(&g_is_active)) {
+        PyErr_SetString(PyExc_RuntimeError, "Profiler not running");
+        return NULL;
+    }
+
+    if (platform_timer_pause() < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * _resume() - Re-arm timers disarmed by _pause()
+ *
+ * Statistics keep accumulating across pauses. Resuming while not paused
+ * is a no-op.
+ */
+static PyObject* spprof_resume(PyObject* self, PyObject* args) {
+    if (!ATOMIC_LOAD(&g_is_active)) {
+        PyErr_SetString(PyExc_RuntimeError, "Profiler not running");
+        return NULL;
+    }
+
+    if (platform_timer_resume() < 0) {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
 /**
  * _get_stats() - Get current profiling statistics
  *
@@ -305,6 +458,7 @@ static PyObject* spprof_is_active(PyObject* self, PyObject* args) {
  *   - 'interval_ns': int
  *   - 'safe_mode_rejects': int (samples discarded due to safe mode)
  *   - 'validation_drops': int (samples dropped due to free-threading validation)
+ *   - 'timer_overruns': int (missed timer expirations folded into sample weights)
  */
 static PyObject* spprof_get_stats(PyObject* self, PyObject* args) {
     int is_active = ATOMIC_LOAD(&g_is_active);
@@ -325,14 +479,24 @@ static PyObject* spprof_get_stats(PyObject* self, PyObject* args) {
     /* Get validation drop count (free-threading speculative capture) */
     uint64_t validation_drops = signal_handler_validation_drops();
     
+    /* Interval multiplier applied by the overhead budget controller */
+    unsigned int interval_scale = 1;
+#ifdef SPPROF_PLATFORM_LINUX
+    interval_scale = (unsigned int)platform_get_interval_scale();
+#endif
+    
     return Py_BuildValue(
-        "{s:K, s:K, s:K, s:K, s:K, s:K}",
+        "{s:K, s:K, s:K, s:K, s:K, s:K, s:K, s:K, s:K, s:I}",
         "collected_samples", collected,
         "dropped_samples", dropped,
         "duration_ns", duration_ns,
         "interval_ns", g_interval_ns,
         "safe_mode_rejects", safe_mode_rejects,
-        "validation_drops", validation_drops
+        "validation_drops", validation_drops,
+        "timer_overruns", signal_handler_timer_overruns(),
+        "handler_ns", signal_handler_handler_ns(),
+        "handler_calls", signal_handler_handler_calls(),
+        "interval_scale", interval_scale
     );
 }
 
@@ -375,6 +539,27 @@ static PyObject* spprof_unregister_thread(PyObject* self, PyObject* args) {
     Py_RETURN_TRUE;
 }
 
+/**
+ * _set_label_var(var) - Register the ContextVar spprof.labels() sets
+ *
+ * Samples record the label set id the variable holds in the sampled
+ * thread's current Context. Returns False if samples cannot record labels
+ * on this interpreter or platform.
+ */
+static PyObject* spprof_set_label_var(PyObject* self, PyObject* args) {
+    PyObject* var;
+
+    if (!PyArg_ParseTuple(args, "O!", &PyContextVar_Type, &var)) {
+        return NULL;
+    }
+
+    int registered = signal_handler_set_label_var(var);
+    if (registered < 0) {
+        return NULL;
+    }
+    return PyBool_FromLong(registered);
+}
+
 /**
  * _set_native_unwinding(enabled) - Enable/disable native stack unwinding
  *
@@ -486,9 +671,11 @@ static PyObject* spprof_drain_buffer(PyObject* self, PyObject* args) {
 
         /* Create sample dict */
         PyObject* sample_dict = Py_BuildValue(
-            "{s:K, s:K, s:O}",
+            "{s:K, s:K, s:I, s:N, s:O}",
             "timestamp", sample->timestamp,
             "thread_id", sample->thread_id,
+            "weight", sample->weight,
+            "cpu_time_ns", cpu_time_to_py(sample->cpu_time_ns),
             "frames", frames_list
         );
 
@@ -515,6 +702,890 @@ static PyObject* spprof_drain_buffer(PyObject* self, PyObject* args) {
     return Py_BuildValue("(Oi)", result_list, has_more);
 }
 
+/**
+ * Insert `value` under `key` and drop our reference to it.
+ *
+ * @return 0 on success, -1 with an exception set (including value == NULL).
+ */
+static int dict_set_steal(PyObject* dict, const char* key, PyObject* value) {
+    if (value == NULL) {
+        return -1;
+    }
+    int rc = PyDict_SetItemString(dict, key, value);
+    Py_DECREF(value);
+    return rc;
+}
+
+/**
+ * Copy `count` elements of `elem_size` bytes into a new bytes object.
+ */
+static PyObject* column_to_bytes(const void* data, size_t count, size_t elem_size) {
+    if (count == 0) {
+        return PyBytes_FromStringAndSize(NULL, 0);
+    }
+    return PyBytes_FromStringAndSize((const char*)data, (Py_ssize_t)(count * elem_size));
+}
+
+/**
+ * Convert a filled StackTable into the dict returned by _drain_columnar().
+ *
+ * Frames are split into per-field columns so every numeric column is a
+ * flat native-endian array that Python can load with array.frombytes().
+ */
+static PyObject* stack_table_to_dict(const StackTable* table) {
+    PyObject* result = PyDict_New();
+    if (result == NULL) {
+        return NULL;
+    }
+
+    /* Truncated names may end mid UTF-8 sequence, so decode leniently */
+    PyObject* strings = PyList_New((Py_ssize_t)table->string_count);
+    if (dict_set_steal(result, "strings", strings) < 0) {
+        Py_DECREF(result);
+        return NULL;
+    }
+    for (size_t i = 0; i < table->string_count; i++) {
+        const char* str = table->strings[i];
+        PyObject* decoded = PyUnicode_DecodeUTF8(str, (Py_ssize_t)strlen(str), "replace");
+        if (decoded == NULL) {
+            Py_DECREF(result);
+            return NULL;
+        }
+        PyList_SET_ITEM(strings, (Py_ssize_t)i, decoded);
+    }
+
+    size_t frame_count = table->frame_count;
+    static const char* const frame_keys[5] = {
+        "frame_functions", "frame_filenames", "frame_linenos", "frame_is_native",
+        "frame_addresses",
+    };
+    PyObject* frame_columns[5] = {
+        PyBytes_FromStringAndSize(NULL, (Py_ssize_t)(frame_count * sizeof(uint32_t))),
+        PyBytes_FromStringAndSize(NULL, (Py_ssize_t)(frame_count * sizeof(uint32_t))),
+        PyBytes_FromStringAndSize(NULL, (Py_ssize_t)(frame_count * sizeof(int32_t))),
+        PyBytes_FromStringAndSize(NULL, (Py_ssize_t)frame_count),
+        PyBytes_FromStringAndSize(NULL, (Py_ssize_t)(frame_count * sizeof(uint64_t))),
+    };
+    int failed = 0;
+    for (int c = 0; c < 5; c++) {
+        failed |= frame_columns[c] == NULL;
+    }
+    if (!failed) {
+        uint32_t* function_ids = (uint32_t*)PyBytes_AS_STRING(frame_columns[0]);
+        uint32_t* filename_ids = (uint32_t*)PyBytes_AS_STRING(frame_columns[1]);
+        int32_t* linenos = (int32_t*)PyBytes_AS_STRING(frame_columns[2]);
+        char* native_flags = PyBytes_AS_STRING(frame_columns[3]);
+        uint64_t* addresses = (uint64_t*)PyBytes_AS_STRING(frame_columns[4]);
+        for (size_t i = 0; i < frame_count; i++) {
+            function_ids[i] = table->frames[i].function;
+            filename_ids[i] = table->frames[i].filename;
+            linenos[i] = table->frames[i].lineno;
+            native_flags[i] = (char)table->frames[i].is_native;
+            addresses[i] = table->frames[i].address;
+        }
+        for (int c = 0; c < 5 && !failed; c++) {
+            failed = PyDict_SetItemString(result, frame_keys[c], frame_columns[c]) < 0;
+        }
+    }
+    for (int c = 0; c < 5; c++) {
+        Py_XDECREF(frame_columns[c]);
+    }
+    if (failed) {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    size_t sample_count = table->sample_count;
+    if (dict_set_steal(result, "stack_offsets",
+                       column_to_bytes(table->stack_offsets, table->stack_count + 1,
+                                       sizeof(uint32_t))) < 0 ||
+        dict_set_steal(result, "stack_frames",
+                       column_to_bytes(table->stack_frames, table->stack_frames_len,
+                                       sizeof(uint32_t))) < 0 ||
+        dict_set_steal(result, "timestamps",
+                       column_to_bytes(table->timestamps, sample_count, sizeof(uint64_t))) < 0 ||
+        dict_set_steal(result, "thread_ids",
+                       column_to_bytes(table->thread_ids, sample_count, sizeof(uint64_t))) < 0 ||
+        dict_set_steal(result, "cpu_times",
+                       column_to_bytes(table->cpu_times, sample_count, sizeof(uint64_t))) < 0 ||
+        dict_set_steal(result, "weights",
+                       column_to_bytes(table->weights, sample_count, sizeof(uint32_t))) < 0 ||
+        dict_set_steal(result, "stack_ids",
+                       column_to_bytes(table->stack_ids, sample_count, sizeof(uint32_t))) < 0 ||
+        dict_set_steal(result, "label_ids",
+                       column_to_bytes(table->label_ids, sample_count, sizeof(uint32_t))) < 0 ||
+        dict_set_steal(result, "task_ids",
+                       column_to_bytes(table->task_ids, sample_count, sizeof(uint32_t))) < 0) {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    size_t row_count = table->aggregate_count;
+    if (dict_set_steal(result, "aggregate_thread_ids",
+                       column_to_bytes(table->aggregate_thread_ids, row_count,
+                                       sizeof(uint64_t))) < 0 ||
+        dict_set_steal(result, "aggregate_stack_ids",
+                       column_to_bytes(table->aggregate_stack_ids, row_count,
+                                       sizeof(uint32_t))) < 0 ||
+        dict_set_steal(result, "aggregate_label_ids",
+                       column_to_bytes(table->aggregate_label_ids, row_count,
+                                       sizeof(uint32_t))) < 0 ||
+        dict_set_steal(result, "aggregate_task_ids",
+                       column_to_bytes(table->aggregate_task_ids, row_count,
+                                       sizeof(uint32_t))) < 0 ||
+        dict_set_steal(result, "aggregate_counts",
+                       column_to_bytes(table->aggregate_counts, row_count,
+                                       sizeof(uint64_t))) < 0 ||
+        dict_set_steal(result, "aggregate_weights",
+                       column_to_bytes(table->aggregate_weights, row_count,
+                                       sizeof(uint64_t))) < 0 ||
+        dict_set_steal(result, "aggregate_cpu_times",
+                       column_to_bytes(table->aggregate_cpu_times, row_count,
+                                       sizeof(uint64_t))) < 0) {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+/**
+ * Look up a sample's Context in the tasks dict and set its task_id.
+ *
+ * @return 0 on success (task_id stays 0 when untracked), -1 with an
+ *         exception set.
+ */
+static int sample_task_id(PyObject* tasks, ResolvedSample* sample) {
+    PyObject* key = PyLong_FromUnsignedLongLong((unsigned long long)sample->context);
+    if (key == NULL) {
+        return -1;
+    }
+    PyObject* value = PyDict_GetItemWithError(tasks, key);
+    Py_DECREF(key);
+    if (value == NULL) {
+        return PyErr_Occurred() ? -1 : 0;
+    }
+    unsigned long task_id = PyLong_AsUnsignedLong(value);
+    if (task_id == (unsigned long)-1 && PyErr_Occurred()) {
+        return -1;
+    }
+    sample->task_id = (uint32_t)task_id;
+    return 0;
+}
+
+/**
+ * _drain_columnar() - Drain every pending sample into interned columns
+ *
+ * Replaces the per-frame dicts of _drain_buffer() with a string table,
+ * a frame table and per-sample columns. Numeric columns are bytes objects
+ * holding native-endian arrays (uint32 unless noted):
+ *
+ *   - 'strings': list of str (function names and file paths)
+ *   - 'frame_functions', 'frame_filenames': string ids per frame
+ *   - 'frame_linenos': int32 per frame; 'frame_is_native': uint8 per frame
+ *   - 'frame_addresses': uint64 native PC per frame (0 for Python frames)
+ *   - 'stack_offsets': stack i spans stack_frames[offsets[i]:offsets[i + 1]]
+ *   - 'stack_frames': frame ids, leaf first
+ *   - 'timestamps', 'thread_ids': uint64 per sample
+ *   - 'cpu_times': uint64 per sample, 2**64 - 1 when not measured
+ *   - 'weights', 'stack_ids': per sample
+ *   - 'label_ids': spprof.labels() set id per sample, 0 if none
+ *   - 'task_ids': tracked asyncio task id per sample, 0 if none
+ *
+ * tasks, when given, maps id(contextvars.Context) to a task id; a sample
+ * taken while that Context was current gets the id. The Contexts must be
+ * kept alive until the drain so their addresses are not reused.
+ *
+ * With aggregate=True the sample columns stay empty and each sample is
+ * instead folded into one row per unique (thread, stack, label set, task):
+ *
+ *   - 'aggregate_thread_ids': uint64
+ *   - 'aggregate_stack_ids', 'aggregate_label_ids', 'aggregate_task_ids': uint32
+ *   - 'aggregate_counts', 'aggregate_weights': uint64 sums
+ *   - 'aggregate_cpu_times': uint64 sum, 2**64 - 1 if none was measured
+ *
+ * Call between _stop_timer() and _finalize_stop().
+ */
+static PyObject* spprof_drain_columnar(PyObject* self, PyObject* args, PyObject* kwds) {
+    /* Same char** limitation as spprof_start() */
+#if defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wwrite-strings"
+#pragma clang diagnostic ignored "-Wincompatible-pointer-types-discards-qualifiers"
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wwrite-strings"
+#pragma GCC diagnostic ignored "-Wdiscarded-qualifiers"
+#endif
+    static char* kwlist[] = {"aggregate", "tasks", NULL};
+#if defined(__clang__)
+#pragma clang diagnostic pop
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+    int aggregate = 0;
+    PyObject* tasks = Py_None;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|pO", kwlist, &aggregate, &tasks)) {
+        return NULL;
+    }
+    if (tasks != Py_None && !PyDict_Check(tasks)) {
+        PyErr_SetString(PyExc_TypeError, "tasks must be a dict or None");
+        return NULL;
+    }
+    if (tasks != Py_None && PyDict_GET_SIZE(tasks) == 0) {
+        tasks = Py_None;
+    }
+
+    StackTable* table = stack_table_create();
+    /* ResolvedSample is ~165KB; keep the batch off the stack. Batches are
+     * resolved in parallel, then interned here in order. */
+    size_t batch_size = resolver_batch_size();
+    ResolvedSample* batch = (ResolvedSample*)malloc(batch_size * sizeof(ResolvedSample));
+    if (table == NULL || batch == NULL) {
+        stack_table_destroy(table);
+        free(batch);
+        return PyErr_NoMemory();
+    }
+
+    size_t count;
+    while ((count = resolver_next_samples(batch, batch_size)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            ResolvedSample* sample = &batch[i];
+            if (tasks != Py_None && sample->context != 0 &&
+                sample_task_id(tasks, sample) < 0) {
+                stack_table_destroy(table);
+                free(batch);
+                return NULL;
+            }
+            int rc = aggregate ? stack_table_aggregate_sample(table, sample)
+                               : stack_table_add_sample(table, sample);
+            if (rc < 0) {
+                stack_table_destroy(table);
+                free(batch);
+                return PyErr_NoMemory();
+            }
+        }
+    }
+    free(batch);
+
+    PyObject* result = stack_table_to_dict(table);
+    stack_table_destroy(table);
+    return result;
+}
+
+/* Numeric column attributes of spprof._SampleColumns, in ColumnsView order */
+#define COLUMNS_VIEW_BUFFERS 13
+
+/**
+ * ColumnsView - A ProfileColumns borrowed from a Python _SampleColumns
+ *
+ * Holds buffer exports of every column plus a tuple of the string table,
+ * so the writers can run without the GIL while the data stays pinned.
+ */
+typedef struct {
+    ProfileColumns cols;
+    Py_buffer views[COLUMNS_VIEW_BUFFERS];
+    int view_count;
+    PyObject* strings;              /* tuple; keeps the UTF-8 caches alive */
+    PyObject* thread_name_values;   /* list of str */
+    const char** string_ptrs;
+    size_t* string_lengths;
+    uint64_t* thread_name_ids;
+    const char** thread_names;
+    PyObject* label_sets;           /* dict; keeps the label strings alive */
+    uint32_t* label_offsets;
+    const char** label_keys;
+    const char** label_values;
+} ColumnsView;
+
+/**
+ * Export one numeric column attribute as a flat buffer.
+ *
+ * @return 0 on success, -1 with an exception set.
+ */
+static int columns_view_buffer(ColumnsView* view, PyObject* columns, const char* attr,
+                               size_t elem_size, const void** data, size_t* count) {
+    PyObject* column = PyObject_GetAttrString(columns, attr);
+    if (column == NULL) {
+        return -1;
+    }
+    Py_buffer* buffer = &view->views[view->view_count];
+    int rc = PyObject_GetBuffer(column, buffer, PyBUF_SIMPLE);
+    Py_DECREF(column);
+    if (rc < 0) {
+        return -1;
+    }
+    view->view_count++;
+    if ((size_t)buffer->len % elem_size != 0) {
+        PyErr_Format(PyExc_ValueError, "column %s has a partial element", attr);
+        return -1;
+    }
+    *data = buffer->buf;
+    *count = (size_t)buffer->len / elem_size;
+    return 0;
+}
+
+static void columns_view_close(ColumnsView* view) {
+    for (int i = 0; i < view->view_count; i++) {
+        PyBuffer_Release(&view->views[i]);
+    }
+    Py_XDECREF(view->strings);
+    Py_XDECREF(view->thread_name_values);
+    free(view->string_ptrs);
+    free(view->string_lengths);
+    free(view->thread_name_ids);
+    free(view->thread_names);
+    Py_XDECREF(view->label_sets);
+    free(view->label_offsets);
+    free(view->label_keys);
+    free(view->label_values);
+}
+
+/**
+ * Borrow the label_ids column and label_sets ({id: {key: value}}) of a
+ * _SampleColumns. Leaves cols->label_ids NULL when there are no sets.
+ *
+ * @return 0 on success, -1 with an exception set.
+ */
+static int columns_view_labels(ColumnsView* view, PyObject* columns) {
+    ProfileColumns* cols = &view->cols;
+    size_t ids_count;
+    if (columns_view_buffer(view, columns, "label_ids", sizeof(uint32_t),
+                            (const void**)&cols->label_ids, &ids_count) < 0) {
+        return -1;
+    }
+    if (ids_count != cols->sample_count) {
+        PyErr_SetString(PyExc_ValueError, "profile columns have mismatched lengths");
+        return -1;
+    }
+    view->label_sets = PyObject_GetAttrString(columns, "label_sets");
+    if (view->label_sets == NULL) {
+        return -1;
+    }
+    if (!PyDict_Check(view->label_sets)) {
+        PyErr_SetString(PyExc_TypeError, "label_sets must be a dict");
+        return -1;
+    }
+    if (PyDict_Size(view->label_sets) == 0) {
+        cols->label_ids = NULL;
+        return 0;
+    }
+
+    /* Ids are interned process-wide, so sets are indexed by id directly */
+    Py_ssize_t pos = 0;
+    PyObject* key;
+    PyObject* value;
+    unsigned long long max_id = 0;
+    size_t pair_count = 0;
+    while (PyDict_Next(view->label_sets, &pos, &key, &value)) {
+        unsigned long long id = PyLong_Check(key) ? PyLong_AsUnsignedLongLong(key) : 0;
+        Py_ssize_t len = PyObject_Length(value);
+        if (PyErr_Occurred() || len < 0) {
+            return -1;
+        }
+        if (id == 0 || id >= UINT32_MAX) {
+            PyErr_SetString(PyExc_ValueError, "label set ids must be in [1, 2**32 - 1)");
+            return -1;
+        }
+        max_id = id > max_id ? id : max_id;
+        pair_count += (size_t)len;
+    }
+    view->label_offsets = (uint32_t*)calloc((size_t)max_id + 2, sizeof(uint32_t));
+    view->label_keys = (const char**)calloc(pair_count + 1, sizeof(char*));
+    view->label_values = (const char**)calloc(pair_count + 1, sizeof(char*));
+    if (view->label_offsets == NULL || view->label_keys == NULL || view->label_values == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    /* Count each set's pairs at offsets[id + 1], prefix-sum, then fill */
+    pos = 0;
+    while (PyDict_Next(view->label_sets, &pos, &key, &value)) {
+        size_t id = (size_t)PyLong_AsUnsignedLongLong(key);
+        view->label_offsets[id + 1] = (uint32_t)PyObject_Length(value);
+    }
+    for (size_t id = 0; id <= (size_t)max_id; id++) {
+        view->label_offsets[id + 1] += view->label_offsets[id];
+    }
+    pos = 0;
+    while (PyDict_Next(view->label_sets, &pos, &key, &value)) {
+        size_t id = (size_t)PyLong_AsUnsignedLongLong(key);
+        size_t cursor = view->label_offsets[id];
+        PyObject* items = PyMapping_Items(value);
+        if (items == NULL) {
+            return -1;
+        }
+        Py_ssize_t count = PyList_GET_SIZE(items);
+        if ((size_t)count != view->label_offsets[id + 1] - cursor) {
+            Py_DECREF(items);
+            PyErr_SetString(PyExc_RuntimeError, "label set changed size");
+            return -1;
+        }
+        for (Py_ssize_t i = 0; i < count; i++) {
+            PyObject* pair = PyList_GET_ITEM(items, i);
+            PyObject* label_key = PyTuple_GET_ITEM(pair, 0);
+            PyObject* label_value = PyTuple_GET_ITEM(pair, 1);
+            if (!PyUnicode_Check(label_key) || !PyUnicode_Check(label_value)) {
+                Py_DECREF(items);
+                PyErr_SetString(PyExc_TypeError, "labels must map str to str");
+                return -1;
+            }
+            /* The mapping owns both strings; their UTF-8 caches outlive items */
+            view->label_keys[cursor] = PyUnicode_AsUTF8(label_key);
+            view->label_values[cursor] = PyUnicode_AsUTF8(label_value);
+            if (view->label_keys[cursor] == NULL || view->label_values[cursor] == NULL) {
+                Py_DECREF(items);
+                return -1;
+            }
+            cursor++;
+        }
+        Py_DECREF(items);
+    }
+    cols->label_offsets = view->label_offsets;
+    cols->label_keys = view->label_keys;
+    cols->label_values = view->label_values;
+    cols->label_set_count = (size_t)max_id + 1;
+    return 0;
+}
+
+/**
+ * Borrow the columns of a _SampleColumns object and validate them.
+ *
+ * @return 0 on success, -1 with an exception set (call columns_view_close
+ *         either way).
+ */
+static int columns_view_open(ColumnsView* view, PyObject* columns) {
+    memset(view, 0, sizeof(*view));
+    ProfileColumns* cols = &view->cols;
+
+    PyObject* strings = PyObject_GetAttrString(columns, "strings");
+    if (strings == NULL) {
+        return -1;
+    }
+    view->strings = PySequence_Tuple(strings);
+    Py_DECREF(strings);
+    if (view->strings == NULL) {
+        return -1;
+    }
+    size_t string_count = (size_t)PyTuple_GET_SIZE(view->strings);
+    view->string_ptrs = (const char**)calloc(string_count + 1, sizeof(char*));
+    view->string_lengths = (size_t*)calloc(string_count + 1, sizeof(size_t));
+    if (view->string_ptrs == NULL || view->string_lengths == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (size_t i = 0; i < string_count; i++) {
+        Py_ssize_t len;
+        const char* utf8 = PyUnicode_AsUTF8AndSize(
+            PyTuple_GET_ITEM(view->strings, (Py_ssize_t)i), &len);
+        if (utf8 == NULL) {
+            return -1;
+        }
+        view->string_ptrs[i] = utf8;
+        view->string_lengths[i] = (size_t)len;
+    }
+    cols->strings = view->string_ptrs;
+    cols->string_lengths = view->string_lengths;
+    cols->string_count = string_count;
+
+    size_t filenames_count, linenos_count, native_count, addresses_count, offsets_count;
+    size_t threads_count, cpu_count, weights_count, stacks_count;
+    if (columns_view_buffer(view, columns, "frame_functions", sizeof(uint32_t),
+                            (const void**)&cols->frame_functions, &cols->frame_count) < 0 ||
+        columns_view_buffer(view, columns, "frame_filenames", sizeof(uint32_t),
+                            (const void**)&cols->frame_filenames, &filenames_count) < 0 ||
+        columns_view_buffer(view, columns, "frame_linenos", sizeof(int32_t),
+                            (const void**)&cols->frame_linenos, &linenos_count) < 0 ||
+        columns_view_buffer(view, columns, "frame_is_native", sizeof(uint8_t),
+                            (const void**)&cols->frame_is_native, &native_count) < 0 ||
+        columns_view_buffer(view, columns, "frame_addresses", sizeof(uint64_t),
+                            (const void**)&cols->frame_addresses, &addresses_count) < 0 ||
+        columns_view_buffer(view, columns, "stack_offsets", sizeof(uint32_t),
+                            (const void**)&cols->stack_offsets, &offsets_count) < 0 ||
+        columns_view_buffer(view, columns, "stack_frames", sizeof(uint32_t),
+                            (const void**)&cols->stack_frames, &cols->stack_frames_len) < 0 ||
+        columns_view_buffer(view, columns, "timestamps", sizeof(uint64_t),
+                            (const void**)&cols->timestamps, &cols->sample_count) < 0 ||
+        columns_view_buffer(view, columns, "thread_ids", sizeof(uint64_t),
+                            (const void**)&cols->thread_ids, &threads_count) < 0 ||
+        columns_view_buffer(view, columns, "cpu_times", sizeof(uint64_t),
+                            (const void**)&cols->cpu_times, &cpu_count) < 0 ||
+        columns_view_buffer(view, columns, "weights", sizeof(uint32_t),
+                            (const void**)&cols->weights, &weights_count) < 0 ||
+        columns_view_buffer(view, columns, "stack_ids", sizeof(uint32_t),
+                            (const void**)&cols->stack_ids, &stacks_count) < 0) {
+        return -1;
+    }
+    if (filenames_count != cols->frame_count || linenos_count != cols->frame_count ||
+        native_count != cols->frame_count || addresses_count != cols->frame_count ||
+        offsets_count == 0 ||
+        threads_count != cols->sample_count || cpu_count != cols->sample_count ||
+        weights_count != cols->sample_count || stacks_count != cols->sample_count) {
+        PyErr_SetString(PyExc_ValueError, "profile columns have mismatched lengths");
+        return -1;
+    }
+    cols->stack_count = offsets_count - 1;
+    if (columns_view_labels(view, columns) < 0) {
+        return -1;
+    }
+    if (output_columns_validate(cols) < 0) {
+        PyErr_SetString(PyExc_ValueError, "profile columns reference out-of-range ids");
+        return -1;
+    }
+
+    /* Thread names: {thread_id: name} */
+    PyObject* names = PyObject_GetAttrString(columns, "thread_names");
+    if (names == NULL) {
+        return -1;
+    }
+    if (!PyDict_Check(names)) {
+        Py_DECREF(names);
+        PyErr_SetString(PyExc_TypeError, "thread_names must be a dict");
+        return -1;
+    }
+    size_t name_count = (size_t)PyDict_Size(names);
+    view->thread_name_values = PyList_New(0);
+    view->thread_name_ids = (uint64_t*)calloc(name_count + 1, sizeof(uint64_t));
+    view->thread_names = (const char**)calloc(name_count + 1, sizeof(char*));
+    if (view->thread_name_values == NULL || view->thread_name_ids == NULL ||
+        view->thread_names == NULL) {
+        Py_DECREF(names);
+        if (!PyErr_Occurred()) {
+            PyErr_NoMemory();
+        }
+        return -1;
+    }
+    Py_ssize_t pos = 0;
+    PyObject* key;
+    PyObject* value;
+    while (PyDict_Next(names, &pos, &key, &value)) {
+        if (!PyLong_Check(key) || !PyUnicode_Check(value)) {
+            continue;
+        }
+        uint64_t thread_id = PyLong_AsUnsignedLongLong(key);
+        const char* utf8 = PyUnicode_AsUTF8(value);
+        if ((thread_id == (uint64_t)-1 && PyErr_Occurred()) || utf8 == NULL ||
+            PyList_Append(view->thread_name_values, value) < 0) {
+            Py_DECREF(names);
+            return -1;
+        }
+        view->thread_name_ids[cols->thread_name_count] = thread_id;
+        view->thread_names[cols->thread_name_count++] = utf8;
+    }
+    Py_DECREF(names);
+    cols->thread_name_ids = view->thread_name_ids;
+    cols->thread_names = view->thread_names;
+    return 0;
+}
+
+/**
+ * _write_collapsed(fd, columns, mark_native) - Stream folded stacks to fd
+ *
+ * columns is a spprof._SampleColumns. Output matches output.to_collapsed().
+ * The GIL is released while writing.
+ */
+static PyObject* spprof_write_collapsed(PyObject* self, PyObject* args) {
+    int fd;
+    PyObject* columns;
+    int mark_native = 1;
+
+    if (!PyArg_ParseTuple(args, "iO|p", &fd, &columns, &mark_native)) {
+        return NULL;
+    }
+
+    ColumnsView view;
+    if (columns_view_open(&view, columns) < 0) {
+        columns_view_close(&view);
+        return NULL;
+    }
+
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = output_write_collapsed(fd, &view.cols, mark_native);
+    Py_END_ALLOW_THREADS
+
+    columns_view_close(&view);
+    if (rc < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    Py_RETURN_NONE;
+}
+
+/**
+ * _write_speedscope(fd, columns, interval_ms, exporter) - Stream speedscope JSON
+ *
+ * columns is a spprof._SampleColumns. The document is equivalent to
+ * output.to_speedscope() (compact, keys in a different order). The GIL is
+ * released while writing.
+ */
+static PyObject* spprof_write_speedscope(PyObject* self, PyObject* args) {
+    int fd;
+    PyObject* columns;
+    double interval_ms;
+    const char* exporter;
+
+    if (!PyArg_ParseTuple(args, "iOds", &fd, &columns, &interval_ms, &exporter)) {
+        return NULL;
+    }
+
+    ColumnsView view;
+    if (columns_view_open(&view, columns) < 0) {
+        columns_view_close(&view);
+        return NULL;
+    }
+
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = output_write_speedscope(fd, &view.cols, interval_ms, exporter);
+    Py_END_ALLOW_THREADS
+
+    columns_view_close(&view);
+    if (rc < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    Py_RETURN_NONE;
+}
+
+/**
+ * _write_pprof(fd, columns, interval_ms, time_nanos, duration_nanos) - Stream pprof
+ *
+ * columns is a spprof._SampleColumns. Writes a profile.proto message,
+ * gzip-compressed when the extension was built with zlib. The GIL is
+ * released while writing.
+ *
+ * Returns True if the output is gzip-compressed, False if raw protobuf.
+ */
+static PyObject* spprof_write_pprof(PyObject* self, PyObject* args) {
+    int fd;
+    PyObject* columns;
+    double interval_ms;
+    long long time_nanos;
+    long long duration_nanos;
+
+    if (!PyArg_ParseTuple(args, "iOdLL", &fd, &columns, &interval_ms, &time_nanos,
+                          &duration_nanos)) {
+        return NULL;
+    }
+
+    ColumnsView view;
+    if (columns_view_open(&view, columns) < 0) {
+        columns_view_close(&view);
+        return NULL;
+    }
+
+    int rc;
+    int compressed = 0;
+    Py_BEGIN_ALLOW_THREADS
+    rc = output_write_pprof(fd, &view.cols, interval_ms, (int64_t)time_nanos,
+                            (int64_t)duration_nanos, &compressed);
+    Py_END_ALLOW_THREADS
+
+    columns_view_close(&view);
+    if (rc < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    return PyBool_FromLong(compressed);
+}
+
+/**
+ * _write_perfetto(fd, columns, interval_ms, pid, process_name, timestamp_offset_ns)
+ *     - Stream a Perfetto trace
+ *
+ * columns is a spprof._SampleColumns. Writes one track per thread with
+ * samples replayed as nested slices. The GIL is released while writing.
+ */
+static PyObject* spprof_write_perfetto(PyObject* self, PyObject* args) {
+    int fd;
+    PyObject* columns;
+    double interval_ms;
+    unsigned long long pid;
+    const char* process_name;
+    long long timestamp_offset_ns;
+
+    if (!PyArg_ParseTuple(args, "iOdKsL", &fd, &columns, &interval_ms, &pid, &process_name,
+                          &timestamp_offset_ns)) {
+        return NULL;
+    }
+
+    ColumnsView view;
+    if (columns_view_open(&view, columns) < 0) {
+        columns_view_close(&view);
+        return NULL;
+    }
+
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = output_write_perfetto(fd, &view.cols, interval_ms, (uint64_t)pid, process_name,
+                               (int64_t)timestamp_offset_ns);
+    Py_END_ALLOW_THREADS
+
+    columns_view_close(&view);
+    if (rc < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    Py_RETURN_NONE;
+}
+
+/**
+ * _write_perf_script(fd, map_fd, columns, interval_ms, pid, comm, map_name)
+ *     - Stream perf script text and its perf map
+ *
+ * columns is a spprof._SampleColumns. The GIL is released while writing.
+ */
+static PyObject* spprof_write_perf_script(PyObject* self, PyObject* args) {
+    int fd;
+    int map_fd;
+    PyObject* columns;
+    double interval_ms;
+    unsigned long long pid;
+    const char* comm;
+    const char* map_name;
+
+    if (!PyArg_ParseTuple(args, "iiOdKss", &fd, &map_fd, &columns, &interval_ms, &pid, &comm,
+                          &map_name)) {
+        return NULL;
+    }
+
+    ColumnsView view;
+    if (columns_view_open(&view, columns) < 0) {
+        columns_view_close(&view);
+        return NULL;
+    }
+
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = output_write_perf_script(fd, map_fd, &view.cols, interval_ms, (uint64_t)pid, comm,
+                                  map_name);
+    Py_END_ALLOW_THREADS
+
+    columns_view_close(&view);
+    if (rc < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    Py_RETURN_NONE;
+}
+
+/**
+ * _capture_samples(fd, codes) - Drain raw samples into .spprof SAMPLES chunks
+ *
+ * codes is the capture's list of code objects (index = code id). Code
+ * objects first referenced by this drain are appended to it, so the caller
+ * can write their metadata. Nothing is resolved.
+ *
+ * Returns a dict with "samples", "empty_samples" and "invalid_frames".
+ */
+static PyObject* spprof_capture_samples(PyObject* self, PyObject* args) {
+    int fd;
+    PyObject* codes;
+
+    if (!PyArg_ParseTuple(args, "iO!", &fd, &PyList_Type, &codes)) {
+        return NULL;
+    }
+
+    CaptureCodeTable table;
+    if (capture_code_table_init(&table) < 0) {
+        return PyErr_NoMemory();
+    }
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(codes); i++) {
+        if (capture_code_table_seed(&table, (uintptr_t)PyList_GET_ITEM(codes, i)) < 0) {
+            capture_code_table_free(&table);
+            return PyErr_NoMemory();
+        }
+    }
+
+    CaptureStats stats;
+    int rc = capture_drain_samples(fd, &table, &stats);
+    int saved_errno = errno;
+
+    /* Hand the references taken for new ids over to the list */
+    int list_failed = 0;
+    for (size_t i = table.first_new; i < table.count; i++) {
+        PyObject* code = (PyObject*)table.codes[i];
+        if (!list_failed && PyList_Append(codes, code) < 0) {
+            list_failed = 1;
+        }
+        Py_DECREF(code);
+    }
+    capture_code_table_free(&table);
+
+    if (list_failed) {
+        return NULL;
+    }
+    if (rc < 0) {
+        errno = saved_errno;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+
+    PyObject* result = PyDict_New();
+    if (result == NULL ||
+        dict_set_steal(result, "samples", PyLong_FromUnsignedLongLong(stats.samples)) < 0 ||
+        dict_set_steal(result, "empty_samples",
+                       PyLong_FromUnsignedLongLong(stats.empty_samples)) < 0 ||
+        dict_set_steal(result, "invalid_frames",
+                       PyLong_FromUnsignedLongLong(stats.invalid_frames)) < 0) {
+        Py_XDECREF(result);
+        return NULL;
+    }
+    return result;
+}
+
+/**
+ * _capture_write_chunk(fd, type, data) - Append one .spprof chunk
+ */
+static PyObject* spprof_capture_write_chunk(PyObject* self, PyObject* args) {
+    int fd;
+    unsigned int type;
+    Py_buffer data;
+
+    if (!PyArg_ParseTuple(args, "iIy*", &fd, &type, &data)) {
+        return NULL;
+    }
+
+    int rc;
+    Py_BEGIN_ALLOW_THREADS
+    rc = capture_write_chunk(fd, (uint32_t)type, data.buf, (size_t)data.len);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&data);
+    if (rc < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    Py_RETURN_NONE;
+}
+
+/**
+ * _module_map() - Snapshot the loaded modules
+ *
+ * Returns a list of (start, limit, file_offset, path, build_id, is_python)
+ * tuples sorted by start; is_python marks the module holding the
+ * interpreter loop.
+ */
+static PyObject* spprof_module_map(PyObject* self, PyObject* args) {
+    ModuleMap map;
+    if (module_map_snapshot(&map) < 0) {
+        return PyErr_NoMemory();
+    }
+
+    const ModuleInfo* interpreter =
+        module_map_find(&map, (uint64_t)(uintptr_t)&PyEval_EvalCode);
+    PyObject* result = PyList_New((Py_ssize_t)map.count);
+    for (size_t i = 0; result != NULL && i < map.count; i++) {
+        const ModuleInfo* module = &map.modules[i];
+        PyObject* entry = Py_BuildValue(
+            "(KKKssO)", (unsigned long long)module->start, (unsigned long long)module->limit,
+            (unsigned long long)module->file_offset, module->path, module->build_id,
+            module == interpreter ? Py_True : Py_False);
+        if (entry == NULL) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, (Py_ssize_t)i, entry);
+    }
+    module_map_free(&map);
+    return result;
+}
+
 /**
  * _capture_native_stack() - Capture current native stack (for testing)
  *
@@ -528,6 +1599,7 @@ static PyObject* spprof_capture_native_stack(PyObject* self, PyObject* args) {
     }
 
     NativeStack stack;
+    native_symbols_begin_batch();
     int captured = unwind_capture_with_symbols(&stack, 1);  /* Skip this function */
 
     if (captured < 0) {
@@ -574,6 +1646,10 @@ static PyObject* spprof_capture_native_stack(PyObject* self, PyObject* args) {
  * environments where the tiny theoretical risk of accessing freed memory
  * is unacceptable.
  *
+ * On Python 3.12+ the code registry tracks code object lifetimes, which
+ * gives the same guarantee without discarding samples, so safe mode then
+ * rejects nothing.
+ *
  * Note: Darwin/Mach samples are always safe (INCREF'd during capture).
  * Safe mode only affects Linux signal-handler samples.
  */
@@ -611,6 +1687,8 @@ static PyObject* spprof_get_code_registry_stats(PyObject* self, PyObject* args)
     uint64_t validations = 0;
     uint64_t invalid_count = 0;
     uint64_t safe_mode_rejects = 0;
+    uint64_t retired_held = 0;
+    uint64_t retired_resolved = 0;
 
     code_registry_get_stats_extended(
         &refs_held,
@@ -620,20 +1698,280 @@ static PyObject* spprof_get_code_registry_stats(PyObject* self, PyObject* args)
         &invalid_count,
         &safe_mode_rejects
     );
+    code_registry_get_lifetime_stats(&retired_held, &retired_resolved);
 
     return Py_BuildValue(
-        "{s:K, s:K, s:K, s:K, s:K, s:K, s:O}",
+        "{s:K, s:K, s:K, s:K, s:K, s:K, s:O, s:O, s:K, s:K}",
         "refs_held", refs_held,
         "refs_added", refs_added,
         "refs_released", refs_released,
         "validations", validations,
         "invalid_count", invalid_count,
         "safe_mode_rejects", safe_mode_rejects,
-        "safe_mode_enabled", code_registry_is_safe_mode() ? Py_True : Py_False
+        "safe_mode_enabled", code_registry_is_safe_mode() ? Py_True : Py_False,
+        "lifetime_tracking", code_registry_tracks_lifetimes() ? Py_True : Py_False,
+        "retired_held", retired_held,
+        "retired_resolved", retired_resolved
+    );
+}
+
+/**
+ * _set_resolver_workers(n) - Set the threads that resolve drained samples
+ *
+ * 0 uses one per online CPU (up to 8), 1 resolves in the draining
+ * thread only. Applies to drains that start afterwards.
+ */
+static PyObject* spprof_set_resolver_workers(PyObject* self, PyObject* args) {
+    int workers;
+
+    if (!PyArg_ParseTuple(args, "i", &workers)) {
+        return NULL;
+    }
+    if (workers < 0) {
+        PyErr_SetString(PyExc_ValueError, "workers must be >= 0");
+        return NULL;
+    }
+
+    resolver_set_workers(workers);
+    Py_RETURN_NONE;
+}
+
+/**
+ * _get_resolver_stats() - Get resolver cache statistics
+ *
+ * Counts since the last _start(): code cache hits, misses (code objects
+ * read), evictions, evicted code objects read again, and Python frames
+ * that could not be resolved.
+ */
+static PyObject* spprof_get_resolver_stats(PyObject* self, PyObject* args) {
+    uint64_t cache_hits = 0;
+    uint64_t cache_misses = 0;
+    uint64_t cache_collisions = 0;
+    uint64_t cache_reinserts = 0;
+    uint64_t invalid_frames = 0;
+
+    resolver_get_stats(&cache_hits, &cache_misses, &cache_collisions, &cache_reinserts,
+                       &invalid_frames);
+
+    return Py_BuildValue(
+        "{s:K, s:K, s:K, s:K, s:K}",
+        "cache_hits", cache_hits,
+        "cache_misses", cache_misses,
+        "cache_collisions", cache_collisions,
+        "cache_reinserts", cache_reinserts,
+        "invalid_frames", invalid_frames
+    );
+}
+
+/**
+ * _code_cache_reset() - Empty the code cache (for testing)
+ *
+ * Also initializes it; call before _code_cache_insert(). Only while not
+ * profiling.
+ */
+static PyObject* spprof_code_cache_reset(PyObject* self, PyObject* args) {
+    if (ATOMIC_LOAD(&g_is_active)) {
+        PyErr_SetString(PyExc_RuntimeError, "Profiler is running");
+        return NULL;
+    }
+    code_cache_init();
+    Py_RETURN_NONE;
+}
+
+/**
+ * _code_cache_insert(address, lo, hi) - Insert a fake code object (for testing)
+ *
+ * Records an object named "code@<address>" alive during [lo, hi), with
+ * hi None for a live one, and returns its id. Only while not profiling,
+ * after _code_cache_reset(); the next _start() clears the cache.
+ */
+static PyObject* spprof_code_cache_insert(PyObject* self, PyObject* args) {
+    unsigned long long address;
+    unsigned long long lo;
+    PyObject* hi_obj;
+
+    if (!PyArg_ParseTuple(args, "KKO", &address, &lo, &hi_obj)) {
+        return NULL;
+    }
+    if (ATOMIC_LOAD(&g_is_active)) {
+        PyErr_SetString(PyExc_RuntimeError, "Profiler is running");
+        return NULL;
+    }
+    uint64_t hi = CODE_GENERATION_LIVE;
+    if (hi_obj != Py_None) {
+        hi = PyLong_AsUnsignedLongLong(hi_obj);
+        if (hi == (uint64_t)-1 && PyErr_Occurred()) {
+            return NULL;
+        }
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "code@%llx", address);
+    uint32_t id = code_cache_insert((uintptr_t)address, lo, hi, name, "<test>", NULL, 0, 0, 1);
+    if (id == CODE_ID_NONE) {
+        return PyErr_NoMemory();
+    }
+    return PyLong_FromUnsignedLong(id);
+}
+
+/**
+ * _code_cache_lookup(address, generation) - Look up a code id (for testing)
+ *
+ * Returns the id, or None on a miss.
+ */
+static PyObject* spprof_code_cache_lookup(PyObject* self, PyObject* args) {
+    unsigned long long address;
+    unsigned long long generation;
+
+    if (!PyArg_ParseTuple(args, "KK", &address, &generation)) {
+        return NULL;
+    }
+    uint32_t id = code_cache_lookup((uintptr_t)address, generation);
+    if (id == CODE_ID_NONE) {
+        Py_RETURN_NONE;
+    }
+    return PyLong_FromUnsignedLong(id);
+}
+
+/**
+ * _set_symbol_cache_dir(path) - Set or clear the native symbol cache directory
+ *
+ * With a directory, native frames are named from build-id keyed symbol
+ * tables stored there (native_symbols.h). None disables the cache.
+ */
+static PyObject* spprof_set_symbol_cache_dir(PyObject* self, PyObject* args) {
+    PyObject* path;
+
+    if (!PyArg_ParseTuple(args, "O", &path)) {
+        return NULL;
+    }
+
+    if (path == Py_None) {
+        native_symbols_set_cache_dir(NULL);
+        Py_RETURN_NONE;
+    }
+
+    PyObject* encoded = NULL;
+    if (!PyUnicode_FSConverter(path, &encoded)) {
+        return NULL;
+    }
+    int result = native_symbols_set_cache_dir(PyBytes_AS_STRING(encoded));
+    Py_DECREF(encoded);
+    if (result < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    Py_RETURN_NONE;
+}
+
+/**
+ * _get_symbol_cache_stats() - Get native symbol cache statistics
+ *
+ * Counts since the module was loaded: tables mapped from cache files and
+ * tables parsed from ELF files; plus the JIT functions currently known
+ * from perf map and jitdump files.
+ */
+static PyObject* spprof_get_symbol_cache_stats(PyObject* self, PyObject* args) {
+    uint64_t tables_mapped = 0;
+    uint64_t tables_built = 0;
+    uint64_t jit_symbols = 0;
+
+    native_symbols_get_stats(&tables_mapped, &tables_built, &jit_symbols);
+
+    return Py_BuildValue(
+        "{s:K, s:K, s:K}",
+        "tables_mapped", tables_mapped,
+        "tables_built", tables_built,
+        "jit_symbols", jit_symbols
     );
 }
 
 /* Method table */
+/* =============================================================================
+ * Attach Mode (remote.c)
+ * ============================================================================= */
+
+/**
+ * _remote_sample(pid, runtime) - Sample another process's threads
+ *
+ * Returns a list of (thread_id, native_thread_id, frames) where frames is
+ * a tuple of (code_address, bytecode_offset) pairs, leaf first, and
+ * bytecode_offset is -1 if unknown. Raises OSError if the target cannot be
+ * read (PermissionError without ptrace access, ProcessLookupError once it
+ * exits).
+ */
+static PyObject* spprof_remote_sample(PyObject* self, PyObject* args) {
+    int pid;
+    unsigned long long runtime;
+    if (!PyArg_ParseTuple(args, "iK", &pid, &runtime)) {
+        return NULL;
+    }
+    if (remote_init() < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+
+    RemoteStack* stacks = PyMem_Malloc(sizeof(RemoteStack) * SPPROF_REMOTE_MAX_THREADS);
+    if (stacks == NULL) {
+        return PyErr_NoMemory();
+    }
+    int count;
+    int saved_errno;
+    Py_BEGIN_ALLOW_THREADS
+    count = remote_sample(pid, (uintptr_t)runtime, stacks, SPPROF_REMOTE_MAX_THREADS);
+    saved_errno = errno;
+    Py_END_ALLOW_THREADS
+    if (count < 0) {
+        PyMem_Free(stacks);
+        errno = saved_errno;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+
+    PyObject* result = PyList_New(count);
+    for (int i = 0; result != NULL && i < count; i++) {
+        const RemoteStack* stack = &stacks[i];
+        PyObject* frames = PyTuple_New(stack->depth);
+        for (int d = 0; frames != NULL && d < stack->depth; d++) {
+            PyObject* pair = Py_BuildValue("(KL)", (unsigned long long)stack->code[d],
+                                           (long long)stack->offset[d]);
+            if (pair == NULL) {
+                Py_CLEAR(frames);
+                break;
+            }
+            PyTuple_SET_ITEM(frames, d, pair);
+        }
+        PyObject* entry = frames ? Py_BuildValue("(KKN)",
+                                                 (unsigned long long)stack->thread_id,
+                                                 (unsigned long long)stack->native_thread_id,
+                                                 frames)
+                                 : NULL;
+        if (entry == NULL) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, i, entry);
+    }
+    PyMem_Free(stacks);
+    return result;
+}
+
+/**
+ * _remote_code(pid, code_type, code_address) - Read a code object of another process
+ *
+ * Returns (name, filename, firstlineno, linetable, code_size), or None if
+ * the address no longer holds a code object.
+ */
+static PyObject* spprof_remote_code(PyObject* self, PyObject* args) {
+    int pid;
+    unsigned long long code_type;
+    unsigned long long code;
+    if (!PyArg_ParseTuple(args, "iKK", &pid, &code_type, &code)) {
+        return NULL;
+    }
+    if (remote_init() < 0) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    return remote_code_info(pid, (uintptr_t)code_type, (uintptr_t)code);
+}
+
 static PyMethodDef SpProfMethods[] = {
     {"_start", (PyCFunction)(void(*)(void))spprof_start, METH_VARARGS | METH_KEYWORDS,
      "Start profiling (internal). Use spprof.start() instead."},
@@ -641,18 +1979,47 @@ static PyMethodDef SpProfMethods[] = {
      "Stop profiling and return raw samples (internal, legacy API)."},
     {"_stop_timer", spprof_stop_timer, METH_NOARGS,
      "Stop the profiling timer without draining samples (streaming API)."},
+#ifdef SPPROF_PLATFORM_LINUX
+    {"_after_fork_child", spprof_after_fork_child, METH_NOARGS,
+     "Resume sampling in a forked child (internal)."},
+#endif
     {"_finalize_stop", spprof_finalize_stop, METH_NOARGS,
      "Clean up resolver after streaming drain is complete."},
     {"_drain_buffer", spprof_drain_buffer, METH_VARARGS,
      "Drain samples from buffer in chunks (streaming API). Returns (samples, has_more)."},
+    {"_drain_columnar", (PyCFunction)(void(*)(void))spprof_drain_columnar,
+     METH_VARARGS | METH_KEYWORDS,
+     "Drain all pending samples into interned string/frame/stack tables and columns."},
+    {"_write_collapsed", spprof_write_collapsed, METH_VARARGS,
+     "Stream folded stacks for columnar samples to a file descriptor."},
+    {"_write_speedscope", spprof_write_speedscope, METH_VARARGS,
+     "Stream speedscope JSON for columnar samples to a file descriptor."},
+    {"_write_pprof", spprof_write_pprof, METH_VARARGS,
+     "Stream a pprof profile for columnar samples to a file descriptor."},
+    {"_write_perfetto", spprof_write_perfetto, METH_VARARGS,
+     "Stream a Perfetto trace for columnar samples to a file descriptor."},
+    {"_write_perf_script", spprof_write_perf_script, METH_VARARGS,
+     "Stream perf script text and a perf map for columnar samples to file descriptors."},
+    {"_capture_samples", spprof_capture_samples, METH_VARARGS,
+     "Drain raw samples unresolved into .spprof SAMPLES chunks."},
+    {"_capture_write_chunk", spprof_capture_write_chunk, METH_VARARGS,
+     "Append one chunk to a .spprof capture file."},
+    {"_module_map", spprof_module_map, METH_NOARGS,
+     "Snapshot the loaded modules as (start, limit, offset, path, build_id, is_python)."},
     {"_is_active", spprof_is_active, METH_NOARGS,
      "Check if profiling is active."},
+    {"_pause", spprof_pause, METH_NOARGS,
+     "Disarm sampling timers without ending the session."},
+    {"_resume", spprof_resume, METH_NOARGS,
+     "Re-arm sampling timers disarmed by _pause()."},
     {"_get_stats", spprof_get_stats, METH_NOARGS,
      "Get current profiling statistics."},
     {"_register_thread", spprof_register_thread, METH_NOARGS,
      "Register current thread for per-thread sampling (Linux)."},
     {"_unregister_thread", spprof_unregister_thread, METH_NOARGS,
      "Unregister current thread from sampling."},
+    {"_set_label_var", spprof_set_label_var, METH_VARARGS,
+     "Register the ContextVar holding the current label set id."},
     {"_set_native_unwinding", spprof_set_native_unwinding, METH_VARARGS,
      "Enable or disable native C-stack unwinding."},
     {"_native_unwinding_available", spprof_native_unwinding_available, METH_NOARGS,
@@ -667,6 +2034,24 @@ static PyMethodDef SpProfMethods[] = {
      "Check if safe mode is enabled."},
     {"_get_code_registry_stats", spprof_get_code_registry_stats, METH_NOARGS,
      "Get code registry statistics including safe mode rejects."},
+    {"_set_resolver_workers", spprof_set_resolver_workers, METH_VARARGS,
+     "Set the number of threads that resolve drained samples (0 = per CPU)."},
+    {"_get_resolver_stats", spprof_get_resolver_stats, METH_NOARGS,
+     "Get resolver code cache statistics."},
+    {"_code_cache_reset", spprof_code_cache_reset, METH_NOARGS,
+     "Empty the code cache (for testing)."},
+    {"_code_cache_insert", spprof_code_cache_insert, METH_VARARGS,
+     "Insert a fake code object into the code cache (for testing)."},
+    {"_code_cache_lookup", spprof_code_cache_lookup, METH_VARARGS,
+     "Look up a code id in the code cache (for testing)."},
+    {"_set_symbol_cache_dir", spprof_set_symbol_cache_dir, METH_VARARGS,
+     "Set the native symbol cache directory (None disables it)."},
+    {"_get_symbol_cache_stats", spprof_get_symbol_cache_stats, METH_NOARGS,
+     "Get native symbol cache statistics."},
+    {"_remote_sample", spprof_remote_sample, METH_VARARGS,
+     "Sample the threads of another process (attach mode)."},
+    {"_remote_code", spprof_remote_code, METH_VARARGS,
+     "Read a code object of another process (attach mode)."},
     {NULL, NULL, 0, NULL}
 };
 
@@ -722,6 +2107,15 @@ PyMODINIT_FUNC PyInit__native(void) {
         return NULL;
     }
 
+#ifdef Py_GIL_DISABLED
+    /* Importing must not turn the GIL back on. Native state is guarded by
+     * its own locks and the Python layer serializes start/stop/drain. */
+    if (PyUnstable_Module_SetGIL(module, Py_MOD_GIL_NOT_USED) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+#endif
+
     /* Initialize platform subsystem */
     if (platform_init() < 0) {
         Py_DECREF(module);
@@ -0,0 +1,254 @@
+/**
+ * module_map.c - Snapshot of the executable modules loaded in the process
+ *
+ * See module_map.h.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+/* Must be before any includes for dl_iterate_phdr */
+#if defined(__linux__)
+#define _GNU_SOURCE 1
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "module_map.h"
+
+#if defined(__linux__) || defined(__FreeBSD__)
+#define SPPROF_MODULE_MAP_ELF 1
+#include <link.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#define SPPROF_MODULE_MAP_MACHO 1
+#include <mach-o/dyld.h>
+#include <mach-o/loader.h>
+#endif
+
+/* GNU build-id note type (elf.h may not define it everywhere) */
+#ifndef NT_GNU_BUILD_ID
+#define NT_GNU_BUILD_ID 3
+#endif
+
+/**
+ * Append an empty module entry, growing the array as needed.
+ *
+ * @return New entry, or NULL on allocation failure.
+ */
+static ModuleInfo* module_map_append(ModuleMap* map, size_t* capacity) {
+    if (map->count >= *capacity) {
+        size_t new_capacity = *capacity > 0 ? *capacity * 2 : 64;
+        ModuleInfo* grown = (ModuleInfo*)realloc(map->modules, new_capacity * sizeof(ModuleInfo));
+        if (grown == NULL) {
+            return NULL;
+        }
+        map->modules = grown;
+        *capacity = new_capacity;
+    }
+    ModuleInfo* module = &map->modules[map->count++];
+    memset(module, 0, sizeof(*module));
+    return module;
+}
+
+static void hex_encode(const unsigned char* bytes, size_t len, char* out) {
+    static const char hex[] = "0123456789abcdef";
+    if (len > SPPROF_MAX_BUILD_ID) {
+        len = SPPROF_MAX_BUILD_ID;
+    }
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = hex[bytes[i] >> 4];
+        out[2 * i + 1] = hex[bytes[i] & 0xF];
+    }
+    out[2 * len] = '\0';
+}
+
+#if defined(SPPROF_MODULE_MAP_ELF)
+
+typedef struct {
+    ModuleMap* map;
+    size_t capacity;
+    uint64_t page_mask;
+    int failed;
+} ElfCollector;
+
+void module_map_read_build_id(const unsigned char* notes, size_t size, size_t align, char* out) {
+    size_t pos = 0;
+    while (pos + sizeof(ElfW(Nhdr)) <= size) {
+        const ElfW(Nhdr)* note = (const ElfW(Nhdr)*)(const void*)(notes + pos);
+        size_t name_size = (note->n_namesz + align - 1) & ~(align - 1);
+        size_t desc_size = (note->n_descsz + align - 1) & ~(align - 1);
+        size_t desc_pos = pos + sizeof(ElfW(Nhdr)) + name_size;
+        if (desc_pos + note->n_descsz > size) {
+            return;
+        }
+        if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+            memcmp(notes + pos + sizeof(ElfW(Nhdr)), "GNU", 4) == 0) {
+            hex_encode(notes + desc_pos, note->n_descsz, out);
+            return;
+        }
+        pos = desc_pos + desc_size;
+    }
+}
+
+static int collect_elf_module(struct dl_phdr_info* info, size_t size, void* data) {
+    ElfCollector* collector = (ElfCollector*)data;
+    const ElfW(Phdr)* text = NULL;
+
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++) {
+        if (info->dlpi_phdr[i].p_type == PT_LOAD && (info->dlpi_phdr[i].p_flags & PF_X)) {
+            text = &info->dlpi_phdr[i];
+            break;
+        }
+    }
+    if (text == NULL) {
+        return 0;
+    }
+
+    ModuleInfo* module = module_map_append(collector->map, &collector->capacity);
+    if (module == NULL) {
+        collector->failed = 1;
+        return 1;
+    }
+
+    /* Page-align like /proc/self/maps so offset arithmetic matches the file */
+    uint64_t vaddr = (uint64_t)info->dlpi_addr + (uint64_t)text->p_vaddr;
+    module->start = vaddr & collector->page_mask;
+    module->limit = vaddr + (uint64_t)text->p_memsz;
+    module->file_offset = (uint64_t)text->p_offset & collector->page_mask;
+    module->load_bias = (uint64_t)info->dlpi_addr;
+
+    if (info->dlpi_name != NULL && info->dlpi_name[0] != '\0') {
+        snprintf(module->path, sizeof(module->path), "%s", info->dlpi_name);
+    } else {
+#if defined(__linux__)
+        /* The main executable is reported without a name */
+        ssize_t len = readlink("/proc/self/exe", module->path, sizeof(module->path) - 1);
+        module->path[len > 0 ? len : 0] = '\0';
+#endif
+    }
+
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum && module->build_id[0] == '\0'; i++) {
+        const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type == PT_NOTE) {
+            module_map_read_build_id((const unsigned char*)(info->dlpi_addr + phdr->p_vaddr),
+                                     (size_t)phdr->p_memsz, phdr->p_align == 8 ? 8 : 4,
+                                     module->build_id);
+        }
+    }
+    return 0;
+}
+
+static int snapshot_platform(ModuleMap* map) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    ElfCollector collector = {
+        map, 0, ~((uint64_t)(page_size > 0 ? page_size : 4096) - 1), 0,
+    };
+    dl_iterate_phdr(collect_elf_module, &collector);
+    return collector.failed ? -1 : 0;
+}
+
+#elif defined(SPPROF_MODULE_MAP_MACHO)
+
+static int snapshot_platform(ModuleMap* map) {
+    size_t capacity = 0;
+    uint32_t image_count = _dyld_image_count();
+
+    for (uint32_t i = 0; i < image_count; i++) {
+        const struct mach_header* header = _dyld_get_image_header(i);
+        if (header == NULL || header->magic != MH_MAGIC_64) {
+            continue;
+        }
+        const struct mach_header_64* header64 = (const struct mach_header_64*)header;
+        uint64_t slide = (uint64_t)_dyld_get_image_vmaddr_slide(i);
+        const unsigned char* cursor = (const unsigned char*)(header64 + 1);
+        const struct segment_command_64* text = NULL;
+        const struct uuid_command* uuid = NULL;
+
+        for (uint32_t c = 0; c < header64->ncmds; c++) {
+            const struct load_command* command = (const struct load_command*)(const void*)cursor;
+            if (command->cmd == LC_SEGMENT_64) {
+                const struct segment_command_64* segment =
+                    (const struct segment_command_64*)(const void*)cursor;
+                if (strcmp(segment->segname, SEG_TEXT) == 0) {
+                    text = segment;
+                }
+            } else if (command->cmd == LC_UUID) {
+                uuid = (const struct uuid_command*)(const void*)cursor;
+            }
+            cursor += command->cmdsize;
+        }
+        if (text == NULL) {
+            continue;
+        }
+
+        ModuleInfo* module = module_map_append(map, &capacity);
+        if (module == NULL) {
+            return -1;
+        }
+        module->start = text->vmaddr + slide;
+        module->limit = module->start + text->vmsize;
+        module->file_offset = text->fileoff;
+        module->load_bias = slide;
+        const char* name = _dyld_get_image_name(i);
+        snprintf(module->path, sizeof(module->path), "%s", name != NULL ? name : "");
+        if (uuid != NULL) {
+            hex_encode(uuid->uuid, sizeof(uuid->uuid), module->build_id);
+        }
+    }
+    return 0;
+}
+
+#else
+
+static int snapshot_platform(ModuleMap* map) {
+    (void)map;
+    return 0;
+}
+
+#endif
+
+static int compare_modules(const void* lhs, const void* rhs) {
+    const ModuleInfo* a = (const ModuleInfo*)lhs;
+    const ModuleInfo* b = (const ModuleInfo*)rhs;
+    return (a->start > b->start) - (a->start < b->start);
+}
+
+int module_map_snapshot(ModuleMap* map) {
+    map->modules = NULL;
+    map->count = 0;
+    if (snapshot_platform(map) < 0) {
+        module_map_free(map);
+        return -1;
+    }
+    if (map->count > 1) {
+        qsort(map->modules, map->count, sizeof(ModuleInfo), compare_modules);
+    }
+    return 0;
+}
+
+void module_map_free(ModuleMap* map) {
+    free(map->modules);
+    map->modules = NULL;
+    map->count = 0;
+}
+
+const ModuleInfo* module_map_find(const ModuleMap* map, uint64_t address) {
+    size_t lo = 0;
+    size_t hi = map->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map->modules[mid].start <= address) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return NULL;
+    }
+    const ModuleInfo* module = &map->modules[lo - 1];
+    return address < module->limit ? module : NULL;
+}
@@ -0,0 +1,86 @@
+/**
+ * module_map.h - Snapshot of the executable modules loaded in the process
+ *
+ * Records the text range, path and build id of every loaded binary so that
+ * native PCs captured by the sampler can be attributed to a file and
+ * symbolized offline (e.g. pprof mappings).
+ *
+ * PLATFORM SUPPORT:
+ *   - Linux (and other ELF systems): dl_iterate_phdr() and NT_GNU_BUILD_ID
+ *   - macOS: dyld image list, __TEXT segment and LC_UUID
+ *   - Windows: not implemented; snapshots are empty
+ *
+ * ERROR HANDLING:
+ *   POSIX-style (Pattern 1): 0 on success, -1 on allocation failure.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPPROF_MODULE_MAP_H
+#define SPPROF_MODULE_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "resolver.h"
+
+/* Longest build id kept (bytes); GNU build ids are 20, Mach-O UUIDs 16 */
+#define SPPROF_MAX_BUILD_ID 64
+
+/**
+ * ModuleInfo - One loaded module's executable segment
+ */
+typedef struct {
+    uint64_t start;         /* First mapped byte of the executable segment */
+    uint64_t limit;         /* One past its last byte */
+    uint64_t file_offset;   /* File offset that `start` maps */
+    uint64_t load_bias;     /* Added to the file's addresses when loaded */
+    char path[SPPROF_MAX_FILENAME];
+    char build_id[SPPROF_MAX_BUILD_ID * 2 + 1];  /* Lowercase hex, "" if none */
+} ModuleInfo;
+
+/**
+ * ModuleMap - Loaded modules sorted by start address
+ */
+typedef struct {
+    ModuleInfo* modules;
+    size_t count;
+} ModuleMap;
+
+/**
+ * Snapshot the currently loaded modules.
+ *
+ * @param map Receives the modules; free with module_map_free().
+ * @return 0 on success, -1 on error.
+ */
+int module_map_snapshot(ModuleMap* map);
+
+/**
+ * Free a snapshot taken by module_map_snapshot().
+ *
+ * @param map Snapshot to free (left empty).
+ */
+void module_map_free(ModuleMap* map);
+
+/**
+ * Find the module whose executable segment contains an address.
+ *
+ * @param map Snapshot to search.
+ * @param address Native PC.
+ * @return Matching module, or NULL.
+ */
+const ModuleInfo* module_map_find(const ModuleMap* map, uint64_t address);
+
+/**
+ * Hex-encode the NT_GNU_BUILD_ID note found in a block of ELF notes.
+ *
+ * ELF platforms only.
+ *
+ * @param notes Contents of a PT_NOTE segment or SHT_NOTE section.
+ * @param size  Its size in bytes.
+ * @param align Note alignment (4 or 8).
+ * @param out   Receives the lowercase hex id; left untouched if none.
+ */
+void module_map_read_build_id(const unsigned char* notes, size_t size, size_t align, char* out);
+
+#endif /* SPPROF_MODULE_MAP_H */
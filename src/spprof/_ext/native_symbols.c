@@ -0,0 +1,1224 @@
+/**
+ * native_symbols.c - Native address index: module symbols and JIT code
+ *
+ * See native_symbols.h for the design and the cache file format. A table
+ * image is laid out exactly like its cache file, so a freshly parsed
+ * table is written with one write() and a cached one is used straight
+ * from its mapping.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <Python.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "native_symbols.h"
+#include "module_map.h"
+
+#if defined(__linux__) || defined(__FreeBSD__)
+#define SPPROF_NATIVE_SYMBOLS_ELF 1
+#include <fcntl.h>
+#include <limits.h>
+#include <link.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(SPPROF_NATIVE_SYMBOLS_ELF)
+
+/* Indirect functions resolve to a real implementation at load time */
+#ifndef STT_GNU_IFUNC
+#define STT_GNU_IFUNC 10
+#endif
+
+#define LOAD_ACQUIRE(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/*
+ * =============================================================================
+ * Cache File Layout
+ * =============================================================================
+ */
+
+/* Bump the digit when the layout changes; old files are then ignored */
+static const char SYMBOL_FILE_MAGIC[8] = "SPSYMv1";
+#define SYMBOL_FILE_ENDIAN 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t endian;        /* SYMBOL_FILE_ENDIAN as written */
+    uint32_t entry_size;    /* sizeof(SymbolEntry) */
+    uint64_t count;
+    uint64_t strings_size;
+    char build_id[SPPROF_MAX_BUILD_ID * 2 + 8];  /* NUL-padded hex */
+} SymbolFileHeader;
+
+typedef struct {
+    uint64_t addr;          /* ELF virtual address */
+    uint32_t size;          /* Clamped to UINT32_MAX; 0 if unknown */
+    uint32_t name;          /* Offset into the strings */
+} SymbolEntry;
+
+/**
+ * SymbolTable - One module's symbols, parsed or mapped
+ */
+typedef struct {
+    const SymbolEntry* entries;
+    uint64_t count;
+    const char* strings;
+    uint64_t strings_size;
+    void* image;            /* Header, entries and strings */
+    size_t image_size;
+    int mapped;             /* image is an mmap of the cache file */
+} SymbolTable;
+
+/*
+ * =============================================================================
+ * Index State
+ * =============================================================================
+ */
+
+/* Modules loaded after the snapshot are looked for this often, on a miss */
+#define MODULE_RESCAN_INTERVAL_NS 1000000000ULL
+
+/*
+ * Lookups hold g_index_lock for reading while they use g_modules and
+ * g_tables; snapshots and native_symbols_reset() hold it for writing.
+ * g_lock (taken inside it, never around it) serializes table loading and
+ * guards the cache directory and statistics.
+ */
+static pthread_rwlock_t g_index_lock = PTHREAD_RWLOCK_INITIALIZER;
+static ModuleMap g_modules;
+static int g_ready = 0;                 /* g_modules is valid */
+static SymbolTable** g_tables = NULL;   /* Per module; atomic, NULL until tried */
+static SymbolTable g_no_table;          /* Module has no usable table */
+static const ModuleInfo* g_interpreter = NULL;
+static uint64_t g_snapshot_ns = 0;      /* Atomic: when g_modules was taken */
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static char g_cache_dir[PATH_MAX];
+static int g_enabled = 0;               /* Atomic: a directory is set */
+
+static uint64_t g_tables_mapped = 0;
+static uint64_t g_tables_built = 0;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void table_free(SymbolTable* table) {
+    if (table == NULL || table == &g_no_table) {
+        return;
+    }
+    if (table->mapped) {
+        munmap(table->image, table->image_size);
+    } else {
+        free(table->image);
+    }
+    free(table);
+}
+
+/**
+ * Point a table at an image that has a valid header.
+ *
+ * @return 0 if the sizes in the header match the image, -1 otherwise.
+ */
+static int table_attach(SymbolTable* table, void* image, size_t image_size) {
+    const SymbolFileHeader* header = (const SymbolFileHeader*)image;
+    uint64_t available = image_size - sizeof(SymbolFileHeader);
+
+    if (header->count > available / sizeof(SymbolEntry) ||
+        header->strings_size != available - header->count * sizeof(SymbolEntry) ||
+        header->strings_size == 0) {
+        return -1;
+    }
+    table->entries = (const SymbolEntry*)(const void*)((const char*)image + sizeof(*header));
+    table->count = header->count;
+    table->strings = (const char*)(table->entries + header->count);
+    table->strings_size = header->strings_size;
+    /* Every name is then NUL-terminated within the strings */
+    if (table->strings[table->strings_size - 1] != '\0') {
+        return -1;
+    }
+    table->image = image;
+    table->image_size = image_size;
+    return 0;
+}
+
+/**
+ * Map <cache_dir>/<build_id>.sym.
+ *
+ * Only the header is checked here, so loading is O(1); name offsets are
+ * bounds-checked by each lookup instead.
+ *
+ * @return Table, or NULL if the file is missing or does not match.
+ */
+static SymbolTable* table_map_file(const char* path, const char* build_id) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(SymbolFileHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void* image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return NULL;
+    }
+
+    const SymbolFileHeader* header = (const SymbolFileHeader*)image;
+    SymbolTable* table = (SymbolTable*)calloc(1, sizeof(SymbolTable));
+    if (table == NULL ||
+        memcmp(header->magic, SYMBOL_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->endian != SYMBOL_FILE_ENDIAN ||
+        header->entry_size != sizeof(SymbolEntry) ||
+        strncmp(header->build_id, build_id, sizeof(header->build_id)) != 0 ||
+        table_attach(table, image, size) < 0) {
+        free(table);
+        munmap(image, size);
+        return NULL;
+    }
+    table->mapped = 1;
+    return table;
+}
+
+/**
+ * Write a table image to <cache_dir>/<build_id>.sym.
+ *
+ * Writes a temporary file first and renames it into place. Failures are
+ * ignored: the table is still used from memory.
+ */
+static void table_write_file(const char* path, const SymbolTable* table) {
+    char tmp_path[PATH_MAX];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid()) >=
+        (int)sizeof(tmp_path)) {
+        return;
+    }
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    const char* data = (const char*)table->image;
+    size_t remaining = table->image_size;
+    while (remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        data += written;
+        remaining -= (size_t)written;
+    }
+    if (close(fd) < 0 || remaining > 0 || rename(tmp_path, path) < 0) {
+        unlink(tmp_path);
+    }
+}
+
+/*
+ * =============================================================================
+ * ELF Parsing
+ * =============================================================================
+ */
+
+typedef struct {
+    uint64_t addr;
+    uint64_t size;
+    const char* name;
+    int rank;               /* Lower wins among symbols at one address */
+} ParsedSymbol;
+
+static int compare_parsed(const void* lhs, const void* rhs) {
+    const ParsedSymbol* a = (const ParsedSymbol*)lhs;
+    const ParsedSymbol* b = (const ParsedSymbol*)rhs;
+    if (a->addr != b->addr) {
+        return (a->addr > b->addr) - (a->addr < b->addr);
+    }
+    if (a->rank != b->rank) {
+        return a->rank - b->rank;
+    }
+    return (a->size < b->size) - (a->size > b->size);
+}
+
+static int binding_rank(unsigned char info) {
+    switch (ELF64_ST_BIND(info)) {
+        case STB_GLOBAL: return 0;
+        case STB_WEAK:   return 1;
+        default:         return 2;
+    }
+}
+
+/* Bounds of a section inside the file, or NULL */
+static const unsigned char* section_data(const unsigned char* file, size_t file_size,
+                                         const ElfW(Shdr)* section) {
+    if (section->sh_type == SHT_NOBITS || section->sh_offset > file_size ||
+        section->sh_size > file_size - section->sh_offset) {
+        return NULL;
+    }
+    return file + section->sh_offset;
+}
+
+/**
+ * Build a table image from the function symbols of a mapped ELF file.
+ *
+ * Uses .symtab when the file is not stripped (it also names static
+ * functions) and .dynsym otherwise. Refuses a file whose build id is not
+ * the loaded module's, e.g. a library upgraded on disk since it was
+ * loaded.
+ *
+ * @return Table, or NULL if the file has no usable symbols.
+ */
+static SymbolTable* table_parse_elf(const unsigned char* file, size_t file_size,
+                                    const char* build_id) {
+    const ElfW(Ehdr)* ehdr = (const ElfW(Ehdr)*)(const void*)file;
+    if (file_size < sizeof(*ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        ehdr->e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32) ||
+        ehdr->e_ident[EI_DATA] !=
+            (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? ELFDATA2LSB : ELFDATA2MSB) ||
+        ehdr->e_shentsize != sizeof(ElfW(Shdr)) || ehdr->e_shoff > file_size ||
+        ehdr->e_shnum > (file_size - ehdr->e_shoff) / sizeof(ElfW(Shdr))) {
+        return NULL;
+    }
+    const ElfW(Shdr)* sections = (const ElfW(Shdr)*)(const void*)(file + ehdr->e_shoff);
+    size_t section_count = ehdr->e_shnum;
+
+    char file_build_id[SPPROF_MAX_BUILD_ID * 2 + 1] = "";
+    const ElfW(Shdr)* symtab = NULL;
+    const ElfW(Shdr)* dynsym = NULL;
+    for (size_t i = 0; i < section_count; i++) {
+        const ElfW(Shdr)* section = &sections[i];
+        if (section->sh_type == SHT_NOTE && file_build_id[0] == '\0') {
+            const unsigned char* notes = section_data(file, file_size, section);
+            if (notes != NULL) {
+                module_map_read_build_id(notes, (size_t)section->sh_size,
+                                         section->sh_addralign == 8 ? 8 : 4, file_build_id);
+            }
+        } else if (section->sh_type == SHT_SYMTAB) {
+            symtab = section;
+        } else if (section->sh_type == SHT_DYNSYM) {
+            dynsym = section;
+        }
+    }
+    if (strcmp(file_build_id, build_id) != 0) {
+        return NULL;
+    }
+
+    const ElfW(Shdr)* chosen = symtab != NULL ? symtab : dynsym;
+    if (chosen == NULL || chosen->sh_entsize != sizeof(ElfW(Sym)) ||
+        chosen->sh_link >= section_count) {
+        return NULL;
+    }
+    const ElfW(Sym)* symbols = (const ElfW(Sym)*)(const void*)section_data(file, file_size,
+                                                                           chosen);
+    const char* names = (const char*)section_data(file, file_size, &sections[chosen->sh_link]);
+    if (symbols == NULL || names == NULL) {
+        return NULL;
+    }
+    size_t symbol_count = (size_t)(chosen->sh_size / sizeof(ElfW(Sym)));
+    size_t names_size = (size_t)sections[chosen->sh_link].sh_size;
+
+    ParsedSymbol* parsed = (ParsedSymbol*)malloc((symbol_count > 0 ? symbol_count : 1) *
+                                                 sizeof(ParsedSymbol));
+    if (parsed == NULL) {
+        return NULL;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < symbol_count; i++) {
+        const ElfW(Sym)* sym = &symbols[i];
+        int type = ELF64_ST_TYPE(sym->st_info);
+        if ((type != STT_FUNC && type != STT_GNU_IFUNC) || sym->st_shndx == SHN_UNDEF ||
+            sym->st_value == 0 || sym->st_name == 0 || sym->st_name >= names_size ||
+            memchr(names + sym->st_name, '\0', names_size - sym->st_name) == NULL) {
+            continue;
+        }
+        parsed[count].addr = (uint64_t)sym->st_value;
+        parsed[count].size = (uint64_t)sym->st_size;
+        parsed[count].name = names + sym->st_name;
+        parsed[count].rank = binding_rank(sym->st_info);
+        count++;
+    }
+    if (count > 1) {
+        qsort(parsed, count, sizeof(ParsedSymbol), compare_parsed);
+    }
+
+    /* Keep one symbol per address (aliases); sizes of the kept names */
+    size_t kept = 0;
+    uint64_t strings_size = 1;  /* Leading empty string: never a valid name */
+    for (size_t i = 0; i < count; i++) {
+        if (kept > 0 && parsed[kept - 1].addr == parsed[i].addr) {
+            continue;
+        }
+        parsed[kept++] = parsed[i];
+        strings_size += strlen(parsed[i].name) + 1;
+    }
+    if (kept == 0 || kept > UINT32_MAX || strings_size > UINT32_MAX) {
+        free(parsed);
+        return NULL;
+    }
+
+    size_t image_size = sizeof(SymbolFileHeader) + kept * sizeof(SymbolEntry) +
+                        (size_t)strings_size;
+    char* image = (char*)calloc(1, image_size);
+    SymbolTable* table = (SymbolTable*)calloc(1, sizeof(SymbolTable));
+    if (image == NULL || table == NULL) {
+        free(image);
+        free(table);
+        free(parsed);
+        return NULL;
+    }
+
+    SymbolFileHeader* header = (SymbolFileHeader*)(void*)image;
+    memcpy(header->magic, SYMBOL_FILE_MAGIC, sizeof(header->magic));
+    header->endian = SYMBOL_FILE_ENDIAN;
+    header->entry_size = sizeof(SymbolEntry);
+    header->count = kept;
+    header->strings_size = strings_size;
+    snprintf(header->build_id, sizeof(header->build_id), "%s", build_id);
+
+    SymbolEntry* entries = (SymbolEntry*)(void*)(image + sizeof(SymbolFileHeader));
+    char* strings = (char*)(entries + kept);
+    uint32_t offset = 1;
+    for (size_t i = 0; i < kept; i++) {
+        size_t len = strlen(parsed[i].name) + 1;
+        entries[i].addr = parsed[i].addr;
+        entries[i].size = parsed[i].size > UINT32_MAX ? UINT32_MAX : (uint32_t)parsed[i].size;
+        entries[i].name = offset;
+        memcpy(strings + offset, parsed[i].name, len);
+        offset += (uint32_t)len;
+    }
+    free(parsed);
+
+    table_attach(table, image, image_size);
+    return table;
+}
+
+/**
+ * Parse a module's file on disk.
+ *
+ * @return Table, or NULL if the file cannot be read or does not match.
+ */
+static SymbolTable* table_build(const ModuleInfo* module) {
+    int fd = open(module->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void* file = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        return NULL;
+    }
+    SymbolTable* table = table_parse_elf((const unsigned char*)file, size, module->build_id);
+    munmap(file, size);
+    return table;
+}
+
+/*
+ * =============================================================================
+ * Index
+ * =============================================================================
+ */
+
+/**
+ * Load a module's table from the cache, or parse and cache it.
+ * Caller holds g_lock.
+ */
+static SymbolTable* table_load_locked(const ModuleInfo* module) {
+    /* Without a build id a cached table could belong to another file */
+    if (module->build_id[0] == '\0' || module->path[0] != '/' || g_cache_dir[0] == '\0') {
+        return NULL;
+    }
+
+    char cache_path[PATH_MAX];
+    int cacheable = snprintf(cache_path, sizeof(cache_path), "%s/%s.sym", g_cache_dir,
+                             module->build_id) < (int)sizeof(cache_path);
+    if (cacheable) {
+        SymbolTable* table = table_map_file(cache_path, module->build_id);
+        if (table != NULL) {
+            g_tables_mapped++;
+            return table;
+        }
+    }
+
+    SymbolTable* table = table_build(module);
+    if (table != NULL) {
+        g_tables_built++;
+        if (cacheable) {
+            table_write_file(cache_path, table);
+        }
+    }
+    return table;
+}
+
+/* Same file mapped at the same place, so its table still applies */
+static int module_same(const ModuleInfo* a, const ModuleInfo* b) {
+    return a->start == b->start && a->load_bias == b->load_bias &&
+           strcmp(a->path, b->path) == 0 && strcmp(a->build_id, b->build_id) == 0;
+}
+
+/**
+ * Replace g_modules with a fresh snapshot. Tables of modules still mapped
+ * are carried over; the others are freed.
+ * Caller holds g_index_lock for writing.
+ */
+static int index_snapshot_locked(void) {
+    ModuleMap modules;
+    if (module_map_snapshot(&modules) < 0) {
+        return -1;
+    }
+    SymbolTable** tables = (SymbolTable**)calloc(modules.count > 0 ? modules.count : 1,
+                                                 sizeof(SymbolTable*));
+    if (tables == NULL) {
+        module_map_free(&modules);
+        return -1;
+    }
+
+    if (g_ready) {
+        /* Both maps are sorted by start address */
+        size_t j = 0;
+        for (size_t i = 0; i < g_modules.count; i++) {
+            const ModuleInfo* old = &g_modules.modules[i];
+            while (j < modules.count && modules.modules[j].start < old->start) {
+                j++;
+            }
+            if (j < modules.count && module_same(old, &modules.modules[j])) {
+                tables[j] = g_tables[i];
+            } else {
+                table_free(g_tables[i]);
+            }
+        }
+        free(g_tables);
+        module_map_free(&g_modules);
+    }
+
+    g_modules = modules;
+    g_tables = tables;
+    g_interpreter = module_map_find(&g_modules, (uint64_t)(uintptr_t)&Py_Initialize);
+    g_ready = 1;
+    STORE_RELEASE(&g_snapshot_ns, monotonic_ns());
+    return 0;
+}
+
+/**
+ * Read-lock the index, snapshotting the modules first if there is no
+ * snapshot or (when `rescan` is set) the last one is old enough.
+ * On success the caller holds g_index_lock for reading.
+ */
+static int index_read_lock(int rescan) {
+    pthread_rwlock_rdlock(&g_index_lock);
+    if (g_ready && !rescan) {
+        return 0;
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+
+    pthread_rwlock_wrlock(&g_index_lock);
+    int result = 0;
+    /* Another thread may have taken a snapshot while we waited */
+    if (!g_ready || (rescan && monotonic_ns() - LOAD_ACQUIRE(&g_snapshot_ns) >=
+                                   MODULE_RESCAN_INTERVAL_NS)) {
+        result = index_snapshot_locked();
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+    if (result < 0) {
+        return -1;
+    }
+    pthread_rwlock_rdlock(&g_index_lock);
+    if (!g_ready) {
+        /* Reset between the two locks */
+        pthread_rwlock_unlock(&g_index_lock);
+        return -1;
+    }
+    return 0;
+}
+
+/* Caller holds g_index_lock for reading */
+static const SymbolTable* index_table(size_t module_index) {
+    SymbolTable* table = LOAD_ACQUIRE(&g_tables[module_index]);
+    if (table != NULL) {
+        return table;
+    }
+    pthread_mutex_lock(&g_lock);
+    table = g_tables[module_index];
+    if (table == NULL) {
+        table = table_load_locked(&g_modules.modules[module_index]);
+        if (table == NULL) {
+            table = &g_no_table;
+        }
+        STORE_RELEASE(&g_tables[module_index], table);
+    }
+    pthread_mutex_unlock(&g_lock);
+    return table;
+}
+
+/* Symbol covering an ELF virtual address, or NULL */
+static const SymbolEntry* table_find(const SymbolTable* table, uint64_t addr) {
+    size_t lo = 0;
+    size_t hi = (size_t)table->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (table->entries[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return NULL;
+    }
+    const SymbolEntry* entry = &table->entries[lo - 1];
+    /* A gap after a sized symbol is left to dladdr() */
+    if ((entry->size != 0 && addr - entry->addr >= entry->size) ||
+        entry->name == 0 || entry->name >= table->strings_size) {
+        return NULL;
+    }
+    return entry;
+}
+
+/*
+ * =============================================================================
+ * JIT Symbols (perf map and jitdump)
+ * =============================================================================
+ *
+ * Code generated at run time (CPython's perf trampolines, numba, cffi,
+ * LLVM) lives in anonymous mappings that no module covers. Generators
+ * that support perf describe it in /tmp/perf-<pid>.map, one
+ * "START SIZE name" line (hex) per function, or in a jit-<pid>.dump file
+ * in perf's jitdump format, which the generator keeps mapped. Both only
+ * grow, so each source is read from where the last read stopped, when a
+ * PC outside every module is not found and the file grew. Misses are
+ * remembered per PC and the files checked at most once per batch or
+ * JIT_REFRESH_INTERVAL_NS, so resolver threads hitting unnamed code do not
+ * queue on the write lock.
+ */
+
+#define JIT_DUMP_MAGIC 0x4A695444u  /* "JiTD" in native byte order */
+#define JIT_DUMP_HEADER_SIZE 40
+#define JIT_RECORD_HEADER_SIZE 16
+#define JIT_CODE_LOAD 0
+#define JIT_CODE_MOVE 1
+
+/* JIT_CODE_LOAD: pid, tid, vma, code_addr, code_size, code_index, name */
+#define JIT_LOAD_FIXED_SIZE 40
+/* JIT_CODE_MOVE: pid, tid, vma, old_code_addr, new_code_addr, code_size, code_index */
+#define JIT_MOVE_SIZE 48
+
+/* Longest name read from a jitdump record */
+#define JIT_NAME_MAX 1024
+
+/* Chunk read from a perf map at a time; longer lines are skipped */
+#define JIT_READ_CHUNK 65536
+
+/* A jitdump not at /tmp is looked for in /proc/self/maps this often */
+#define JIT_SCAN_INTERVAL_NS 100000000ULL
+
+/* Within a batch, misses check the sources for new entries this often */
+#define JIT_REFRESH_INTERVAL_NS 10000000ULL
+
+/* PCs known to miss since symbols were last added (power of two) */
+#define JIT_MISS_SLOTS 256
+
+/* Arena blocks for names; never moved, freed only when the pid changes */
+#define JIT_ARENA_BLOCK 65536
+
+typedef struct {
+    uint64_t start;
+    uint64_t size;
+    const char* name;
+    const char* source;     /* Path of the file that registered it */
+    uint64_t seq;           /* Registration order; the latest wins */
+} JitSymbol;
+
+typedef struct {
+    char path[PATH_MAX];
+    int fd;                 /* -1 until found */
+    uint64_t offset;        /* Bytes consumed */
+    int broken;             /* Malformed: stop reading */
+} JitSource;
+
+typedef struct JitArenaBlock {
+    struct JitArenaBlock* next;
+    size_t used;
+    size_t size;
+    char data[];
+} JitArenaBlock;
+
+/* Readers share the lock; reading new entries takes it exclusively */
+static pthread_rwlock_t g_jit_lock = PTHREAD_RWLOCK_INITIALIZER;
+static uint64_t g_jit_next_refresh_ns = 0;  /* Atomic: 0 lets the next miss refresh */
+static uint64_t g_jit_misses[JIT_MISS_SLOTS];  /* Atomic slots; cleared under the write lock */
+static JitSymbol* g_jit_symbols = NULL;  /* Sorted by start after each read */
+static size_t g_jit_count = 0;
+static size_t g_jit_capacity = 0;
+static uint64_t g_jit_seq = 0;
+static JitArenaBlock* g_jit_arena = NULL;
+static JitSource g_perf_map = {"", -1, 0, 0};
+static JitSource g_jit_dump = {"", -1, 0, 0};
+static pid_t g_jit_pid = 0;
+static uint64_t g_jit_last_scan_ns = 0;
+
+static void jit_source_close(JitSource* source) {
+    if (source->fd >= 0) {
+        close(source->fd);
+    }
+    source->path[0] = '\0';
+    source->fd = -1;
+    source->offset = 0;
+    source->broken = 0;
+}
+
+/* Forget everything; a forked child has its own map files */
+static void jit_clear_locked(void) {
+    while (g_jit_arena != NULL) {
+        JitArenaBlock* next = g_jit_arena->next;
+        free(g_jit_arena);
+        g_jit_arena = next;
+    }
+    free(g_jit_symbols);
+    g_jit_symbols = NULL;
+    g_jit_count = 0;
+    g_jit_capacity = 0;
+    jit_source_close(&g_perf_map);
+    jit_source_close(&g_jit_dump);
+    g_jit_last_scan_ns = 0;
+    memset(g_jit_misses, 0, sizeof(g_jit_misses));
+}
+
+/* Copy a name into the arena; NULL on allocation failure */
+static const char* jit_intern(const char* name, size_t len) {
+    if (g_jit_arena == NULL || g_jit_arena->size - g_jit_arena->used < len + 1) {
+        size_t size = len + 1 > JIT_ARENA_BLOCK ? len + 1 : JIT_ARENA_BLOCK;
+        JitArenaBlock* block = (JitArenaBlock*)malloc(sizeof(JitArenaBlock) + size);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = g_jit_arena;
+        block->used = 0;
+        block->size = size;
+        g_jit_arena = block;
+    }
+    char* copy = g_jit_arena->data + g_jit_arena->used;
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+    g_jit_arena->used += len + 1;
+    return copy;
+}
+
+static void jit_add(uint64_t start, uint64_t size, const char* name, const char* source) {
+    if (g_jit_count >= g_jit_capacity) {
+        size_t capacity = g_jit_capacity > 0 ? g_jit_capacity * 2 : 1024;
+        JitSymbol* grown = (JitSymbol*)realloc(g_jit_symbols, capacity * sizeof(JitSymbol));
+        if (grown == NULL) {
+            return;
+        }
+        g_jit_symbols = grown;
+        g_jit_capacity = capacity;
+    }
+    JitSymbol* symbol = &g_jit_symbols[g_jit_count++];
+    symbol->start = start;
+    symbol->size = size;
+    symbol->name = name;
+    symbol->source = source;
+    symbol->seq = g_jit_seq++;
+}
+
+static int compare_jit(const void* lhs, const void* rhs) {
+    const JitSymbol* a = (const JitSymbol*)lhs;
+    const JitSymbol* b = (const JitSymbol*)rhs;
+    if (a->start != b->start) {
+        return (a->start > b->start) - (a->start < b->start);
+    }
+    return (a->seq < b->seq) - (a->seq > b->seq);
+}
+
+/* Re-sort after appending; code re-registered at an address keeps only its latest name */
+static void jit_sort_locked(void) {
+    qsort(g_jit_symbols, g_jit_count, sizeof(JitSymbol), compare_jit);
+    size_t kept = 0;
+    for (size_t i = 0; i < g_jit_count; i++) {
+        if (kept == 0 || g_jit_symbols[kept - 1].start != g_jit_symbols[i].start) {
+            g_jit_symbols[kept++] = g_jit_symbols[i];
+        }
+    }
+    g_jit_count = kept;
+}
+
+/* Symbol whose code covers an address; caller holds g_jit_lock */
+static const JitSymbol* jit_find_locked(uint64_t pc) {
+    size_t lo = 0;
+    size_t hi = g_jit_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (g_jit_symbols[mid].start <= pc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return NULL;
+    }
+    const JitSymbol* symbol = &g_jit_symbols[lo - 1];
+    return pc - symbol->start < symbol->size ? symbol : NULL;
+}
+
+/* Name registered at exactly `start`, searching newest first; for JIT_CODE_MOVE */
+static const char* jit_name_at(uint64_t start) {
+    for (size_t i = g_jit_count; i > 0; i--) {
+        if (g_jit_symbols[i - 1].start == start) {
+            return g_jit_symbols[i - 1].name;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Read full bytes at an offset.
+ *
+ * @return 0 if all `len` bytes were read, -1 otherwise.
+ */
+static int read_at(int fd, void* buffer, size_t len, uint64_t offset) {
+    char* out = (char*)buffer;
+    while (len > 0) {
+        ssize_t got = pread(fd, out, len, (off_t)offset);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        out += got;
+        len -= (size_t)got;
+        offset += (uint64_t)got;
+    }
+    return 0;
+}
+
+/* Bytes a source has that were not read yet (0 if none or on error) */
+static uint64_t jit_source_pending(const JitSource* source) {
+    struct stat st;
+    if (fstat(source->fd, &st) < 0 || (uint64_t)st.st_size <= source->offset) {
+        return 0;
+    }
+    return (uint64_t)st.st_size - source->offset;
+}
+
+/* Parse one "START SIZE name" line (NUL-terminated, no newline) */
+static void jit_parse_perf_line(char* line) {
+    char* end = NULL;
+    uint64_t start = strtoull(line, &end, 16);
+    if (end == line || *end != ' ') {
+        return;
+    }
+    char* size_text = end + 1;
+    uint64_t size = strtoull(size_text, &end, 16);
+    if (end == size_text || *end != ' ') {
+        return;
+    }
+    const char* name = end + 1;
+    size_t len = strlen(name);
+    if (len > 0 && name[len - 1] == '\r') {
+        len--;
+    }
+    if (len == 0 || size == 0) {
+        return;
+    }
+    const char* interned = jit_intern(name, len);
+    if (interned != NULL) {
+        jit_add(start, size, interned, g_perf_map.path);
+    }
+}
+
+/* Read the complete lines appended to /tmp/perf-<pid>.map since the last read */
+static void jit_read_perf_map(void) {
+    JitSource* source = &g_perf_map;
+    if (source->fd < 0) {
+        snprintf(source->path, sizeof(source->path), "/tmp/perf-%ld.map", (long)g_jit_pid);
+        source->fd = open(source->path, O_RDONLY | O_CLOEXEC);
+        if (source->fd < 0) {
+            return;
+        }
+    }
+
+    uint64_t pending = jit_source_pending(source);
+    if (pending == 0) {
+        return;
+    }
+    char* buffer = (char*)malloc(JIT_READ_CHUNK + 1);
+    if (buffer == NULL) {
+        return;
+    }
+    while (pending > 0) {
+        size_t len = pending < JIT_READ_CHUNK ? (size_t)pending : JIT_READ_CHUNK;
+        if (read_at(source->fd, buffer, len, source->offset) < 0) {
+            break;
+        }
+        size_t consumed = len;
+        while (consumed > 0 && buffer[consumed - 1] != '\n') {
+            consumed--;
+        }
+        if (consumed == 0) {
+            if (len < JIT_READ_CHUNK) {
+                break;  /* A line still being written */
+            }
+            /* No newline in a whole chunk: skip it rather than stall */
+            source->offset += len;
+            pending -= len;
+            continue;
+        }
+        char* line = buffer;
+        while (line < buffer + consumed) {
+            char* newline = (char*)memchr(line, '\n', (size_t)(buffer + consumed - line));
+            *newline = '\0';
+            jit_parse_perf_line(line);
+            line = newline + 1;
+        }
+        source->offset += consumed;
+        pending -= consumed;
+    }
+    free(buffer);
+}
+
+/* Open a jitdump and check its header; 0 on success */
+static int jit_open_dump(const char* path) {
+    JitSource* source = &g_jit_dump;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    uint32_t header[JIT_DUMP_HEADER_SIZE / sizeof(uint32_t)];
+    /* magic, version, total_size, elf_mach, pad1, pid, timestamp, flags */
+    if (read_at(fd, header, sizeof(header), 0) < 0 || header[0] != JIT_DUMP_MAGIC ||
+        header[2] < JIT_DUMP_HEADER_SIZE) {
+        close(fd);
+        return -1;
+    }
+    snprintf(source->path, sizeof(source->path), "%s", path);
+    source->fd = fd;
+    source->offset = header[2];
+    return 0;
+}
+
+/**
+ * Find this process's jitdump: /tmp/jit-<pid>.dump, or any mapped file of
+ * that name (writers mmap it so perf can find it).
+ */
+static int jit_find_dump(void) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "/tmp/jit-%ld.dump", (long)g_jit_pid);
+    if (jit_open_dump(path) == 0) {
+        return 0;
+    }
+
+    uint64_t now = monotonic_ns();
+    if (g_jit_last_scan_ns != 0 && now - g_jit_last_scan_ns < JIT_SCAN_INTERVAL_NS) {
+        return -1;
+    }
+    g_jit_last_scan_ns = now;
+
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), "/jit-%ld.dump", (long)g_jit_pid);
+    size_t suffix_len = strlen(suffix);
+    FILE* maps = fopen("/proc/self/maps", "re");
+    if (maps == NULL) {
+        return -1;
+    }
+    int result = -1;
+    char line[PATH_MAX + 128];
+    while (result < 0 && fgets(line, sizeof(line), maps) != NULL) {
+        size_t len = strcspn(line, "\n");
+        line[len] = '\0';
+        char* file = strchr(line, '/');
+        if (file != NULL && len >= suffix_len &&
+            strcmp(line + len - suffix_len, suffix) == 0) {
+            result = jit_open_dump(file);
+        }
+    }
+    fclose(maps);
+    return result;
+}
+
+/* Read the complete records appended to the jitdump since the last read */
+static void jit_read_dump(void) {
+    JitSource* source = &g_jit_dump;
+    if (source->broken || (source->fd < 0 && jit_find_dump() < 0)) {
+        return;
+    }
+
+    uint64_t pending = jit_source_pending(source);
+    while (pending >= JIT_RECORD_HEADER_SIZE) {
+        uint32_t record[JIT_RECORD_HEADER_SIZE / sizeof(uint32_t)];  /* id, total_size, timestamp */
+        if (read_at(source->fd, record, sizeof(record), source->offset) < 0) {
+            return;
+        }
+        uint32_t id = record[0];
+        uint32_t total_size = record[1];
+        if (total_size < JIT_RECORD_HEADER_SIZE) {
+            source->broken = 1;
+            return;
+        }
+        if (total_size > pending) {
+            return;  /* A record still being written */
+        }
+
+        uint64_t body_offset = source->offset + JIT_RECORD_HEADER_SIZE;
+        size_t body_size = total_size - JIT_RECORD_HEADER_SIZE;
+        if (id == JIT_CODE_LOAD && body_size > JIT_LOAD_FIXED_SIZE) {
+            char body[JIT_LOAD_FIXED_SIZE + JIT_NAME_MAX];
+            size_t len = body_size < sizeof(body) ? body_size : sizeof(body);
+            uint64_t fields[4] = {0};  /* vma, code_addr, code_size, code_index */
+            const char* name = body + JIT_LOAD_FIXED_SIZE;
+            const char* name_end = NULL;
+            if (read_at(source->fd, body, len, body_offset) == 0) {
+                memcpy(fields, body + 8, sizeof(fields));
+                name_end = (const char*)memchr(name, '\0', len - JIT_LOAD_FIXED_SIZE);
+            }
+            if (name_end != NULL && name_end > name && fields[2] > 0) {
+                const char* interned = jit_intern(name, (size_t)(name_end - name));
+                if (interned != NULL) {
+                    jit_add(fields[1], fields[2], interned, source->path);
+                }
+            }
+        } else if (id == JIT_CODE_MOVE && body_size >= JIT_MOVE_SIZE) {
+            uint64_t fields[5] = {0};  /* vma, old_code_addr, new_code_addr, code_size, code_index */
+            if (read_at(source->fd, fields, sizeof(fields), body_offset + 8) == 0) {
+                const char* name = jit_name_at(fields[1]);
+                if (name != NULL && fields[3] > 0) {
+                    jit_add(fields[2], fields[3], name, source->path);
+                }
+            }
+        }
+        source->offset += total_size;
+        pending -= total_size;
+    }
+}
+
+/**
+ * Pick up new perf map lines and jitdump records. Caller holds the write lock.
+ *
+ * @return 1 if symbols were added, 0 otherwise.
+ */
+static int jit_refresh_locked(void) {
+    pid_t pid = getpid();
+    if (pid != g_jit_pid) {
+        jit_clear_locked();
+        g_jit_pid = pid;
+    }
+    uint64_t before = g_jit_seq;
+    jit_read_perf_map();
+    jit_read_dump();
+    if (g_jit_seq == before) {
+        return 0;
+    }
+    jit_sort_locked();
+    memset(g_jit_misses, 0, sizeof(g_jit_misses));
+    return 1;
+}
+
+static uint64_t* jit_miss_slot(uint64_t pc) {
+    return &g_jit_misses[((pc >> 2) * 0x9E3779B97F4A7C15ULL) >> 56 & (JIT_MISS_SLOTS - 1)];
+}
+
+/**
+ * Whether a refresh could find anything: a source not opened yet, bytes
+ * appended since the last read, or a fork. Caller holds the read lock.
+ */
+static int jit_sources_changed_locked(void) {
+    if (getpid() != g_jit_pid || g_perf_map.fd < 0 ||
+        (g_jit_dump.fd < 0 && !g_jit_dump.broken)) {
+        return 1;
+    }
+    return jit_source_pending(&g_perf_map) > 0 ||
+           (!g_jit_dump.broken && jit_source_pending(&g_jit_dump) > 0);
+}
+
+/* Claim the refresh for this interval; only one thread wins it */
+static int jit_refresh_due(void) {
+    uint64_t due = LOAD_ACQUIRE(&g_jit_next_refresh_ns);
+    uint64_t now = monotonic_ns();
+    if (due != 0 && now < due) {
+        return 0;
+    }
+    return __atomic_compare_exchange_n(&g_jit_next_refresh_ns, &due,
+                                       now + JIT_REFRESH_INTERVAL_NS, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+static void jit_fill(const JitSymbol* symbol, NativeSymbol* out) {
+    snprintf(out->name, sizeof(out->name), "%s", symbol->name);
+    out->address = (uintptr_t)symbol->start;
+    snprintf(out->path, sizeof(out->path), "%s", symbol->source);
+    /* CPython's perf trampolines stand for the eval loop frames they wrap */
+    out->is_interpreter = strncmp(symbol->name, "py::", 4) == 0;
+}
+
+/**
+ * Name a PC outside every module from the JIT sources.
+ *
+ * Hits and repeated misses only take the read lock. A new miss re-reads
+ * the sources under the write lock only if the refresh is due and fstat()
+ * shows they grew.
+ */
+static int jit_lookup(uintptr_t pc, NativeSymbol* out) {
+    pthread_rwlock_rdlock(&g_jit_lock);
+    const JitSymbol* symbol = jit_find_locked((uint64_t)pc);
+    if (symbol != NULL) {
+        jit_fill(symbol, out);
+        pthread_rwlock_unlock(&g_jit_lock);
+        return 1;
+    }
+    uint64_t* miss = jit_miss_slot((uint64_t)pc);
+    int refresh = __atomic_load_n(miss, __ATOMIC_RELAXED) != (uint64_t)pc &&
+                  jit_refresh_due() && jit_sources_changed_locked();
+    if (!refresh) {
+        __atomic_store_n(miss, (uint64_t)pc, __ATOMIC_RELAXED);
+    }
+    pthread_rwlock_unlock(&g_jit_lock);
+    if (!refresh) {
+        return 0;
+    }
+
+    pthread_rwlock_wrlock(&g_jit_lock);
+    jit_refresh_locked();
+    symbol = jit_find_locked((uint64_t)pc);
+    if (symbol != NULL) {
+        jit_fill(symbol, out);
+    } else {
+        __atomic_store_n(miss, (uint64_t)pc, __ATOMIC_RELAXED);
+    }
+    pthread_rwlock_unlock(&g_jit_lock);
+    return symbol != NULL;
+}
+
+int native_symbols_set_cache_dir(const char* dir) {
+    if (dir != NULL && strlen(dir) >= sizeof(g_cache_dir)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    pthread_mutex_lock(&g_lock);
+    snprintf(g_cache_dir, sizeof(g_cache_dir), "%s", dir != NULL ? dir : "");
+    STORE_RELEASE(&g_enabled, dir != NULL && dir[0] != '\0');
+    pthread_mutex_unlock(&g_lock);
+    return 0;
+}
+
+/* Caller holds g_index_lock for reading */
+static int module_lookup(const ModuleInfo* module, uintptr_t pc, NativeSymbol* out) {
+    if (!LOAD_ACQUIRE(&g_enabled)) {
+        return 0;
+    }
+    const SymbolTable* table = index_table((size_t)(module - g_modules.modules));
+    const SymbolEntry* entry = table_find(table, (uint64_t)pc - module->load_bias);
+    if (entry == NULL) {
+        return 0;
+    }
+    snprintf(out->name, sizeof(out->name), "%s", table->strings + entry->name);
+    out->address = (uintptr_t)(entry->addr + module->load_bias);
+    snprintf(out->path, sizeof(out->path), "%s", module->path);
+    out->is_interpreter = module == g_interpreter;
+    return 1;
+}
+
+int native_symbols_lookup(uintptr_t pc, NativeSymbol* out) {
+    if (index_read_lock(0) < 0) {
+        return 0;
+    }
+    const ModuleInfo* module = module_map_find(&g_modules, (uint64_t)pc);
+    if (module == NULL &&
+        monotonic_ns() - LOAD_ACQUIRE(&g_snapshot_ns) >= MODULE_RESCAN_INTERVAL_NS) {
+        /* Possibly a library dlopen()ed since the snapshot */
+        pthread_rwlock_unlock(&g_index_lock);
+        if (index_read_lock(1) < 0) {
+            return 0;
+        }
+        module = module_map_find(&g_modules, (uint64_t)pc);
+    }
+    int found = module != NULL ? module_lookup(module, pc, out) : 0;
+    pthread_rwlock_unlock(&g_index_lock);
+
+    if (module == NULL) {
+        return jit_lookup(pc, out);
+    }
+    return found;
+}
+
+void native_symbols_reset(void) {
+    pthread_rwlock_wrlock(&g_index_lock);
+    if (g_ready) {
+        for (size_t i = 0; i < g_modules.count; i++) {
+            table_free(g_tables[i]);
+        }
+        free(g_tables);
+        g_tables = NULL;
+        module_map_free(&g_modules);
+        g_interpreter = NULL;
+        g_ready = 0;
+    }
+    pthread_rwlock_unlock(&g_index_lock);
+}
+
+void native_symbols_begin_batch(void) {
+    /* Racing a lookup at worst makes it refresh once more */
+    for (size_t i = 0; i < JIT_MISS_SLOTS; i++) {
+        __atomic_store_n(&g_jit_misses[i], 0, __ATOMIC_RELAXED);
+    }
+    STORE_RELEASE(&g_jit_next_refresh_ns, 0);
+}
+
+void native_symbols_get_stats(uint64_t* tables_mapped, uint64_t* tables_built,
+                              uint64_t* jit_symbols) {
+    pthread_mutex_lock(&g_lock);
+    if (tables_mapped) *tables_mapped = g_tables_mapped;
+    if (tables_built) *tables_built = g_tables_built;
+    pthread_mutex_unlock(&g_lock);
+    pthread_rwlock_rdlock(&g_jit_lock);
+    if (jit_symbols) *jit_symbols = g_jit_count;
+    pthread_rwlock_unlock(&g_jit_lock);
+}
+
+#else /* !SPPROF_NATIVE_SYMBOLS_ELF */
+
+int native_symbols_set_cache_dir(const char* dir) {
+    (void)dir;
+    return 0;
+}
+
+int native_symbols_lookup(uintptr_t pc, NativeSymbol* out) {
+    (void)pc;
+    (void)out;
+    return 0;
+}
+
+void native_symbols_reset(void) {
+}
+
+void native_symbols_begin_batch(void) {
+}
+
+void native_symbols_get_stats(uint64_t* tables_mapped, uint64_t* tables_built,
+                              uint64_t* jit_symbols) {
+    if (tables_mapped) *tables_mapped = 0;
+    if (tables_built) *tables_built = 0;
+    if (jit_symbols) *jit_symbols = 0;
+}
+
+#endif /* SPPROF_NATIVE_SYMBOLS_ELF */
@@ -0,0 +1,133 @@
+/**
+ * native_symbols.h - Native address index: module symbols and JIT code
+ *
+ * Resolves native PCs from the function symbols (.symtab, else .dynsym)
+ * of the ELF modules loaded in the process. A module's table is read from
+ * its file on disk the first time a PC lands in it, then written to the
+ * symbol cache directory as <build-id>.sym. Later sessions, including
+ * other processes, mmap that file instead of parsing ELF again: loading
+ * is O(1) and lookups are a binary search of the mapped entries.
+ *
+ * Module tables are only used while a cache directory is set.
+ *
+ * PCs outside every module (JIT code in anonymous mappings) are named
+ * from /tmp/perf-<pid>.map and this process's jitdump (jit-<pid>.dump),
+ * whether or not a cache directory is set. Both files are re-read from
+ * where the last read stopped when such a PC is not found and fstat()
+ * shows they grew, at most once per batch of lookups or 10ms
+ * (native_symbols_begin_batch()); PCs that missed are remembered until
+ * symbols are added or the next batch starts.
+ *
+ * The modules are snapshotted at the first lookup. A PC outside every
+ * module snapshots them again, at most once a second, so libraries
+ * dlopen()ed later are indexed too.
+ *
+ * For a PC the index cannot name, callers (the resolver and unwind.c)
+ * fall back to dladdr().
+ *
+ * CACHE FILE FORMAT (native endianness, all offsets in bytes):
+ *   SymbolFileHeader                magic, layout check, counts, build id
+ *   SymbolEntry[count]              sorted by addr (ELF virtual address)
+ *   char strings[strings_size]      NUL-terminated names
+ *
+ * Files are written to a temporary name and renamed into place, so
+ * concurrent writers never expose a partial file. A file whose header
+ * does not match this build's layout or the module's build id is ignored.
+ *
+ * PLATFORM SUPPORT:
+ *   ELF systems only (Linux, FreeBSD). Elsewhere lookups always miss.
+ *
+ * THREAD SAFETY:
+ *   All functions are thread-safe. Lookups share a read lock on the
+ *   module index; snapshots and native_symbols_reset() take it for
+ *   writing, so a reset waits for lookups in progress.
+ *
+ * ERROR HANDLING:
+ *   POSIX-style (Pattern 1). Cache I/O failures are not errors: the
+ *   table is kept in memory and the file is simply not written.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPPROF_NATIVE_SYMBOLS_H
+#define SPPROF_NATIVE_SYMBOLS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "module_map.h"
+
+/**
+ * NativeSymbol - Result of a successful lookup
+ *
+ * Names are copied out, so they outlive native_symbols_reset().
+ */
+typedef struct {
+    char name[SPPROF_MAX_FUNC_NAME];    /* Function symbol containing the PC */
+    uintptr_t address;                  /* Where that function starts in memory */
+    char path[SPPROF_MAX_FILENAME];     /* Module file */
+    int is_interpreter;                 /* 1 if the module is the Python interpreter */
+} NativeSymbol;
+
+/**
+ * Set the symbol cache directory, or disable the index.
+ *
+ * The directory must exist. Tables already loaded are kept.
+ *
+ * Thread safety: SAFE.
+ *
+ * @param dir Directory path, or NULL to disable.
+ * @return 0 on success, -1 with errno = ENAMETOOLONG if dir is too long.
+ */
+int native_symbols_set_cache_dir(const char* dir);
+
+/**
+ * Name the function containing a native PC.
+ *
+ * Holds the module index's read lock; the first hit in a module also
+ * takes the table loading lock. PCs outside every module may re-snapshot
+ * the modules (write lock, at most once a second), then take the JIT
+ * symbols' read lock. Their write lock is taken only to read new perf map
+ * lines or jitdump records, when a refresh is due and the files grew.
+ *
+ * @param pc  Native PC (return address or instruction pointer).
+ * @param out Receives the symbol on success.
+ * @return 1 if found, 0 if the caller should fall back to dladdr().
+ */
+int native_symbols_lookup(uintptr_t pc, NativeSymbol* out);
+
+/**
+ * Unmap every table and forget the loaded modules.
+ *
+ * The next lookup snapshots the modules again, so libraries loaded since
+ * are picked up. The cache directory, JIT symbols and statistics are
+ * kept; JIT symbols are dropped only in a forked child.
+ *
+ * Thread safety: SAFE. Waits for lookups in progress.
+ */
+void native_symbols_reset(void);
+
+/**
+ * Start a batch of lookups (a drain, a captured stack).
+ *
+ * Within a batch, a PC outside every module that is not found is
+ * remembered as a miss, and the perf map and jitdump are checked for new
+ * entries at most once every 10ms. Starting a batch forgets the misses and
+ * lets the next one check the files straight away.
+ *
+ * Thread safety: SAFE.
+ */
+void native_symbols_begin_batch(void);
+
+/**
+ * Symbol cache statistics since the module was loaded.
+ *
+ * @param tables_mapped Tables loaded from cache files (can be NULL).
+ * @param tables_built  Tables parsed from ELF files (can be NULL).
+ * @param jit_symbols   JIT functions currently known (can be NULL).
+ */
+void native_symbols_get_stats(uint64_t* tables_mapped, uint64_t* tables_built,
+                              uint64_t* jit_symbols);
+
+#endif /* SPPROF_NATIVE_SYMBOLS_H */
@@ -0,0 +1,1604 @@
+/**
+ * output_writer.c - Streaming profile writers
+ *
+ * See output_writer.h. The speedscope and collapsed writers mirror the
+ * Python formatters in output.py field for field, so a profile saved
+ * natively loads to the same JSON value (speedscope) or the same bytes
+ * (collapsed) as one saved through the Python path. The pprof, Perfetto and
+ * perf script writers have no Python counterpart.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define output_sys_write(fd, buf, n) _write((fd), (buf), (unsigned int)(n))
+#else
+#include <unistd.h>
+#define output_sys_write(fd, buf, n) write((fd), (buf), (n))
+#endif
+
+#ifdef SPPROF_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+#include "output_writer.h"
+#include "module_map.h"
+
+/* Bytes buffered before each write() */
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+
+/* cpu_times value for samples without a CPU time measurement */
+#define OUTPUT_CPU_TIME_UNKNOWN UINT64_MAX
+
+/* ============================================================================
+ * Buffered fd output
+ * ============================================================================ */
+
+typedef struct {
+    int fd;
+    int error;      /* errno of the first failure; later writes are dropped */
+    size_t len;
+#ifdef SPPROF_HAS_ZLIB
+    int gzip;       /* Deflate buffered data into a gzip stream */
+    z_stream zs;
+    unsigned char compressed[OUTPUT_BUFFER_SIZE];
+#endif
+    char data[OUTPUT_BUFFER_SIZE];
+} OutputBuffer;
+
+static void write_all(OutputBuffer* out, const char* data, size_t len) {
+    while (len > 0 && out->error == 0) {
+        size_t chunk = len > (1U << 30) ? (1U << 30) : len;
+        ptrdiff_t written = (ptrdiff_t)output_sys_write(out->fd, data, chunk);
+        if (written < 0) {
+            if (errno != EINTR) {
+                out->error = errno;
+            }
+            continue;
+        }
+        data += written;
+        len -= (size_t)written;
+    }
+}
+
+#ifdef SPPROF_HAS_ZLIB
+/**
+ * Deflate the buffered bytes and write whatever zlib produces.
+ *
+ * @param flush Z_NO_FLUSH while streaming, Z_FINISH for the trailer.
+ */
+static void gzip_deflate(OutputBuffer* out, int flush) {
+    out->zs.next_in = (Bytef*)out->data;
+    out->zs.avail_in = (uInt)out->len;
+    int rc;
+    do {
+        out->zs.next_out = out->compressed;
+        out->zs.avail_out = (uInt)sizeof(out->compressed);
+        rc = deflate(&out->zs, flush);
+        if (rc == Z_STREAM_ERROR) {
+            out->error = EIO;
+            return;
+        }
+        write_all(out, (const char*)out->compressed,
+                  sizeof(out->compressed) - out->zs.avail_out);
+    } while (out->error == 0 &&
+             (out->zs.avail_out == 0 || (flush == Z_FINISH && rc != Z_STREAM_END)));
+}
+#endif
+
+static void out_flush(OutputBuffer* out) {
+#ifdef SPPROF_HAS_ZLIB
+    if (out->gzip) {
+        gzip_deflate(out, Z_NO_FLUSH);
+        out->len = 0;
+        return;
+    }
+#endif
+    write_all(out, out->data, out->len);
+    out->len = 0;
+}
+
+static void out_write(OutputBuffer* out, const char* data, size_t len) {
+    while (len > 0) {
+        if (out->len == OUTPUT_BUFFER_SIZE) {
+            out_flush(out);
+        }
+        size_t chunk = OUTPUT_BUFFER_SIZE - out->len;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(out->data + out->len, data, chunk);
+        out->len += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+static void out_puts(OutputBuffer* out, const char* str) {
+    out_write(out, str, strlen(str));
+}
+
+static void out_u64(OutputBuffer* out, uint64_t value) {
+    char tmp[24];
+    int n = snprintf(tmp, sizeof(tmp), "%" PRIu64, value);
+    out_write(out, tmp, (size_t)n);
+}
+
+static void out_i64(OutputBuffer* out, int64_t value) {
+    char tmp[24];
+    int n = snprintf(tmp, sizeof(tmp), "%" PRId64, value);
+    out_write(out, tmp, (size_t)n);
+}
+
+static void out_double(OutputBuffer* out, double value) {
+    /* 17 significant digits round-trip, so readers get Python's exact value */
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), "%.17g", value);
+    out_write(out, tmp, (size_t)n);
+}
+
+/**
+ * Write a JSON string literal. Non-ASCII UTF-8 passes through unescaped.
+ */
+/**
+ * Write a JSON-escaped string body (without the quotes).
+ */
+static void out_json_chars(OutputBuffer* out, const char* str, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    size_t run = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out_write(out, str + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"':  out_write(out, "\\\"", 2); break;
+            case '\\': out_write(out, "\\\\", 2); break;
+            case '\n': out_write(out, "\\n", 2); break;
+            case '\r': out_write(out, "\\r", 2); break;
+            case '\t': out_write(out, "\\t", 2); break;
+            default: {
+                char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                out_write(out, esc, sizeof(esc));
+                break;
+            }
+        }
+    }
+    out_write(out, str + run, len - run);
+}
+
+static void out_json_string(OutputBuffer* out, const char* str, size_t len) {
+    out_write(out, "\"", 1);
+    out_json_chars(out, str, len);
+    out_write(out, "\"", 1);
+}
+
+static OutputBuffer* out_open(int fd) {
+    OutputBuffer* out = (OutputBuffer*)malloc(sizeof(OutputBuffer));
+    if (out == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    out->fd = fd;
+    out->error = 0;
+    out->len = 0;
+#ifdef SPPROF_HAS_ZLIB
+    out->gzip = 0;
+#endif
+    return out;
+}
+
+/**
+ * Open a buffer whose output is gzip-compressed when zlib is available.
+ *
+ * @param compressed Receives 1 if the stream is gzip, 0 if written raw.
+ */
+static OutputBuffer* out_open_gzip(int fd, int* compressed) {
+    OutputBuffer* out = out_open(fd);
+    *compressed = 0;
+#ifdef SPPROF_HAS_ZLIB
+    if (out != NULL) {
+        memset(&out->zs, 0, sizeof(out->zs));
+        /* windowBits 15 + 16 selects the gzip wrapper */
+        if (deflateInit2(&out->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            free(out);
+            errno = ENOMEM;
+            return NULL;
+        }
+        out->gzip = 1;
+        *compressed = 1;
+    }
+#endif
+    return out;
+}
+
+/**
+ * Flush and free the buffer.
+ *
+ * @return 0 if every write succeeded, -1 with errno set otherwise.
+ */
+static int out_close(OutputBuffer* out) {
+#ifdef SPPROF_HAS_ZLIB
+    if (out->gzip) {
+        gzip_deflate(out, Z_FINISH);
+        out->len = 0;
+        out->gzip = 0;
+        deflateEnd(&out->zs);
+    }
+#endif
+    out_flush(out);
+    int error = out->error;
+    free(out);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Two-word key map (thread ids, speedscope frame keys)
+ * ============================================================================ */
+
+typedef struct {
+    uint64_t a;
+    uint64_t b;
+    uint32_t value;
+    uint32_t used;
+} KeyMapSlot;
+
+typedef struct {
+    KeyMapSlot* slots;
+    size_t mask;
+    size_t count;
+} KeyMap;
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static int keymap_init(KeyMap* map) {
+    map->slots = (KeyMapSlot*)calloc(64, sizeof(KeyMapSlot));
+    map->mask = 63;
+    map->count = 0;
+    return map->slots != NULL ? 0 : -1;
+}
+
+static KeyMapSlot* keymap_probe(KeyMapSlot* slots, size_t mask, uint64_t a, uint64_t b) {
+    size_t pos = (size_t)mix64(a ^ mix64(b)) & mask;
+    while (slots[pos].used && (slots[pos].a != a || slots[pos].b != b)) {
+        pos = (pos + 1) & mask;
+    }
+    return &slots[pos];
+}
+
+/**
+ * Find the value stored for (a, b), inserting next_value if absent.
+ *
+ * @return Pointer to the slot's value, or NULL on allocation failure.
+ */
+static uint32_t* keymap_get(KeyMap* map, uint64_t a, uint64_t b, uint32_t next_value) {
+    KeyMapSlot* slot = keymap_probe(map->slots, map->mask, a, b);
+    if (slot->used) {
+        return &slot->value;
+    }
+
+    if ((map->count + 1) * 2 > map->mask + 1) {
+        size_t new_mask = map->mask * 2 + 1;
+        KeyMapSlot* slots = (KeyMapSlot*)calloc(new_mask + 1, sizeof(KeyMapSlot));
+        if (slots == NULL) {
+            return NULL;
+        }
+        for (size_t i = 0; i <= map->mask; i++) {
+            if (map->slots[i].used) {
+                *keymap_probe(slots, new_mask, map->slots[i].a, map->slots[i].b) = map->slots[i];
+            }
+        }
+        free(map->slots);
+        map->slots = slots;
+        map->mask = new_mask;
+        slot = keymap_probe(slots, new_mask, a, b);
+    }
+
+    slot->a = a;
+    slot->b = b;
+    slot->value = next_value;
+    slot->used = 1;
+    map->count++;
+    return &slot->value;
+}
+
+/* ============================================================================
+ * Validation
+ * ============================================================================ */
+
+int output_columns_validate(const ProfileColumns* cols) {
+    for (size_t i = 0; i < cols->frame_count; i++) {
+        if (cols->frame_functions[i] >= cols->string_count ||
+            cols->frame_filenames[i] >= cols->string_count) {
+            return -1;
+        }
+    }
+    if (cols->stack_offsets[0] != 0 ||
+        cols->stack_offsets[cols->stack_count] != cols->stack_frames_len) {
+        return -1;
+    }
+    for (size_t i = 0; i < cols->stack_count; i++) {
+        if (cols->stack_offsets[i] > cols->stack_offsets[i + 1]) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < cols->stack_frames_len; i++) {
+        if (cols->stack_frames[i] >= cols->frame_count) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < cols->sample_count; i++) {
+        if (cols->stack_ids[i] >= cols->stack_count) {
+            return -1;
+        }
+    }
+    if (cols->label_ids != NULL) {
+        for (size_t s = 0; s < cols->label_set_count; s++) {
+            if (cols->label_offsets[s] > cols->label_offsets[s + 1]) {
+                return -1;
+            }
+        }
+        for (size_t i = 0; i < cols->sample_count; i++) {
+            if (cols->label_ids[i] != 0 && cols->label_ids[i] >= cols->label_set_count) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Label set id of sample i, 0 when the columns carry no labels.
+ */
+static uint32_t sample_label(const ProfileColumns* cols, size_t i) {
+    return cols->label_ids != NULL ? cols->label_ids[i] : 0;
+}
+
+/* ============================================================================
+ * Collapsed stacks
+ * ============================================================================ */
+
+typedef struct {
+    size_t offset;      /* Start of the rendered stack in the text arena */
+    size_t len;
+    uint64_t weight;
+    const char* text;   /* Set once the arena stops moving */
+} CollapsedLine;
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t capacity;
+} TextArena;
+
+static int arena_append(TextArena* arena, const char* data, size_t len) {
+    if (arena->len + len > arena->capacity) {
+        size_t capacity = arena->capacity > 0 ? arena->capacity : 64 * 1024;
+        while (capacity < arena->len + len) {
+            capacity *= 2;
+        }
+        char* grown = (char*)realloc(arena->data, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        arena->data = grown;
+        arena->capacity = capacity;
+    }
+    memcpy(arena->data + arena->len, data, len);
+    arena->len += len;
+    return 0;
+}
+
+/**
+ * Render one frame the way output.to_collapsed() does.
+ */
+static int arena_append_frame(TextArena* arena, const ProfileColumns* cols,
+                              uint32_t frame_id, int mark_native) {
+    uint32_t function = cols->frame_functions[frame_id];
+    uint32_t filename = cols->frame_filenames[frame_id];
+    int32_t lineno = cols->frame_linenos[frame_id];
+    int is_native = cols->frame_is_native[frame_id] != 0;
+
+    if (mark_native && is_native && arena_append(arena, "[native] ", 9) < 0) {
+        return -1;
+    }
+    if (arena_append(arena, cols->strings[function], cols->string_lengths[function]) < 0) {
+        return -1;
+    }
+    if (cols->string_lengths[filename] > 0 && lineno != 0 && !is_native) {
+        char line[16];
+        int n = snprintf(line, sizeof(line), ":%" PRId32 ")", lineno);
+        if (arena_append(arena, " (", 2) < 0 ||
+            arena_append(arena, cols->strings[filename], cols->string_lengths[filename]) < 0 ||
+            arena_append(arena, line, (size_t)n) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int compare_lines(const void* lhs, const void* rhs) {
+    const CollapsedLine* a = (const CollapsedLine*)lhs;
+    const CollapsedLine* b = (const CollapsedLine*)rhs;
+    size_t common = a->len < b->len ? a->len : b->len;
+    int c = memcmp(a->text, b->text, common);
+    if (c != 0) {
+        return c;
+    }
+    return (a->len > b->len) - (a->len < b->len);
+}
+
+int output_write_collapsed(int fd, const ProfileColumns* cols, int mark_native) {
+    int result = -1;
+    uint64_t* stack_weights = (uint64_t*)calloc(cols->stack_count + 1, sizeof(uint64_t));
+    uint8_t* stack_seen = (uint8_t*)calloc(cols->stack_count + 1, 1);
+    CollapsedLine* lines = (CollapsedLine*)calloc(cols->stack_count + 1, sizeof(CollapsedLine));
+    TextArena arena = {NULL, 0, 0};
+    OutputBuffer* out = NULL;
+
+    if (stack_weights == NULL || stack_seen == NULL || lines == NULL) {
+        errno = ENOMEM;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < cols->sample_count; i++) {
+        stack_weights[cols->stack_ids[i]] += cols->weights[i];
+        stack_seen[cols->stack_ids[i]] = 1;
+    }
+
+    /* Render each sampled, non-empty stack root first */
+    size_t line_count = 0;
+    for (size_t s = 0; s < cols->stack_count; s++) {
+        uint32_t start = cols->stack_offsets[s];
+        uint32_t end = cols->stack_offsets[s + 1];
+        if (!stack_seen[s] || start == end) {
+            continue;
+        }
+        CollapsedLine* line = &lines[line_count++];
+        line->offset = arena.len;
+        line->weight = stack_weights[s];
+        for (uint32_t f = end; f > start; f--) {
+            if ((f != end && arena_append(&arena, ";", 1) < 0) ||
+                arena_append_frame(&arena, cols, cols->stack_frames[f - 1], mark_native) < 0) {
+                errno = ENOMEM;
+                goto cleanup;
+            }
+        }
+        line->len = arena.len - line->offset;
+    }
+    for (size_t i = 0; i < line_count; i++) {
+        lines[i].text = arena.data + lines[i].offset;
+    }
+
+    /* Distinct stacks can render identically; sorting brings them together */
+    qsort(lines, line_count, sizeof(CollapsedLine), compare_lines);
+
+    out = out_open(fd);
+    if (out == NULL) {
+        goto cleanup;
+    }
+    int first = 1;
+    for (size_t i = 0; i < line_count;) {
+        uint64_t weight = 0;
+        size_t j = i;
+        while (j < line_count && compare_lines(&lines[i], &lines[j]) == 0) {
+            weight += lines[j++].weight;
+        }
+        if (!first) {
+            out_write(out, "\n", 1);
+        }
+        first = 0;
+        out_write(out, lines[i].text, lines[i].len);
+        out_write(out, " ", 1);
+        out_u64(out, weight);
+        i = j;
+    }
+    result = out_close(out);
+
+cleanup:
+    free(stack_weights);
+    free(stack_seen);
+    free(lines);
+    free(arena.data);
+    return result;
+}
+
+/* ============================================================================
+ * Speedscope
+ * ============================================================================ */
+
+static const char* thread_name_for(const ProfileColumns* cols, uint64_t thread_id) {
+    for (size_t i = 0; i < cols->thread_name_count; i++) {
+        if (cols->thread_name_ids[i] == thread_id && cols->thread_names[i][0] != '\0') {
+            return cols->thread_names[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Write a speedscope profile name: the thread name, then " [k=v, ...]" for
+ * a labelled set, as output.to_speedscope() names it.
+ */
+static void out_profile_name(OutputBuffer* out, const ProfileColumns* cols,
+                             uint64_t thread_id, uint32_t label_id) {
+    const char* name = thread_name_for(cols, thread_id);
+    out_puts(out, "\"");
+    if (name != NULL) {
+        out_json_chars(out, name, strlen(name));
+    } else {
+        out_puts(out, "Thread-");
+        out_u64(out, thread_id);
+    }
+    uint32_t begin = label_id != 0 ? cols->label_offsets[label_id] : 0;
+    uint32_t end = label_id != 0 ? cols->label_offsets[label_id + 1] : 0;
+    if (begin < end) {
+        out_puts(out, " [");
+        for (uint32_t p = begin; p < end; p++) {
+            if (p > begin) {
+                out_puts(out, ", ");
+            }
+            out_json_chars(out, cols->label_keys[p], strlen(cols->label_keys[p]));
+            out_puts(out, "=");
+            out_json_chars(out, cols->label_values[p], strlen(cols->label_values[p]));
+        }
+        out_puts(out, "]");
+    }
+    out_puts(out, "\"");
+}
+
+int output_write_speedscope(int fd, const ProfileColumns* cols, double interval_ms,
+                            const char* exporter) {
+    int result = -1;
+    size_t n = cols->sample_count;
+    uint32_t* sample_thread = (uint32_t*)malloc((n + 1) * sizeof(uint32_t));
+    uint32_t* order = (uint32_t*)malloc((n + 1) * sizeof(uint32_t));
+    uint32_t* frame_to_shared = (uint32_t*)malloc((cols->frame_count + 1) * sizeof(uint32_t));
+    uint32_t* shared_frames = (uint32_t*)malloc((cols->frame_count + 1) * sizeof(uint32_t));
+    size_t* thread_starts = NULL;
+    uint64_t* thread_list = NULL;
+    uint32_t* label_list = NULL;
+    KeyMap threads = {NULL, 0, 0};
+    KeyMap frame_keys = {NULL, 0, 0};
+    OutputBuffer* out = NULL;
+
+    if (sample_thread == NULL || order == NULL || frame_to_shared == NULL ||
+        shared_frames == NULL || keymap_init(&threads) < 0 || keymap_init(&frame_keys) < 0) {
+        errno = ENOMEM;
+        goto cleanup;
+    }
+    memset(frame_to_shared, 0xFF, (cols->frame_count + 1) * sizeof(uint32_t));
+
+    /* Number (thread, label set) profiles in order of first appearance,
+     * like the Python dict */
+    for (size_t i = 0; i < n; i++) {
+        uint32_t* index = keymap_get(&threads, cols->thread_ids[i], sample_label(cols, i),
+                                     (uint32_t)threads.count);
+        if (index == NULL) {
+            errno = ENOMEM;
+            goto cleanup;
+        }
+        sample_thread[i] = *index;
+    }
+
+    /* Counting sort of sample indices by thread, stable within a thread */
+    size_t thread_count = threads.count;
+    thread_starts = (size_t*)calloc(thread_count + 1, sizeof(size_t));
+    thread_list = (uint64_t*)malloc((thread_count + 1) * sizeof(uint64_t));
+    label_list = (uint32_t*)malloc((thread_count + 1) * sizeof(uint32_t));
+    if (thread_starts == NULL || thread_list == NULL || label_list == NULL) {
+        errno = ENOMEM;
+        goto cleanup;
+    }
+    for (size_t i = 0; i < n; i++) {
+        thread_starts[sample_thread[i] + 1]++;
+        thread_list[sample_thread[i]] = cols->thread_ids[i];
+        label_list[sample_thread[i]] = sample_label(cols, i);
+    }
+    for (size_t t = 0; t < thread_count; t++) {
+        thread_starts[t + 1] += thread_starts[t];
+    }
+    {
+        size_t* cursor = (size_t*)malloc((thread_count + 1) * sizeof(size_t));
+        if (cursor == NULL) {
+            errno = ENOMEM;
+            goto cleanup;
+        }
+        memcpy(cursor, thread_starts, (thread_count + 1) * sizeof(size_t));
+        for (size_t i = 0; i < n; i++) {
+            order[cursor[sample_thread[i]]++] = (uint32_t)i;
+        }
+        free(cursor);
+    }
+
+    out = out_open(fd);
+    if (out == NULL) {
+        goto cleanup;
+    }
+
+    out_puts(out, "{\"$schema\": \"https://www.speedscope.app/file-format-schema.json\", "
+                  "\"version\": \"1.0.0\", \"profiles\": [");
+    size_t shared_count = 0;
+    double ns_per_weight = interval_ms * 1000000.0;
+
+    for (size_t t = 0; t < thread_count; t++) {
+        size_t begin = thread_starts[t];
+        size_t end = thread_starts[t + 1];
+
+        if (t > 0) {
+            out_puts(out, ", ");
+        }
+        out_puts(out, "{\"type\": \"sampled\", \"name\": ");
+        out_profile_name(out, cols, thread_list[t], label_list[t]);
+        out_puts(out, ", \"unit\": \"nanoseconds\", \"startValue\": 0, \"endValue\": ");
+        out_i64(out, (int64_t)(cols->timestamps[order[end - 1]] - cols->timestamps[order[begin]]));
+
+        out_puts(out, ", \"samples\": [");
+        for (size_t k = begin; k < end; k++) {
+            uint32_t stack = cols->stack_ids[order[k]];
+            out_puts(out, k > begin ? ", [" : "[");
+            for (uint32_t f = cols->stack_offsets[stack]; f < cols->stack_offsets[stack + 1]; f++) {
+                uint32_t frame_id = cols->stack_frames[f];
+                uint32_t shared = frame_to_shared[frame_id];
+                if (shared == UINT32_MAX) {
+                    /* Speedscope frames are keyed by (name, file, line) only */
+                    uint64_t key = ((uint64_t)cols->frame_functions[frame_id] << 32) |
+                                   cols->frame_filenames[frame_id];
+                    uint32_t* index = keymap_get(&frame_keys, key,
+                                                 (uint32_t)cols->frame_linenos[frame_id],
+                                                 (uint32_t)shared_count);
+                    if (index == NULL) {
+                        out->error = ENOMEM;
+                        break;
+                    }
+                    if (*index == shared_count) {
+                        shared_frames[shared_count++] = frame_id;
+                    }
+                    shared = frame_to_shared[frame_id] = *index;
+                }
+                if (f > cols->stack_offsets[stack]) {
+                    out_puts(out, ", ");
+                }
+                out_u64(out, shared);
+            }
+            out_puts(out, "]");
+        }
+
+        out_puts(out, "], \"weights\": [");
+        for (size_t k = begin; k < end; k++) {
+            if (k > begin) {
+                out_puts(out, ", ");
+            }
+            uint64_t cpu_time = cols->cpu_times[order[k]];
+            if (cpu_time != OUTPUT_CPU_TIME_UNKNOWN) {
+                out_u64(out, cpu_time);
+            } else {
+                out_double(out, ns_per_weight * (double)cols->weights[order[k]]);
+            }
+        }
+        out_puts(out, "]}");
+    }
+
+    out_puts(out, "], \"shared\": {\"frames\": [");
+    for (size_t i = 0; i < shared_count; i++) {
+        uint32_t frame_id = shared_frames[i];
+        uint32_t function = cols->frame_functions[frame_id];
+        uint32_t filename = cols->frame_filenames[frame_id];
+        out_puts(out, i > 0 ? ", {\"name\": " : "{\"name\": ");
+        out_json_string(out, cols->strings[function], cols->string_lengths[function]);
+        out_puts(out, ", \"file\": ");
+        out_json_string(out, cols->strings[filename], cols->string_lengths[filename]);
+        out_puts(out, ", \"line\": ");
+        out_i64(out, cols->frame_linenos[frame_id]);
+        out_puts(out, "}");
+    }
+    out_puts(out, "]}, \"name\": \"spprof profile\", \"exporter\": ");
+    out_json_string(out, exporter, strlen(exporter));
+    out_puts(out, "}");
+    result = out_close(out);
+
+cleanup:
+    free(sample_thread);
+    free(order);
+    free(frame_to_shared);
+    free(shared_frames);
+    free(thread_starts);
+    free(thread_list);
+    free(label_list);
+    free(threads.slots);
+    free(frame_keys.slots);
+    return result;
+}
+
+/* ============================================================================
+ * pprof (profile.proto)
+ * ============================================================================ */
+
+/* Field numbers from github.com/google/pprof/proto/profile.proto */
+enum {
+    PPROF_SAMPLE_TYPE = 1,
+    PPROF_SAMPLE = 2,
+    PPROF_MAPPING = 3,
+    PPROF_LOCATION = 4,
+    PPROF_FUNCTION = 5,
+    PPROF_STRING_TABLE = 6,
+    PPROF_TIME_NANOS = 9,
+    PPROF_DURATION_NANOS = 10,
+    PPROF_PERIOD_TYPE = 11,
+    PPROF_PERIOD = 12,
+    PPROF_DEFAULT_SAMPLE_TYPE = 14,
+};
+
+/* Fixed strings appended after the interned ones, in this order */
+static const char* const pprof_fixed_strings[] = {
+    "samples", "count", "cpu", "nanoseconds", "thread_id", "thread_name",
+};
+enum {
+    PPROF_STR_SAMPLES,
+    PPROF_STR_COUNT,
+    PPROF_STR_CPU,
+    PPROF_STR_NANOSECONDS,
+    PPROF_STR_THREAD_ID,
+    PPROF_STR_THREAD_NAME,
+    PPROF_FIXED_STRING_COUNT,
+};
+
+/**
+ * PbMessage - Growable scratch buffer one submessage is encoded into
+ */
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t capacity;
+    int failed;
+} PbMessage;
+
+static size_t varint_encode(uint64_t value, uint8_t* out) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+static size_t varint_size(uint64_t value) {
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static void pb_raw(PbMessage* msg, const void* data, size_t len) {
+    if (msg->failed) {
+        return;
+    }
+    if (msg->len + len > msg->capacity) {
+        size_t capacity = msg->capacity > 0 ? msg->capacity : 256;
+        while (capacity < msg->len + len) {
+            capacity *= 2;
+        }
+        uint8_t* grown = (uint8_t*)realloc(msg->data, capacity);
+        if (grown == NULL) {
+            msg->failed = 1;
+            return;
+        }
+        msg->data = grown;
+        msg->capacity = capacity;
+    }
+    memcpy(msg->data + msg->len, data, len);
+    msg->len += len;
+}
+
+static void pb_varint(PbMessage* msg, uint64_t value) {
+    uint8_t tmp[10];
+    pb_raw(msg, tmp, varint_encode(value, tmp));
+}
+
+/* Varint field; zero is the proto3 default and is omitted */
+static void pb_field_varint(PbMessage* msg, uint32_t field, uint64_t value) {
+    if (value != 0) {
+        pb_varint(msg, (uint64_t)field << 3);
+        pb_varint(msg, value);
+    }
+}
+
+static void pb_field_bytes(PbMessage* msg, uint32_t field, const void* data, size_t len) {
+    pb_varint(msg, ((uint64_t)field << 3) | 2);
+    pb_varint(msg, len);
+    pb_raw(msg, data, len);
+}
+
+static void pb_field_packed(PbMessage* msg, uint32_t field, const uint64_t* values, size_t count) {
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++) {
+        size += varint_size(values[i]);
+    }
+    pb_varint(msg, ((uint64_t)field << 3) | 2);
+    pb_varint(msg, size);
+    for (size_t i = 0; i < count; i++) {
+        pb_varint(msg, values[i]);
+    }
+}
+
+/**
+ * Write a length-delimited top-level field to the output and reset `msg`.
+ */
+static void pb_emit(OutputBuffer* out, uint32_t field, PbMessage* msg) {
+    uint8_t tmp[20];
+    size_t n = varint_encode(((uint64_t)field << 3) | 2, tmp);
+    n += varint_encode(msg->len, tmp + n);
+    out_write(out, (const char*)tmp, n);
+    out_write(out, (const char*)msg->data, msg->len);
+    msg->len = 0;
+}
+
+static void pprof_emit_string(OutputBuffer* out, const char* str, size_t len) {
+    uint8_t tmp[12];
+    size_t n = varint_encode(((uint64_t)PPROF_STRING_TABLE << 3) | 2, tmp);
+    n += varint_encode(len, tmp + n);
+    out_write(out, (const char*)tmp, n);
+    out_write(out, str, len);
+}
+
+static void pprof_emit_value_type(OutputBuffer* out, uint32_t field, PbMessage* msg,
+                                  uint64_t type, uint64_t unit) {
+    pb_field_varint(msg, 1, type);
+    pb_field_varint(msg, 2, unit);
+    pb_emit(out, field, msg);
+}
+
+int output_write_pprof(int fd, const ProfileColumns* cols, double interval_ms,
+                       int64_t time_nanos, int64_t duration_nanos, int* compressed) {
+    int result = -1;
+    size_t n = cols->sample_count;
+    uint64_t interval_ns = (uint64_t)(interval_ms * 1000000.0 + 0.5);
+    uint64_t* row_threads = (uint64_t*)malloc((n + 1) * sizeof(uint64_t));
+    uint32_t* row_stacks = (uint32_t*)malloc((n + 1) * sizeof(uint32_t));
+    uint32_t* row_labels = (uint32_t*)malloc((n + 1) * sizeof(uint32_t));
+    uint64_t* row_counts = (uint64_t*)calloc(n + 1, sizeof(uint64_t));
+    uint64_t* row_cpu = (uint64_t*)calloc(n + 1, sizeof(uint64_t));
+    uint32_t* frame_function = (uint32_t*)malloc((cols->frame_count + 1) * sizeof(uint32_t));
+    uint32_t* frame_mapping = (uint32_t*)calloc(cols->frame_count + 1, sizeof(uint32_t));
+    uint32_t* function_frames = (uint32_t*)malloc((cols->frame_count + 1) * sizeof(uint32_t));
+    uint32_t* module_mapping = NULL;
+    uint32_t* mapping_modules = NULL;
+    uint64_t* scratch = NULL;
+    KeyMap rows = {NULL, 0, 0};
+    KeyMap functions = {NULL, 0, 0};
+    ModuleMap modules = {NULL, 0};
+    PbMessage msg = {NULL, 0, 0, 0};
+    PbMessage line = {NULL, 0, 0, 0};
+    OutputBuffer* out = NULL;
+
+    *compressed = 0;
+    if (row_threads == NULL || row_stacks == NULL || row_labels == NULL || row_counts == NULL ||
+        row_cpu == NULL ||
+        frame_function == NULL || frame_mapping == NULL || function_frames == NULL ||
+        keymap_init(&rows) < 0 || keymap_init(&functions) < 0) {
+        errno = ENOMEM;
+        goto cleanup;
+    }
+
+    /* One pprof sample per (thread, stack, label set), values [count, cpu
+     * nanoseconds] */
+    for (size_t i = 0; i < n; i++) {
+        uint32_t label = sample_label(cols, i);
+        uint32_t* row = keymap_get(&rows, cols->thread_ids[i],
+                                   ((uint64_t)label << 32) | cols->stack_ids[i],
+                                   (uint32_t)rows.count);
+        if (row == NULL) {
+            errno = ENOMEM;
+            goto cleanup;
+        }
+        row_threads[*row] = cols->thread_ids[i];
+        row_stacks[*row] = cols->stack_ids[i];
+        row_labels[*row] = label;
+        row_counts[*row] += cols->weights[i];
+        if (cols->cpu_times[i] != OUTPUT_CPU_TIME_UNKNOWN) {
+            row_cpu[*row] += cols->cpu_times[i];
+        } else {
+            row_cpu[*row] += interval_ns * cols->weights[i];
+        }
+    }
+
+    /* Functions are (name, file) pairs; frames differing only in line share one */
+    size_t function_count = 0;
+    for (size_t f = 0; f < cols->frame_count; f++) {
+        uint32_t* function = keymap_get(&functions, cols->frame_functions[f],
+                                        cols->frame_filenames[f], (uint32_t)function_count);
+        if (function == NULL) {
+            errno = ENOMEM;
+            goto cleanup;
+        }
+        if (*function == function_count) {
+            function_frames[function_count++] = (uint32_t)f;
+        }
+        frame_function[f] = *function;
+    }
+
+    /* Attribute native PCs to the modules loaded now, for offline symbolization */
+    size_t mapping_count = 0;
+    int has_native = 0;
+    for (size_t f = 0; f < cols->frame_count && !has_native; f++) {
+        has_native = cols->frame_is_native[f] && cols->frame_addresses[f] != 0;
+    }
+    if (has_native) {
+        if (module_map_snapshot(&modules) < 0) {
+            errno = ENOMEM;
+            goto cleanup;
+        }
+        module_mapping = (uint32_t*)calloc(modules.count + 1, sizeof(uint32_t));
+        mapping_modules = (uint32_t*)malloc((modules.count + 1) * sizeof(uint32_t));
+        if (module_mapping == NULL || mapping_modules == NULL) {
+            errno = ENOMEM;
+            goto cleanup;
+        }
+        for (size_t f = 0; f < cols->frame_count; f++) {
+            if (!cols->frame_is_native[f] || cols->frame_addresses[f] == 0) {
+                continue;
+            }
+            const ModuleInfo* module = module_map_find(&modules, cols->frame_addresses[f]);
+            if (module == NULL) {
+                continue;
+            }
+            size_t index = (size_t)(module - modules.modules);
+            if (module_mapping[index] == 0) {
+                mapping_modules[mapping_count] = (uint32_t)index;
+                module_mapping[index] = (uint32_t)++mapping_count;
+            }
+            frame_mapping[f] = module_mapping[index];
+        }
+    }
+
+    /* String ids: 0 is "", then the interned strings, fixed strings, thread
+     * names, each label's key and value, and finally each mapping's path and
+     * build id */
+    size_t label_pairs = cols->label_ids != NULL ? cols->label_offsets[cols->label_set_count] : 0;
+    uint64_t fixed_base = cols->string_count + 1;
+    uint64_t names_base = fixed_base + PPROF_FIXED_STRING_COUNT;
+    uint64_t labels_base = names_base + cols->thread_name_count;
+    uint64_t mappings_base = labels_base + 2 * label_pairs;
+
+    size_t max_depth = 2;
+    for (size_t s = 0; s < cols->stack_count; s++) {
+        size_t depth = cols->stack_offsets[s + 1] - cols->stack_offsets[s];
+        max_depth = depth > max_depth ? depth : max_depth;
+    }
+    scratch = (uint64_t*)malloc(max_depth * sizeof(uint64_t));
+    if (scratch == NULL) {
+        errno = ENOMEM;
+        goto cleanup;
+    }
+
+    out = out_open_gzip(fd, compressed);
+    if (out == NULL) {
+        goto cleanup;
+    }
+
+    pprof_emit_value_type(out, PPROF_SAMPLE_TYPE, &msg, fixed_base + PPROF_STR_SAMPLES,
+                          fixed_base + PPROF_STR_COUNT);
+    pprof_emit_value_type(out, PPROF_SAMPLE_TYPE, &msg, fixed_base + PPROF_STR_CPU,
+                          fixed_base + PPROF_STR_NANOSECONDS);
+
+    for (size_t r = 0; r < rows.count && !msg.failed && !line.failed; r++) {
+        uint32_t stack = row_stacks[r];
+        uint32_t start = cols->stack_offsets[stack];
+        uint32_t depth = cols->stack_offsets[stack + 1] - start;
+        for (uint32_t k = 0; k < depth; k++) {
+            scratch[k] = (uint64_t)cols->stack_frames[start + k] + 1;
+        }
+        pb_field_packed(&msg, 1, scratch, depth);
+        scratch[0] = row_counts[r];
+        scratch[1] = row_cpu[r];
+        pb_field_packed(&msg, 2, scratch, 2);
+
+        pb_field_varint(&line, 1, fixed_base + PPROF_STR_THREAD_ID);
+        pb_field_varint(&line, 3, row_threads[r]);
+        pb_field_bytes(&msg, 3, line.data, line.len);
+        line.len = 0;
+        for (size_t t = 0; t < cols->thread_name_count; t++) {
+            if (cols->thread_name_ids[t] == row_threads[r] && cols->thread_names[t][0] != '\0') {
+                pb_field_varint(&line, 1, fixed_base + PPROF_STR_THREAD_NAME);
+                pb_field_varint(&line, 2, names_base + t);
+                pb_field_bytes(&msg, 3, line.data, line.len);
+                line.len = 0;
+                break;
+            }
+        }
+        if (row_labels[r] != 0) {
+            for (uint32_t p = cols->label_offsets[row_labels[r]];
+                 p < cols->label_offsets[row_labels[r] + 1]; p++) {
+                pb_field_varint(&line, 1, labels_base + 2 * p);
+                pb_field_varint(&line, 2, labels_base + 2 * p + 1);
+                pb_field_bytes(&msg, 3, line.data, line.len);
+                line.len = 0;
+            }
+        }
+        pb_emit(out, PPROF_SAMPLE, &msg);
+    }
+
+    for (size_t m = 0; m < mapping_count; m++) {
+        const ModuleInfo* module = &modules.modules[mapping_modules[m]];
+        pb_field_varint(&msg, 1, m + 1);
+        pb_field_varint(&msg, 2, module->start);
+        pb_field_varint(&msg, 3, module->limit);
+        pb_field_varint(&msg, 4, module->file_offset);
+        pb_field_varint(&msg, 5, mappings_base + 2 * m);
+        pb_field_varint(&msg, 6, mappings_base + 2 * m + 1);
+        /* has_functions stays false so pprof re-symbolizes from the binary */
+        pb_emit(out, PPROF_MAPPING, &msg);
+    }
+
+    for (size_t f = 0; f < cols->frame_count && !msg.failed && !line.failed; f++) {
+        pb_field_varint(&msg, 1, f + 1);
+        pb_field_varint(&msg, 2, frame_mapping[f]);
+        pb_field_varint(&msg, 3, cols->frame_is_native[f] ? cols->frame_addresses[f] : 0);
+        pb_field_varint(&line, 1, (uint64_t)frame_function[f] + 1);
+        pb_field_varint(&line, 2, (uint64_t)(int64_t)cols->frame_linenos[f]);
+        pb_field_bytes(&msg, 4, line.data, line.len);
+        line.len = 0;
+        pb_emit(out, PPROF_LOCATION, &msg);
+    }
+
+    for (size_t i = 0; i < function_count && !msg.failed; i++) {
+        uint32_t frame_id = function_frames[i];
+        pb_field_varint(&msg, 1, i + 1);
+        pb_field_varint(&msg, 2, (uint64_t)cols->frame_functions[frame_id] + 1);
+        pb_field_varint(&msg, 3, (uint64_t)cols->frame_functions[frame_id] + 1);
+        pb_field_varint(&msg, 4, (uint64_t)cols->frame_filenames[frame_id] + 1);
+        pb_emit(out, PPROF_FUNCTION, &msg);
+    }
+
+    pprof_emit_string(out, "", 0);
+    for (size_t i = 0; i < cols->string_count; i++) {
+        pprof_emit_string(out, cols->strings[i], cols->string_lengths[i]);
+    }
+    for (size_t i = 0; i < PPROF_FIXED_STRING_COUNT; i++) {
+        pprof_emit_string(out, pprof_fixed_strings[i], strlen(pprof_fixed_strings[i]));
+    }
+    for (size_t t = 0; t < cols->thread_name_count; t++) {
+        pprof_emit_string(out, cols->thread_names[t], strlen(cols->thread_names[t]));
+    }
+    for (size_t p = 0; p < label_pairs; p++) {
+        pprof_emit_string(out, cols->label_keys[p], strlen(cols->label_keys[p]));
+        pprof_emit_string(out, cols->label_values[p], strlen(cols->label_values[p]));
+    }
+    for (size_t m = 0; m < mapping_count; m++) {
+        const ModuleInfo* module = &modules.modules[mapping_modules[m]];
+        pprof_emit_string(out, module->path, strlen(module->path));
+        pprof_emit_string(out, module->build_id, strlen(module->build_id));
+    }
+
+    pb_field_varint(&msg, PPROF_TIME_NANOS, (uint64_t)time_nanos);
+    pb_field_varint(&msg, PPROF_DURATION_NANOS, (uint64_t)duration_nanos);
+    out_write(out, (const char*)msg.data, msg.len);
+    msg.len = 0;
+    pprof_emit_value_type(out, PPROF_PERIOD_TYPE, &msg, fixed_base + PPROF_STR_CPU,
+                          fixed_base + PPROF_STR_NANOSECONDS);
+    pb_field_varint(&msg, PPROF_PERIOD, interval_ns);
+    pb_field_varint(&msg, PPROF_DEFAULT_SAMPLE_TYPE, fixed_base + PPROF_STR_CPU);
+    out_write(out, (const char*)msg.data, msg.len);
+
+    if (msg.failed || line.failed) {
+        out->error = ENOMEM;
+    }
+    result = out_close(out);
+
+cleanup:
+    free(row_threads);
+    free(row_stacks);
+    free(row_labels);
+    free(row_counts);
+    free(row_cpu);
+    free(frame_function);
+    free(frame_mapping);
+    free(function_frames);
+    free(module_mapping);
+    free(mapping_modules);
+    free(scratch);
+    free(rows.slots);
+    free(functions.slots);
+    module_map_free(&modules);
+    free(msg.data);
+    free(line.data);
+    return result;
+}
+
+/* ============================================================================
+ * Perfetto (perfetto.protos.Trace)
+ * ============================================================================ */
+
+/* Field numbers from perfetto/protos/perfetto/trace/trace_packet.proto,
+ * track_event/track_event.proto, track_event/track_descriptor.proto,
+ * track_event/{process,thread}_descriptor.proto and
+ * interned_data/interned_data.proto */
+enum {
+    PERFETTO_TRACE_PACKET = 1,
+
+    PERFETTO_PACKET_TIMESTAMP = 8,
+    PERFETTO_PACKET_SEQUENCE_ID = 10,
+    PERFETTO_PACKET_TRACK_EVENT = 11,
+    PERFETTO_PACKET_INTERNED_DATA = 12,
+    PERFETTO_PACKET_SEQUENCE_FLAGS = 13,
+    PERFETTO_PACKET_TRACK_DESCRIPTOR = 60,
+
+    PERFETTO_TRACK_UUID = 1,
+    PERFETTO_TRACK_PROCESS = 3,
+    PERFETTO_TRACK_THREAD = 4,
+    PERFETTO_TRACK_PARENT_UUID = 5,
+    PERFETTO_PROCESS_PID = 1,
+    PERFETTO_PROCESS_NAME = 6,
+    PERFETTO_THREAD_PID = 1,
+    PERFETTO_THREAD_TID = 2,
+    PERFETTO_THREAD_NAME = 5,
+
+    PERFETTO_EVENT_TYPE = 9,
+    PERFETTO_EVENT_NAME_IID = 10,
+    PERFETTO_EVENT_TRACK_UUID = 11,
+
+    PERFETTO_INTERNED_EVENT_NAMES = 2,
+    PERFETTO_INTERNED_NAME_IID = 1,
+    PERFETTO_INTERNED_NAME_NAME = 2,
+};
+
+enum {
+    PERFETTO_SLICE_BEGIN = 1,
+    PERFETTO_SLICE_END = 2,
+};
+
+enum {
+    PERFETTO_SEQ_INCREMENTAL_STATE_CLEARED = 1,
+    PERFETTO_SEQ_NEEDS_INCREMENTAL_STATE = 2,
+};
+
+/* Track uuids only need to be unique within the trace */
+#define PERFETTO_PROCESS_UUID_SALT 0x7370702d70726f63ULL
+#define PERFETTO_THREAD_UUID_SALT  0x7370702d74687264ULL
+
+/**
+ * PerfettoSequence - Encoder state for one thread's packet sequence
+ */
+typedef struct {
+    OutputBuffer* out;
+    PbMessage packet;
+    PbMessage event;
+    PbMessage interned;
+    PbMessage name;
+    uint32_t sequence_id;
+    uint64_t track_uuid;
+    int cleared;                /* First packet (incremental state reset) sent */
+} PerfettoSequence;
+
+typedef struct {
+    uint32_t thread;            /* Thread number in order of first appearance */
+    uint32_t sample;
+    uint64_t timestamp;
+} PerfettoOrder;
+
+static int compare_perfetto_order(const void* lhs, const void* rhs) {
+    const PerfettoOrder* a = (const PerfettoOrder*)lhs;
+    const PerfettoOrder* b = (const PerfettoOrder*)rhs;
+    if (a->thread != b->thread) {
+        return a->thread < b->thread ? -1 : 1;
+    }
+    if (a->timestamp != b->timestamp) {
+        return a->timestamp < b->timestamp ? -1 : 1;
+    }
+    return (a->sample > b->sample) - (a->sample < b->sample);
+}
+
+/**
+ * Intern the slice name of `frame_id` in the next packet: the function for
+ * native frames, "function (file:line)" for Python frames.
+ */
+static void perfetto_intern_frame(PerfettoSequence* seq, const ProfileColumns* cols,
+                                  uint32_t frame_id) {
+    uint32_t function = cols->frame_functions[frame_id];
+    PbMessage* name = &seq->name;
+
+    pb_field_varint(name, PERFETTO_INTERNED_NAME_IID, (uint64_t)frame_id + 1);
+    if (cols->frame_is_native[frame_id]) {
+        pb_field_bytes(name, PERFETTO_INTERNED_NAME_NAME, cols->strings[function],
+                       cols->string_lengths[function]);
+    } else {
+        uint32_t filename = cols->frame_filenames[frame_id];
+        char line[24];
+        int line_len = snprintf(line, sizeof(line), ":%" PRId32 ")", cols->frame_linenos[frame_id]);
+        size_t len = cols->string_lengths[function] + 2 + cols->string_lengths[filename] +
+                     (size_t)line_len;
+        pb_varint(name, ((uint64_t)PERFETTO_INTERNED_NAME_NAME << 3) | 2);
+        pb_varint(name, len);
+        pb_raw(name, cols->strings[function], cols->string_lengths[function]);
+        pb_raw(name, " (", 2);
+        pb_raw(name, cols->strings[filename], cols->string_lengths[filename]);
+        pb_raw(name, line, (size_t)line_len);
+    }
+    pb_field_bytes(&seq->interned, PERFETTO_INTERNED_EVENT_NAMES, name->data, name->len);
+    name->len = 0;
+}
+
+static void perfetto_emit_event(PerfettoSequence* seq, uint64_t timestamp, uint64_t type,
+                                uint64_t name_iid) {
+    pb_field_varint(&seq->event, PERFETTO_EVENT_TYPE, type);
+    pb_field_varint(&seq->event, PERFETTO_EVENT_NAME_IID, name_iid);
+    pb_field_varint(&seq->event, PERFETTO_EVENT_TRACK_UUID, seq->track_uuid);
+
+    pb_field_varint(&seq->packet, PERFETTO_PACKET_TIMESTAMP, timestamp);
+    pb_field_varint(&seq->packet, PERFETTO_PACKET_SEQUENCE_ID, seq->sequence_id);
+    pb_field_bytes(&seq->packet, PERFETTO_PACKET_TRACK_EVENT, seq->event.data, seq->event.len);
+    if (seq->interned.len > 0) {
+        pb_field_bytes(&seq->packet, PERFETTO_PACKET_INTERNED_DATA, seq->interned.data,
+                       seq->interned.len);
+        seq->interned.len = 0;
+    }
+    pb_field_varint(&seq->packet, PERFETTO_PACKET_SEQUENCE_FLAGS,
+                    seq->cleared ? PERFETTO_SEQ_NEEDS_INCREMENTAL_STATE
+                                 : PERFETTO_SEQ_INCREMENTAL_STATE_CLEARED |
+                                       PERFETTO_SEQ_NEEDS_INCREMENTAL_STATE);
+    seq->cleared = 1;
+    seq->event.len = 0;
+    pb_emit(seq->out, PERFETTO_TRACE_PACKET, &seq->packet);
+}
+
+/**
+ * Emit the track descriptor packet for a process (tid == 0) or thread.
+ */
+static void perfetto_emit_track(OutputBuffer* out, PbMessage* packet, PbMessage* track,
+                                PbMessage* body, uint64_t uuid, uint64_t parent_uuid,
+                                uint64_t pid, uint64_t tid, const char* name) {
+    /* ProcessDescriptor.pid and ThreadDescriptor.pid share field 1 */
+    pb_field_varint(body, PERFETTO_PROCESS_PID, pid);
+    if (tid != 0) {
+        pb_field_varint(body, PERFETTO_THREAD_TID, tid);
+    }
+    if (name != NULL) {
+        pb_field_bytes(body, tid == 0 ? PERFETTO_PROCESS_NAME : PERFETTO_THREAD_NAME, name,
+                       strlen(name));
+    }
+    pb_field_varint(track, PERFETTO_TRACK_UUID, uuid);
+    pb_field_varint(track, PERFETTO_TRACK_PARENT_UUID, parent_uuid);
+    pb_field_bytes(track, tid == 0 ? PERFETTO_TRACK_PROCESS : PERFETTO_TRACK_THREAD, body->data,
+                   body->len);
+    pb_field_bytes(packet, PERFETTO_PACKET_TRACK_DESCRIPTOR, track->data, track->len);
+    body->len = 0;
+    track->len = 0;
+    pb_emit(out, PERFETTO_TRACE_PACKET, packet);
+}
+
+int output_write_perfetto(int fd, const ProfileColumns* cols, double interval_ms,
+                          uint64_t pid, const char* process_name,
+                          int64_t timestamp_offset_ns) {
+    int result = -1;
+    size_t n = cols->sample_count;
+    uint64_t interval_ns = (uint64_t)(interval_ms * 1000000.0 + 0.5);
+    uint64_t process_uuid = mix64(pid ^ PERFETTO_PROCESS_UUID_SALT);
+    PerfettoOrder* order = (PerfettoOrder*)malloc((n + 1) * sizeof(PerfettoOrder));
+    uint32_t* interned_in = (uint32_t*)calloc(cols->frame_count + 1, sizeof(uint32_t));
+    uint32_t* open_frames = NULL;
+    KeyMap threads = {NULL, 0, 0};
+    PerfettoSequence seq;
+    OutputBuffer* out = NULL;
+
+    memset(&seq, 0, sizeof(seq));
+    if (order == NULL || interned_in == NULL || keymap_init(&threads) < 0) {
+        errno = ENOMEM;
+        goto cleanup;
+    }
+
+    size_t max_depth = 1;
+    for (size_t s = 0; s < cols->stack_count; s++) {
+        size_t depth = cols->stack_offsets[s + 1] - cols->stack_offsets[s];
+        max_depth = depth > max_depth ? depth : max_depth;
+    }
+    open_frames = (uint32_t*)malloc(max_depth * sizeof(uint32_t));
+    if (open_frames == NULL) {
+        errno = ENOMEM;
+        goto cleanup;
+    }
+
+    /* Group samples by thread (first appearance), in time order within one */
+    for (size_t i = 0; i < n; i++) {
+        uint32_t* thread = keymap_get(&threads, cols->thread_ids[i], 0, (uint32_t)threads.count);
+        if (thread == NULL) {
+            errno = ENOMEM;
+            goto cleanup;
+        }
+        order[i].thread = *thread;
+        order[i].sample = (uint32_t)i;
+        /* Clamp rather than wrap if a negative offset overshoots */
+        int64_t timestamp = (int64_t)cols->timestamps[i] + timestamp_offset_ns;
+        order[i].timestamp = timestamp > 0 ? (uint64_t)timestamp : 0;
+    }
+    qsort(order, n, sizeof(PerfettoOrder), compare_perfetto_order);
+
+    out = out_open(fd);
+    if (out == NULL) {
+        goto cleanup;
+    }
+    seq.out = out;
+
+    perfetto_emit_track(out, &seq.packet, &seq.event, &seq.name, process_uuid, 0, pid, 0,
+                        process_name);
+
+    for (size_t begin = 0; begin < n && !out->error; ) {
+        uint32_t thread = order[begin].thread;
+        uint64_t thread_id = cols->thread_ids[order[begin].sample];
+        size_t end = begin;
+        while (end < n && order[end].thread == thread) {
+            end++;
+        }
+
+        seq.sequence_id = thread + 1;
+        seq.track_uuid = mix64(thread_id ^ PERFETTO_THREAD_UUID_SALT);
+        seq.cleared = 0;
+        perfetto_emit_track(out, &seq.packet, &seq.event, &seq.name, seq.track_uuid,
+                            process_uuid, pid, thread_id, thread_name_for(cols, thread_id));
+
+        /* Replay the stacks as nested slices; frames shared with the open
+         * stack (root side) carry on, everything above them is closed */
+        size_t open_depth = 0;
+        uint64_t previous = order[begin].timestamp;
+        for (size_t k = begin; k < end; k++) {
+            uint64_t timestamp = order[k].timestamp;
+            uint32_t stack = cols->stack_ids[order[k].sample];
+            uint32_t first = cols->stack_offsets[stack];
+            uint32_t depth = cols->stack_offsets[stack + 1] - first;
+
+            if (open_depth > 0 && timestamp > previous + 2 * interval_ns) {
+                /* The thread was not sampled for a while; do not bridge it */
+                while (open_depth > 0) {
+                    open_depth--;
+                    perfetto_emit_event(&seq, previous + interval_ns, PERFETTO_SLICE_END, 0);
+                }
+            }
+
+            size_t common = 0;
+            while (common < open_depth && common < depth &&
+                   open_frames[common] == cols->stack_frames[first + depth - 1 - common]) {
+                common++;
+            }
+            while (open_depth > common) {
+                open_depth--;
+                perfetto_emit_event(&seq, timestamp, PERFETTO_SLICE_END, 0);
+            }
+            while (open_depth < depth) {
+                uint32_t frame_id = cols->stack_frames[first + depth - 1 - open_depth];
+                if (interned_in[frame_id] != seq.sequence_id) {
+                    interned_in[frame_id] = seq.sequence_id;
+                    perfetto_intern_frame(&seq, cols, frame_id);
+                }
+                open_frames[open_depth++] = frame_id;
+                perfetto_emit_event(&seq, timestamp, PERFETTO_SLICE_BEGIN,
+                                    (uint64_t)frame_id + 1);
+            }
+            previous = timestamp;
+        }
+        while (open_depth > 0) {
+            open_depth--;
+            perfetto_emit_event(&seq, previous + interval_ns, PERFETTO_SLICE_END, 0);
+        }
+
+        if (seq.packet.failed || seq.event.failed || seq.interned.failed || seq.name.failed) {
+            out->error = ENOMEM;
+        }
+        begin = end;
+    }
+    result = out_close(out);
+
+cleanup:
+    free(order);
+    free(interned_in);
+    free(open_frames);
+    free(threads.slots);
+    free(seq.packet.data);
+    free(seq.event.data);
+    free(seq.interned.data);
+    free(seq.name.data);
+    return result;
+}
+
+/* ============================================================================
+ * perf script
+ * ============================================================================ */
+
+/*
+ * Python frames get synthetic addresses, PERF_SCRIPT_PY_SIZE bytes per
+ * (function, file) symbol from PERF_SCRIPT_PY_BASE. That region is below
+ * where Linux places executables, libraries and mmaps.
+ */
+#define PERF_SCRIPT_PY_BASE 0x1000000000ULL
+#define PERF_SCRIPT_PY_SIZE 0x10
+
+typedef struct {
+    uint64_t timestamp;
+    uint32_t sample;
+} PerfScriptOrder;
+
+static int compare_perf_script_order(const void* lhs, const void* rhs) {
+    const PerfScriptOrder* a = (const PerfScriptOrder*)lhs;
+    const PerfScriptOrder* b = (const PerfScriptOrder*)rhs;
+    if (a->timestamp != b->timestamp) {
+        return a->timestamp < b->timestamp ? -1 : 1;
+    }
+    return (a->sample > b->sample) - (a->sample < b->sample);
+}
+
+/**
+ * Write a name on a perf script line: control characters (a newline would
+ * split the record) become spaces, and an empty name is "[unknown]" as in
+ * perf.
+ */
+static void out_perf_text(OutputBuffer* out, const char* str, size_t len) {
+    if (len == 0) {
+        out_puts(out, "[unknown]");
+        return;
+    }
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        if ((unsigned char)str[i] < 0x20 || str[i] == 0x7f) {
+            out_write(out, str + start, i - start);
+            out_write(out, " ", 1);
+            start = i + 1;
+        }
+    }
+    out_write(out, str + start, len - start);
+}
+
+static void out_perf_symbol(OutputBuffer* out, const ProfileColumns* cols, uint32_t frame_id) {
+    uint32_t func = cols->frame_functions[frame_id];
+    uint32_t file = cols->frame_filenames[frame_id];
+    if (!cols->frame_is_native[frame_id]) {
+        out_puts(out, "py::");
+        out_perf_text(out, cols->strings[func], cols->string_lengths[func]);
+        out_write(out, ":", 1);
+    }
+    out_perf_text(out, cols->strings[file], cols->string_lengths[file]);
+}
+
+static void out_hex(OutputBuffer* out, uint64_t value, int width) {
+    char tmp[24];
+    int n = snprintf(tmp, sizeof(tmp), "%*" PRIx64, width, value);
+    out_write(out, tmp, (size_t)n);
+}
+
+int output_write_perf_script(int fd, int map_fd, const ProfileColumns* cols,
+                             double interval_ms, uint64_t pid, const char* comm,
+                             const char* map_name) {
+    int result = -1;
+    size_t n = cols->sample_count;
+    uint64_t interval_ns = (uint64_t)(interval_ms * 1000000.0 + 0.5);
+    PerfScriptOrder* order = (PerfScriptOrder*)malloc((n + 1) * sizeof(PerfScriptOrder));
+    /* Synthetic address of each Python frame's symbol, 0 until assigned */
+    uint64_t* frame_address = (uint64_t*)calloc(cols->frame_count + 1, sizeof(uint64_t));
+    KeyMap symbols = {NULL, 0, 0};
+    OutputBuffer* out = NULL;
+    OutputBuffer* map = NULL;
+
+    if (order == NULL || frame_address == NULL || keymap_init(&symbols) < 0) {
+        errno = ENOMEM;
+        goto cleanup;
+    }
+    out = out_open(fd);
+    map = out_open(map_fd);
+    if (out == NULL || map == NULL) {
+        goto cleanup;
+    }
+
+    /* One symbol per (function, file), whatever the line; the perf map
+     * gets a "START SIZE symbol" line (hex) for each new one */
+    for (size_t f = 0; f < cols->frame_count; f++) {
+        if (cols->frame_is_native[f]) {
+            continue;
+        }
+        size_t known = symbols.count;
+        uint32_t* symbol = keymap_get(&symbols, cols->frame_functions[f], cols->frame_filenames[f],
+                                      (uint32_t)known);
+        if (symbol == NULL) {
+            errno = ENOMEM;
+            goto cleanup;
+        }
+        frame_address[f] = PERF_SCRIPT_PY_BASE + (uint64_t)*symbol * PERF_SCRIPT_PY_SIZE;
+        if (symbols.count > known) {
+            out_hex(map, frame_address[f], 0);
+            out_write(map, " ", 1);
+            out_hex(map, PERF_SCRIPT_PY_SIZE, 0);
+            out_write(map, " ", 1);
+            out_perf_symbol(map, cols, (uint32_t)f);
+            out_write(map, "\n", 1);
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        order[i].timestamp = cols->timestamps[i];
+        order[i].sample = (uint32_t)i;
+    }
+    qsort(order, n, sizeof(PerfScriptOrder), compare_perf_script_order);
+
+    for (size_t k = 0; k < n && !out->error; k++) {
+        uint32_t i = order[k].sample;
+        uint64_t timestamp = cols->timestamps[i];
+        uint32_t stack = cols->stack_ids[i];
+        uint64_t weight = cols->weights[i] > 0 ? cols->weights[i] : 1;
+
+        /* "comm pid/tid secs.usecs: period event:" as perf script prints it */
+        out_perf_text(out, comm, strlen(comm));
+        out_write(out, " ", 1);
+        out_u64(out, pid);
+        out_write(out, "/", 1);
+        out_u64(out, cols->thread_ids[i]);
+        char time_text[48];
+        int len = snprintf(time_text, sizeof(time_text), " %" PRIu64 ".%06" PRIu64 ": ",
+                           timestamp / UINT64_C(1000000000),
+                           timestamp % UINT64_C(1000000000) / UINT64_C(1000));
+        out_write(out, time_text, (size_t)len);
+        out_u64(out, weight * interval_ns);
+        out_puts(out, " cpu-clock:\n");
+
+        /* Callchain, leaf first: "\t<addr> <symbol> (<dso>)" */
+        for (uint32_t j = cols->stack_offsets[stack]; j < cols->stack_offsets[stack + 1]; j++) {
+            uint32_t frame_id = cols->stack_frames[j];
+            int native = cols->frame_is_native[frame_id];
+            out_write(out, "\t", 1);
+            out_hex(out, native ? cols->frame_addresses[frame_id] : frame_address[frame_id], 16);
+            out_write(out, " ", 1);
+            if (native) {
+                uint32_t func = cols->frame_functions[frame_id];
+                uint32_t file = cols->frame_filenames[frame_id];
+                out_perf_text(out, cols->strings[func], cols->string_lengths[func]);
+                out_write(out, " (", 2);
+                out_perf_text(out, cols->strings[file], cols->string_lengths[file]);
+            } else {
+                out_perf_symbol(out, cols, frame_id);
+                out_write(out, " (", 2);
+                out_puts(out, map_name);
+            }
+            out_write(out, ")\n", 2);
+        }
+        out_write(out, "\n", 1);
+    }
+
+    result = out_close(map);
+    map = NULL;
+    if (out_close(out) < 0) {
+        result = -1;
+    }
+    out = NULL;
+
+cleanup:
+    if (out != NULL) {
+        free(out);
+    }
+    if (map != NULL) {
+        free(map);
+    }
+    free(order);
+    free(frame_address);
+    free(symbols.slots);
+    return result;
+}
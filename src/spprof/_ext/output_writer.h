@@ -0,0 +1,179 @@
+/**
+ * output_writer.h - Streaming profile writers
+ *
+ * Native counterparts of output.py's to_speedscope() and to_collapsed() for
+ * profiles still held in the columnar layout produced by _drain_columnar()
+ * (see stack_table.h), plus pprof (profile.proto), Perfetto and perf script
+ * encoders. They render straight from the interned tables into a file
+ * descriptor through a fixed-size buffer, so no per-sample Python objects
+ * and no whole-document string are ever built.
+ *
+ * The writers touch only the plain C arrays described by ProfileColumns;
+ * callers may release the GIL around them.
+ *
+ * ERROR HANDLING:
+ *   POSIX-style (Pattern 1): 0 on success, -1 on error with errno set
+ *   (EINVAL for inconsistent columns, ENOMEM, or the error from write()).
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPPROF_OUTPUT_WRITER_H
+#define SPPROF_OUTPUT_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * ProfileColumns - Read-only view of a columnar profile
+ *
+ * Layout matches the StackTable export: strings are UTF-8 (not necessarily
+ * NUL-terminated), stack i spans stack_frames[stack_offsets[i] ..
+ * stack_offsets[i + 1]) leaf first, and cpu_times uses UINT64_MAX for
+ * "not measured".
+ */
+typedef struct {
+    const char* const* strings;
+    const size_t* string_lengths;
+    size_t string_count;
+
+    const uint32_t* frame_functions;
+    const uint32_t* frame_filenames;
+    const int32_t* frame_linenos;
+    const uint8_t* frame_is_native;
+    const uint64_t* frame_addresses;    /* Native PC, 0 for Python frames */
+    size_t frame_count;
+
+    const uint32_t* stack_offsets;      /* stack_count + 1 entries */
+    const uint32_t* stack_frames;
+    size_t stack_count;
+    size_t stack_frames_len;
+
+    const uint64_t* timestamps;
+    const uint64_t* thread_ids;
+    const uint64_t* cpu_times;
+    const uint32_t* weights;
+    const uint32_t* stack_ids;
+    size_t sample_count;
+
+    /* Optional thread names (UTF-8, NUL-terminated), looked up by thread id */
+    const uint64_t* thread_name_ids;
+    const char* const* thread_names;
+    size_t thread_name_count;
+
+    /* Optional spprof.labels() sets: sample i carries set label_ids[i] (0 for
+     * none), and set s spans label_keys/label_values[label_offsets[s] ..
+     * label_offsets[s + 1]), sorted by key (UTF-8, NUL-terminated) */
+    const uint32_t* label_ids;          /* NULL when no sample is labelled */
+    const uint32_t* label_offsets;      /* label_set_count + 1 entries */
+    const char* const* label_keys;
+    const char* const* label_values;
+    size_t label_set_count;
+} ProfileColumns;
+
+/**
+ * Check that every id and offset in the columns is in range.
+ *
+ * @param cols Columns to validate.
+ * @return 0 if consistent, -1 otherwise.
+ */
+int output_columns_validate(const ProfileColumns* cols);
+
+/**
+ * Write folded stacks ("root;...;leaf weight" lines, sorted, no trailing
+ * newline), identical to output.to_collapsed().
+ *
+ * @param fd Destination file descriptor (not closed).
+ * @param cols Validated columns.
+ * @param mark_native Prefix native frames with "[native] ".
+ * @return 0 on success, -1 on error.
+ */
+int output_write_collapsed(int fd, const ProfileColumns* cols, int mark_native);
+
+/**
+ * Write a speedscope document equivalent to output.to_speedscope().
+ *
+ * @param fd Destination file descriptor (not closed).
+ * @param cols Validated columns.
+ * @param interval_ms Sampling interval; samples without CPU time weigh
+ *                    interval_ms * 1e6 * weight nanoseconds.
+ * @param exporter Value of the "exporter" field (NUL-terminated UTF-8).
+ * @return 0 on success, -1 on error.
+ */
+int output_write_speedscope(int fd, const ProfileColumns* cols, double interval_ms,
+                            const char* exporter);
+
+/**
+ * Write a pprof profile (profile.proto), gzip-compressed when built with
+ * zlib (SPPROF_HAS_ZLIB) and raw protobuf otherwise.
+ *
+ * Samples are merged per (thread, stack) with values [samples/count,
+ * cpu/nanoseconds] and thread_id / thread_name labels. Native frames keep
+ * their PC and point at a mapping taken from the modules loaded at the
+ * time of the call, so pprof can symbolize them against the binaries.
+ *
+ * @param fd Destination file descriptor (not closed).
+ * @param cols Validated columns.
+ * @param interval_ms Sampling interval; also the CPU time charged per unit
+ *                    of weight to samples without a measurement.
+ * @param time_nanos Profile start, nanoseconds since the Unix epoch.
+ * @param duration_nanos Profile duration in nanoseconds.
+ * @param compressed Receives 1 if the output is gzip, 0 if raw.
+ * @return 0 on success, -1 on error.
+ */
+int output_write_pprof(int fd, const ProfileColumns* cols, double interval_ms,
+                       int64_t time_nanos, int64_t duration_nanos, int* compressed);
+
+/**
+ * Write a Perfetto trace (perfetto.protos.Trace, uncompressed) with one
+ * track per thread under a process track.
+ *
+ * Each thread becomes its own packet sequence with interned slice names.
+ * Its samples are replayed in time order as nested slices: frames shared
+ * with the previous sample stay open, so consecutive identical stacks
+ * merge into one slice per frame. A thread's slices are closed one
+ * interval after its last sample, or before a gap of more than two
+ * intervals with no samples.
+ *
+ * @param fd Destination file descriptor (not closed).
+ * @param cols Validated columns.
+ * @param interval_ms Sampling interval.
+ * @param pid Process id recorded in the track descriptors.
+ * @param process_name Process track name (NUL-terminated UTF-8).
+ * @param timestamp_offset_ns Added to every sample timestamp, e.g. to move
+ *                            CLOCK_MONOTONIC onto the trace clock
+ *                            (CLOCK_BOOTTIME).
+ * @return 0 on success, -1 on error.
+ */
+int output_write_perfetto(int fd, const ProfileColumns* cols, double interval_ms,
+                          uint64_t pid, const char* process_name,
+                          int64_t timestamp_offset_ns);
+
+/**
+ * Write samples as `perf script` text plus a companion perf map.
+ *
+ * Each sample is a "comm pid/tid secs.usecs: period cpu-clock:" header
+ * followed by its mixed callchain, leaf first, as "\taddr symbol (dso)"
+ * lines and a blank line. Samples are in timestamp order, and the period is
+ * weight * interval in nanoseconds. Native frames keep their PC, symbol and
+ * library. Each Python (function, file) pair gets a synthetic address
+ * range and the symbol "py::function:file", as CPython's perf trampoline
+ * names them. Those ranges are listed in the perf map ("START SIZE symbol"
+ * lines) and use map_name as their dso.
+ *
+ * @param fd Destination of the script text (not closed).
+ * @param map_fd Destination of the perf map (not closed).
+ * @param cols Validated columns.
+ * @param interval_ms Sampling interval.
+ * @param pid Process id printed on every sample.
+ * @param comm Command name printed on every sample (NUL-terminated UTF-8).
+ * @param map_name Dso printed for Python frames, normally
+ *                 "/tmp/perf-<pid>.map" (NUL-terminated UTF-8).
+ * @return 0 on success, -1 on error.
+ */
+int output_write_perf_script(int fd, int map_fd, const ProfileColumns* cols,
+                             double interval_ms, uint64_t pid, const char* comm,
+                             const char* map_name);
+
+#endif /* SPPROF_OUTPUT_WRITER_H */
@@ -60,9 +60,7 @@
 #include "../error.h"
 
 /* Internal API for Python frame capture */
-#ifdef SPPROF_USE_INTERNAL_API
 #include "../internal/pycore_tstate.h"
-#endif
 
 /* Architecture-specific includes */
 #if defined(__x86_64__)
@@ -699,6 +697,10 @@ static int write_mixed_sample_to_ringbuffer(
     sample.thread_id = thread_id;
     sample.depth = python_depth;
     sample.native_depth = native_stack ? native_stack->depth : 0;
+    sample.weight = 1;
+    sample.cpu_time_ns = SPPROF_CPU_TIME_UNKNOWN;
+    /* Frames are held from capture on, so a later generation is still exact */
+    sample.code_generation = code_registry_generation();
     
     /* Copy Python frame data */
     for (int i = 0; i < python_depth && i < SPPROF_MAX_STACK_DEPTH; i++) {
@@ -744,6 +746,8 @@ static int write_native_sample_to_ringbuffer(const CapturedStack* stack,
     sample.timestamp = stack->timestamp;
     sample.thread_id = stack->thread_id;
     sample.depth = stack->depth;
+    sample.weight = 1;
+    sample.cpu_time_ns = SPPROF_CPU_TIME_UNKNOWN;
     
     /* Copy native instruction pointers - mark with high bit for native frames */
     for (int i = 0; i < stack->depth && i < SPPROF_MAX_STACK_DEPTH; i++) {
@@ -917,7 +921,6 @@ static void sample_all_threads(ThreadSnapshot* snapshot, MachSamplerState* state
         uintptr_t instr_ptrs[SPPROF_MAX_STACK_DEPTH];
         int python_depth = 0;
         
-#ifdef SPPROF_USE_INTERNAL_API
         /* Capture Python frames from the suspended thread's state.
          * This is safe because the target thread is suspended. */
         python_depth = _spprof_capture_frames_with_instr_from_tstate(
@@ -949,7 +952,6 @@ static void sample_all_threads(ThreadSnapshot* snapshot, MachSamplerState* state
             uint64_t gc_epoch = code_registry_get_gc_epoch();
             code_registry_add_refs_batch(python_frames, python_depth, gc_epoch);
         }
-#endif
         
         /* ================================================================
          * Resume thread IMMEDIATELY after capture and INCREF
@@ -12,6 +12,8 @@
  *   - Timer overrun tracking for profiling accuracy assessment
  *   - Race-free shutdown with signal blocking
  *   - Pause/resume support without timer recreation
+ *   - Optional overhead budget controller that stretches timer intervals
+ *   - High-frequency mode: sub-millisecond sampling of a single thread
  *
  * Copyright (c) 2024 spprof contributors
  * SPDX-License-Identifier: MIT
@@ -54,6 +56,15 @@ extern RingBuffer* g_ringbuffer;
 #define SPPROF_SIGNAL SIGPROF
 #endif
 
+/* How often the overhead budget controller re-evaluates the interval */
+#define SPPROF_CONTROLLER_PERIOD_NS 100000000ULL  /* 100ms */
+
+/* Samples a controller window must contain before overhead is judged */
+#define SPPROF_CONTROLLER_MIN_SAMPLES 8
+
+/* Upper bound on interval stretching (1ms base -> 1s at most) */
+#define SPPROF_MAX_INTERVAL_SCALE 1000U
+
 /*
  * =============================================================================
  * Thread Timer Registry (uthash-based)
@@ -110,14 +121,19 @@ static pthread_rwlock_t g_registry_lock = PTHREAD_RWLOCK_INITIALIZER;
  * =============================================================================
  */
 
-/* Timer state */
+/* Timer state.
+ * timer_t is an opaque handle: glibc hands back the kernel timer id cast to
+ * a pointer, so the first timer of a process is NULL. Liveness is tracked
+ * separately instead of comparing the handle against NULL. */
 static timer_t g_main_timer = NULL;
+static int g_main_timer_active = 0;
+static pid_t g_main_tid = 0;
 static int g_platform_initialized = 0;
-static uint64_t g_interval_ns = 0;
+/* Written by the budget controller thread, read from the caller's */
+static _Atomic uint64_t g_interval_ns = 0;
 
-/* Pause state */
-static int g_paused = 0;
-static uint64_t g_saved_interval_ns = 0;
+/* Pause state; changes under g_controller_lock */
+static _Atomic int g_paused = 0;
 
 /* Statistics (atomic for signal-safe reads) */
 static _Atomic uint64_t g_total_overruns = 0;
@@ -132,6 +148,25 @@ static _Atomic int g_using_wall_time = 0;
 static __thread timer_t tl_timer_id = NULL;
 static __thread int tl_timer_active = 0;
 
+/* High-frequency mode: requested for the next timer, and currently running */
+static int g_high_frequency = 0;
+static int g_high_frequency_active = 0;
+
+/* pthread_atfork handlers are registered once per process */
+static int g_atfork_registered = 0;
+static __thread sigset_t tl_fork_saved_mask;
+
+/* Overhead budget controller state */
+static double g_overhead_budget = 0.0;          /* Fraction of process CPU, 0 = off */
+static uint64_t g_base_interval_ns = 0;         /* Interval requested by the user */
+static _Atomic uint32_t g_interval_scale = 1;   /* Current interval multiplier */
+static pthread_t g_controller_thread;
+static int g_controller_running = 0;
+static int g_controller_stop = 0;
+/* Serializes interval changes: scale updates, pause and resume */
+static pthread_mutex_t g_controller_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_controller_cond = PTHREAD_COND_INITIALIZER;
+
 /*
  * =============================================================================
  * Registry Management Functions
@@ -188,13 +223,11 @@ static void registry_cleanup(void) {
     ThreadTimerEntry *entry, *tmp;
     HASH_ITER(hh, g_thread_registry, entry, tmp) {
         /* Capture final overrun count before deletion */
-        if (entry->timer_id != NULL) {
-            int overrun = timer_getoverrun(entry->timer_id);
-            if (overrun > 0) {
-                atomic_fetch_add(&g_total_overruns, (uint64_t)overrun);
-            }
-            timer_delete(entry->timer_id);
+        int overrun = timer_getoverrun(entry->timer_id);
+        if (overrun > 0) {
+            atomic_fetch_add(&g_total_overruns, (uint64_t)overrun);
         }
+        timer_delete(entry->timer_id);
         HASH_DEL(g_thread_registry, entry);
         free(entry);
     }
@@ -222,9 +255,10 @@ static void registry_cleanup(void) {
  *
  * @param tid Thread ID (from gettid())
  * @param timer_id POSIX timer handle from timer_create()
+ * @param active 1 if the timer is armed, 0 if it waits for resume
  * @return 0 on success, -1 on error (ENOMEM or duplicate TID)
  */
-static int registry_add_thread(pid_t tid, timer_t timer_id) {
+static int registry_add_thread(pid_t tid, timer_t timer_id, int active) {
     SPPROF_ASSERT_NOT_IN_SIGNAL("registry_add_thread");
     
     ThreadTimerEntry* entry = malloc(sizeof(ThreadTimerEntry));
@@ -236,7 +270,7 @@ static int registry_add_thread(pid_t tid, timer_t timer_id) {
     entry->tid = tid;
     entry->timer_id = timer_id;
     entry->overruns = 0;
-    entry->active = 1;
+    entry->active = active;
     
     pthread_rwlock_wrlock(&g_registry_lock);
     
@@ -302,13 +336,11 @@ static int registry_remove_thread(pid_t tid) {
     
     if (entry) {
         /* Capture final overrun count before deletion */
-        if (entry->timer_id != NULL) {
-            int overrun = timer_getoverrun(entry->timer_id);
-            if (overrun > 0) {
-                atomic_fetch_add(&g_total_overruns, (uint64_t)overrun);
-            }
-            timer_delete(entry->timer_id);
+        int overrun = timer_getoverrun(entry->timer_id);
+        if (overrun > 0) {
+            atomic_fetch_add(&g_total_overruns, (uint64_t)overrun);
         }
+        timer_delete(entry->timer_id);
         free(entry);
         return 0;
     }
@@ -397,7 +429,7 @@ static int registry_pause_all(void) {
     pthread_rwlock_wrlock(&g_registry_lock);
     ThreadTimerEntry *entry, *tmp;
     HASH_ITER(hh, g_thread_registry, entry, tmp) {
-        if (entry->active && entry->timer_id != NULL) {
+        if (entry->active) {
             timer_settime(entry->timer_id, 0, &zero, NULL);
             entry->active = 0;
         }
@@ -410,7 +442,7 @@ static int registry_pause_all(void) {
 /**
  * Resume all paused thread timers.
  *
- * Restores saved interval to all paused timers.
+ * Arms all paused timers with interval_ns.
  * Thread-safe (acquires write lock).
  *
  * SIGNAL SAFETY: NOT async-signal-safe. Uses pthread_rwlock.
@@ -429,7 +461,7 @@ static int registry_resume_all(uint64_t interval_ns) {
     pthread_rwlock_wrlock(&g_registry_lock);
     ThreadTimerEntry *entry, *tmp;
     HASH_ITER(hh, g_thread_registry, entry, tmp) {
-        if (!entry->active && entry->timer_id != NULL) {
+        if (!entry->active) {
             timer_settime(entry->timer_id, 0, &its, NULL);
             entry->active = 1;
         }
@@ -439,6 +471,298 @@ static int registry_resume_all(uint64_t interval_ns) {
     return 0;
 }
 
+/**
+ * Re-arm all running thread timers with a new interval.
+ *
+ * Paused timers are left alone; they pick up the interval on resume.
+ * Thread-safe (acquires read lock; entries are not modified).
+ *
+ * SIGNAL SAFETY: NOT async-signal-safe. Uses pthread_rwlock.
+ *
+ * @param interval_ns Interval to set (nanoseconds)
+ */
+static void registry_set_interval_all(uint64_t interval_ns) {
+    SPPROF_ASSERT_NOT_IN_SIGNAL("registry_set_interval_all");
+    
+    struct itimerspec its;
+    its.it_value.tv_sec = (time_t)(interval_ns / 1000000000ULL);
+    its.it_value.tv_nsec = (long)(interval_ns % 1000000000ULL);
+    its.it_interval = its.it_value;
+    
+    pthread_rwlock_rdlock(&g_registry_lock);
+    ThreadTimerEntry *entry, *tmp;
+    HASH_ITER(hh, g_thread_registry, entry, tmp) {
+        if (entry->active) {
+            timer_settime(entry->timer_id, 0, &its, NULL);
+        }
+    }
+    pthread_rwlock_unlock(&g_registry_lock);
+}
+
+/*
+ * =============================================================================
+ * Overhead Budget Controller
+ * =============================================================================
+ *
+ * When a budget is set, a background thread compares the time spent inside
+ * the signal handler with the CPU time consumed by the whole process every
+ * SPPROF_CONTROLLER_PERIOD_NS. If the ratio exceeds the budget, all timer
+ * intervals are stretched by an integer scale; once overhead falls well
+ * below the budget the scale is relaxed again. Windows are extended until
+ * they hold SPPROF_CONTROLLER_MIN_SAMPLES handler calls, so a long interval
+ * is not mistaken for zero overhead.
+ *
+ * Each sample's weight is multiplied by the current scale, so weighted
+ * totals keep estimating CPU time while fewer samples are taken.
+ */
+
+/**
+ * Get CPU time consumed by the whole process.
+ *
+ * @return Process CPU time in nanoseconds, or 0 on error
+ */
+static uint64_t process_cpu_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) < 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Compute the next interval scale from the measured overhead.
+ *
+ * Over budget, the scale grows in proportion to the excess (at least by 1).
+ * Below half the budget, it shrinks towards 75% of the budget (at least by 1).
+ * In between, the scale is left alone to avoid oscillation.
+ *
+ * @param scale Current interval scale
+ * @param overhead Measured handler time / process CPU time
+ * @param budget Target overhead fraction
+ * @return New interval scale in [1, SPPROF_MAX_INTERVAL_SCALE]
+ */
+static uint32_t controller_next_scale(uint32_t scale, double overhead,
+                                      double budget) {
+    if (overhead > budget) {
+        double target = (double)scale * overhead / budget;
+        if (target >= (double)SPPROF_MAX_INTERVAL_SCALE) {
+            return SPPROF_MAX_INTERVAL_SCALE;
+        }
+        /* Truncation + 1 rounds up and guarantees progress */
+        return (uint32_t)target + 1;
+    }
+    
+    if (scale > 1 && overhead < 0.5 * budget) {
+        uint32_t next = (uint32_t)((double)scale * overhead / (0.75 * budget));
+        if (next < 1) {
+            next = 1;
+        }
+        if (next >= scale) {
+            next = scale - 1;
+        }
+        return next;
+    }
+    
+    return scale;
+}
+
+/**
+ * Switch all timers to base interval * scale.
+ *
+ * Caller holds g_controller_lock, so sampling is not paused.
+ *
+ * @param scale New interval scale
+ */
+static void controller_apply_scale(uint32_t scale) {
+    uint64_t interval_ns = g_base_interval_ns * scale;
+    
+    atomic_store(&g_interval_scale, scale);
+    signal_handler_set_weight_scale(scale);
+    atomic_store(&g_interval_ns, interval_ns);
+    registry_set_interval_all(interval_ns);
+}
+
+static void* controller_main(void* arg) {
+    (void)arg;
+    
+    /* This thread has no timer, but keep profiling signals away anyway */
+    sigset_t block_set;
+    sigemptyset(&block_set);
+    sigaddset(&block_set, SPPROF_SIGNAL);
+    pthread_sigmask(SIG_BLOCK, &block_set, NULL);
+    
+    uint64_t last_handler_ns = signal_handler_handler_ns();
+    uint64_t last_calls = signal_handler_handler_calls();
+    uint64_t last_cpu_ns = process_cpu_ns();
+    
+    pthread_mutex_lock(&g_controller_lock);
+    while (!g_controller_stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t nsec = (uint64_t)deadline.tv_nsec + SPPROF_CONTROLLER_PERIOD_NS;
+        deadline.tv_sec += (time_t)(nsec / 1000000000ULL);
+        deadline.tv_nsec = (long)(nsec % 1000000000ULL);
+        
+        pthread_cond_timedwait(&g_controller_cond, &g_controller_lock, &deadline);
+        if (g_controller_stop) {
+            break;
+        }
+        
+        /* Sampling is paused: discard the window, it says nothing */
+        if (atomic_load(&g_paused)) {
+            last_handler_ns = signal_handler_handler_ns();
+            last_calls = signal_handler_handler_calls();
+            last_cpu_ns = process_cpu_ns();
+            continue;
+        }
+        
+        /* Keep extending the window until it holds enough samples */
+        uint64_t calls = signal_handler_handler_calls();
+        if (calls - last_calls < SPPROF_CONTROLLER_MIN_SAMPLES) {
+            continue;
+        }
+        
+        uint64_t handler_ns = signal_handler_handler_ns();
+        uint64_t cpu_ns = process_cpu_ns();
+        uint64_t d_handler = handler_ns - last_handler_ns;
+        uint64_t d_cpu = cpu_ns - last_cpu_ns;
+        last_handler_ns = handler_ns;
+        last_calls = calls;
+        last_cpu_ns = cpu_ns;
+        
+        if (d_cpu == 0) {
+            continue;
+        }
+        
+        double overhead = (double)d_handler / (double)d_cpu;
+        uint32_t scale = atomic_load(&g_interval_scale);
+        uint32_t next = controller_next_scale(scale, overhead, g_overhead_budget);
+        if (next != scale) {
+            controller_apply_scale(next);
+        }
+    }
+    pthread_mutex_unlock(&g_controller_lock);
+    
+    return NULL;
+}
+
+/**
+ * Start the controller thread.
+ *
+ * @return 0 on success, -1 on error
+ */
+static int controller_start(void) {
+    if (g_controller_running) {
+        return 0;
+    }
+    
+    g_controller_stop = 0;
+    if (pthread_create(&g_controller_thread, NULL, controller_main, NULL) != 0) {
+        return -1;
+    }
+    g_controller_running = 1;
+    return 0;
+}
+
+/**
+ * Stop the controller thread and wait for it to exit.
+ */
+static void controller_stop(void) {
+    if (!g_controller_running) {
+        return;
+    }
+    
+    pthread_mutex_lock(&g_controller_lock);
+    g_controller_stop = 1;
+    pthread_cond_signal(&g_controller_cond);
+    pthread_mutex_unlock(&g_controller_lock);
+    
+    pthread_join(g_controller_thread, NULL);
+    g_controller_running = 0;
+}
+
+int platform_set_overhead_budget(double fraction) {
+    if (!(fraction >= 0.0 && fraction <= 1.0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    g_overhead_budget = fraction;
+    return 0;
+}
+
+uint32_t platform_get_interval_scale(void) {
+    return atomic_load(&g_interval_scale);
+}
+
+int platform_set_high_frequency(int enabled) {
+    g_high_frequency = enabled ? 1 : 0;
+    return 0;
+}
+
+/*
+ * =============================================================================
+ * Fork Handling
+ * =============================================================================
+ *
+ * POSIX timers are not inherited by fork(), and the child runs only the
+ * forking thread. The child handler forgets the parent's timers, registry
+ * entries and controller thread, so the child looks like a process whose
+ * timers were never created. Sampling is re-armed later, from Python's
+ * after-fork hook (module.c _after_fork_child()), once the interpreter is
+ * usable again. A fork() followed by exec() never gets that far.
+ */
+
+/**
+ * Before fork(): hold SIGPROF and the registry still.
+ *
+ * The write lock keeps the registry consistent for the child to walk.
+ */
+static void atfork_prepare(void) {
+    sigset_t block_set;
+    sigemptyset(&block_set);
+    sigaddset(&block_set, SPPROF_SIGNAL);
+    pthread_sigmask(SIG_BLOCK, &block_set, &tl_fork_saved_mask);
+    pthread_rwlock_wrlock(&g_registry_lock);
+}
+
+/**
+ * After fork(), in the parent: undo atfork_prepare().
+ */
+static void atfork_parent(void) {
+    pthread_rwlock_unlock(&g_registry_lock);
+    pthread_sigmask(SIG_SETMASK, &tl_fork_saved_mask, NULL);
+}
+
+/**
+ * After fork(), in the child: drop timer state that refers to the parent.
+ *
+ * Entries are freed without timer_delete(): their timers belong to the
+ * parent. Locks are re-initialized since their owners were not copied.
+ */
+static void atfork_child(void) {
+    ThreadTimerEntry *entry, *tmp;
+    HASH_ITER(hh, g_thread_registry, entry, tmp) {
+        HASH_DEL(g_thread_registry, entry);
+        free(entry);
+    }
+    g_thread_registry = NULL;
+    pthread_rwlock_init(&g_registry_lock, NULL);
+    
+    g_main_timer = NULL;
+    g_main_timer_active = 0;
+    g_main_tid = 0;
+    tl_timer_id = NULL;
+    tl_timer_active = 0;
+    atomic_store(&g_paused, 0);
+    
+    g_controller_running = 0;
+    g_controller_stop = 0;
+    pthread_mutex_init(&g_controller_lock, NULL);
+    pthread_cond_init(&g_controller_cond, NULL);
+    
+    pthread_sigmask(SIG_SETMASK, &tl_fork_saved_mask, NULL);
+}
+
 /*
  * =============================================================================
  * Platform Initialization
@@ -453,9 +777,16 @@ int platform_init(void) {
     /* Initialize thread timer registry */
     registry_init();
     
+    /* Cannot be undone, so only once even across platform_cleanup() */
+    if (!g_atfork_registered) {
+        if (pthread_atfork(atfork_prepare, atfork_parent, atfork_child) != 0) {
+            return -1;
+        }
+        g_atfork_registered = 1;
+    }
+    
     /* Reset pause state */
-    g_paused = 0;
-    g_saved_interval_ns = 0;
+    atomic_store(&g_paused, 0);
     
     g_platform_initialized = 1;
     return 0;
@@ -487,15 +818,35 @@ int platform_timer_create(uint64_t interval_ns) {
         return -1;
     }
     
-    g_interval_ns = interval_ns;
+    atomic_store(&g_interval_ns, interval_ns);
+    g_base_interval_ns = interval_ns;
+    atomic_store(&g_interval_scale, 1);
+    signal_handler_set_weight_scale(1);
     
     /* Install signal handler first */
     if (signal_handler_install(SPPROF_SIGNAL) < 0) {
         return -1;
     }
     
+    /*
+     * High-frequency mode: CPU-clock timers are checked on scheduler ticks
+     * (1-10ms), so they cannot fire at sub-millisecond intervals. Use a
+     * high-resolution CLOCK_MONOTONIC timer on this thread only and let the
+     * per-sample CPU deltas tell on-CPU time from waiting.
+     */
+    if (g_high_frequency) {
+        size_t capacity = g_ringbuffer ? ringbuffer_capacity(g_ringbuffer) : 0;
+        if (capacity == 0 || signal_handler_hf_enable(capacity) < 0) {
+            signal_handler_uninstall(SPPROF_SIGNAL);
+            return -1;
+        }
+        g_high_frequency_active = 1;
+    }
+    
     /* Start accepting samples */
+    signal_handler_set_interval(interval_ns);
     signal_handler_start();
+    signal_handler_thread_baseline();
     
     /* Create timer for main thread */
     pid_t tid = (pid_t)syscall(SYS_gettid);
@@ -523,7 +874,12 @@ int platform_timer_create(uint64_t interval_ns) {
      */
     int timer_created = 0;
     
-    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &g_main_timer) == 0) {
+    if (g_high_frequency_active) {
+        if (timer_create(CLOCK_MONOTONIC, &sev, &g_main_timer) == 0) {
+            timer_created = 1;
+            atomic_store(&g_using_wall_time, 1);
+        }
+    } else if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &g_main_timer) == 0) {
         timer_created = 1;
         atomic_store(&g_using_wall_time, 0);
     } else {
@@ -537,6 +893,8 @@ int platform_timer_create(uint64_t interval_ns) {
     if (!timer_created) {
         atomic_fetch_add(&g_timer_create_failures, 1);
         signal_handler_stop();
+        signal_handler_hf_disable();
+        g_high_frequency_active = 0;
         signal_handler_uninstall(SPPROF_SIGNAL);
         return -1;
     }
@@ -551,12 +909,21 @@ int platform_timer_create(uint64_t interval_ns) {
         timer_delete(g_main_timer);
         g_main_timer = NULL;
         signal_handler_stop();
+        signal_handler_hf_disable();
+        g_high_frequency_active = 0;
         signal_handler_uninstall(SPPROF_SIGNAL);
         return -1;
     }
+    g_main_timer_active = 1;
+    g_main_tid = tid;
     
     /* Track main thread timer in registry */
-    registry_add_thread(tid, g_main_timer);
+    registry_add_thread(tid, g_main_timer, 1);
+    
+    if (g_overhead_budget > 0.0) {
+        /* Sampling still works without the controller, just unthrottled */
+        controller_start();
+    }
     
     return 0;
 }
@@ -569,26 +936,36 @@ int platform_timer_destroy(void) {
     sigaddset(&block_set, SPPROF_SIGNAL);
     pthread_sigmask(SIG_BLOCK, &block_set, &old_set);
     
+    /* No interval changes while timers are torn down */
+    controller_stop();
+    atomic_store(&g_paused, 0);
+    
     /* Stop accepting samples */
     signal_handler_stop();
     
-    /* Capture final overrun count from main timer */
-    if (g_main_timer != NULL) {
-        int overrun = timer_getoverrun(g_main_timer);
-        if (overrun > 0) {
-            atomic_fetch_add(&g_total_overruns, (uint64_t)overrun);
+    /* Delete main timer. Its registry entry shares the handle, so removing
+     * the entry deletes the timer and captures the final overrun count. */
+    if (g_main_timer_active) {
+        if (registry_remove_thread(g_main_tid) < 0) {
+            int overrun = timer_getoverrun(g_main_timer);
+            if (overrun > 0) {
+                atomic_fetch_add(&g_total_overruns, (uint64_t)overrun);
+            }
+            timer_delete(g_main_timer);
         }
-        timer_delete(g_main_timer);
         g_main_timer = NULL;
+        g_main_timer_active = 0;
     }
     
     /* Delete thread-local timer if any */
-    if (tl_timer_active && tl_timer_id != NULL) {
-        int overrun = timer_getoverrun(tl_timer_id);
-        if (overrun > 0) {
-            atomic_fetch_add(&g_total_overruns, (uint64_t)overrun);
+    if (tl_timer_active) {
+        if (registry_remove_thread((pid_t)syscall(SYS_gettid)) < 0) {
+            int overrun = timer_getoverrun(tl_timer_id);
+            if (overrun > 0) {
+                atomic_fetch_add(&g_total_overruns, (uint64_t)overrun);
+            }
+            timer_delete(tl_timer_id);
         }
-        timer_delete(tl_timer_id);
         tl_timer_id = NULL;
         tl_timer_active = 0;
     }
@@ -600,6 +977,12 @@ int platform_timer_destroy(void) {
         /* Discard pending SIGPROF */
     }
     
+    /* No more high-frequency samples can arrive: hand them to the resolver */
+    if (g_high_frequency_active) {
+        signal_handler_hf_disable();
+        g_high_frequency_active = 0;
+    }
+    
     /* Restore original signal mask */
     pthread_sigmask(SIG_SETMASK, &old_set, NULL);
     
@@ -619,25 +1002,22 @@ int platform_timer_destroy(void) {
  * Pause all profiling timers.
  *
  * Disarms timers by setting zero interval. Timers remain allocated.
+ * Holds g_controller_lock so the budget controller cannot rescale
+ * timers halfway through.
  *
  * @return 0 on success, -1 on error
  */
 int platform_timer_pause(void) {
-    if (g_paused || g_main_timer == NULL) {
+    pthread_mutex_lock(&g_controller_lock);
+    if (atomic_load(&g_paused) || !g_main_timer_active) {
+        pthread_mutex_unlock(&g_controller_lock);
         return 0;  /* Already paused or no timer */
     }
     
-    /* Save current interval */
-    struct itimerspec current;
-    if (timer_gettime(g_main_timer, &current) < 0) {
-        return -1;
-    }
-    g_saved_interval_ns = (uint64_t)current.it_interval.tv_sec * 1000000000ULL 
-                        + (uint64_t)current.it_interval.tv_nsec;
-    
     /* Disarm main timer */
     struct itimerspec zero = {0};
     if (timer_settime(g_main_timer, 0, &zero, NULL) < 0) {
+        pthread_mutex_unlock(&g_controller_lock);
         return -1;
     }
     
@@ -646,40 +1026,47 @@ int platform_timer_pause(void) {
     
     /* Stop accepting samples */
     signal_handler_stop();
-    g_paused = 1;
+    atomic_store(&g_paused, 1);
     
+    pthread_mutex_unlock(&g_controller_lock);
     return 0;
 }
 
 /**
  * Resume all paused profiling timers.
  *
- * Restores saved interval to all timers.
+ * Re-arms every timer with the current interval (base interval times the
+ * controller's scale).
  *
  * @return 0 on success, -1 on error
  */
 int platform_timer_resume(void) {
-    if (!g_paused || g_main_timer == NULL) {
+    pthread_mutex_lock(&g_controller_lock);
+    if (!atomic_load(&g_paused) || !g_main_timer_active) {
+        pthread_mutex_unlock(&g_controller_lock);
         return 0;  /* Not paused or no timer */
     }
     
-    /* Start accepting samples */
-    signal_handler_start();
+    /* Accept samples again (statistics carry over from before the pause) */
+    signal_handler_resume();
     
     /* Restore main timer interval */
+    uint64_t interval_ns = atomic_load(&g_interval_ns);
     struct itimerspec its;
-    its.it_value.tv_sec = (time_t)(g_saved_interval_ns / 1000000000ULL);
-    its.it_value.tv_nsec = (long)(g_saved_interval_ns % 1000000000ULL);
+    its.it_value.tv_sec = (time_t)(interval_ns / 1000000000ULL);
+    its.it_value.tv_nsec = (long)(interval_ns % 1000000000ULL);
     its.it_interval = its.it_value;
     
     if (timer_settime(g_main_timer, 0, &its, NULL) < 0) {
+        pthread_mutex_unlock(&g_controller_lock);
         return -1;
     }
     
     /* Resume all registered thread timers */
-    registry_resume_all(g_saved_interval_ns);
+    registry_resume_all(interval_ns);
     
-    g_paused = 0;
+    atomic_store(&g_paused, 0);
+    pthread_mutex_unlock(&g_controller_lock);
     return 0;
 }
 
@@ -702,6 +1089,12 @@ int platform_register_thread(uint64_t interval_ns) {
         return 0;  /* Already registered */
     }
     
+    /* High-frequency mode samples exactly one thread */
+    if (g_high_frequency_active) {
+        errno = EBUSY;
+        return -1;
+    }
+    
     pid_t tid = (pid_t)syscall(SYS_gettid);
     
     /* Check if already in registry (e.g., re-registration) */
@@ -749,25 +1142,38 @@ int platform_register_thread(uint64_t interval_ns) {
         return -1;
     }
     
-    /* Configure and start timer */
-    struct itimerspec its;
-    its.it_value.tv_sec = (time_t)(interval_ns / 1000000000ULL);
-    its.it_value.tv_nsec = (long)(interval_ns % 1000000000ULL);
-    its.it_interval = its.it_value;
-    
-    if (timer_settime(timer_id, 0, &its, NULL) < 0) {
-        timer_delete(timer_id);
-        return -1;
+    /* Pause, resume and rescaling wait until the entry is in the registry */
+    pthread_mutex_lock(&g_controller_lock);
+    int paused = atomic_load(&g_paused);
+    
+    /* Configure and start timer (stretched if the controller is throttling).
+     * While paused it stays disarmed; platform_timer_resume() arms it. */
+    if (!paused) {
+        interval_ns *= atomic_load(&g_interval_scale);
+        struct itimerspec its;
+        its.it_value.tv_sec = (time_t)(interval_ns / 1000000000ULL);
+        its.it_value.tv_nsec = (long)(interval_ns % 1000000000ULL);
+        its.it_interval = its.it_value;
+        
+        if (timer_settime(timer_id, 0, &its, NULL) < 0) {
+            pthread_mutex_unlock(&g_controller_lock);
+            timer_delete(timer_id);
+            return -1;
+        }
     }
     
     /* Update TLS (fast path) */
     tl_timer_id = timer_id;
     tl_timer_active = 1;
     
+    /* CPU deltas of this thread's samples start from now */
+    signal_handler_thread_baseline();
+    
     /* Update registry (management path) */
-    if (registry_add_thread(tid, timer_id) < 0) {
+    if (registry_add_thread(tid, timer_id, !paused) < 0) {
         /* Registry add failed (e.g., duplicate) - still continue with TLS */
     }
+    pthread_mutex_unlock(&g_controller_lock);
     
     return 0;
 }
@@ -908,13 +1314,14 @@ int platform_is_using_wall_time(void) {
 void platform_debug_info(void) {
     SPPROF_ASSERT_NOT_IN_SIGNAL("platform_debug_info");
     
+    uint64_t interval_ns = atomic_load(&g_interval_ns);
     fprintf(stderr, "[spprof] Linux Platform Info:\n");
     fprintf(stderr, "  Initialized: %d\n", g_platform_initialized);
     fprintf(stderr, "  Main timer: %p\n", (void*)g_main_timer);
     fprintf(stderr, "  Interval: %llu ns (%.2f ms)\n", 
-            (unsigned long long)g_interval_ns,
-            (double)g_interval_ns / 1000000.0);
-    fprintf(stderr, "  Paused: %d\n", g_paused);
+            (unsigned long long)interval_ns,
+            (double)interval_ns / 1000000.0);
+    fprintf(stderr, "  Paused: %d\n", atomic_load(&g_paused));
     fprintf(stderr, "  Signal: %d (SIGPROF=%d)\n", SPPROF_SIGNAL, SIGPROF);
     
     pthread_rwlock_rdlock(&g_registry_lock);
@@ -100,7 +100,8 @@ int platform_timer_destroy(void);
 /**
  * Pause all profiling timers.
  *
- * Disarms timers by setting zero interval. Timers remain allocated.
+ * Disarms timers by setting zero interval. Timers remain allocated and
+ * statistics are kept for platform_timer_resume().
  * On platforms that don't support this, returns 0 (no-op).
  *
  * @return 0 on success, -1 on error
@@ -235,6 +236,38 @@ void platform_get_extended_stats(
     uint64_t* registered_threads
 );
 
+/**
+ * Set the sampling overhead budget for the next platform_timer_create().
+ *
+ * When non-zero, a controller thread stretches all timer intervals so the
+ * time spent in the signal handler stays below this fraction of process
+ * CPU time. Sample weights are scaled to match.
+ *
+ * @param fraction Budget in [0, 1]; 0 disables the controller
+ * @return 0 on success, -1 on error (EINVAL)
+ */
+int platform_set_overhead_budget(double fraction);
+
+/**
+ * Get the current interval multiplier applied by the overhead controller.
+ *
+ * @return Interval scale (1 when not throttling)
+ */
+uint32_t platform_get_interval_scale(void);
+
+/**
+ * Select high-frequency mode for the next platform_timer_create().
+ *
+ * In high-frequency mode only the calling thread is sampled, with a
+ * high-resolution wall-clock timer that supports sub-millisecond intervals
+ * (down to SPPROF_HF_MIN_INTERVAL_NS). platform_register_thread() fails
+ * while it is active.
+ *
+ * @param enabled 1 to enable, 0 to disable
+ * @return 0 on success
+ */
+int platform_set_high_frequency(int enabled);
+
 #endif /* SPPROF_PLATFORM_LINUX */
 
 /*
@@ -33,6 +33,7 @@
 
 #include "platform.h"
 #include "../ringbuffer.h"
+#include "../code_registry.h"
 #include "../framewalker.h"
 #include "../unwind.h"
 
@@ -535,6 +536,9 @@ static void CALLBACK timer_callback(PVOID param, BOOLEAN timer_fired) {
         memset(&sample, 0, sizeof(sample));
         sample.timestamp = timestamp;
         sample.thread_id = (uint64_t)tstate->thread_id;
+        sample.weight = 1;
+        sample.cpu_time_ns = SPPROF_CPU_TIME_UNKNOWN;
+        sample.code_generation = code_registry_generation();
         
         /* Adjust timestamp with thread CPU time if enabled */
         if (g_use_cpu_time) {
@@ -767,13 +771,52 @@ int platform_timer_destroy(void) {
     return 0;
 }
 
+/*
+ * Timer-queue timers cannot be disarmed in place, so pausing pushes the
+ * next expiry out as far as possible and resume restores the interval.
+ */
+#define SPPROF_TIMER_PARKED_MS 0xFFFFFFFEUL
+
 int platform_timer_pause(void) {
-    /* Windows: Not implemented - return success (no-op) */
+    AcquireSRWLockExclusive(&g_timer_lock);
+    
+    /* Callbacks already queued exit early once sampling is inactive */
+    InterlockedExchange(&g_sampling_active, 0);
+    
+    if (g_timer != NULL &&
+        !ChangeTimerQueueTimer(g_timer_queue, g_timer,
+                               SPPROF_TIMER_PARKED_MS, SPPROF_TIMER_PARKED_MS)) {
+        ReleaseSRWLockExclusive(&g_timer_lock);
+        SPPROF_LOG_ERROR("Failed to pause timer: %lu", GetLastError());
+        return -1;
+    }
+    
+    ReleaseSRWLockExclusive(&g_timer_lock);
     return 0;
 }
 
 int platform_timer_resume(void) {
-    /* Windows: Not implemented - return success (no-op) */
+    AcquireSRWLockExclusive(&g_timer_lock);
+    
+    if (g_timer == NULL) {
+        ReleaseSRWLockExclusive(&g_timer_lock);
+        return 0;
+    }
+    
+    DWORD interval_ms = (DWORD)(g_interval_ns / 1000000);
+    if (interval_ms < 1) {
+        interval_ms = 1;
+    }
+    
+    InterlockedExchange(&g_sampling_active, 1);
+    if (!ChangeTimerQueueTimer(g_timer_queue, g_timer, interval_ms, interval_ms)) {
+        InterlockedExchange(&g_sampling_active, 0);
+        ReleaseSRWLockExclusive(&g_timer_lock);
+        SPPROF_LOG_ERROR("Failed to resume timer: %lu", GetLastError());
+        return -1;
+    }
+    
+    ReleaseSRWLockExclusive(&g_timer_lock);
     return 0;
 }
 
@@ -983,6 +1026,18 @@ uint64_t signal_handler_errors(void) {
     return 0;  /* No error tracking on Windows yet */
 }
 
+uint64_t signal_handler_timer_overruns(void) {
+    return 0;  /* Timer queue callbacks don't report overruns */
+}
+
+uint64_t signal_handler_handler_ns(void) {
+    return 0;  /* Handler cost is not measured on Windows yet */
+}
+
+uint64_t signal_handler_handler_calls(void) {
+    return 0;
+}
+
 void signal_handler_start(void) {
     InterlockedExchange(&g_sampling_active, 1);
 }
@@ -1012,6 +1067,12 @@ int signal_handler_in_context(void) {
     return 0;
 }
 
+int signal_handler_set_label_var(PyObject* var) {
+    (void)var;
+    /* The sampler thread cannot see other threads' labels; samples record 0 */
+    return 0;
+}
+
 /*
  * =============================================================================
  * Debug Support
@@ -1056,4 +1117,16 @@ uint64_t signal_handler_validation_drops(void) {
     return 0;
 }
 
+/**
+ * Check for high-frequency samples outside the ring buffer.
+ * Windows has no high-frequency mode, so nothing is ever buffered.
+ */
+int signal_handler_hf_buffering(void) {
+    return 0;
+}
+
+size_t signal_handler_hf_flush(void) {
+    return 0;
+}
+
 #endif /* _WIN32 */
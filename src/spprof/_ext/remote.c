@@ -0,0 +1,351 @@
+/**
+ * remote.c - Read another CPython process's stacks (attach mode)
+ *
+ * See remote.h for the model. Each sample costs one process_vm_readv()
+ * for the runtime, one per thread state (plus one for its _PyCFrame on
+ * 3.11/3.12) and one per frame. Code objects are read once per address
+ * by remote_code_info() and cached by the caller.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#define _GNU_SOURCE 1
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <errno.h>
+#include <string.h>
+
+#include "remote.h"
+
+#if defined(__linux__) && PY_VERSION_HEX >= 0x030B0000
+#define SPPROF_REMOTE_SUPPORTED 1
+#endif
+
+#ifdef SPPROF_REMOTE_SUPPORTED
+
+#include <dlfcn.h>
+#include <sys/uio.h>
+
+#include "internal/pycore_frame.h"
+#include "internal/pycore_tstate.h"
+
+/*
+ * =============================================================================
+ * Layout
+ * =============================================================================
+ */
+
+/* How far into _PyRuntimeState / PyInterpreterState the list heads are looked for */
+#define REMOTE_SCAN_BYTES (64 * 1024)
+
+/* Longest name or filename read from the target, in code points */
+#define REMOTE_MAX_STR 4096
+
+/* Largest line table read from the target */
+#define REMOTE_MAX_LINETABLE (1 << 20)
+
+static int g_layout_ready = 0;
+static size_t g_main_interp_offset = 0;   /* _PyRuntimeState -> main interpreter */
+static size_t g_threads_head_offset = 0;  /* PyInterpreterState -> first thread */
+
+/**
+ * Offset of the first pointer-aligned word in [base, base + limit) equal to
+ * value, or -1.
+ */
+static Py_ssize_t find_word(const void* base, size_t limit, const void* value) {
+    const uintptr_t* words = (const uintptr_t*)base;
+    for (size_t i = 0; i < limit / sizeof(uintptr_t); i++) {
+        if (words[i] == (uintptr_t)value) {
+            return (Py_ssize_t)(i * sizeof(uintptr_t));
+        }
+    }
+    return -1;
+}
+
+int remote_init(void) {
+    if (g_layout_ready) {
+        return 0;
+    }
+
+    const char* runtime = (const char*)dlsym(RTLD_DEFAULT, "_PyRuntime");
+    PyInterpreterState* main_interp = PyInterpreterState_Main();
+    PyThreadState* head = main_interp ? PyInterpreterState_ThreadHead(main_interp) : NULL;
+    if (runtime == NULL || head == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    /* struct pyinterpreters is { mutex, head, main, ... }. With no
+     * subinterpreters here, head and main both hold the main interpreter:
+     * prefer main, which stays put when the target creates more. */
+    Py_ssize_t interp = find_word(runtime, REMOTE_SCAN_BYTES, main_interp);
+    if (interp < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    const uintptr_t* next_word = (const uintptr_t*)(runtime + interp) + 1;
+    if (*next_word == (uintptr_t)main_interp) {
+        interp += (Py_ssize_t)sizeof(uintptr_t);
+    }
+
+    /* struct pythreads starts with the list head */
+    Py_ssize_t threads = find_word(main_interp, REMOTE_SCAN_BYTES, head);
+    if (threads < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    g_main_interp_offset = (size_t)interp;
+    g_threads_head_offset = (size_t)threads;
+    g_layout_ready = 1;
+    return 0;
+}
+
+/*
+ * =============================================================================
+ * Reading
+ * =============================================================================
+ */
+
+int remote_read(int pid, uintptr_t addr, void* buf, size_t size) {
+    struct iovec local = { buf, size };
+    struct iovec remote = { (void*)addr, size };
+    ssize_t got = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+    if (got < 0) {
+        return -1;
+    }
+    if ((size_t)got != size) {
+        errno = EFAULT;
+        return -1;
+    }
+    return 0;
+}
+
+static int read_ptr(int pid, uintptr_t addr, uintptr_t* out) {
+    return remote_read(pid, addr, out, sizeof(*out));
+}
+
+/* User-space, 8-byte aligned: anything else is a torn or stale pointer */
+static int remote_ptr_ok(uintptr_t addr) {
+    return addr >= 0x10000 && addr < ((uintptr_t)1 << 56) && (addr & 0x7) == 0;
+}
+
+static uintptr_t current_frame(int pid, const PyThreadState* ts) {
+#if SPPROF_PY311 || SPPROF_PY312
+    _spprof_CFrame cframe;
+    if (!remote_ptr_ok((uintptr_t)ts->cframe) ||
+        remote_read(pid, (uintptr_t)ts->cframe, &cframe, sizeof(cframe)) < 0) {
+        return 0;
+    }
+    return (uintptr_t)cframe.current_frame;
+#else
+    (void)pid;
+    return (uintptr_t)ts->current_frame;
+#endif
+}
+
+/**
+ * Walk one thread's frame chain into stack.
+ *
+ * @return 0 on success (stack->depth may be 0), -1 if the chain was torn.
+ */
+static int walk_frames(int pid, uintptr_t frame, RemoteStack* stack) {
+    stack->depth = 0;
+    for (int walked = 0; frame != 0; walked++) {
+        if (walked >= SPPROF_FRAME_WALK_LIMIT || !remote_ptr_ok(frame)) {
+            return -1;
+        }
+        _spprof_InterpreterFrame f;
+        if (remote_read(pid, frame, &f, sizeof(f)) < 0) {
+            return -1;
+        }
+        if (f.owner != SPPROF_FRAME_OWNED_BY_CSTACK && stack->depth < SPPROF_MAX_STACK_DEPTH) {
+#if SPPROF_PY314
+            uintptr_t code = (uintptr_t)(f.f_executable.bits & ~SPPROF_STACKREF_TAG_MASK);
+#elif SPPROF_PY313
+            uintptr_t code = (uintptr_t)f.f_executable;
+#else
+            uintptr_t code = (uintptr_t)f.f_code;
+#endif
+            /* Not type-checked here: remote_code_info() rejects non-code */
+            if (remote_ptr_ok(code)) {
+                uintptr_t instr = (uintptr_t)_spprof_frame_get_instr_ptr(&f);
+                uintptr_t start = code + offsetof(PyCodeObject, co_code_adaptive);
+                stack->code[stack->depth] = code;
+                stack->offset[stack->depth] = instr >= start ? (int64_t)(instr - start) : -1;
+                stack->depth++;
+            }
+        }
+        frame = (uintptr_t)f.previous;
+    }
+    return 0;
+}
+
+int remote_sample(int pid, uintptr_t runtime, RemoteStack* stacks, int max_stacks) {
+    if (!g_layout_ready) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    uintptr_t interp;
+    if (read_ptr(pid, runtime + g_main_interp_offset, &interp) < 0) {
+        return -1;
+    }
+    if (!remote_ptr_ok(interp)) {
+        return 0;  /* Not initialized yet, or finalizing */
+    }
+
+    uintptr_t tstate;
+    if (read_ptr(pid, interp + g_threads_head_offset, &tstate) < 0) {
+        return -1;
+    }
+
+    int count = 0;
+    for (int i = 0; tstate != 0 && i < SPPROF_THREAD_WALK_LIMIT && count < max_stacks; i++) {
+        PyThreadState ts;
+        if (!remote_ptr_ok(tstate) || remote_read(pid, tstate, &ts, sizeof(ts)) < 0) {
+            break;  /* Torn list: keep the threads read so far */
+        }
+        RemoteStack* stack = &stacks[count];
+        stack->thread_id = (uint64_t)ts.thread_id;
+        stack->native_thread_id = (uint64_t)ts.native_thread_id;
+        uintptr_t frame = current_frame(pid, &ts);
+        if (frame != 0 && walk_frames(pid, frame, stack) == 0 && stack->depth > 0) {
+            count++;
+        }
+        tstate = (uintptr_t)ts.next;
+    }
+    return count;
+}
+
+/*
+ * =============================================================================
+ * Code Objects
+ * =============================================================================
+ */
+
+/**
+ * Read a compact str of the target. New reference, or NULL without an
+ * exception if it cannot be read.
+ */
+static PyObject* read_str(int pid, uintptr_t addr) {
+    PyCompactUnicodeObject u;
+    if (!remote_ptr_ok(addr) || remote_read(pid, addr, &u, sizeof(PyASCIIObject)) < 0) {
+        return NULL;
+    }
+    if (!u._base.state.compact || u._base.length < 0 || u._base.length > REMOTE_MAX_STR) {
+        return NULL;
+    }
+    unsigned int kind = u._base.state.kind;
+    if (kind != 1 && kind != 2 && kind != 4) {
+        return NULL;
+    }
+    uintptr_t data = addr + (u._base.state.ascii ? sizeof(PyASCIIObject)
+                                                 : sizeof(PyCompactUnicodeObject));
+    size_t size = (size_t)u._base.length * kind;
+    char buf[REMOTE_MAX_STR * 4];
+    if (size > 0 && remote_read(pid, data, buf, size) < 0) {
+        return NULL;
+    }
+    PyObject* str = PyUnicode_FromKindAndData((int)kind, buf, u._base.length);
+    if (str == NULL) {
+        PyErr_Clear();
+    }
+    return str;
+}
+
+/**
+ * Read a bytes object of the target. New reference, or NULL without an
+ * exception if it cannot be read.
+ */
+static PyObject* read_bytes(int pid, uintptr_t addr) {
+    PyVarObject header;
+    if (!remote_ptr_ok(addr) || remote_read(pid, addr, &header, sizeof(header)) < 0) {
+        return NULL;
+    }
+    if (header.ob_size < 0 || header.ob_size > REMOTE_MAX_LINETABLE) {
+        return NULL;
+    }
+    PyObject* bytes = PyBytes_FromStringAndSize(NULL, header.ob_size);
+    if (bytes == NULL) {
+        PyErr_Clear();
+        return NULL;
+    }
+    if (header.ob_size > 0 &&
+        remote_read(pid, addr + offsetof(PyBytesObject, ob_sval),
+                    PyBytes_AS_STRING(bytes), (size_t)header.ob_size) < 0) {
+        Py_DECREF(bytes);
+        return NULL;
+    }
+    return bytes;
+}
+
+PyObject* remote_code_info(int pid, uintptr_t code_type, uintptr_t code_addr) {
+    if (!g_layout_ready) {
+        PyErr_SetString(PyExc_RuntimeError, "Remote layout not initialized");
+        return NULL;
+    }
+
+    /* Everything before the bytecode */
+    PyCodeObject code;
+    if (remote_read(pid, code_addr, &code, offsetof(PyCodeObject, co_code_adaptive)) < 0) {
+        if (errno == EFAULT) {
+            Py_RETURN_NONE;  /* Freed and unmapped since the sample */
+        }
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    PyCodeObject* co = &code;
+    if ((uintptr_t)Py_TYPE(co) != code_type || Py_SIZE(co) < 0) {
+        Py_RETURN_NONE;
+    }
+
+    PyObject* name = read_str(pid, (uintptr_t)co->co_name);
+    PyObject* filename = read_str(pid, (uintptr_t)co->co_filename);
+    PyObject* linetable = read_bytes(pid, (uintptr_t)co->co_linetable);
+    if (name == NULL || filename == NULL || linetable == NULL) {
+        Py_XDECREF(name);
+        Py_XDECREF(filename);
+        Py_XDECREF(linetable);
+        Py_RETURN_NONE;
+    }
+    return Py_BuildValue(
+        "(NNiNn)", name, filename, co->co_firstlineno, linetable,
+        Py_SIZE(co) * (Py_ssize_t)sizeof(_Py_CODEUNIT)
+    );
+}
+
+#else /* !SPPROF_REMOTE_SUPPORTED */
+
+int remote_init(void) {
+    errno = ENOSYS;
+    return -1;
+}
+
+int remote_read(int pid, uintptr_t addr, void* buf, size_t size) {
+    (void)pid;
+    (void)addr;
+    (void)buf;
+    (void)size;
+    errno = ENOSYS;
+    return -1;
+}
+
+int remote_sample(int pid, uintptr_t runtime, RemoteStack* stacks, int max_stacks) {
+    (void)pid;
+    (void)runtime;
+    (void)stacks;
+    (void)max_stacks;
+    errno = ENOSYS;
+    return -1;
+}
+
+PyObject* remote_code_info(int pid, uintptr_t code_type, uintptr_t code_addr) {
+    (void)pid;
+    (void)code_type;
+    (void)code_addr;
+    errno = ENOSYS;
+    return PyErr_SetFromErrno(PyExc_OSError);
+}
+
+#endif /* SPPROF_REMOTE_SUPPORTED */
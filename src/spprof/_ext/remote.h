@@ -0,0 +1,109 @@
+/**
+ * remote.h - Read another CPython process's stacks (attach mode)
+ *
+ * Samples a running interpreter from outside with process_vm_readv(): no
+ * code is injected and the target pays nothing. Starting from the
+ * target's _PyRuntime, the reader follows interpreters, thread states and
+ * _PyInterpreterFrame chains using the same struct layouts the in-process
+ * sampler uses (internal/pycore_frame.h) and the public PyThreadState and
+ * PyCodeObject definitions.
+ *
+ * LAYOUT:
+ *   Layouts are this interpreter's, so the target must run the same
+ *   CPython minor version (and build flavour). Offsets of the
+ *   interpreter list head in _PyRuntimeState and of the thread list head
+ *   in PyInterpreterState are not public; remote_init() finds them by
+ *   scanning this process's own runtime for the pointers the public API
+ *   returns.
+ *
+ * CONSISTENCY:
+ *   The target keeps running while we read, so a stack may be torn.
+ *   Only the main interpreter's threads are sampled.
+ *   Frames are range-checked, code objects are type-checked against the
+ *   target's PyCode_Type, and walks are bounded by
+ *   SPPROF_FRAME_WALK_LIMIT. A thread whose walk fails is left out of
+ *   that sample.
+ *
+ * PLATFORM SUPPORT:
+ *   Linux with Python 3.11+. Elsewhere every call fails with ENOSYS.
+ *   Reading needs ptrace access to the target (same user and
+ *   kernel.yama.ptrace_scope <= 1 with a parent relationship, or
+ *   CAP_SYS_PTRACE), the same as py-spy.
+ *
+ * ERROR HANDLING:
+ *   POSIX-style (Pattern 1): 0 or a count on success, -1 with errno set.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPPROF_REMOTE_H
+#define SPPROF_REMOTE_H
+
+#include <Python.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ringbuffer.h"
+
+/* Most threads reported per remote sample */
+#define SPPROF_REMOTE_MAX_THREADS 256
+
+/**
+ * RemoteStack - One thread's stack in the target, leaf first
+ */
+typedef struct {
+    uint64_t thread_id;         /* threading.get_ident() in the target */
+    uint64_t native_thread_id;  /* Kernel TID */
+    int depth;
+    uintptr_t code[SPPROF_MAX_STACK_DEPTH];   /* Target PyCodeObject addresses */
+    int64_t offset[SPPROF_MAX_STACK_DEPTH];   /* Bytecode offset, -1 if unknown */
+} RemoteStack;
+
+/**
+ * Learn the runtime layout from this interpreter.
+ *
+ * Idempotent. Requires the GIL.
+ *
+ * @return 0 on success, -1 (errno ENOSYS or ENOENT) if unsupported.
+ */
+int remote_init(void);
+
+/**
+ * Copy size bytes at addr in pid into buf.
+ *
+ * @return 0 on success, -1 on a short or failed read (errno set;
+ *         EPERM without ptrace access, ESRCH if pid is gone).
+ */
+int remote_read(int pid, uintptr_t addr, void* buf, size_t size);
+
+/**
+ * Take one sample of every thread of pid's main interpreter.
+ *
+ * Does not require the GIL.
+ *
+ * @param pid        Target process.
+ * @param runtime    Address of _PyRuntime in the target.
+ * @param stacks     Receives up to max_stacks stacks.
+ * @param max_stacks Capacity of stacks.
+ * @return Number of stacks filled, or -1 if the runtime itself could not
+ *         be read (errno set).
+ */
+int remote_sample(int pid, uintptr_t runtime, RemoteStack* stacks, int max_stacks);
+
+/**
+ * Read a code object of the target.
+ *
+ * Requires the GIL (builds Python objects).
+ *
+ * @param pid       Target process.
+ * @param code_type Address of PyCode_Type in the target.
+ * @param code_addr Address from RemoteStack.code.
+ * @return New tuple (name, filename, firstlineno, linetable, code_size)
+ *         where code_size is the bytecode length in bytes; Py_None if
+ *         the address no longer holds a code object; NULL with an
+ *         exception set if the target could not be read.
+ */
+PyObject* remote_code_info(int pid, uintptr_t code_type, uintptr_t code_addr);
+
+#endif /* SPPROF_REMOTE_H */
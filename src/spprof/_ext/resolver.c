@@ -15,6 +15,14 @@
  *   2. Include native frames until we hit the Python interpreter
  *   3. Insert the Python stack at that point
  *   4. Optionally continue with remaining native frames (main/entry)
+ *
+ * PARALLEL RESOLUTION:
+ * Samples are resolved in batches. Each Python frame is first mapped to a
+ * code id (code_cache.h) with a lock-free lookup; only code objects not
+ * yet cached are read, with the GIL held, one at a time. Building the
+ * frames from the ids (names, line table decoding, dladdr) touches no
+ * Python object, so it is spread over a small pool of worker threads
+ * with the GIL released.
  */
 
 #define PY_SSIZE_T_CLEAN
@@ -22,15 +30,19 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stddef.h>
 
 /* Platform-specific includes for native symbol resolution */
 #if defined(__APPLE__) || defined(__linux__)
 #define SPPROF_HAS_DLADDR 1
+#define SPPROF_HAS_WORKERS 1
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE 1
 #endif
 #include <dlfcn.h>
 #include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
 #endif
 
 #ifdef _WIN32
@@ -38,7 +50,10 @@
 #endif
 
 #include "resolver.h"
+#include "code_cache.h"
 #include "code_registry.h"
+#include "native_symbols.h"
+#include "signal_handler.h"
 #include "error.h"
 
 /*
@@ -56,99 +71,18 @@ typedef union {
 } _Py_CODEUNIT;
 #endif
 
-/*
- * =============================================================================
- * Symbol Resolution Cache (4-Way Set-Associative with Pseudo-LRU)
- * =============================================================================
- *
- * Design rationale:
- * - Direct-mapped cache has high collision rate due to pointer alignment
- *   (PyCodeObject* are typically 8-16 byte aligned, wasting lower hash bits)
- * - 4-way set-associative reduces collision eviction by 4x
- * - Pseudo-LRU (tree-based) provides near-optimal eviction with minimal overhead
- * - Better hash function uses middle bits and multiplicative mixing
- *
- * Memory layout:
- * - 1024 sets × 4 ways = 4096 total entries (same as before)
- * - Each set has 3-bit LRU state for tree-based pseudo-LRU
- */
-#define CACHE_WAYS 4
-#define CACHE_SETS 1024
-#define CACHE_SET_MASK (CACHE_SETS - 1)
-
-/* Forward declarations */
-static int resolve_code_object_with_instr(uintptr_t code_addr, uintptr_t instr_ptr, ResolvedFrame* out);
-
-typedef struct {
-    uintptr_t key;
-    ResolvedFrame value;
-    int valid;
-} CacheEntry;
-
-typedef struct {
-    CacheEntry ways[CACHE_WAYS];
-    uint8_t lru_bits;  /* 3 bits for tree-based pseudo-LRU */
-} CacheSet;
+/* Destroyed-code snapshots kept before the resolver drops them when idle */
+#define RETIRED_RELEASE_THRESHOLD 1024
 
-/*
- * Hash function for code object pointers.
- * Uses multiplicative hashing with golden ratio prime to spread aligned pointers.
- * Combines middle bits (more entropy than low bits for aligned pointers).
- */
-static inline size_t cache_hash(uintptr_t addr) {
-    /* Golden ratio prime for good distribution */
-    const uintptr_t GOLDEN_RATIO = 0x9E3779B97F4A7C15ULL;
-    
-    /* Multiplicative hash - spreads aligned addresses across all buckets */
-    uintptr_t h = addr * GOLDEN_RATIO;
-    
-    /* Use upper bits (better mixed by multiplication) */
-    return (size_t)((h >> 32) ^ h) & CACHE_SET_MASK;
-}
+/* Raw samples read from the ring buffer per resolution batch */
+#define RESOLVE_BATCH 256
 
-/*
- * Pseudo-LRU using a binary tree:
- *
- *        [bit 0]
- *        /     \
- *    [bit 1]  [bit 2]
- *     /  \     /  \
- *   W0   W1  W2   W3
- *
- * Bit meaning: 0 = go left, 1 = go right (for eviction victim selection)
- * On access: set bits to point AWAY from accessed way
- */
+/* Samples a worker claims at a time */
+#define WORKER_CHUNK 4
 
-/* Get the eviction victim based on LRU bits */
-static inline int lru_get_victim(uint8_t lru_bits) {
-    if ((lru_bits & 0x1) == 0) {
-        /* Go left */
-        return ((lru_bits & 0x2) == 0) ? 0 : 1;
-    } else {
-        /* Go right */
-        return ((lru_bits & 0x4) == 0) ? 2 : 3;
-    }
-}
-
-/* Update LRU bits after accessing a way */
-static inline uint8_t lru_update_access(uint8_t lru_bits, int way) {
-    switch (way) {
-        case 0:
-            /* Accessed W0: point away (bit0=1, bit1=1) */
-            return (uint8_t)((lru_bits | 0x1) | 0x2);
-        case 1:
-            /* Accessed W1: point away (bit0=1, bit1=0) */
-            return (uint8_t)((lru_bits | 0x1) & ~0x2);
-        case 2:
-            /* Accessed W2: point away (bit0=0, bit2=1) */
-            return (uint8_t)((lru_bits & ~0x1) | 0x4);
-        case 3:
-            /* Accessed W3: point away (bit0=0, bit2=0) */
-            return (uint8_t)((lru_bits & ~0x1) & ~0x4);
-        default:
-            return lru_bits;
-    }
-}
+/* Forward declarations */
+static void build_python_frame(uintptr_t code_addr, uintptr_t instr_ptr, uint32_t id,
+                               ResolvedFrame* out);
 
 /*
  * =============================================================================
@@ -251,8 +185,9 @@ static int is_python_interpreter_library(const char* lib_path) {
 }
 
 /**
- * Resolve a native PC address to symbol information via dladdr.
+ * Resolve a native PC address to symbol information.
  *
+ * Tries the symbol cache index (native_symbols.h) first, then dladdr.
  * Safe to call after thread_resume() - this is the whole point of
  * deferring symbol resolution to the resolver.
  *
@@ -263,6 +198,7 @@ static int is_python_interpreter_library(const char* lib_path) {
  */
 static int resolve_native_frame(uintptr_t pc, ResolvedFrame* out, int* is_interpreter) {
     Dl_info info;
+    NativeSymbol symbol;
     
     memset(out, 0, sizeof(*out));
     out->is_native = 1;
@@ -282,6 +218,17 @@ static int resolve_native_frame(uintptr_t pc, ResolvedFrame* out, int* is_interp
     pc = pc & 0x0000007FFFFFFFFFULL;
 #endif
     
+    out->address = pc;
+
+    if (native_symbols_lookup(pc, &symbol)) {
+        snprintf(out->function_name, SPPROF_MAX_FUNC_NAME, "%s", symbol.name);
+        snprintf(out->filename, SPPROF_MAX_FILENAME, "%s", symbol.path);
+        if (is_interpreter) {
+            *is_interpreter = symbol.is_interpreter;
+        }
+        return 1;
+    }
+
     if (dladdr((void*)pc, &info) == 0) {
         /* dladdr failed - format as hex address */
         snprintf(out->function_name, SPPROF_MAX_FUNC_NAME, "0x%lx", (unsigned long)pc);
@@ -332,6 +279,7 @@ static int resolve_native_frame(uintptr_t pc, ResolvedFrame* out, int* is_interp
     memset(out, 0, sizeof(*out));
     out->is_native = 1;
     out->lineno = 0;
+    out->address = pc;
     snprintf(out->function_name, SPPROF_MAX_FUNC_NAME, "0x%lx", (unsigned long)pc);
     if (is_interpreter) {
         *is_interpreter = 0;
@@ -357,13 +305,30 @@ static int resolve_native_frame(uintptr_t pc, ResolvedFrame* out, int* is_interp
  *   5. Optionally add remaining native frames (main/entry points)
  */
 
+/* Append the resolvable Python frames; returns the new output count */
+static int append_python_frames(const uintptr_t* python_frames, const uintptr_t* instr_ptrs,
+                                const uint32_t* code_ids, int python_depth,
+                                ResolvedFrame* out_frames, int out_idx, int max_frames) {
+    for (int j = 0; j < python_depth && out_idx < max_frames; j++) {
+        if (code_ids[j] != CODE_ID_NONE) {
+            build_python_frame(python_frames[j], instr_ptrs ? instr_ptrs[j] : 0,
+                               code_ids[j], &out_frames[out_idx]);
+            out_idx++;
+        }
+    }
+    return out_idx;
+}
+
 /**
  * Merge native and Python frames using the "Trim & Sandwich" algorithm.
  *
+ * Touches no Python object: the Python frames come from the code cache.
+ *
  * @param native_pcs Array of native PC addresses (leaf first).
  * @param native_depth Number of native frames.
  * @param python_frames Array of Python code object pointers (leaf first).
  * @param instr_ptrs Array of instruction pointers for Python line numbers.
+ * @param code_ids Code id of each Python frame, CODE_ID_NONE if invalid.
  * @param python_depth Number of Python frames.
  * @param out_frames Output array for merged frames.
  * @param max_frames Maximum frames to output.
@@ -374,6 +339,7 @@ static int merge_native_and_python_frames(
     int native_depth,
     const uintptr_t* python_frames,
     const uintptr_t* instr_ptrs,
+    const uint32_t* code_ids,
     int python_depth,
     ResolvedFrame* out_frames,
     int max_frames
@@ -395,14 +361,8 @@ static int merge_native_and_python_frames(
     
     /* If no native frames, just resolve Python frames */
     if (native_depth == 0) {
-        for (int i = 0; i < python_depth && out_idx < max_frames; i++) {
-            if (resolve_code_object_with_instr(python_frames[i], 
-                                               instr_ptrs ? instr_ptrs[i] : 0,
-                                               &out_frames[out_idx])) {
-                out_idx++;
-            }
-        }
-        return out_idx;
+        return append_python_frames(python_frames, instr_ptrs, code_ids, python_depth,
+                                    out_frames, out_idx, max_frames);
     }
     
     /* If no Python frames, just resolve native frames */
@@ -428,13 +388,8 @@ static int merge_native_and_python_frames(
         
         if (is_interp && !python_inserted) {
             /* We hit the interpreter - INSERT PYTHON STACK HERE */
-            for (int j = 0; j < python_depth && out_idx < max_frames; j++) {
-                if (resolve_code_object_with_instr(python_frames[j],
-                                                   instr_ptrs ? instr_ptrs[j] : 0,
-                                                   &out_frames[out_idx])) {
-                    out_idx++;
-                }
-            }
+            out_idx = append_python_frames(python_frames, instr_ptrs, code_ids, python_depth,
+                                           out_frames, out_idx, max_frames);
             python_inserted = 1;
             
             /* Skip interpreter frames - we've replaced them with Python frames */
@@ -449,13 +404,8 @@ static int merge_native_and_python_frames(
     
     /* If we never hit interpreter frames, append Python stack at the end */
     if (!python_inserted) {
-        for (int j = 0; j < python_depth && out_idx < max_frames; j++) {
-            if (resolve_code_object_with_instr(python_frames[j],
-                                               instr_ptrs ? instr_ptrs[j] : 0,
-                                               &out_frames[out_idx])) {
-                out_idx++;
-            }
-        }
+        out_idx = append_python_frames(python_frames, instr_ptrs, code_ids, python_depth,
+                                       out_frames, out_idx, max_frames);
     }
     
     return out_idx;
@@ -466,135 +416,202 @@ static RingBuffer* g_ringbuffer = NULL;
 static ResolvedSample* g_samples = NULL;
 static size_t g_sample_count = 0;
 static size_t g_sample_capacity = 0;
-static CacheSet g_cache[CACHE_SETS];
 static uint64_t g_cache_hits = 0;
 static uint64_t g_cache_misses = 0;
-static uint64_t g_cache_collisions = 0;  /* Track collision evictions */
 static uint64_t g_invalid_frames = 0;
+static int g_active_drains = 0;  /* Ring buffer reads in progress (under the resolver lock) */
+static int g_worker_setting = 0; /* resolver_set_workers(); 0 = one per CPU */
 static int g_initialized = 0;
 
 /*
- * Cache synchronization for thread safety.
- *
- * The symbol resolution cache is protected by a mutex to allow safe concurrent
- * access from multiple threads calling resolver_drain_samples() or
- * resolver_resolve_frame(). While the resolver was originally designed as
- * single-consumer, the streaming API (_drain_buffer) may be called from
- * multiple Python threads concurrently.
+ * Resolver state synchronization.
  *
- * The mutex protects:
- *   - g_cache array (read/write of cache entries and LRU bits)
- *   - g_cache_hits, g_cache_misses, g_cache_collisions counters
+ * The code id cache has its own per-shard locks and lock-free readers
+ * (see code_cache.h). This mutex only protects bookkeeping shared by
+ * concurrent drains and by the worker threads:
+ *   - g_cache_hits, g_cache_misses counters (workers add their totals
+ *     once per batch)
  *   - g_invalid_frames counter
+ *   - g_active_drains
  *
  * Note: The GIL is NOT sufficient protection because:
  *   1. Python releases the GIL during I/O and can yield mid-drain
  *   2. Multiple threads could call _drain_buffer() concurrently
- *   3. Future optimizations might add parallelism within the resolver
+ *   3. Worker threads resolve batches with the GIL released
  */
 #if defined(__APPLE__) || defined(__linux__)
-static pthread_mutex_t g_cache_lock = PTHREAD_MUTEX_INITIALIZER;
-#define CACHE_LOCK()   pthread_mutex_lock(&g_cache_lock)
-#define CACHE_UNLOCK() pthread_mutex_unlock(&g_cache_lock)
+static pthread_mutex_t g_resolver_lock = PTHREAD_MUTEX_INITIALIZER;
+#define RESOLVER_LOCK()   pthread_mutex_lock(&g_resolver_lock)
+#define RESOLVER_UNLOCK() pthread_mutex_unlock(&g_resolver_lock)
 #elif defined(_WIN32)
-static CRITICAL_SECTION g_cache_lock;
-static int g_cache_lock_initialized = 0;
-#define CACHE_LOCK()   EnterCriticalSection(&g_cache_lock)
-#define CACHE_UNLOCK() LeaveCriticalSection(&g_cache_lock)
+static CRITICAL_SECTION g_resolver_lock;
+static int g_resolver_lock_initialized = 0;
+#define RESOLVER_LOCK()   EnterCriticalSection(&g_resolver_lock)
+#define RESOLVER_UNLOCK() LeaveCriticalSection(&g_resolver_lock)
 #else
 /* Fallback: no locking (single-threaded only) */
-#define CACHE_LOCK()   ((void)0)
-#define CACHE_UNLOCK() ((void)0)
+#define RESOLVER_LOCK()   ((void)0)
+#define RESOLVER_UNLOCK() ((void)0)
 #endif
 
+/* Add a batch's counters to the totals */
+static void add_stats(uint64_t hits, uint64_t misses, uint64_t invalid) {
+    if (hits == 0 && misses == 0 && invalid == 0) {
+        return;
+    }
+    RESOLVER_LOCK();
+    g_cache_hits += hits;
+    g_cache_misses += misses;
+    g_invalid_frames += invalid;
+    RESOLVER_UNLOCK();
+}
+
+/*
+ * =============================================================================
+ * Frame Building (no GIL)
+ * =============================================================================
+ */
+
 /**
- * Compute line number from instruction pointer.
+ * Byte offset of instr_ptr into the bytecode of a code object.
  *
- * Uses Python's internal line number table to map bytecode offset to line.
- * Requires the GIL to be held.
+ * Computed from addresses alone, so it also works for a code object that
+ * has since been destroyed.
  *
- * On Windows:
- *   - If instr_ptr contains a line number directly (>0 and < 1M), use it
- *   - Otherwise fall back to co_firstlineno
- *   - The Windows platform now captures line numbers via PyFrame_GetLineNumber()
- *     and stores them in the instr_ptrs array
- *
- * On POSIX with Python 3.11+:
- *   - Use PyCode_Addr2Line for accurate line number from instruction pointer
+ * @param code_addr  Address of the code object.
+ * @param code_units Its bytecode length (Py_SIZE) in code units.
+ * @param instr_ptr  Captured instruction pointer.
+ * @return Offset in bytes, or -1 if instr_ptr is outside the bytecode.
  */
-static int compute_lineno_from_instr(PyCodeObject* co, uintptr_t instr_ptr) {
-    if (co == NULL) {
-        return 0;
+static int bytecode_offset(uintptr_t code_addr, Py_ssize_t code_units, uintptr_t instr_ptr) {
+#if PY_VERSION_HEX >= 0x030B0000 && !defined(_WIN32)
+    /* The sampler records pointers into the live (adaptive) bytecode, not
+     * into the copy PyCode_GetCode() returns. _PyCode_CODE() is internal
+     * on 3.13+, so locate the bytecode by its public field. */
+    uintptr_t code_start = code_addr + offsetof(PyCodeObject, co_code_adaptive);
+    uintptr_t code_end = code_start + (uintptr_t)code_units * sizeof(_Py_CODEUNIT);
+    if (instr_ptr < code_start || instr_ptr >= code_end) {
+        return -1;
     }
-    
+    return (int)(instr_ptr - code_start);
+#else
+    (void)code_addr;
+    (void)code_units;
+    (void)instr_ptr;
+    return -1;
+#endif
+}
+
+int resolver_code_offset(uintptr_t code_addr, uintptr_t instr_ptr) {
+    return bytecode_offset(code_addr, Py_SIZE((PyCodeObject*)code_addr), instr_ptr);
+}
+
+/**
+ * Line number of a sampled instruction.
+ *
+ * On Windows, instr_ptr holds the line number itself (captured via
+ * PyFrame_GetLineNumber() in windows.c); actual instruction pointers
+ * would be far larger than 1,000,000. Before 3.11 only the first line
+ * is known. On 3.11+ the offset is looked up in the copied location
+ * table, which needs neither the GIL nor the code object.
+ */
+static int code_info_line(uintptr_t code_addr, uintptr_t instr_ptr, const CodeInfo* info) {
     if (instr_ptr == 0) {
-        return co->co_firstlineno;
+        return info->firstlineno;
     }
-
 #if defined(_WIN32)
-    /* On Windows, instr_ptr contains the line number directly (captured via
-     * PyFrame_GetLineNumber in windows.c). We detect this by checking if it's
-     * a reasonable line number (< 1,000,000). Actual instruction pointers would
-     * be much larger memory addresses. */
-    if (instr_ptr > 0 && instr_ptr < 1000000) {
+    (void)code_addr;
+    if (instr_ptr < 1000000) {
         return (int)instr_ptr;
     }
-    return co->co_firstlineno;
+    return info->firstlineno;
 #elif PY_VERSION_HEX < 0x030B0000
-    /* Python < 3.11: Use first line number */
-    return co->co_firstlineno;
+    (void)code_addr;
+    return info->firstlineno;
 #else
-    /* Python 3.11+ on POSIX: Use PyCode_Addr2Line if available */
-    /* Calculate byte offset from code start */
-    /* PyCode_GetCode returns a NEW REFERENCE - must decref! */
-    PyObject* code_bytes = PyCode_GetCode((PyCodeObject*)co);
-    if (code_bytes == NULL) {
-        return co->co_firstlineno;
-    }
-    
-    _Py_CODEUNIT* code_start = (_Py_CODEUNIT*)PyBytes_AS_STRING(code_bytes);
-    if (code_start == NULL) {
-        Py_DECREF(code_bytes);
-        return co->co_firstlineno;
+    int byte_offset = bytecode_offset(code_addr, info->code_units, instr_ptr);
+    if (byte_offset < 0) {
+        return info->firstlineno;
     }
+    return code_linetable_line(info->linetable, info->linetable_len, info->firstlineno,
+                               byte_offset);
+#endif
+}
 
-    /* Compute offset in code units (2 bytes each) */
-    Py_ssize_t offset = ((_Py_CODEUNIT*)instr_ptr - code_start);
-    if (offset < 0) {
-        Py_DECREF(code_bytes);
-        return co->co_firstlineno;
+/* Copy a string of known length into a fixed buffer, truncating */
+static void copy_bounded(const char* src, size_t len, char* out, size_t size) {
+    if (len > size - 1) {
+        len = size - 1;
     }
+    memcpy(out, src, len);
+    out[len] = '\0';
+}
 
-    /* Convert code unit offset to byte offset */
-    int byte_offset = (int)((size_t)offset * sizeof(_Py_CODEUNIT));
+/**
+ * Fill a Python frame from the cached info of its code object.
+ *
+ * @param code_addr Captured PyCodeObject* pointer (only used as a number).
+ * @param instr_ptr Captured instruction pointer, 0 if none.
+ * @param id        Code id from the code cache.
+ * @param out       Receives the frame.
+ */
+static void build_python_frame(uintptr_t code_addr, uintptr_t instr_ptr, uint32_t id,
+                               ResolvedFrame* out) {
+    const CodeInfo* info = code_cache_info(id);
+    copy_bounded(info->function_name, info->function_name_len, out->function_name,
+                 SPPROF_MAX_FUNC_NAME);
+    copy_bounded(info->filename, info->filename_len, out->filename, SPPROF_MAX_FILENAME);
+    out->lineno = code_info_line(code_addr, instr_ptr, info);
+    out->is_native = 0;
+    out->address = 0;
+}
 
-    /* Use the address-to-line API */
-    int lineno = PyCode_Addr2Line((PyCodeObject*)co, byte_offset);
-    
-    /* Release the code bytes reference */
-    Py_DECREF(code_bytes);
-    
-    if (lineno < 0) {
-        return co->co_firstlineno;
+/*
+ * =============================================================================
+ * Code Object Resolution (GIL held)
+ * =============================================================================
+ */
+
+/* UTF-8 of a str, "<unknown>" if it is missing */
+static const char* utf8_or_unknown(PyObject* str) {
+    const char* utf8 = NULL;
+    if (str != NULL && PyUnicode_Check(str)) {
+        utf8 = PyUnicode_AsUTF8(str);
+        if (utf8 == NULL) {
+            PyErr_Clear();
+        }
     }
-    return lineno;
-#endif
+    return utf8 != NULL ? utf8 : "<unknown>";
 }
 
-/* Resolve a code object to frame info */
-static int resolve_code_object(uintptr_t code_addr, ResolvedFrame* out) {
-    return resolve_code_object_with_instr(code_addr, 0, out);
+/* Location table of a 3.11+ code object or snapshot, NULL before 3.11 */
+static const uint8_t* linetable_bytes(PyObject* linetable, size_t* len) {
+    *len = 0;
+#if PY_VERSION_HEX >= 0x030B0000
+    if (linetable != NULL && PyBytes_Check(linetable)) {
+        *len = (size_t)PyBytes_GET_SIZE(linetable);
+        return (const uint8_t*)PyBytes_AS_STRING(linetable);
+    }
+#else
+    (void)linetable;
+#endif
+    return NULL;
 }
 
-/* Resolve a code object with instruction pointer for accurate line number */
-static int resolve_code_object_with_instr(uintptr_t code_addr, uintptr_t instr_ptr, ResolvedFrame* out) {
+/**
+ * Read a code object into the code cache.
+ *
+ * Requires the GIL.
+ *
+ * @param code_addr  Captured PyCodeObject* pointer.
+ * @param generation code_registry_generation() read before the capture.
+ * @return Code id, or CODE_ID_NONE if the pointer is invalid.
+ */
+static uint32_t resolve_code_id(uintptr_t code_addr, uint64_t generation) {
     if (code_addr == 0) {
-        return 0;
+        return CODE_ID_NONE;
     }
 
-    /* Need GIL to access Python objects */
-    PyGILState_STATE gstate = PyGILState_Ensure();
-
     /*
      * SAFETY: Use code registry for validation before dereferencing.
      * 
@@ -604,148 +621,472 @@ static int resolve_code_object_with_instr(uintptr_t code_addr, uintptr_t instr_p
      * 3. Code object was freed and memory possibly reused
      *
      * The registry validation checks:
+     * - If the object was destroyed since capture (3.12+): resolve from
+     *   the snapshot taken at destruction, without touching code_addr
      * - If we hold a reference (guaranteed valid)
      * - Basic pointer sanity (alignment, range)
      * - PyCode_Check (type verification)
      */
-    CodeValidationResult validation = code_registry_validate(code_addr, 0);
+    CodeSnapshot snapshot;
+    CodeValidationResult validation = code_registry_validate_at(code_addr, generation, &snapshot);
+    if (validation == CODE_RETIRED) {
+        size_t len = 0;
+        const uint8_t* table = linetable_bytes(snapshot.linetable, &len);
+        uint32_t id = code_cache_insert(code_addr, generation, snapshot.generation,
+                                        utf8_or_unknown(snapshot.name),
+                                        utf8_or_unknown(snapshot.filename), table, len,
+                                        snapshot.code_units, snapshot.firstlineno);
+        code_snapshot_release(&snapshot);
+        return id;
+    }
     if (validation != CODE_VALID) {
-        PyGILState_Release(gstate);
+        return CODE_ID_NONE;
+    }
+
+    /*
+     * The cache entry stays valid until the object's death is reported
+     * (code_cache_note_death()). Where deaths are not reported (3.11), or
+     * other threads run while we read (free-threaded), pin the object so
+     * its address cannot be reused under the entry.
+     */
+#if defined(Py_GIL_DISABLED) && defined(__linux__)
+    code_registry_pin(code_addr);
+#else
+    if (!code_registry_tracks_lifetimes()) {
+        code_registry_pin(code_addr);
+    }
+#endif
+
+    PyCodeObject* co = (PyCodeObject*)code_addr;
+    size_t len = 0;
+    const uint8_t* table = NULL;
+    Py_ssize_t code_units = 0;
+#if PY_VERSION_HEX >= 0x030B0000
+    table = linetable_bytes(co->co_linetable, &len);
+    code_units = Py_SIZE(co);
+#endif
+    return code_cache_insert(code_addr, generation, CODE_GENERATION_LIVE,
+                             utf8_or_unknown(co->co_name), utf8_or_unknown(co->co_filename),
+                             table, len, code_units, co->co_firstlineno);
+}
+
+/*
+ * =============================================================================
+ * Batch Resolution
+ * =============================================================================
+ *
+ * A batch of raw samples is resolved in four passes:
+ *   1. (workers) Look up every Python frame's code id. Samples whose
+ *      frames all hit are built right away.
+ *   2. (GIL)     Read the code objects that missed into the cache.
+ *   3. (workers) Build the samples that had a miss.
+ *   4. (GIL)     Release the sampler's code object references.
+ * In steady state nearly every frame hits, so pass 2 is short and the
+ * batch is resolved almost entirely in parallel.
+ */
+
+/**
+ * SampleIds - Code ids of one raw sample's Python frames
+ */
+typedef struct {
+    uint32_t ids[SPPROF_MAX_STACK_DEPTH];
+    int pending;  /* A frame missed the cache in pass 1 */
+} SampleIds;
+
+typedef struct {
+    const RawSample* raws;
+    SampleIds* ids;
+    ResolvedSample* out;  /* out[i] is resolved from raws[i] */
+    size_t count;
+} ResolveBatch;
+
+typedef void (*BatchRangeFn)(ResolveBatch* batch, size_t begin, size_t end);
+
+static inline int python_depth(const RawSample* raw) {
+    return raw->depth < SPPROF_MAX_STACK_DEPTH ? raw->depth : SPPROF_MAX_STACK_DEPTH;
+}
+
+/**
+ * Build a resolved sample from its raw sample and code ids.
+ *
+ * @return Frames of a Python-only sample that could not be resolved.
+ */
+static int build_sample(const RawSample* raw, const uint32_t* ids, ResolvedSample* out) {
+    out->timestamp = raw->timestamp;
+    out->thread_id = raw->thread_id;
+    out->weight = raw->weight > 0 ? raw->weight : 1;
+    out->cpu_time_ns = raw->cpu_time_ns;
+    out->label_id = raw->label_id;
+    out->context = raw->context;
+    out->task_id = 0;
+
+    int depth = python_depth(raw);
+
+    /*
+     * MIXED-MODE RESOLUTION:
+     * If we have native frames, use the "Trim & Sandwich" merge algorithm.
+     * This produces a coherent stack: [Native C] -> [Python] -> [Entry]
+     */
+    if (raw->native_depth > 0) {
+        out->depth = merge_native_and_python_frames(
+            raw->native_pcs,
+            raw->native_depth,
+            raw->frames,
+            raw->instr_ptrs,
+            ids,
+            depth,
+            out->frames,
+            SPPROF_MAX_STACK_DEPTH
+        );
         return 0;
     }
 
-    PyObject* code = (PyObject*)code_addr;
+    /* Python-only sample (legacy path) */
+    out->depth = append_python_frames(raw->frames, raw->instr_ptrs, ids, depth,
+                                      out->frames, 0, SPPROF_MAX_STACK_DEPTH);
+    return depth - out->depth;
+}
 
-    PyCodeObject* co = (PyCodeObject*)code;
+/* Pass 1: look up code ids and build the samples that fully hit */
+static void lookup_range(ResolveBatch* batch, size_t begin, size_t end) {
+    uint64_t hits = 0;
+    uint64_t invalid = 0;
+    for (size_t i = begin; i < end; i++) {
+        const RawSample* raw = &batch->raws[i];
+        SampleIds* sample_ids = &batch->ids[i];
+        int depth = python_depth(raw);
+        sample_ids->pending = 0;
+        for (int j = 0; j < depth; j++) {
+            uint32_t id = code_cache_lookup(raw->frames[j], raw->code_generation);
+            sample_ids->ids[j] = id;
+            if (id != CODE_ID_NONE) {
+                hits++;
+            } else if (raw->frames[j] != 0) {
+                sample_ids->pending = 1;
+            }
+        }
+        if (!sample_ids->pending) {
+            invalid += (uint64_t)build_sample(raw, sample_ids->ids, &batch->out[i]);
+        }
+    }
+    add_stats(hits, 0, invalid);
+}
 
-    /* Get function name */
-    PyObject* name = co->co_name;
-    if (name != NULL && PyUnicode_Check(name)) {
-        const char* name_str = PyUnicode_AsUTF8(name);
-        if (name_str != NULL) {
-            strncpy(out->function_name, name_str, SPPROF_MAX_FUNC_NAME - 1);
-            out->function_name[SPPROF_MAX_FUNC_NAME - 1] = '\0';
-        } else {
-            strcpy(out->function_name, "<unknown>");
+/* Pass 3: build the samples that waited for pass 2 */
+static void build_pending_range(ResolveBatch* batch, size_t begin, size_t end) {
+    uint64_t invalid = 0;
+    for (size_t i = begin; i < end; i++) {
+        if (batch->ids[i].pending) {
+            invalid += (uint64_t)build_sample(&batch->raws[i], batch->ids[i].ids,
+                                              &batch->out[i]);
         }
-    } else {
-        strcpy(out->function_name, "<unknown>");
     }
+    add_stats(0, 0, invalid);
+}
 
-    /* Get filename */
-    PyObject* filename = co->co_filename;
-    if (filename != NULL && PyUnicode_Check(filename)) {
-        const char* filename_str = PyUnicode_AsUTF8(filename);
-        if (filename_str != NULL) {
-            strncpy(out->filename, filename_str, SPPROF_MAX_FILENAME - 1);
-            out->filename[SPPROF_MAX_FILENAME - 1] = '\0';
-        } else {
-            strcpy(out->filename, "<unknown>");
+/* Pass 2: read the code objects that missed; requires the GIL */
+static size_t resolve_pending(ResolveBatch* batch) {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t pending = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        SampleIds* sample_ids = &batch->ids[i];
+        if (!sample_ids->pending) {
+            continue;
+        }
+        pending++;
+        const RawSample* raw = &batch->raws[i];
+        int depth = python_depth(raw);
+        for (int j = 0; j < depth; j++) {
+            if (sample_ids->ids[j] != CODE_ID_NONE || raw->frames[j] == 0) {
+                continue;
+            }
+            /* An earlier sample of this batch may have read it already */
+            uint32_t id = code_cache_lookup(raw->frames[j], raw->code_generation);
+            if (id != CODE_ID_NONE) {
+                hits++;
+            } else {
+                id = resolve_code_id(raw->frames[j], raw->code_generation);
+                misses++;
+            }
+            sample_ids->ids[j] = id;
         }
-    } else {
-        strcpy(out->filename, "<unknown>");
     }
+    add_stats(hits, misses, 0);
+    return pending;
+}
 
-    /* Get line number - use instruction pointer if available for accuracy */
-    if (instr_ptr != 0) {
-        out->lineno = compute_lineno_from_instr(co, instr_ptr);
-    } else {
-        out->lineno = co->co_firstlineno;
+#ifdef SPPROF_HAS_WORKERS
+
+/*
+ * Worker pool.
+ *
+ * Persistent threads, started on first use and joined by
+ * resolver_shutdown(). A job is published under the pool lock; workers
+ * and the submitting thread then claim WORKER_CHUNK samples at a time.
+ * Only one job runs at once: a drain that finds the pool busy resolves
+ * its batch itself.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;      /* A job was published, or stopping */
+    pthread_cond_t idle;      /* busy dropped to 0 */
+    pthread_t threads[SPPROF_RESOLVER_MAX_WORKERS];
+    int thread_count;
+    int busy;                 /* Workers inside the current job */
+    int stopping;
+    uint64_t job_seq;
+    BatchRangeFn fn;          /* NULL once the job is complete */
+    ResolveBatch* batch;
+    size_t next;              /* Next unclaimed sample (atomic) */
+    pid_t pid;                /* Process the threads belong to */
+} g_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .idle = PTHREAD_COND_INITIALIZER,
+};
+static pthread_mutex_t g_pool_job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Claim and run chunks of the current job until none are left */
+static void pool_run_chunks(BatchRangeFn fn, ResolveBatch* batch) {
+    for (;;) {
+        size_t begin = __atomic_fetch_add(&g_pool.next, WORKER_CHUNK, __ATOMIC_RELAXED);
+        if (begin >= batch->count) {
+            return;
+        }
+        size_t end = begin + WORKER_CHUNK < batch->count ? begin + WORKER_CHUNK : batch->count;
+        fn(batch, begin, end);
     }
-    out->is_native = 0;
+}
 
-    PyGILState_Release(gstate);
-    return 1;
+static void* pool_worker(void* arg) {
+    (void)arg;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&g_pool.lock);
+    for (;;) {
+        while (!g_pool.stopping && g_pool.job_seq == seen) {
+            pthread_cond_wait(&g_pool.wake, &g_pool.lock);
+        }
+        if (g_pool.stopping) {
+            break;
+        }
+        seen = g_pool.job_seq;
+        if (g_pool.fn == NULL) {
+            continue;  /* Woke after the job was already finished */
+        }
+        BatchRangeFn fn = g_pool.fn;
+        ResolveBatch* batch = g_pool.batch;
+        g_pool.busy++;
+        pthread_mutex_unlock(&g_pool.lock);
+
+        pool_run_chunks(fn, batch);
+
+        pthread_mutex_lock(&g_pool.lock);
+        if (--g_pool.busy == 0) {
+            pthread_cond_broadcast(&g_pool.idle);
+        }
+    }
+    pthread_mutex_unlock(&g_pool.lock);
+    return NULL;
 }
 
-/* Cache lookup - searches all ways in the set (thread-safe) */
-static int cache_lookup(uintptr_t code_addr, ResolvedFrame* out) {
-    size_t set_idx = cache_hash(code_addr);
-    int found = 0;
-    
-    CACHE_LOCK();
-    
-    CacheSet* set = &g_cache[set_idx];
-    
-    /* Search all ways for a match */
-    for (int way = 0; way < CACHE_WAYS; way++) {
-        CacheEntry* entry = &set->ways[way];
-        if (entry->valid && entry->key == code_addr) {
-            *out = entry->value;
-            /* Update LRU - mark this way as most recently used */
-            set->lru_bits = lru_update_access(set->lru_bits, way);
-            g_cache_hits++;
-            found = 1;
+/**
+ * Start worker threads until `helpers` run. Call with the pool lock held.
+ *
+ * @return Number of running workers.
+ */
+static int pool_start_locked(int helpers) {
+    if (g_pool.pid != getpid()) {
+        /* Forked: the parent's workers do not exist here */
+        g_pool.thread_count = 0;
+        g_pool.busy = 0;
+        g_pool.fn = NULL;
+        g_pool.pid = getpid();
+    }
+
+    /* Workers must not take the profiler's (or anyone's) signals */
+    sigset_t all;
+    sigset_t saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+    while (g_pool.thread_count < helpers) {
+        if (pthread_create(&g_pool.threads[g_pool.thread_count], NULL, pool_worker, NULL) != 0) {
             break;
         }
+        g_pool.thread_count++;
     }
-    
-    if (!found) {
-        g_cache_misses++;
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    return g_pool.thread_count;
+}
+
+/* Join all workers; the caller ensures no job is running */
+static void pool_stop(void) {
+    pthread_mutex_lock(&g_pool.lock);
+    if (g_pool.pid != getpid()) {
+        g_pool.thread_count = 0;
+        pthread_mutex_unlock(&g_pool.lock);
+        return;
     }
-    
-    CACHE_UNLOCK();
-    return found;
+    int count = g_pool.thread_count;
+    g_pool.stopping = 1;
+    pthread_cond_broadcast(&g_pool.wake);
+    pthread_mutex_unlock(&g_pool.lock);
+
+    for (int i = 0; i < count; i++) {
+        pthread_join(g_pool.threads[i], NULL);
+    }
+
+    pthread_mutex_lock(&g_pool.lock);
+    g_pool.thread_count = 0;
+    g_pool.stopping = 0;
+    pthread_mutex_unlock(&g_pool.lock);
 }
 
-/* Cache insert - uses LRU for eviction when set is full (thread-safe) */
-static void cache_insert(uintptr_t code_addr, const ResolvedFrame* frame) {
-    size_t set_idx = cache_hash(code_addr);
-    
-    CACHE_LOCK();
-    
-    CacheSet* set = &g_cache[set_idx];
-    
-    /* First, check if key already exists (update in place) */
-    for (int way = 0; way < CACHE_WAYS; way++) {
-        CacheEntry* entry = &set->ways[way];
-        if (entry->valid && entry->key == code_addr) {
-            entry->value = *frame;
-            set->lru_bits = lru_update_access(set->lru_bits, way);
-            CACHE_UNLOCK();
+/* Worker count to use: the setting, or one per online CPU */
+static int worker_count(void) {
+    int workers = g_worker_setting;
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)(cpus < SPPROF_RESOLVER_MAX_WORKERS ? cpus
+                                                                       : SPPROF_RESOLVER_MAX_WORKERS)
+                           : 1;
+    }
+    return workers < SPPROF_RESOLVER_MAX_WORKERS ? workers : SPPROF_RESOLVER_MAX_WORKERS;
+}
+
+/**
+ * Run fn over a batch on the worker pool, or in this thread.
+ *
+ * Requires the GIL, which is released while the workers run.
+ */
+static void run_batch(BatchRangeFn fn, ResolveBatch* batch) {
+    int workers = worker_count();
+    if (workers > 1 && batch->count > WORKER_CHUNK &&
+        pthread_mutex_trylock(&g_pool_job_lock) == 0) {
+        pthread_mutex_lock(&g_pool.lock);
+        int running = pool_start_locked(workers - 1);
+        if (running > 0) {
+            g_pool.fn = fn;
+            g_pool.batch = batch;
+            __atomic_store_n(&g_pool.next, 0, __ATOMIC_RELAXED);
+            g_pool.job_seq++;
+            pthread_cond_broadcast(&g_pool.wake);
+        }
+        pthread_mutex_unlock(&g_pool.lock);
+
+        if (running > 0) {
+            PyThreadState* tstate = PyEval_SaveThread();
+            pool_run_chunks(fn, batch);
+
+            pthread_mutex_lock(&g_pool.lock);
+            while (g_pool.busy > 0) {
+                pthread_cond_wait(&g_pool.idle, &g_pool.lock);
+            }
+            g_pool.fn = NULL;
+            g_pool.batch = NULL;
+            pthread_mutex_unlock(&g_pool.lock);
+            PyEval_RestoreThread(tstate);
+
+            pthread_mutex_unlock(&g_pool_job_lock);
             return;
         }
+        pthread_mutex_unlock(&g_pool_job_lock);
     }
-    
-    /* Second, look for an empty slot */
-    for (int way = 0; way < CACHE_WAYS; way++) {
-        CacheEntry* entry = &set->ways[way];
-        if (!entry->valid) {
-            entry->key = code_addr;
-            entry->value = *frame;
-            entry->valid = 1;
-            set->lru_bits = lru_update_access(set->lru_bits, way);
-            CACHE_UNLOCK();
-            return;
+    fn(batch, 0, batch->count);
+}
+
+#else /* !SPPROF_HAS_WORKERS */
+
+static void run_batch(BatchRangeFn fn, ResolveBatch* batch) {
+    fn(batch, 0, batch->count);
+}
+
+#endif /* SPPROF_HAS_WORKERS */
+
+/**
+ * Resolve raw samples, keeping those with at least one frame.
+ *
+ * This is the common resolution logic shared by every drain function.
+ *
+ * @param raws  Raw samples read from the ring buffer.
+ * @param count Number of raw samples.
+ * @param out   Receives up to count resolved samples, in order.
+ * @return Number of samples written to out, or -1 on allocation failure
+ *         (the raw samples are then released unresolved).
+ *
+ * SIDE EFFECTS:
+ *   - Releases code object references via code_registry_release_refs_batch()
+ *   - Increments g_invalid_frames counter for unresolvable frames
+ *   - May add entries to the code cache
+ */
+static long resolve_raw_samples(const RawSample* raws, size_t count, ResolvedSample* out) {
+    PyGILState_STATE gstate = PyGILState_Ensure();
+
+    SampleIds* ids = (SampleIds*)malloc(count * sizeof(SampleIds));
+    long kept = -1;
+    if (ids != NULL) {
+        ResolveBatch batch = {raws, ids, out, count};
+        run_batch(lookup_range, &batch);
+        if (resolve_pending(&batch) > 0) {
+            run_batch(build_pending_range, &batch);
+        }
+
+        /* Drop samples left without frames, keeping the order */
+        kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (out[i].depth > 0) {
+                if ((size_t)kept != i) {
+                    memcpy(&out[kept], &out[i], sizeof(ResolvedSample));
+                }
+                kept++;
+            }
         }
+        free(ids);
     }
-    
-    /* Set is full - evict LRU victim */
-    int victim = lru_get_victim(set->lru_bits);
-    CacheEntry* entry = &set->ways[victim];
-    
-    if (entry->valid) {
-        g_cache_collisions++;  /* Track actual evictions */
+
+    /*
+     * SAFETY: Release code object references after processing the batch.
+     *
+     * The Darwin/Mach sampler adds refs via code_registry_add_refs_batch()
+     * during capture. Now that we've resolved the frames, release those refs.
+     * For samples from signal handlers (Linux), this is a no-op since they
+     * don't add refs (can't call Python API from signal handler).
+     */
+    for (size_t i = 0; i < count; i++) {
+        if (raws[i].depth > 0) {
+            code_registry_release_refs_batch(raws[i].frames, (size_t)raws[i].depth);
+        }
     }
-    
-    entry->key = code_addr;
-    entry->value = *frame;
-    entry->valid = 1;
-    set->lru_bits = lru_update_access(set->lru_bits, victim);
-    
-    CACHE_UNLOCK();
+
+    PyGILState_Release(gstate);
+    return kept;
+}
+
+/* Read up to max raw samples from the ring buffer */
+static size_t read_raw_samples(RawSample* raws, size_t max) {
+    size_t count = 0;
+    while (count < max && ringbuffer_read(g_ringbuffer, &raws[count])) {
+        count++;
+    }
+    return count;
 }
 
+/*
+ * =============================================================================
+ * Public API
+ * =============================================================================
+ */
+
 int resolver_init(RingBuffer* rb) {
     if (g_initialized) {
         return 0;
     }
 
 #ifdef _WIN32
-    /* Initialize Windows critical section for cache synchronization */
-    if (!g_cache_lock_initialized) {
-        InitializeCriticalSection(&g_cache_lock);
-        g_cache_lock_initialized = 1;
+    /* Initialize Windows critical section for resolver state */
+    if (!g_resolver_lock_initialized) {
+        InitializeCriticalSection(&g_resolver_lock);
+        g_resolver_lock_initialized = 1;
     }
 #endif
 
@@ -757,21 +1098,20 @@ int resolver_init(RingBuffer* rb) {
         return -1;
     }
 
-    /* Clear cache (sets all entries invalid and LRU bits to 0) */
-    CACHE_LOCK();
-    memset(g_cache, 0, sizeof(g_cache));
+    RESOLVER_LOCK();
     g_cache_hits = 0;
     g_cache_misses = 0;
-    g_cache_collisions = 0;
     g_invalid_frames = 0;
-    CACHE_UNLOCK();
+    RESOLVER_UNLOCK();
 
     /* Initialize code object registry for safe reference tracking */
-    if (code_registry_init() != 0) {
+    if (code_cache_init() != 0 || code_registry_init() != 0) {
         free(g_samples);
         g_samples = NULL;
         return -1;
     }
+    /* Deaths close the cache entries of destroyed code objects */
+    code_registry_set_death_hook(code_cache_note_death);
 
 #ifdef SPPROF_HAS_DLADDR
     /* Initialize Python interpreter base address for robust detection */
@@ -787,7 +1127,12 @@ void resolver_shutdown(void) {
         return;
     }
 
+#ifdef SPPROF_HAS_WORKERS
+    pool_stop();
+#endif
+
     /* Clean up code registry (releases held references) */
+    code_registry_set_death_hook(NULL);
     code_registry_cleanup();
 
     /* Free samples if not already freed */
@@ -798,16 +1143,17 @@ void resolver_shutdown(void) {
         g_sample_capacity = 0;
     }
     
-    /* Clear cache (protected by mutex) */
-    CACHE_LOCK();
-    memset(g_cache, 0, sizeof(g_cache));
-    CACHE_UNLOCK();
+    /* Drop the cache and every code id */
+    code_cache_reset();
+
+    /* Unmap symbol tables; the next session snapshots the modules again */
+    native_symbols_reset();
     
     /* Note: We don't reset g_python_lib_base or g_python_base_initialized here.
      * The Python interpreter base address doesn't change during process lifetime,
      * so there's no need to re-detect it on each profiler restart. */
     
-    /* Note: We don't destroy the cache mutex/critical section here because
+    /* Note: We don't destroy the resolver mutex/critical section here because
      * it may be reused if profiling is restarted. On POSIX, the static
      * PTHREAD_MUTEX_INITIALIZER doesn't need destruction. On Windows, the
      * CRITICAL_SECTION persists for process lifetime. */
@@ -816,90 +1162,50 @@ void resolver_shutdown(void) {
     g_initialized = 0;
 }
 
-/**
- * Resolve a single raw sample into a resolved sample.
- *
- * This is the common resolution logic shared by resolver_get_samples() and
- * resolver_drain_samples(). Extracts the duplicated sample processing code
- * into a reusable helper.
- *
- * @param raw Input raw sample with unresolved frame pointers.
- * @param out Output resolved sample with function names and filenames.
- * @return 1 if sample has at least one resolved frame, 0 otherwise.
- *
- * SIDE EFFECTS:
- *   - Releases code object references via code_registry_release_refs_batch()
- *   - Increments g_invalid_frames counter for unresolvable frames
- *   - May update resolution cache
- */
-static int resolve_raw_sample(const RawSample* raw, ResolvedSample* out) {
-    out->timestamp = raw->timestamp;
-    out->thread_id = raw->thread_id;
-    out->depth = 0;
+/* A sample read from the ring buffer is being resolved until drain_end() */
+static void drain_begin(void) {
+    /* High-frequency samples reach the ring buffer only when moved there */
+    signal_handler_hf_flush();
+    
+    /* JIT code registered since the last drain is looked for once more */
+    native_symbols_begin_batch();
+    
+    RESOLVER_LOCK();
+    g_active_drains++;
+    RESOLVER_UNLOCK();
+}
 
-    /*
-     * MIXED-MODE RESOLUTION:
-     * If we have native frames, use the "Trim & Sandwich" merge algorithm.
-     * This produces a coherent stack: [Native C] -> [Python] -> [Entry]
-     */
-    if (raw->native_depth > 0) {
-        /* Use merge algorithm for mixed-mode samples */
-        out->depth = merge_native_and_python_frames(
-            raw->native_pcs,
-            raw->native_depth,
-            raw->frames,
-            raw->instr_ptrs,
-            raw->depth,
-            out->frames,
-            SPPROF_MAX_STACK_DEPTH
-        );
-    } else {
-        /* Python-only sample (legacy path) */
-        for (int i = 0; i < raw->depth && i < SPPROF_MAX_STACK_DEPTH; i++) {
-            uintptr_t code_addr = raw->frames[i];
-            uintptr_t instr_ptr = raw->instr_ptrs[i];
-            ResolvedFrame* frame = &out->frames[out->depth];
-
-            /* If we have an instruction pointer, resolve with it for accuracy */
-            /* Cache is only used for code_addr (lineno may vary per call site) */
-            if (instr_ptr != 0) {
-                /* Resolve with instruction pointer - don't cache as line varies */
-                if (resolve_code_object_with_instr(code_addr, instr_ptr, frame)) {
-                    out->depth++;
-                } else {
-                    g_invalid_frames++;
-                }
-            } else {
-                /* No instruction pointer - use cache */
-                if (cache_lookup(code_addr, frame)) {
-                    out->depth++;
-                    continue;
-                }
+static void drain_end(void) {
+    RESOLVER_LOCK();
+    g_active_drains--;
+    RESOLVER_UNLOCK();
+    resolver_release_retired();
+}
 
-                /* Resolve and cache */
-                if (resolve_code_object(code_addr, frame)) {
-                    cache_insert(code_addr, frame);
-                    out->depth++;
-                } else {
-                    g_invalid_frames++;
-                }
-            }
-        }
+void resolver_release_retired(void) {
+    if (g_ringbuffer == NULL || code_registry_retired_count() < RETIRED_RELEASE_THRESHOLD) {
+        return;
     }
 
     /*
-     * SAFETY: Release code object references after processing sample.
-     *
-     * The Darwin/Mach sampler adds refs via code_registry_add_refs_batch()
-     * during capture. Now that we've resolved the frames, release those refs.
-     * For samples from signal handlers (Linux), this is a no-op since they
-     * don't add refs (can't call Python API from signal handler).
+     * Read the generation before checking that nothing is pending. A
+     * sample written after the check holds objects that were alive at the
+     * check, so they can only die at a later generation than this one.
+     * Code cache entries carry their own generation bounds and do not
+     * depend on the snapshots being dropped.
      */
-    if (raw->depth > 0) {
-        code_registry_release_refs_batch(raw->frames, (size_t)raw->depth);
-    }
+    uint64_t generation = code_registry_generation();
+
+    RESOLVER_LOCK();
+    int idle = g_active_drains == 0 && !signal_handler_hf_buffering() &&
+               !ringbuffer_has_data(g_ringbuffer);
+    RESOLVER_UNLOCK();
 
-    return out->depth > 0 ? 1 : 0;
+    if (idle) {
+        PyGILState_STATE gstate = PyGILState_Ensure();
+        code_registry_release_retired(generation);
+        PyGILState_Release(gstate);
+    }
 }
 
 int resolver_get_samples(ResolvedSample** out, size_t* count) {
@@ -909,25 +1215,46 @@ int resolver_get_samples(ResolvedSample** out, size_t* count) {
         return 0;
     }
 
+    RawSample* raws = (RawSample*)malloc(RESOLVE_BATCH * sizeof(RawSample));
+    if (raws == NULL) {
+        return -1;
+    }
+
     /* Drain remaining samples from ring buffer */
-    RawSample raw;
-    while (ringbuffer_read(g_ringbuffer, &raw)) {
+    int rc = 0;
+    drain_begin();
+    for (;;) {
         /* Expand array if needed */
-        if (g_sample_count >= g_sample_capacity) {
+        if (g_sample_count + RESOLVE_BATCH > g_sample_capacity) {
             size_t new_capacity = g_sample_capacity * 2;
+            if (new_capacity < g_sample_count + RESOLVE_BATCH) {
+                new_capacity = g_sample_count + RESOLVE_BATCH;
+            }
             ResolvedSample* new_samples = (ResolvedSample*)realloc(
                 g_samples, new_capacity * sizeof(ResolvedSample));
             if (new_samples == NULL) {
-                return -1;
+                rc = -1;
+                break;
             }
             g_samples = new_samples;
             g_sample_capacity = new_capacity;
         }
 
-        ResolvedSample* sample = &g_samples[g_sample_count];
-        if (resolve_raw_sample(&raw, sample)) {
-            g_sample_count++;
+        size_t read = read_raw_samples(raws, RESOLVE_BATCH);
+        if (read == 0) {
+            break;
         }
+        long kept = resolve_raw_samples(raws, read, &g_samples[g_sample_count]);
+        if (kept < 0) {
+            rc = -1;
+            break;
+        }
+        g_sample_count += (size_t)kept;
+    }
+    drain_end();
+    free(raws);
+    if (rc < 0) {
+        return -1;
     }
 
     *out = g_samples;
@@ -947,45 +1274,58 @@ void resolver_free_samples(ResolvedSample* samples, size_t count) {
 }
 
 int resolver_resolve_frame(uintptr_t code_addr, ResolvedFrame* out) {
-    if (cache_lookup(code_addr, out)) {
-        return 1;
-    }
-
-    if (resolve_code_object(code_addr, out)) {
-        cache_insert(code_addr, out);
-        return 1;
-    }
-
-    return 0;
+    return resolver_resolve_frame_with_line(code_addr, 0, out);
 }
 
 int resolver_resolve_frame_with_line(uintptr_t code_addr, uintptr_t instr_ptr, ResolvedFrame* out) {
-    /* With instruction pointer, we need to resolve for accurate line number */
-    if (instr_ptr != 0) {
-        return resolve_code_object_with_instr(code_addr, instr_ptr, out);
+    /* The caller holds a pointer to whatever lives at code_addr now */
+    uint64_t generation = code_registry_generation();
+    uint32_t id = code_cache_lookup(code_addr, generation);
+    if (id != CODE_ID_NONE) {
+        add_stats(1, 0, 0);
+    } else {
+        PyGILState_STATE gstate = PyGILState_Ensure();
+        id = resolve_code_id(code_addr, generation);
+        PyGILState_Release(gstate);
+        add_stats(0, 1, 0);
+        if (id == CODE_ID_NONE) {
+            return 0;
+        }
     }
 
-    /* Fall back to cached resolution */
-    return resolver_resolve_frame(code_addr, out);
+    build_python_frame(code_addr, instr_ptr, id, out);
+    return 1;
 }
 
 void resolver_clear_cache(void) {
-    CACHE_LOCK();
-    memset(g_cache, 0, sizeof(g_cache));
+    code_cache_clear();
+    RESOLVER_LOCK();
     g_cache_hits = 0;
     g_cache_misses = 0;
-    g_cache_collisions = 0;
-    CACHE_UNLOCK();
+    RESOLVER_UNLOCK();
 }
 
 void resolver_get_stats(uint64_t* cache_hits, uint64_t* cache_misses, 
-                        uint64_t* cache_collisions, uint64_t* invalid_frames) {
-    CACHE_LOCK();
+                        uint64_t* cache_collisions, uint64_t* cache_reinserts,
+                        uint64_t* invalid_frames) {
+    RESOLVER_LOCK();
     if (cache_hits) *cache_hits = g_cache_hits;
     if (cache_misses) *cache_misses = g_cache_misses;
-    if (cache_collisions) *cache_collisions = g_cache_collisions;
     if (invalid_frames) *invalid_frames = g_invalid_frames;
-    CACHE_UNLOCK();
+    RESOLVER_UNLOCK();
+    code_cache_get_stats(NULL, cache_collisions, cache_reinserts);
+}
+
+void resolver_set_workers(int workers) {
+    g_worker_setting = workers < 0 ? 0 : workers;
+}
+
+size_t resolver_batch_size(void) {
+#ifdef SPPROF_HAS_WORKERS
+    return (size_t)worker_count() * WORKER_CHUNK * 2;
+#else
+    return WORKER_CHUNK;
+#endif
 }
 
 int resolver_has_pending_samples(void) {
@@ -995,6 +1335,55 @@ int resolver_has_pending_samples(void) {
     return ringbuffer_has_data(g_ringbuffer);
 }
 
+int resolver_next_sample(ResolvedSample* out) {
+    if (g_ringbuffer == NULL) {
+        return 0;
+    }
+
+    RawSample raw;
+    int found = 0;
+    drain_begin();
+    while (!found && ringbuffer_read(g_ringbuffer, &raw)) {
+        found = resolve_raw_samples(&raw, 1, out) > 0;
+    }
+    drain_end();
+    return found;
+}
+
+size_t resolver_next_samples(ResolvedSample* out, size_t max_samples) {
+    if (g_ringbuffer == NULL || max_samples == 0) {
+        return 0;
+    }
+    if (max_samples > RESOLVE_BATCH) {
+        max_samples = RESOLVE_BATCH;
+    }
+
+    RawSample* raws = (RawSample*)malloc(max_samples * sizeof(RawSample));
+    if (raws == NULL) {
+        return 0;
+    }
+
+    long kept = 0;
+    drain_begin();
+    while (kept == 0) {
+        size_t read = read_raw_samples(raws, max_samples);
+        if (read == 0) {
+            break;
+        }
+        kept = resolve_raw_samples(raws, read, out);
+    }
+    drain_end();
+    free(raws);
+    return kept > 0 ? (size_t)kept : 0;
+}
+
+int resolver_next_raw_sample(RawSample* out) {
+    if (g_ringbuffer == NULL) {
+        return 0;
+    }
+    return ringbuffer_read(g_ringbuffer, out) ? 1 : 0;
+}
+
 int resolver_drain_samples(size_t max_samples, ResolvedSample** out, size_t* count) {
     *out = NULL;
     *count = 0;
@@ -1010,18 +1399,35 @@ int resolver_drain_samples(size_t max_samples, ResolvedSample** out, size_t* cou
     
     /* Allocate output array for this batch */
     ResolvedSample* samples = (ResolvedSample*)calloc(max_samples, sizeof(ResolvedSample));
-    if (samples == NULL) {
+    RawSample* raws = (RawSample*)malloc(RESOLVE_BATCH * sizeof(RawSample));
+    if (samples == NULL || raws == NULL) {
+        free(samples);
+        free(raws);
         return -1;
     }
     
     size_t sample_count = 0;
-    RawSample raw;
+    int rc = 0;
     
-    while (sample_count < max_samples && ringbuffer_read(g_ringbuffer, &raw)) {
-        ResolvedSample* sample = &samples[sample_count];
-        if (resolve_raw_sample(&raw, sample)) {
-            sample_count++;
+    drain_begin();
+    while (sample_count < max_samples) {
+        size_t want = max_samples - sample_count;
+        size_t read = read_raw_samples(raws, want < RESOLVE_BATCH ? want : RESOLVE_BATCH);
+        if (read == 0) {
+            break;
+        }
+        long kept = resolve_raw_samples(raws, read, &samples[sample_count]);
+        if (kept < 0) {
+            rc = -1;
+            break;
         }
+        sample_count += (size_t)kept;
+    }
+    drain_end();
+    free(raws);
+    if (rc < 0) {
+        free(samples);
+        return -1;
     }
     
     /* Shrink allocation if we got fewer samples than max */
@@ -1041,5 +1447,3 @@ int resolver_drain_samples(size_t max_samples, ResolvedSample** out, size_t* cou
     *count = sample_count;
     return 0;
 }
-
-
@@ -10,9 +10,10 @@
  *
  * THREAD SAFETY:
  *
- * The resolver module uses an internal symbol resolution cache to avoid
- * redundant Python object accesses. This cache is protected by a mutex,
- * making the following functions safe to call from multiple threads:
+ * The resolver module uses an internal code id cache (code_cache.h) to
+ * avoid redundant Python object accesses. Its lookups are lock-free and
+ * its inserts take a per-shard lock, making the following functions safe
+ * to call from multiple threads:
  *
  *   - resolver_drain_samples()   (streaming API)
  *   - resolver_resolve_frame()
@@ -32,6 +33,13 @@
  * safely drain samples concurrently. Each call returns an independent
  * array that the caller must free.
  *
+ * PARALLEL RESOLUTION:
+ *
+ * Drains resolve samples in batches. Code objects missing from the cache
+ * are read with the GIL held; the frames are then built from the cache
+ * by a pool of worker threads (POSIX) with the GIL released. See
+ * resolver_set_workers().
+ *
  * ERROR HANDLING CONVENTIONS (see error.h for full documentation):
  *
  *   Pattern 1 - POSIX-style (0 success, -1 error):
@@ -52,6 +60,9 @@
 #include <stddef.h>
 #include "ringbuffer.h"
 
+/* Most threads (including the caller) that resolve one batch */
+#define SPPROF_RESOLVER_MAX_WORKERS 8
+
 /* Maximum lengths for resolved strings */
 #define SPPROF_MAX_FUNC_NAME 256
 #define SPPROF_MAX_FILENAME 1024
@@ -70,12 +81,14 @@
  *   - filename: Library path (e.g., "/usr/lib/libz.dylib")
  *   - lineno: 0 (no line info for native)
  *   - is_native: 1
+ *   - address: the sampled PC, for offline symbolization
  */
 typedef struct {
     char function_name[SPPROF_MAX_FUNC_NAME];  /* Function name (Python or C) */
     char filename[SPPROF_MAX_FILENAME];        /* Source file or library path */
     int lineno;                                 /* Line number (0 for native) */
     int is_native;                              /* 1 if native C frame, 0 if Python */
+    uintptr_t address;                          /* Native PC (0 for Python frames) */
 } ResolvedFrame;
 
 /**
@@ -86,6 +99,11 @@ typedef struct {
     int depth;                                      /* Number of valid frames */
     uint64_t timestamp;                             /* Original timestamp (ns) */
     uint64_t thread_id;                             /* Thread ID */
+    uint32_t weight;                                /* Timer expirations represented (>= 1) */
+    uint64_t cpu_time_ns;                           /* Thread CPU delta, or SPPROF_CPU_TIME_UNKNOWN */
+    uint32_t label_id;                              /* spprof.labels() set id, 0 if none */
+    uintptr_t context;                              /* contextvars.Context sampled in */
+    uint32_t task_id;                               /* Tracked asyncio task (set by the drain), 0 if none */
 } ResolvedSample;
 
 /**
@@ -142,7 +160,6 @@ void resolver_free_samples(ResolvedSample* samples, size_t count);
  * This function acquires the GIL briefly to access Python objects.
  *
  * Thread safety: SAFE to call from multiple threads concurrently.
- * The internal cache is protected by a mutex.
  *
  * Error handling: Boolean success (Pattern 2)
  *   Returns 1 = success (frame resolved, output populated)
@@ -178,15 +195,17 @@ void resolver_clear_cache(void);
  * Get resolver statistics.
  *
  * Thread safety: SAFE to call from multiple threads concurrently.
- * Statistics are read atomically under the cache lock.
+ * Statistics are read under the resolver lock.
  *
  * @param cache_hits Number of cache hits.
- * @param cache_misses Number of cache misses.
- * @param cache_collisions Number of LRU evictions (can be NULL).
+ * @param cache_misses Number of code objects read on a miss.
+ * @param cache_collisions Number of cache evictions (can be NULL).
+ * @param cache_reinserts Evicted code objects inserted again (can be NULL).
  * @param invalid_frames Number of frames that couldn't be resolved.
  */
 void resolver_get_stats(uint64_t* cache_hits, uint64_t* cache_misses, 
-                        uint64_t* cache_collisions, uint64_t* invalid_frames);
+                        uint64_t* cache_collisions, uint64_t* cache_reinserts,
+                        uint64_t* invalid_frames);
 
 /**
  * Drain samples from the ring buffer in chunks (streaming API).
@@ -198,9 +217,8 @@ void resolver_get_stats(uint64_t* cache_hits, uint64_t* cache_misses,
  * The caller MUST free the returned array with free() when done.
  * Unlike resolver_get_samples(), each call returns a NEW array.
  *
- * Thread safety: SAFE to call from multiple threads concurrently. The internal
- * symbol resolution cache is protected by a mutex. Each call returns an
- * independent array that the caller owns.
+ * Thread safety: SAFE to call from multiple threads concurrently. Each call
+ * returns an independent array that the caller owns.
  *
  * Error handling: POSIX-style (Pattern 1)
  *   Returns 0 on success (even if buffer empty - check *count)
@@ -220,6 +238,95 @@ int resolver_drain_samples(size_t max_samples, ResolvedSample** out, size_t* cou
  */
 int resolver_has_pending_samples(void);
 
+/**
+ * Drain and resolve the next sample from the ring buffer.
+ *
+ * Raw samples that resolve to no frames are consumed and skipped. Lets a
+ * caller that keeps its own compact representation (see stack_table.h)
+ * reuse one ResolvedSample instead of allocating a batch array.
+ *
+ * Thread safety: same as resolver_drain_samples().
+ *
+ * Error handling: Boolean success (Pattern 2)
+ *
+ * @param out Receives the resolved sample.
+ * @return 1 if *out was populated, 0 if the buffer is empty.
+ */
+int resolver_next_sample(ResolvedSample* out);
+
+/**
+ * Drain and resolve a batch of samples from the ring buffer.
+ *
+ * Like resolver_next_sample(), but the batch is resolved in parallel
+ * (see resolver_set_workers()). Takes and releases the GIL.
+ *
+ * Thread safety: same as resolver_drain_samples().
+ *
+ * @param out         Receives the resolved samples.
+ * @param max_samples Capacity of out; resolver_batch_size() keeps every
+ *                    worker busy.
+ * @return Number of samples written, 0 if the buffer is empty.
+ */
+size_t resolver_next_samples(ResolvedSample* out, size_t max_samples);
+
+/**
+ * Set the number of threads that resolve a batch.
+ *
+ * Takes effect on the next batch; workers already started are kept
+ * until resolver_shutdown(). Ignored where threads are unavailable.
+ *
+ * @param workers 0 for one per online CPU (at most
+ *                SPPROF_RESOLVER_MAX_WORKERS), 1 to resolve in the
+ *                calling thread only.
+ */
+void resolver_set_workers(int workers);
+
+/**
+ * Batch size that gives every resolver worker a few samples.
+ *
+ * @return Suggested max_samples for resolver_next_samples().
+ */
+size_t resolver_batch_size(void);
+
+/**
+ * Read the next raw sample from the ring buffer without resolving it.
+ *
+ * For callers that record samples unresolved (see capture.h). Code object
+ * references the sampler took for the sample are still held; release them
+ * with code_registry_release_refs_batch() once done with the frames.
+ *
+ * Error handling: Boolean success (Pattern 2)
+ *
+ * @param out Receives the raw sample.
+ * @return 1 if *out was populated, 0 if the buffer is empty.
+ */
+int resolver_next_raw_sample(RawSample* out);
+
+/**
+ * Byte offset of a sampled instruction pointer within a code object's
+ * bytecode, as accepted by PyCode_Addr2Line() and code.co_lines().
+ *
+ * Requires the GIL and a code object known to be alive.
+ *
+ * @param code_addr Validated PyCodeObject* pointer.
+ * @param instr_ptr Instruction pointer recorded by the sampler.
+ * @return Offset, or -1 if unknown on this platform or out of range.
+ */
+int resolver_code_offset(uintptr_t code_addr, uintptr_t instr_ptr);
+
+/**
+ * Drop snapshots of destroyed code objects once nothing needs them.
+ *
+ * The resolver calls this after each drain. Callers that consume raw
+ * samples themselves (resolver_next_raw_sample()) call it when done.
+ * A no-op until enough snapshots have accumulated, or while samples are
+ * pending in the ring buffer or the high-frequency buffer.
+ *
+ * Thread safety: SAFE to call from multiple threads concurrently.
+ * Takes the GIL.
+ */
+void resolver_release_retired(void);
+
 #endif /* SPPROF_RESOLVER_H */
 
 
@@ -223,8 +223,13 @@ int ringbuffer_write(RingBuffer* rb, const RawSample* sample) {
     /* memcpy is generally async-signal-safe for simple copies */
     slot->timestamp = sample->timestamp;
     slot->thread_id = sample->thread_id;
+    slot->cpu_time_ns = sample->cpu_time_ns;
     slot->depth = sample->depth;
     slot->native_depth = sample->native_depth;
+    slot->weight = sample->weight;
+    slot->label_id = sample->label_id;
+    slot->context = sample->context;
+    slot->code_generation = sample->code_generation;
 
     /* Copy Python frame pointers and instruction pointers */
     for (int i = 0; i < sample->depth && i < SPPROF_MAX_STACK_DEPTH; i++) {
@@ -277,8 +282,13 @@ int ringbuffer_read(RingBuffer* rb, RawSample* out) {
     /* Copy sample data to output */
     out->timestamp = slot->timestamp;
     out->thread_id = slot->thread_id;
+    out->cpu_time_ns = slot->cpu_time_ns;
     out->depth = slot->depth;
     out->native_depth = slot->native_depth;
+    out->weight = slot->weight;
+    out->label_id = slot->label_id;
+    out->context = slot->context;
+    out->code_generation = slot->code_generation;
 
     /* Copy Python frames */
     for (int i = 0; i < slot->depth && i < SPPROF_MAX_STACK_DEPTH; i++) {
@@ -38,6 +38,9 @@ typedef _Atomic uint64_t ATOMIC_UINT64;
 #define SPPROF_RING_SIZE 65536      /* Power of 2 for fast modulo */
 #define SPPROF_MAX_STACK_DEPTH 128  /* Maximum call stack depth */
 
+/* RawSample.cpu_time_ns value when the producer cannot read a thread CPU clock */
+#define SPPROF_CPU_TIME_UNKNOWN UINT64_MAX
+
 /**
  * RawFrameData - Per-frame data captured in signal handler context
  *
@@ -64,8 +67,13 @@ typedef struct {
 typedef struct {
     uint64_t timestamp;                          /* Monotonic clock value (nanoseconds) */
     uint64_t thread_id;                          /* OS thread ID */
+    uint64_t cpu_time_ns;                        /* Thread CPU time since its previous sample */
     int depth;                                   /* Number of valid Python frames */
     int native_depth;                            /* Number of valid native frames */
+    uint32_t weight;                             /* Timer expirations represented (1 + overruns) */
+    uint32_t label_id;                           /* Thread's spprof.labels() set, 0 if none */
+    uintptr_t context;                           /* contextvars.Context (asyncio task), 0 if none */
+    uint64_t code_generation;                    /* code_registry_generation() before capture */
     uintptr_t frames[SPPROF_MAX_STACK_DEPTH];   /* Raw PyCodeObject* pointers (unresolved) */
     uintptr_t instr_ptrs[SPPROF_MAX_STACK_DEPTH]; /* Instruction pointers for line resolution */
     uintptr_t native_pcs[SPPROF_MAX_STACK_DEPTH]; /* Native PC addresses (resolved via dladdr) */
@@ -19,9 +19,9 @@
  * NOTE: This file is only compiled on POSIX systems (Linux, macOS).
  * Windows has its own implementation in platform/windows.c.
  *
- * FREE-THREADING WARNING (Py_GIL_DISABLED):
+ * FREE-THREADING (Py_GIL_DISABLED):
  *
- * Signal-based sampling is NOT SAFE for free-threaded Python builds because:
+ * A plain frame walk is NOT SAFE for free-threaded Python builds because:
  *
  *   1. FRAME CHAIN INSTABILITY:
  *      In GIL-enabled builds, the GIL ensures frame chains are stable when
@@ -43,11 +43,14 @@
  * On Darwin/macOS, we use Mach-based sampling instead (darwin_mach.c) which
  * suspends threads before reading their state. This is safe for free-threading.
  *
- * On Linux with free-threaded Python, signal-based sampling is disabled.
- * Future alternatives could include:
- *   - PEP 669 profiling callbacks (cooperative, at safe points)
- *   - perf_event_open with PEBS (hardware-assisted)
- *   - eBPF-based sampling
+ * On Linux with free-threaded Python, the handler walks speculatively
+ * (_spprof_walk_speculative() in internal/pycore_tstate.h). Every pointer
+ * is range- and alignment-checked before it is followed, cycles and
+ * runaway chains drop the sample, and only objects whose type is
+ * PyCode_Type are recorded. Dropped samples are counted in
+ * _spprof_samples_dropped_validation. The resolver then pins each code
+ * object it resolves for the rest of the session (code_registry_pin()).
+ * Other platforms without Mach sampling refuse to start.
  *
  * Copyright (c) 2024 spprof contributors
  * SPDX-License-Identifier: MIT
@@ -63,8 +66,12 @@
 #include <signal.h>
 #include <stdint.h>
 #include <stdatomic.h>
+#include <pthread.h>
 #include <time.h>
 #include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sched.h>
 
 #ifdef __linux__
 #include <sys/syscall.h>
@@ -72,35 +79,36 @@
 #endif
 
 #include "ringbuffer.h"
+#include "code_registry.h"
 #include "framewalker.h"
 #include "unwind.h"
 #include "error.h"
+#include "signal_handler.h"
 
 /* Note: Darwin uses Mach-based sampler (darwin_mach.c) instead of signals.
  * This file is still compiled on Darwin for compatibility but the signal
  * handler is not used. */
 
-#ifdef SPPROF_USE_INTERNAL_API
 #include "internal/pycore_frame.h"
 #include "internal/pycore_tstate.h"
-#endif
+#include "internal/pycore_context.h"
 
 /*
  * FREE-THREADING SAFETY CHECK
  *
- * On free-threaded builds (Py_GIL_DISABLED) on non-Darwin platforms,
- * signal-based sampling is unsafe. The SPPROF_FREE_THREADING_SAFE macro
- * is defined in pycore_frame.h based on the platform and build configuration.
+ * On free-threaded builds (Py_GIL_DISABLED) on platforms other than Darwin
+ * and Linux, signal-based sampling is unsafe. The SPPROF_FREE_THREADING_SAFE
+ * macro is defined in pycore_frame.h based on the platform and build
+ * configuration.
  *
- * Darwin uses Mach-based sampling (darwin_mach.c) which is safe.
- * This file is still compiled but the handler is effectively disabled.
+ * Darwin uses Mach-based sampling (darwin_mach.c) which is safe, and Linux
+ * captures speculatively with validation. Elsewhere this file is still
+ * compiled but the handler is effectively disabled.
  */
-#ifdef SPPROF_USE_INTERNAL_API
 #if !SPPROF_FREE_THREADING_SAFE
     /* Signal handler will return immediately without capturing frames */
     #define SPPROF_SIGNAL_HANDLER_DISABLED 1
 #endif
-#endif
 
 /*
  * =============================================================================
@@ -119,10 +127,106 @@ static volatile sig_atomic_t g_in_handler = 0;  /* Reentrancy guard */
 static _Atomic uint64_t g_samples_captured = 0;
 static _Atomic uint64_t g_samples_dropped = 0;
 static _Atomic uint64_t g_handler_errors = 0;
+static _Atomic uint64_t g_timer_overruns = 0;   /* Expirations folded into sample weights */
+static _Atomic uint64_t g_handler_ns = 0;       /* Time spent inside the handler */
+static _Atomic uint64_t g_handler_calls = 0;    /* Handler invocations that sampled */
+
+/*
+ * Interval multiplier applied by the overhead controller (platform/linux.c).
+ * When timers run at base_interval * scale, each sample stands for `scale`
+ * base-interval expirations, so it is folded into the sample weight.
+ */
+static _Atomic uint32_t g_weight_scale = 1;
 
 /* Configuration */
 static int g_capture_native = 0;
 static int g_skip_frames = 2;  /* Skip signal handler frames */
+static uint64_t g_nominal_interval_ns = 0;  /* Timer interval, for CPU estimates */
+
+/*
+ * Session epoch, bumped by signal_handler_start(). A thread's CPU clock
+ * baseline is only trusted when it was recorded in the current session.
+ */
+static _Atomic uint32_t g_session_epoch = 0;
+
+/*
+ * Per-thread CPU clock baseline (value at the thread's previous sample).
+ *
+ * initial-exec keeps each access a single thread-pointer-relative load.
+ * The default dynamic TLS model may call __tls_get_addr, which can allocate
+ * on first touch in a dlopen'd module and is not async-signal-safe.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define SPPROF_SIGNAL_TLS __thread __attribute__((tls_model("initial-exec")))
+#else
+#define SPPROF_SIGNAL_TLS __thread
+#endif
+
+static SPPROF_SIGNAL_TLS uint64_t tl_last_cpu_ns = 0;
+static SPPROF_SIGNAL_TLS uint32_t tl_cpu_epoch = 0;
+
+/*
+ * spprof.labels() keeps the current label set id in a ContextVar, as 4
+ * bytes in native byte order. The handler reads it from the interrupted
+ * thread's current Context, so asyncio tasks and copy_context() threads
+ * see the labels of the Context they were started from, as with any other
+ * ContextVar. g_label_var is published last, once the hash and the HAMT
+ * node types it needs are set, and stays set for the process's lifetime.
+ */
+static PyObject* _Atomic g_label_var = NULL;
+static int32_t g_label_hash;
+static _spprof_HamtTypes g_hamt_types;
+
+/*
+ * =============================================================================
+ * High-Frequency Mode State
+ * =============================================================================
+ *
+ * Only the sampled thread's handler writes these, so counters use relaxed
+ * load/store pairs (plain moves) instead of atomic read-modify-write.
+ * Other threads read them for statistics.
+ *
+ * The sample buffer is a single-producer ring: the handler appends at
+ * g_hf_count and drains move samples from g_hf_consumed into the ring
+ * buffer (signal_handler_hf_flush()), so snapshots see them while the
+ * mode is still on. Consumers serialize on g_hf_consumer_lock.
+ */
+
+/**
+ * HFSample - Compact sample recorded in high-frequency mode
+ *
+ * About 1/6 the size of a RawSample; widened into one on replay.
+ */
+typedef struct {
+    uint64_t timestamp;                           /* Monotonic clock value (nanoseconds) */
+    uint64_t cpu_time_ns;                         /* Thread CPU time since its previous sample */
+    uint32_t weight;                              /* Timer expirations represented */
+    uint32_t label_id;                            /* Thread's label set id */
+    uintptr_t context;                            /* Current contextvars.Context */
+    uint64_t code_generation;                     /* code_registry_generation() before capture */
+    int depth;                                    /* Number of valid frames */
+    uintptr_t frames[SPPROF_HF_MAX_DEPTH];        /* Raw PyCodeObject* pointers */
+    uintptr_t instr_ptrs[SPPROF_HF_MAX_DEPTH];    /* Instruction pointers */
+} HFSample;
+
+static HFSample* _Atomic g_hf_samples = NULL;   /* Non-NULL while high-frequency mode is on */
+static size_t g_hf_capacity = 0;
+static uint64_t g_hf_thread_id = 0;
+static _Atomic size_t g_hf_count = 0;           /* Samples written (producer) */
+static _Atomic size_t g_hf_consumed = 0;        /* Samples moved to the ring buffer */
+static _Atomic int g_hf_in_handler = 0;         /* Handlers that may hold the buffer */
+static pthread_mutex_t g_hf_consumer_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic uint64_t g_hf_dropped = 0;
+static _Atomic uint64_t g_hf_overruns = 0;
+static _Atomic uint64_t g_hf_handler_ns = 0;
+static _Atomic uint64_t g_hf_handler_calls = 0;
+static _Atomic int g_hf_buffering = 0;    /* Samples held outside the ring buffer */
+
+/* Single-writer increment: a relaxed load and store, no locked instruction */
+#define HF_COUNTER_ADD(counter, n) \
+    atomic_store_explicit(&(counter), \
+        atomic_load_explicit(&(counter), memory_order_relaxed) + (n), \
+        memory_order_relaxed)
 
 /*
  * =============================================================================
@@ -195,6 +299,85 @@ static inline uint64_t get_thread_id_unsafe(void) {
 #endif
 }
 
+/**
+ * Read the calling thread's CPU clock - ASYNC-SIGNAL-SAFE
+ *
+ * clock_gettime is async-signal-safe per POSIX; on Linux it is served by
+ * the vDSO without a syscall for CLOCK_THREAD_CPUTIME_ID.
+ *
+ * @param out Receives the thread's consumed CPU time in nanoseconds.
+ * @return 1 on success, 0 if the clock is unavailable.
+ */
+static inline int get_thread_cpu_ns_unsafe(uint64_t* out) {
+#ifdef __linux__
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    *out = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    return 1;
+#else
+    (void)out;
+    return 0;
+#endif
+}
+
+/**
+ * CPU time consumed by this thread since its previous sample - ASYNC-SIGNAL-SAFE
+ *
+ * Unlike (sample count x nominal interval), this stays exact when the timer
+ * falls back to wall time (idle threads report ~0) or when signals coalesce.
+ * The first sample of a thread without a baseline (see
+ * signal_handler_thread_baseline()) is estimated as interval x weight.
+ *
+ * @param weight Timer expirations this sample stands for.
+ * @return Delta in nanoseconds, or SPPROF_CPU_TIME_UNKNOWN.
+ */
+static inline uint64_t thread_cpu_delta_unsafe(uint32_t weight) {
+    uint64_t now;
+    if (!get_thread_cpu_ns_unsafe(&now)) {
+        return SPPROF_CPU_TIME_UNKNOWN;
+    }
+
+    uint32_t epoch = atomic_load_explicit(&g_session_epoch, memory_order_relaxed);
+    uint64_t delta;
+    if (tl_cpu_epoch == epoch && now >= tl_last_cpu_ns) {
+        delta = now - tl_last_cpu_ns;
+    } else {
+        uint64_t estimate = g_nominal_interval_ns * weight;
+        delta = estimate < now ? estimate : now;
+    }
+
+    tl_last_cpu_ns = now;
+    tl_cpu_epoch = epoch;
+    return delta;
+}
+
+/**
+ * Label set id in a Context - ASYNC-SIGNAL-SAFE
+ *
+ * ContextVar.set() swaps in a new immutable variable mapping, so the one
+ * the interrupted thread's Context points at cannot change under us.
+ *
+ * @param context The interrupted code's Context (framewalker_current_context()).
+ * @return The spprof.labels() set id in that Context, 0 if none.
+ */
+static inline uint32_t current_label_unsafe(uintptr_t context) {
+    PyObject* var = atomic_load_explicit(&g_label_var, memory_order_acquire);
+    if (var == NULL) {
+        return 0;
+    }
+    PyObject* value = _spprof_context_lookup(&g_hamt_types, (PyObject*)context,
+                                             var, g_label_hash);
+    if (!_spprof_ptr_valid(value) || Py_TYPE(value) != &PyBytes_Type ||
+        Py_SIZE(value) != (Py_ssize_t)sizeof(uint32_t)) {
+        return 0;
+    }
+    uint32_t label_id;
+    memcpy(&label_id, ((PyBytesObject*)value)->ob_sval, sizeof(label_id));
+    return label_id;
+}
+
 /*
  * =============================================================================
  * Stack Capture (ASYNC-SIGNAL-SAFE)
@@ -215,17 +398,12 @@ static inline uint64_t get_thread_id_unsafe(void) {
 SPPROF_UNUSED
 static inline int
 capture_python_stack_unsafe(uintptr_t* frames, int max_depth) {
-#ifdef SPPROF_USE_INTERNAL_API
-    #if defined(SPPROF_FREE_THREADED) && SPPROF_FREE_THREADED && defined(__linux__)
-        /* Free-threaded Linux: Use speculative capture with validation */
-        return _spprof_capture_frames_speculative(frames, max_depth);
-    #else
-        /* GIL-enabled or Darwin (uses Mach sampler): Use direct capture */
-        return _spprof_capture_frames_unsafe(frames, max_depth);
-    #endif
+#if defined(SPPROF_FREE_THREADED) && SPPROF_FREE_THREADED && defined(__linux__)
+    /* Free-threaded Linux: Use speculative capture with validation */
+    return _spprof_capture_frames_speculative(frames, max_depth);
 #else
-    /* Fallback: use framewalker (may not be fully signal-safe) */
-    return framewalker_capture_raw(frames, max_depth);
+    /* GIL-enabled or Darwin (uses Mach sampler): Use direct capture */
+    return _spprof_capture_frames_unsafe(frames, max_depth);
 #endif
 }
 
@@ -238,22 +416,12 @@ capture_python_stack_unsafe(uintptr_t* frames, int max_depth) {
  */
 static inline int
 capture_python_stack_with_instr_unsafe(uintptr_t* frames, uintptr_t* instr_ptrs, int max_depth) {
-#ifdef SPPROF_USE_INTERNAL_API
-    #if defined(SPPROF_FREE_THREADED) && SPPROF_FREE_THREADED && defined(__linux__)
-        /* Free-threaded Linux: Use speculative capture with validation */
-        return _spprof_capture_frames_with_instr_speculative(frames, instr_ptrs, max_depth);
-    #else
-        /* GIL-enabled or Darwin (uses Mach sampler): Use direct capture */
-        return _spprof_capture_frames_with_instr_unsafe(frames, instr_ptrs, max_depth);
-    #endif
+#if defined(SPPROF_FREE_THREADED) && SPPROF_FREE_THREADED && defined(__linux__)
+    /* Free-threaded Linux: Use speculative capture with validation */
+    return _spprof_capture_frames_with_instr_speculative(frames, instr_ptrs, max_depth);
 #else
-    /* Fallback: capture frames only, no instruction pointers */
-    int depth = framewalker_capture_raw(frames, max_depth);
-    /* Zero out instruction pointers - resolver will use first line */
-    for (int i = 0; i < depth; i++) {
-        instr_ptrs[i] = 0;
-    }
-    return depth;
+    /* GIL-enabled or Darwin (uses Mach sampler): Use direct capture */
+    return _spprof_capture_frames_with_instr_unsafe(frames, instr_ptrs, max_depth);
 #endif
 }
 
@@ -276,6 +444,56 @@ capture_native_stack_unsafe(NativeStack* stack, int skip) {
  * =============================================================================
  */
 
+/**
+ * High-frequency capture path - ASYNC-SIGNAL-SAFE
+ *
+ * Writes one compact sample into the preallocated buffer. Runs only on the
+ * sampled thread, so the buffer index needs no atomic read-modify-write.
+ *
+ * @param samples The high-frequency buffer
+ * @param info Signal info (for timer overruns)
+ * @param timestamp Handler entry time
+ */
+static void hf_capture_unsafe(HFSample* samples, siginfo_t* info, uint64_t timestamp) {
+    uint32_t weight = 1;
+#ifdef __linux__
+    if (info != NULL && info->si_code == SI_TIMER && info->si_overrun > 0) {
+        weight += (uint32_t)info->si_overrun;
+        HF_COUNTER_ADD(g_hf_overruns, (uint64_t)info->si_overrun);
+    }
+#else
+    (void)info;
+#endif
+    
+    size_t idx = atomic_load_explicit(&g_hf_count, memory_order_relaxed);
+    size_t consumed = atomic_load_explicit(&g_hf_consumed, memory_order_acquire);
+    if (idx - consumed >= g_hf_capacity) {
+        HF_COUNTER_ADD(g_hf_dropped, 1);
+        return;
+    }
+    
+    HFSample* sample = &samples[idx % g_hf_capacity];
+    sample->code_generation = code_registry_generation();
+    sample->timestamp = timestamp;
+    sample->weight = weight;
+    sample->context = framewalker_current_context();
+    sample->label_id = current_label_unsafe(sample->context);
+    sample->cpu_time_ns = thread_cpu_delta_unsafe(weight);
+    sample->depth = capture_python_stack_with_instr_unsafe(
+        sample->frames,
+        sample->instr_ptrs,
+        SPPROF_HF_MAX_DEPTH
+    );
+    
+    if (sample->depth > 0) {
+        /* Publish the slot to signal_handler_hf_flush() */
+        atomic_store_explicit(&g_hf_count, idx + 1, memory_order_release);
+    }
+    
+    HF_COUNTER_ADD(g_hf_handler_ns, get_timestamp_ns_unsafe() - timestamp);
+    HF_COUNTER_ADD(g_hf_handler_calls, 1);
+}
+
 /**
  * Production signal handler - ASYNC-SIGNAL-SAFE
  *
@@ -291,13 +509,13 @@ capture_native_stack_unsafe(NativeStack* stack, int skip) {
  *   ✓ Uses only stack-allocated storage
  *
  * FREE-THREADING:
- *   On free-threaded builds (Py_GIL_DISABLED) without Darwin/Mach support,
- *   this handler returns immediately without capturing frames to avoid
- *   unsafe frame chain walking. See module.c for the user-facing error.
+ *   On free-threaded Linux builds frames are captured speculatively with
+ *   validation. On other free-threaded platforms without Darwin/Mach
+ *   support this handler returns immediately without capturing frames.
+ *   See module.c for the user-facing error.
  */
 void spprof_signal_handler(int signum, siginfo_t* info, void* ucontext) {
     (void)signum;
-    (void)info;
     (void)ucontext;
     
 #ifdef SPPROF_SIGNAL_HANDLER_DISABLED
@@ -327,14 +545,54 @@ void spprof_signal_handler(int signum, siginfo_t* info, void* ucontext) {
     /* Get timestamp immediately (most accurate timing) */
     uint64_t timestamp = get_timestamp_ns_unsafe();
     
+    /*
+     * Lean single-thread path for sub-millisecond intervals. The counter
+     * is raised before the buffer is loaded, so signal_handler_hf_disable()
+     * cannot free a buffer this handler is still writing.
+     */
+    if (atomic_load_explicit(&g_hf_samples, memory_order_relaxed) != NULL) {
+        atomic_fetch_add(&g_hf_in_handler, 1);
+        HFSample* samples = atomic_load(&g_hf_samples);
+        if (samples != NULL) {
+            hf_capture_unsafe(samples, info, timestamp);
+        }
+        atomic_fetch_sub(&g_hf_in_handler, 1);
+        g_in_handler = 0;
+        return;
+    }
+    
     /* Get thread ID */
     uint64_t thread_id = get_thread_id_unsafe();
     
+    /*
+     * Weight the sample by the number of timer expirations it stands for.
+     * When the handler runs late (busy machine, long GIL hold, signal
+     * coalescing) the kernel delivers one SIGPROF and reports the missed
+     * expirations in si_overrun. Folding them into the weight keeps the
+     * profile proportional to real CPU time instead of under-counting the
+     * busiest threads.
+     */
+    uint32_t weight = atomic_load_explicit(&g_weight_scale, memory_order_relaxed);
+#ifdef __linux__
+    if (info != NULL && info->si_code == SI_TIMER && info->si_overrun > 0) {
+        weight += weight * (uint32_t)info->si_overrun;
+        atomic_fetch_add_explicit(&g_timer_overruns, (uint64_t)info->si_overrun,
+                                  memory_order_relaxed);
+    }
+#else
+    (void)info;
+#endif
+    
     /* Stack-allocated sample buffer */
     RawSample sample;
+    sample.code_generation = code_registry_generation();
     sample.timestamp = timestamp;
     sample.thread_id = thread_id;
     sample.native_depth = 0;
+    sample.weight = weight;
+    sample.context = framewalker_current_context();
+    sample.label_id = current_label_unsafe(sample.context);
+    sample.cpu_time_ns = thread_cpu_delta_unsafe(weight);
     
     /* Capture Python frames with instruction pointers for accurate line numbers */
     sample.depth = capture_python_stack_with_instr_unsafe(
@@ -364,6 +622,11 @@ void spprof_signal_handler(int signum, siginfo_t* info, void* ucontext) {
         }
     }
     
+    /* Account handler cost (entry to exit) for the overhead controller */
+    uint64_t elapsed = get_timestamp_ns_unsafe() - timestamp;
+    atomic_fetch_add_explicit(&g_handler_ns, elapsed, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_handler_calls, 1, memory_order_relaxed);
+    
     /* Clear reentrancy guard */
     g_in_handler = 0;
 }
@@ -446,6 +709,15 @@ void signal_handler_start(void) {
     atomic_store(&g_samples_captured, 0);
     atomic_store(&g_samples_dropped, 0);
     atomic_store(&g_handler_errors, 0);
+    atomic_store(&g_timer_overruns, 0);
+    atomic_store(&g_handler_ns, 0);
+    atomic_store(&g_handler_calls, 0);
+#if defined(SPPROF_FREE_THREADED) && SPPROF_FREE_THREADED && defined(__linux__)
+    atomic_store(&_spprof_samples_dropped_validation, 0);
+#endif
+    
+    /* Invalidate per-thread CPU baselines from earlier sessions */
+    atomic_fetch_add(&g_session_epoch, 1);
     
     /* Enable sample capture */
     g_profiler_active = 1;
@@ -458,6 +730,179 @@ void signal_handler_stop(void) {
     g_profiler_active = 0;
 }
 
+/**
+ * Accept samples again, keeping statistics
+ */
+void signal_handler_resume(void) {
+    atomic_fetch_add(&g_session_epoch, 1);
+    g_profiler_active = 1;
+}
+
+/**
+ * Record the nominal timer interval
+ */
+void signal_handler_set_interval(uint64_t interval_ns) {
+    g_nominal_interval_ns = interval_ns;
+}
+
+/**
+ * Record the calling thread's CPU clock baseline
+ */
+void signal_handler_thread_baseline(void) {
+    uint64_t now;
+    if (get_thread_cpu_ns_unsafe(&now)) {
+        tl_last_cpu_ns = now;
+        tl_cpu_epoch = atomic_load(&g_session_epoch);
+    }
+}
+
+/**
+ * Enter high-frequency mode for the calling thread
+ */
+int signal_handler_hf_enable(size_t capacity) {
+    SPPROF_ASSERT_NOT_IN_SIGNAL("signal_handler_hf_enable");
+    
+    if (atomic_load(&g_hf_samples) != NULL) {
+        return 0;
+    }
+    
+    HFSample* samples = malloc(capacity * sizeof(HFSample));
+    if (samples == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    
+    g_hf_capacity = capacity;
+    g_hf_thread_id = get_thread_id_unsafe();
+    atomic_store(&g_hf_count, 0);
+    atomic_store(&g_hf_consumed, 0);
+    atomic_store(&g_hf_dropped, 0);
+    atomic_store(&g_hf_overruns, 0);
+    atomic_store(&g_hf_handler_ns, 0);
+    atomic_store(&g_hf_handler_calls, 0);
+    atomic_store(&g_hf_buffering, 1);
+    atomic_store(&g_hf_samples, samples);
+    return 0;
+}
+
+/**
+ * Move published high-frequency samples into the ring buffer.
+ *
+ * Caller holds g_hf_consumer_lock, which keeps the buffer alive.
+ *
+ * @param samples The high-frequency buffer
+ * @return Number of samples written to the ring buffer
+ */
+static size_t hf_replay_locked(const HFSample* samples) {
+    size_t count = atomic_load_explicit(&g_hf_count, memory_order_acquire);
+    size_t consumed = atomic_load_explicit(&g_hf_consumed, memory_order_relaxed);
+    size_t replayed = 0;
+    uint64_t dropped = 0;
+    
+    /* RawSample is several KB; keep it off the stack */
+    static RawSample raw;
+    raw.thread_id = g_hf_thread_id;
+    raw.native_depth = 0;
+    
+    for (; consumed < count; consumed++) {
+        const HFSample* hf = &samples[consumed % g_hf_capacity];
+        raw.timestamp = hf->timestamp;
+        raw.cpu_time_ns = hf->cpu_time_ns;
+        raw.weight = hf->weight;
+        raw.label_id = hf->label_id;
+        raw.context = hf->context;
+        raw.code_generation = hf->code_generation;
+        raw.depth = hf->depth;
+        memcpy(raw.frames, hf->frames, (size_t)hf->depth * sizeof(uintptr_t));
+        memcpy(raw.instr_ptrs, hf->instr_ptrs, (size_t)hf->depth * sizeof(uintptr_t));
+        
+        if (g_ringbuffer != NULL && ringbuffer_write(g_ringbuffer, &raw)) {
+            replayed++;
+        } else {
+            dropped++;
+        }
+    }
+    
+    /* Count before releasing the slots so statistics never miss them */
+    atomic_fetch_add(&g_samples_captured, (uint64_t)replayed);
+    atomic_fetch_add(&g_samples_dropped, dropped);
+    atomic_store_explicit(&g_hf_consumed, consumed, memory_order_release);
+    return replayed;
+}
+
+/**
+ * Move high-frequency samples into the ring buffer without leaving the mode
+ */
+size_t signal_handler_hf_flush(void) {
+    SPPROF_ASSERT_NOT_IN_SIGNAL("signal_handler_hf_flush");
+    
+    if (atomic_load(&g_hf_samples) == NULL) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&g_hf_consumer_lock);
+    size_t replayed = 0;
+    HFSample* samples = atomic_load(&g_hf_samples);
+    if (samples != NULL) {
+        replayed = hf_replay_locked(samples);
+    }
+    pthread_mutex_unlock(&g_hf_consumer_lock);
+    return replayed;
+}
+
+/**
+ * Replay high-frequency samples and leave high-frequency mode
+ */
+size_t signal_handler_hf_disable(void) {
+    SPPROF_ASSERT_NOT_IN_SIGNAL("signal_handler_hf_disable");
+    
+    pthread_mutex_lock(&g_hf_consumer_lock);
+    HFSample* samples = atomic_load(&g_hf_samples);
+    if (samples == NULL) {
+        pthread_mutex_unlock(&g_hf_consumer_lock);
+        return 0;
+    }
+    atomic_store(&g_hf_samples, NULL);
+    
+    /*
+     * The sampled thread may be another thread, so a SIGPROF already
+     * pending there is not drained by the caller's sigtimedwait(). Wait
+     * out any handler that loaded the buffer before it was cleared; later
+     * ones see NULL. A handler interrupting this thread finishes before
+     * the loop resumes, so the wait cannot deadlock.
+     */
+    while (atomic_load(&g_hf_in_handler) != 0) {
+        sched_yield();
+    }
+    
+    size_t replayed = hf_replay_locked(samples);
+    
+    /* Fold into the regular counters so statistics survive the switch */
+    atomic_fetch_add(&g_samples_dropped, atomic_load(&g_hf_dropped));
+    atomic_fetch_add(&g_timer_overruns, atomic_load(&g_hf_overruns));
+    atomic_fetch_add(&g_handler_ns, atomic_load(&g_hf_handler_ns));
+    atomic_fetch_add(&g_handler_calls, atomic_load(&g_hf_handler_calls));
+    atomic_store(&g_hf_count, 0);
+    atomic_store(&g_hf_consumed, 0);
+    atomic_store(&g_hf_dropped, 0);
+    atomic_store(&g_hf_overruns, 0);
+    atomic_store(&g_hf_handler_ns, 0);
+    atomic_store(&g_hf_handler_calls, 0);
+    
+    free(samples);
+    g_hf_capacity = 0;
+    atomic_store_explicit(&g_hf_buffering, 0, memory_order_release);
+    pthread_mutex_unlock(&g_hf_consumer_lock);
+    return replayed;
+}
+
+/**
+ * Check for high-frequency samples not yet in the ring buffer
+ */
+int signal_handler_hf_buffering(void) {
+    return atomic_load_explicit(&g_hf_buffering, memory_order_acquire);
+}
+
 /**
  * Configure native frame capture
  */
@@ -471,18 +916,60 @@ void signal_handler_set_native(int enabled) {
  * =============================================================================
  */
 
+/*
+ * High-frequency counters are folded into the regular ones by
+ * signal_handler_hf_disable(); until then both are summed. Samples count
+ * as captured once they leave the high-frequency buffer.
+ */
+
 uint64_t signal_handler_samples_captured(void) {
-    return atomic_load(&g_samples_captured);
+    size_t consumed = atomic_load(&g_hf_consumed);
+    size_t buffered = atomic_load(&g_hf_count) - consumed;
+    return atomic_load(&g_samples_captured) + (uint64_t)buffered;
 }
 
 uint64_t signal_handler_samples_dropped(void) {
-    return atomic_load(&g_samples_dropped);
+    return atomic_load(&g_samples_dropped) + atomic_load(&g_hf_dropped);
 }
 
 uint64_t signal_handler_errors(void) {
     return atomic_load(&g_handler_errors);
 }
 
+uint64_t signal_handler_timer_overruns(void) {
+    return atomic_load(&g_timer_overruns) + atomic_load(&g_hf_overruns);
+}
+
+uint64_t signal_handler_handler_ns(void) {
+    return atomic_load(&g_handler_ns) + atomic_load(&g_hf_handler_ns);
+}
+
+uint64_t signal_handler_handler_calls(void) {
+    return atomic_load(&g_handler_calls) + atomic_load(&g_hf_handler_calls);
+}
+
+void signal_handler_set_weight_scale(uint32_t scale) {
+    atomic_store(&g_weight_scale, scale > 0 ? scale : 1);
+}
+
+int signal_handler_set_label_var(PyObject* var) {
+    if (atomic_load(&g_label_var) != NULL) {
+        return 1;
+    }
+    Py_hash_t hash = PyObject_Hash(var);
+    if (hash == -1) {
+        return -1;
+    }
+    int found = _spprof_hamt_learn_types(&g_hamt_types);
+    if (found <= 0) {
+        return found;
+    }
+    g_label_hash = _spprof_hamt_hash(hash);
+    Py_INCREF(var);
+    atomic_store_explicit(&g_label_var, var, memory_order_release);
+    return 1;
+}
+
 /**
  * Get number of samples dropped due to validation failures (free-threading).
  *
@@ -14,7 +14,9 @@
 #ifndef SPPROF_SIGNAL_HANDLER_H
 #define SPPROF_SIGNAL_HANDLER_H
 
+#include <Python.h>
 #include <stdint.h>
+#include <stddef.h>
 
 /* Include signal.h only on POSIX systems */
 #ifndef _WIN32
@@ -70,6 +72,34 @@ void signal_handler_start(void);
  */
 void signal_handler_stop(void);
 
+/**
+ * Accept samples again after signal_handler_stop() within the same session.
+ *
+ * Unlike signal_handler_start(), statistics are kept. Per-thread CPU
+ * baselines are invalidated so time spent while paused is not attributed
+ * to the first sample after resuming.
+ */
+void signal_handler_resume(void);
+
+/**
+ * Record the nominal sampling interval.
+ *
+ * Used to estimate the CPU time of a thread's first sample when no
+ * baseline was recorded for it. Call before signal_handler_start().
+ *
+ * @param interval_ns Timer interval in nanoseconds
+ */
+void signal_handler_set_interval(uint64_t interval_ns);
+
+/**
+ * Record the calling thread's CPU clock as its sampling baseline.
+ *
+ * Call on the thread itself right after its timer is armed, so the first
+ * sample's CPU delta covers only time spent while profiling.
+ * Must be called after signal_handler_start() for the current session.
+ */
+void signal_handler_thread_baseline(void);
+
 /**
  * Enable or disable native (C-stack) frame capture.
  *
@@ -101,6 +131,133 @@ uint64_t signal_handler_samples_dropped(void);
  */
 uint64_t signal_handler_errors(void);
 
+/**
+ * Get number of timer overruns folded into sample weights.
+ *
+ * Each SIGPROF reports (via si_overrun) how many timer expirations were
+ * missed before the signal was delivered. The handler adds them to the
+ * sample's weight; this counter is the running total since start.
+ *
+ * @return Total overruns observed by the handler (0 on non-Linux)
+ */
+uint64_t signal_handler_timer_overruns(void);
+
+/**
+ * Get total time spent inside the signal handler.
+ *
+ * Measured from handler entry to exit (CLOCK_MONOTONIC) for every
+ * invocation that took a sample. Kernel signal delivery is not included.
+ *
+ * @return Nanoseconds spent in the handler since start
+ */
+uint64_t signal_handler_handler_ns(void);
+
+/**
+ * Get number of handler invocations included in signal_handler_handler_ns().
+ *
+ * @return Number of timed handler invocations since start
+ */
+uint64_t signal_handler_handler_calls(void);
+
+/**
+ * Set the interval multiplier folded into sample weights.
+ *
+ * When the overhead controller slows timers to base_interval * scale,
+ * each sample stands for `scale` base intervals. Setting the scale keeps
+ * weighted profiles unbiased.
+ *
+ * @param scale Interval multiplier (>= 1)
+ */
+void signal_handler_set_weight_scale(uint32_t scale);
+
+/**
+ * Register the ContextVar holding the spprof.labels() set id.
+ *
+ * Each sample records the variable's value in the interrupted thread's
+ * current contextvars.Context: a 4-byte bytes object holding the id in
+ * native byte order, anything else reads as 0. The first registration
+ * wins and is kept for the process's lifetime. Platforms that sample
+ * threads from outside (macOS, Windows) do not read it and record 0.
+ *
+ * Thread safety: Call once with the GIL held, before sampling starts.
+ * Async-signal safety: NO.
+ *
+ * @param var The contextvars.ContextVar.
+ * @return 1 if samples will record labels, 0 if this interpreter's
+ *         Context layout is not recognised, -1 with an exception set.
+ */
+int signal_handler_set_label_var(PyObject* var);
+
+/*
+ * =============================================================================
+ * High-Frequency Mode
+ * =============================================================================
+ *
+ * For sub-millisecond intervals on a single thread, the handler switches to
+ * a lean path: Python frames only (no native unwinding), at most
+ * SPPROF_HF_MAX_DEPTH innermost frames, written into a preallocated buffer
+ * owned by the sampled thread. There is no ring buffer traffic and no atomic
+ * read-modify-write; resolution is deferred until the buffer is replayed
+ * into the ring buffer, by every drain (signal_handler_hf_flush()) and by
+ * signal_handler_hf_disable().
+ */
+
+/* Innermost frames kept per high-frequency sample */
+#define SPPROF_HF_MAX_DEPTH 32
+
+/* Shortest interval accepted in high-frequency mode (50 kHz) */
+#define SPPROF_HF_MIN_INTERVAL_NS 20000ULL
+
+/**
+ * Switch the handler to high-frequency mode for the calling thread.
+ *
+ * NOT async-signal-safe (allocates). Call before signal_handler_start().
+ * Only signals delivered to the calling thread should be armed while
+ * high-frequency mode is enabled.
+ *
+ * @param capacity Maximum number of samples to keep
+ * @return 0 on success, -1 on error (ENOMEM)
+ */
+int signal_handler_hf_enable(size_t capacity);
+
+/**
+ * Leave high-frequency mode.
+ *
+ * Replays the captured samples into the global ring buffer, folds the
+ * high-frequency counters into the regular statistics and frees the
+ * buffer. Call only after the timer is deleted. Waits for a handler still
+ * writing to the buffer on the sampled thread before freeing it. No-op if
+ * high-frequency mode is not enabled.
+ *
+ * @return Number of samples replayed into the ring buffer
+ */
+size_t signal_handler_hf_disable(void);
+
+/**
+ * Move the high-frequency samples captured so far into the ring buffer.
+ *
+ * Frees their slots for new samples, so a session that is drained
+ * periodically (snapshot()) is not limited to one buffer of samples.
+ * Safe to call while the timer runs, from any thread; no-op if
+ * high-frequency mode is not enabled.
+ *
+ * NOT async-signal-safe (takes a mutex).
+ *
+ * @return Number of samples moved into the ring buffer
+ */
+size_t signal_handler_hf_flush(void);
+
+/**
+ * Check if high-frequency samples are waiting outside the ring buffer.
+ *
+ * True from signal_handler_hf_enable() until signal_handler_hf_disable()
+ * has replayed them. Consumers that treat an empty ring buffer as "no
+ * samples pending" must also check this.
+ *
+ * @return 1 while samples are buffered, 0 otherwise
+ */
+int signal_handler_hf_buffering(void);
+
 /**
  * Get number of samples dropped due to validation failures.
  *
@@ -0,0 +1,428 @@
+/**
+ * stack_table.c - Interned string, frame and stack tables for drained samples
+ *
+ * See stack_table.h for the layout. Strings are hashed once per resolved
+ * frame; frames and stacks are hashed over the ids of their parts, so
+ * interning a sample whose stack was already seen costs D string lookups,
+ * D frame lookups and one stack lookup, with no allocation.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stack_table.h"
+
+/* Initial slot count of each index (power of 2) */
+#define STACK_TABLE_INITIAL_SLOTS 1024
+
+/* Initial element count of each growable array */
+#define STACK_TABLE_INITIAL_CAPACITY 256
+
+/* Ids are stored as id + 1 in index slots, so the largest usable id is one less */
+#define STACK_TABLE_MAX_ID (UINT32_MAX - 1)
+
+/* ============================================================================
+ * Hashing
+ * ============================================================================ */
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint32_t fold_hash(uint64_t hash) {
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+/* ============================================================================
+ * Growable arrays and indexes
+ * ============================================================================ */
+
+/**
+ * Ensure *ptr has room for `needed` elements of `elem_size` bytes.
+ *
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int ensure_capacity(void** ptr, size_t* capacity, size_t needed, size_t elem_size) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+    size_t new_capacity = *capacity > 0 ? *capacity : STACK_TABLE_INITIAL_CAPACITY;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    void* grown = realloc(*ptr, new_capacity * elem_size);
+    if (grown == NULL) {
+        return -1;
+    }
+    *ptr = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/**
+ * Reallocate *ptr to hold `count` elements; *ptr is unchanged on failure.
+ *
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int resize_array(void** ptr, size_t count, size_t elem_size) {
+    void* resized = realloc(*ptr, count * elem_size);
+    if (resized == NULL) {
+        return -1;
+    }
+    *ptr = resized;
+    return 0;
+}
+
+static int index_init(StackTableIndex* index) {
+    index->slots = (StackTableSlot*)calloc(STACK_TABLE_INITIAL_SLOTS, sizeof(StackTableSlot));
+    if (index->slots == NULL) {
+        return -1;
+    }
+    index->mask = STACK_TABLE_INITIAL_SLOTS - 1;
+    index->used = 0;
+    return 0;
+}
+
+/**
+ * Double the slot count once the index is 3/4 full.
+ *
+ * @return 0 on success, -1 on allocation failure.
+ */
+static int index_reserve(StackTableIndex* index) {
+    size_t slot_count = index->mask + 1;
+    if ((index->used + 1) * 4 <= slot_count * 3) {
+        return 0;
+    }
+
+    size_t new_count = slot_count * 2;
+    StackTableSlot* slots = (StackTableSlot*)calloc(new_count, sizeof(StackTableSlot));
+    if (slots == NULL) {
+        return -1;
+    }
+    size_t new_mask = new_count - 1;
+    for (size_t i = 0; i < slot_count; i++) {
+        StackTableSlot slot = index->slots[i];
+        if (slot.id_plus_one == 0) {
+            continue;
+        }
+        size_t pos = slot.hash & new_mask;
+        while (slots[pos].id_plus_one != 0) {
+            pos = (pos + 1) & new_mask;
+        }
+        slots[pos] = slot;
+    }
+    free(index->slots);
+    index->slots = slots;
+    index->mask = new_mask;
+    return 0;
+}
+
+/* ============================================================================
+ * Interning
+ * ============================================================================ */
+
+static int intern_string(StackTable* table, const char* str, uint32_t* id) {
+    size_t len = strlen(str);
+    uint32_t hash = fold_hash(fnv1a(FNV_OFFSET_BASIS, str, len));
+    StackTableIndex* index = &table->string_index;
+
+    size_t pos = hash & index->mask;
+    while (index->slots[pos].id_plus_one != 0) {
+        StackTableSlot slot = index->slots[pos];
+        if (slot.hash == hash && strcmp(table->strings[slot.id_plus_one - 1], str) == 0) {
+            *id = slot.id_plus_one - 1;
+            return 0;
+        }
+        pos = (pos + 1) & index->mask;
+    }
+
+    if (table->string_count >= STACK_TABLE_MAX_ID ||
+        ensure_capacity((void**)&table->strings, &table->string_capacity,
+                        table->string_count + 1, sizeof(char*)) < 0) {
+        return -1;
+    }
+    char* copy = (char*)malloc(len + 1);
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(copy, str, len + 1);
+
+    uint32_t new_id = (uint32_t)table->string_count;
+    table->strings[table->string_count++] = copy;
+    index->slots[pos].hash = hash;
+    index->slots[pos].id_plus_one = new_id + 1;
+    index->used++;
+    *id = new_id;
+    /* Grow after inserting so `pos` stayed valid above */
+    return index_reserve(index);
+}
+
+static int intern_frame(StackTable* table, const ResolvedFrame* resolved, uint32_t* id) {
+    StackTableFrame frame;
+    if (intern_string(table, resolved->function_name, &frame.function) < 0 ||
+        intern_string(table, resolved->filename, &frame.filename) < 0) {
+        return -1;
+    }
+    frame.lineno = (int32_t)resolved->lineno;
+    frame.is_native = resolved->is_native ? 1U : 0U;
+    frame.address = resolved->is_native ? (uint64_t)resolved->address : 0;
+
+    uint32_t hash = fold_hash(fnv1a(FNV_OFFSET_BASIS, &frame, sizeof(frame)));
+    StackTableIndex* index = &table->frame_index;
+
+    size_t pos = hash & index->mask;
+    while (index->slots[pos].id_plus_one != 0) {
+        StackTableSlot slot = index->slots[pos];
+        if (slot.hash == hash &&
+            memcmp(&table->frames[slot.id_plus_one - 1], &frame, sizeof(frame)) == 0) {
+            *id = slot.id_plus_one - 1;
+            return 0;
+        }
+        pos = (pos + 1) & index->mask;
+    }
+
+    if (table->frame_count >= STACK_TABLE_MAX_ID ||
+        ensure_capacity((void**)&table->frames, &table->frame_capacity,
+                        table->frame_count + 1, sizeof(StackTableFrame)) < 0) {
+        return -1;
+    }
+
+    uint32_t new_id = (uint32_t)table->frame_count;
+    table->frames[table->frame_count++] = frame;
+    index->slots[pos].hash = hash;
+    index->slots[pos].id_plus_one = new_id + 1;
+    index->used++;
+    *id = new_id;
+    return index_reserve(index);
+}
+
+int stack_table_intern_stack(StackTable* table, const ResolvedSample* sample,
+                             uint32_t* stack_id) {
+    size_t depth = sample->depth > 0 ? (size_t)sample->depth : 0;
+
+    /* Stage the frame ids at the tail of stack_frames; they are kept only
+     * if the stack turns out to be new */
+    if (ensure_capacity((void**)&table->stack_frames, &table->stack_frames_capacity,
+                        table->stack_frames_len + depth, sizeof(uint32_t)) < 0) {
+        return -1;
+    }
+    if (table->stack_frames_len + depth > UINT32_MAX) {
+        return -1;
+    }
+    uint32_t* staged = &table->stack_frames[table->stack_frames_len];
+    for (size_t i = 0; i < depth; i++) {
+        if (intern_frame(table, &sample->frames[i], &staged[i]) < 0) {
+            return -1;
+        }
+    }
+
+    uint32_t hash = fold_hash(fnv1a(FNV_OFFSET_BASIS, staged, depth * sizeof(uint32_t)));
+    StackTableIndex* index = &table->stack_index;
+
+    size_t pos = hash & index->mask;
+    while (index->slots[pos].id_plus_one != 0) {
+        StackTableSlot slot = index->slots[pos];
+        if (slot.hash == hash) {
+            uint32_t existing = slot.id_plus_one - 1;
+            uint32_t start = table->stack_offsets[existing];
+            size_t existing_depth = table->stack_offsets[existing + 1] - start;
+            if (existing_depth == depth &&
+                memcmp(&table->stack_frames[start], staged, depth * sizeof(uint32_t)) == 0) {
+                *stack_id = existing;
+                return 0;
+            }
+        }
+        pos = (pos + 1) & index->mask;
+    }
+
+    /* stack_offsets always holds stack_count + 1 entries */
+    if (table->stack_count >= STACK_TABLE_MAX_ID ||
+        ensure_capacity((void**)&table->stack_offsets, &table->stack_capacity,
+                        table->stack_count + 2, sizeof(uint32_t)) < 0) {
+        return -1;
+    }
+
+    uint32_t new_id = (uint32_t)table->stack_count;
+    table->stack_frames_len += depth;
+    table->stack_offsets[++table->stack_count] = (uint32_t)table->stack_frames_len;
+    index->slots[pos].hash = hash;
+    index->slots[pos].id_plus_one = new_id + 1;
+    index->used++;
+    *stack_id = new_id;
+    return index_reserve(index);
+}
+
+/* ============================================================================
+ * Public API
+ * ============================================================================ */
+
+StackTable* stack_table_create(void) {
+    StackTable* table = (StackTable*)calloc(1, sizeof(StackTable));
+    if (table == NULL) {
+        return NULL;
+    }
+    if (index_init(&table->string_index) < 0 ||
+        index_init(&table->frame_index) < 0 ||
+        index_init(&table->stack_index) < 0 ||
+        index_init(&table->aggregate_index) < 0 ||
+        ensure_capacity((void**)&table->stack_offsets, &table->stack_capacity,
+                        1, sizeof(uint32_t)) < 0) {
+        stack_table_destroy(table);
+        return NULL;
+    }
+    table->stack_offsets[0] = 0;
+    return table;
+}
+
+void stack_table_destroy(StackTable* table) {
+    if (table == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < table->string_count; i++) {
+        free(table->strings[i]);
+    }
+    free(table->strings);
+    free(table->frames);
+    free(table->stack_offsets);
+    free(table->stack_frames);
+    free(table->timestamps);
+    free(table->thread_ids);
+    free(table->cpu_times);
+    free(table->weights);
+    free(table->stack_ids);
+    free(table->label_ids);
+    free(table->task_ids);
+    free(table->aggregate_thread_ids);
+    free(table->aggregate_stack_ids);
+    free(table->aggregate_label_ids);
+    free(table->aggregate_task_ids);
+    free(table->aggregate_counts);
+    free(table->aggregate_weights);
+    free(table->aggregate_cpu_times);
+    free(table->string_index.slots);
+    free(table->frame_index.slots);
+    free(table->stack_index.slots);
+    free(table->aggregate_index.slots);
+    free(table);
+}
+
+int stack_table_add_sample(StackTable* table, const ResolvedSample* sample) {
+    uint32_t stack_id;
+    if (stack_table_intern_stack(table, sample, &stack_id) < 0) {
+        return -1;
+    }
+
+    /* All sample columns share sample_capacity; grow them together */
+    if (table->sample_count >= table->sample_capacity) {
+        size_t capacity = table->sample_capacity > 0
+            ? table->sample_capacity * 2 : STACK_TABLE_INITIAL_CAPACITY;
+        if (resize_array((void**)&table->timestamps, capacity, sizeof(uint64_t)) < 0 ||
+            resize_array((void**)&table->thread_ids, capacity, sizeof(uint64_t)) < 0 ||
+            resize_array((void**)&table->cpu_times, capacity, sizeof(uint64_t)) < 0 ||
+            resize_array((void**)&table->weights, capacity, sizeof(uint32_t)) < 0 ||
+            resize_array((void**)&table->stack_ids, capacity, sizeof(uint32_t)) < 0 ||
+            resize_array((void**)&table->label_ids, capacity, sizeof(uint32_t)) < 0 ||
+            resize_array((void**)&table->task_ids, capacity, sizeof(uint32_t)) < 0) {
+            return -1;
+        }
+        table->sample_capacity = capacity;
+    }
+
+    size_t i = table->sample_count++;
+    table->timestamps[i] = sample->timestamp;
+    table->thread_ids[i] = sample->thread_id;
+    table->cpu_times[i] = sample->cpu_time_ns;
+    table->weights[i] = sample->weight;
+    table->stack_ids[i] = stack_id;
+    table->label_ids[i] = sample->label_id;
+    table->task_ids[i] = sample->task_id;
+    return 0;
+}
+
+int stack_table_aggregate_sample(StackTable* table, const ResolvedSample* sample) {
+    uint32_t stack_id;
+    if (stack_table_intern_stack(table, sample, &stack_id) < 0) {
+        return -1;
+    }
+
+    uint64_t thread_id = sample->thread_id;
+    uint32_t label_id = sample->label_id;
+    uint32_t task_id = sample->task_id;
+    uint64_t key_hash = fnv1a(FNV_OFFSET_BASIS, &thread_id, sizeof(thread_id));
+    key_hash = fnv1a(key_hash, &label_id, sizeof(label_id));
+    key_hash = fnv1a(key_hash, &task_id, sizeof(task_id));
+    uint32_t hash = fold_hash(fnv1a(key_hash, &stack_id, sizeof(stack_id)));
+    StackTableIndex* index = &table->aggregate_index;
+
+    size_t pos = hash & index->mask;
+    size_t row = SIZE_MAX;
+    while (index->slots[pos].id_plus_one != 0) {
+        StackTableSlot slot = index->slots[pos];
+        uint32_t existing = slot.id_plus_one - 1;
+        if (slot.hash == hash &&
+            table->aggregate_stack_ids[existing] == stack_id &&
+            table->aggregate_thread_ids[existing] == thread_id &&
+            table->aggregate_label_ids[existing] == label_id &&
+            table->aggregate_task_ids[existing] == task_id) {
+            row = existing;
+            break;
+        }
+        pos = (pos + 1) & index->mask;
+    }
+
+    if (row == SIZE_MAX) {
+        if (table->aggregate_count >= STACK_TABLE_MAX_ID) {
+            return -1;
+        }
+        /* All aggregate columns share aggregate_capacity */
+        if (table->aggregate_count >= table->aggregate_capacity) {
+            size_t capacity = table->aggregate_capacity > 0
+                ? table->aggregate_capacity * 2 : STACK_TABLE_INITIAL_CAPACITY;
+            if (resize_array((void**)&table->aggregate_thread_ids, capacity, sizeof(uint64_t)) < 0 ||
+                resize_array((void**)&table->aggregate_stack_ids, capacity, sizeof(uint32_t)) < 0 ||
+                resize_array((void**)&table->aggregate_label_ids, capacity, sizeof(uint32_t)) < 0 ||
+                resize_array((void**)&table->aggregate_task_ids, capacity, sizeof(uint32_t)) < 0 ||
+                resize_array((void**)&table->aggregate_counts, capacity, sizeof(uint64_t)) < 0 ||
+                resize_array((void**)&table->aggregate_weights, capacity, sizeof(uint64_t)) < 0 ||
+                resize_array((void**)&table->aggregate_cpu_times, capacity, sizeof(uint64_t)) < 0) {
+                return -1;
+            }
+            table->aggregate_capacity = capacity;
+        }
+
+        row = table->aggregate_count++;
+        table->aggregate_thread_ids[row] = thread_id;
+        table->aggregate_stack_ids[row] = stack_id;
+        table->aggregate_label_ids[row] = label_id;
+        table->aggregate_task_ids[row] = task_id;
+        table->aggregate_counts[row] = 0;
+        table->aggregate_weights[row] = 0;
+        table->aggregate_cpu_times[row] = SPPROF_CPU_TIME_UNKNOWN;
+        index->slots[pos].hash = hash;
+        index->slots[pos].id_plus_one = (uint32_t)row + 1;
+        index->used++;
+        if (index_reserve(index) < 0) {
+            return -1;
+        }
+    }
+
+    table->aggregate_counts[row]++;
+    table->aggregate_weights[row] += sample->weight;
+    if (sample->cpu_time_ns != SPPROF_CPU_TIME_UNKNOWN) {
+        uint64_t total = table->aggregate_cpu_times[row];
+        table->aggregate_cpu_times[row] = (total == SPPROF_CPU_TIME_UNKNOWN ? 0 : total) +
+                                          sample->cpu_time_ns;
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+/**
+ * stack_table.h - Interned string, frame and stack tables for drained samples
+ *
+ * The dict-based drain API hands Python one dict per frame, so a session of
+ * N samples with D frames each costs N*D dicts before a single Sample object
+ * exists. A StackTable instead interns every resolved string, frame and
+ * stack once while draining, and records each sample as a handful of
+ * fixed-size column entries that point at an interned stack.
+ *
+ * Layout:
+ *   - strings: unique function names and file paths (id = index)
+ *   - frames:  unique (function, filename, lineno, is_native, address) tuples
+ *   - stacks:  unique frame-id sequences, leaf first, packed into
+ *              stack_frames; stack i spans
+ *              stack_frames[stack_offsets[i] .. stack_offsets[i + 1])
+ *   - samples: parallel columns (timestamp, thread, weight, cpu time, stack,
+ *              label set, asyncio task)
+ *   - aggregates: one row per unique (thread, stack, label set, task) with
+ *              its sample count, summed weight and summed CPU time, filled
+ *              instead of the sample columns when only totals are wanted
+ *
+ * Every lookup goes through an open-addressed index that stores the 32-bit
+ * hash next to the id, so growing an index never re-hashes keys.
+ *
+ * THREAD SAFETY:
+ *   A StackTable is owned by the single caller that fills it. No locking.
+ *
+ * ERROR HANDLING:
+ *   POSIX-style (Pattern 1): 0 on success, -1 on allocation failure or
+ *   when a table would exceed UINT32_MAX entries.
+ *
+ * Copyright (c) 2024 spprof contributors
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SPPROF_STACK_TABLE_H
+#define SPPROF_STACK_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "resolver.h"
+
+/**
+ * StackTableFrame - An interned frame; strings are ids into the string table
+ */
+typedef struct {
+    uint32_t function;      /* String id of the function name */
+    uint32_t filename;      /* String id of the source file or library path */
+    int32_t lineno;         /* Line number (0 for native) */
+    uint32_t is_native;     /* 1 if native C frame, 0 if Python */
+    uint64_t address;       /* Native PC (0 for Python frames) */
+} StackTableFrame;
+
+/**
+ * StackTableSlot - One open-addressing slot (id_plus_one == 0 means empty)
+ */
+typedef struct {
+    uint32_t hash;
+    uint32_t id_plus_one;
+} StackTableSlot;
+
+typedef struct {
+    StackTableSlot* slots;
+    size_t mask;            /* Slot count - 1 (slot count is a power of 2) */
+    size_t used;
+} StackTableIndex;
+
+/**
+ * StackTable - Interned tables plus per-sample columns
+ */
+typedef struct {
+    /* Strings */
+    char** strings;
+    size_t string_count;
+    size_t string_capacity;
+
+    /* Frames */
+    StackTableFrame* frames;
+    size_t frame_count;
+    size_t frame_capacity;
+
+    /* Stacks (stack_offsets holds stack_count + 1 entries) */
+    uint32_t* stack_offsets;
+    size_t stack_count;
+    size_t stack_capacity;
+    uint32_t* stack_frames;
+    size_t stack_frames_len;
+    size_t stack_frames_capacity;
+
+    /* Sample columns */
+    uint64_t* timestamps;
+    uint64_t* thread_ids;
+    uint64_t* cpu_times;    /* SPPROF_CPU_TIME_UNKNOWN when not measured */
+    uint32_t* weights;
+    uint32_t* stack_ids;
+    uint32_t* label_ids;    /* spprof.labels() set, 0 if none */
+    uint32_t* task_ids;     /* Tracked asyncio task, 0 if none */
+    size_t sample_count;
+    size_t sample_capacity;
+
+    /* Aggregate rows */
+    uint64_t* aggregate_thread_ids;
+    uint32_t* aggregate_stack_ids;
+    uint32_t* aggregate_label_ids;
+    uint32_t* aggregate_task_ids;
+    uint64_t* aggregate_counts;
+    uint64_t* aggregate_weights;
+    uint64_t* aggregate_cpu_times;  /* SPPROF_CPU_TIME_UNKNOWN until one is measured */
+    size_t aggregate_count;
+    size_t aggregate_capacity;
+
+    StackTableIndex string_index;
+    StackTableIndex frame_index;
+    StackTableIndex stack_index;
+    StackTableIndex aggregate_index;
+} StackTable;
+
+/**
+ * Create an empty stack table.
+ *
+ * @return New table, or NULL on allocation failure.
+ */
+StackTable* stack_table_create(void);
+
+/**
+ * Free a stack table and everything it owns. Accepts NULL.
+ *
+ * @param table Table returned by stack_table_create().
+ */
+void stack_table_destroy(StackTable* table);
+
+/**
+ * Intern the frames of a resolved sample as a stack.
+ *
+ * @param table Table to intern into.
+ * @param sample Resolved sample whose frames form the stack.
+ * @param stack_id Receives the id of the (possibly pre-existing) stack.
+ * @return 0 on success, -1 on error.
+ */
+int stack_table_intern_stack(StackTable* table, const ResolvedSample* sample,
+                             uint32_t* stack_id);
+
+/**
+ * Intern a resolved sample's stack and append it to the sample columns.
+ *
+ * @param table Table to append to.
+ * @param sample Resolved sample.
+ * @return 0 on success, -1 on error.
+ */
+int stack_table_add_sample(StackTable* table, const ResolvedSample* sample);
+
+/**
+ * Intern a resolved sample's stack and fold it into its (thread, stack)
+ * aggregate row. Sample columns are left untouched.
+ *
+ * @param table Table to aggregate into.
+ * @param sample Resolved sample.
+ * @return 0 on success, -1 on error.
+ */
+int stack_table_aggregate_sample(StackTable* table, const ResolvedSample* sample);
+
+#endif /* SPPROF_STACK_TABLE_H */
@@ -14,6 +14,7 @@
 #endif
 
 #include "unwind.h"
+#include "native_symbols.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -110,6 +111,27 @@ const char* unwind_method_name(void) {
 #endif
 }
 
+#if defined(SPPROF_HAS_LIBUNWIND) || defined(SPPROF_HAS_BACKTRACE)
+/**
+ * Name a frame from the symbol cache index (native_symbols.h).
+ *
+ * @return 1 if the frame was resolved, 0 to fall back to dladdr().
+ */
+static int resolve_from_index(NativeFrame* frame) {
+    NativeSymbol symbol;
+    if (!native_symbols_lookup(frame->ip, &symbol)) {
+        return 0;
+    }
+    snprintf(frame->symbol, sizeof(frame->symbol), "%s", symbol.name);
+    /* Module paths can be longer than a frame keeps */
+    snprintf(frame->filename, sizeof(frame->filename), "%.*s",
+             (int)sizeof(frame->filename) - 1, symbol.path);
+    frame->offset = frame->ip - symbol.address;
+    frame->resolved = 1;
+    return 1;
+}
+#endif
+
 #if defined(SPPROF_HAS_LIBUNWIND)
 /*
  * libunwind-based stack capture (Linux)
@@ -202,6 +224,11 @@ int unwind_resolve_symbols(NativeStack* stack) {
             continue;
         }
 
+        if (resolve_from_index(frame)) {
+            resolved++;
+            continue;
+        }
+
         /* Use dladdr for additional resolution */
         Dl_info info;
         if (dladdr((void*)frame->ip, &info) != 0) {
@@ -437,6 +464,11 @@ int unwind_resolve_symbols(NativeStack* stack) {
     for (int i = 0; i < stack->depth; i++) {
         NativeFrame* frame = &stack->frames[i];
 
+        if (resolve_from_index(frame)) {
+            resolved++;
+            continue;
+        }
+
         /* Use dladdr for symbol resolution */
         Dl_info info;
         if (dladdr((void*)frame->ip, &info) != 0) {
@@ -1,11 +1,15 @@
 """Type stubs for spprof._native C extension (internal)."""
 
+import contextvars
+import os
 from typing import Any
 
 # --- Internal C Extension Functions ---
 # These are implementation details; use spprof.* public API instead.
 
-def _start(interval_ns: int) -> None:
+def _start(
+    interval_ns: int, overhead_budget_pct: float = 0.0, high_frequency: bool = False
+) -> None:
     """Start profiling (internal). Use spprof.start() instead."""
     ...
 
@@ -13,10 +17,87 @@ def _stop() -> list[dict[str, Any]]:
     """Stop profiling and return raw samples (internal)."""
     ...
 
+def _after_fork_child() -> bool:
+    """Drop the parent's samples and re-arm sampling in a forked child (internal, Linux)."""
+    ...
+
+def _drain_columnar(
+    aggregate: bool = False, tasks: dict[int, int] | None = None
+) -> dict[str, Any]:
+    """Drain pending samples into interned tables and per-sample or per-stack columns (internal)."""
+    ...
+
+def _write_collapsed(fd: int, columns: Any, mark_native: bool = True) -> None:
+    """Stream folded stacks for columnar samples to a file descriptor (internal)."""
+    ...
+
+def _write_speedscope(fd: int, columns: Any, interval_ms: float, exporter: str) -> None:
+    """Stream speedscope JSON for columnar samples to a file descriptor (internal)."""
+    ...
+
+def _write_pprof(
+    fd: int, columns: Any, interval_ms: float, time_nanos: int, duration_nanos: int
+) -> bool:
+    """Stream a pprof profile to a file descriptor; True if gzip-compressed (internal)."""
+    ...
+
+def _write_perfetto(
+    fd: int,
+    columns: Any,
+    interval_ms: float,
+    pid: int,
+    process_name: str,
+    timestamp_offset_ns: int,
+) -> None:
+    """Stream a Perfetto trace with one track per thread to a file descriptor (internal)."""
+    ...
+
+def _write_perf_script(
+    fd: int,
+    map_fd: int,
+    columns: Any,
+    interval_ms: float,
+    pid: int,
+    comm: str,
+    map_name: str,
+) -> None:
+    """Stream perf script text and its perf map to file descriptors (internal)."""
+    ...
+
+def _capture_samples(fd: int, codes: list[Any]) -> dict[str, int]:
+    """Drain raw samples unresolved into .spprof chunks; appends new code objects (internal)."""
+    ...
+
+def _capture_write_chunk(fd: int, type: int, data: bytes) -> None:
+    """Append one chunk to a .spprof capture file (internal)."""
+    ...
+
+def _module_map() -> list[tuple[int, int, int, str, str, bool]]:
+    """Snapshot loaded modules as (start, limit, offset, path, build_id, is_python) (internal)."""
+    ...
+
+def _remote_sample(
+    pid: int, runtime: int
+) -> list[tuple[int, int, tuple[tuple[int, int], ...]]]:
+    """Sample pid's threads as (thread_id, native_id, ((code, offset), ...)) (internal)."""
+    ...
+
+def _remote_code(pid: int, code_type: int, code: int) -> tuple[str, str, int, bytes, int] | None:
+    """Read (name, filename, firstlineno, linetable, code_size) of pid's code (internal)."""
+    ...
+
 def _is_active() -> bool:
     """Check if profiling is active."""
     ...
 
+def _pause() -> None:
+    """Disarm sampling timers without ending the session."""
+    ...
+
+def _resume() -> None:
+    """Re-arm sampling timers disarmed by _pause()."""
+    ...
+
 def _get_stats() -> dict[str, Any]:
     """Get current profiling statistics."""
     ...
@@ -29,6 +110,10 @@ def _unregister_thread() -> bool:
     """Unregister current thread from sampling. Returns True on success."""
     ...
 
+def _set_label_var(var: contextvars.ContextVar[bytes]) -> bool:
+    """Register the ContextVar holding the label set id (internal)."""
+    ...
+
 # --- Native Unwinding Functions ---
 
 def _set_native_unwinding(enabled: bool) -> None:
@@ -55,7 +140,8 @@ def _set_safe_mode(enabled: bool) -> None:
     When safe mode is enabled, code objects captured without holding a
     reference (signal-handler samples on Linux) will be discarded rather
     than validated via PyCode_Check. This trades sample completeness for
-    guaranteed memory safety.
+    guaranteed memory safety. On Python 3.12+ code object lifetimes are
+    tracked instead, and safe mode discards nothing.
 
     Note: Darwin/Mach samples are always safe (INCREF'd during capture).
     Safe mode only affects Linux signal-handler samples.
@@ -77,6 +163,61 @@ def _get_code_registry_stats() -> dict[str, Any]:
         - invalid_count: Validations that returned invalid
         - safe_mode_rejects: Samples discarded due to safe mode
         - safe_mode_enabled: Whether safe mode is enabled
+        - lifetime_tracking: Whether code object destruction is tracked (3.12+)
+        - retired_held: Snapshots of destroyed code objects currently kept
+        - retired_resolved: Frames resolved from such a snapshot
+    """
+    ...
+
+def _set_resolver_workers(workers: int) -> None:
+    """Set the number of threads that resolve drained samples.
+
+    Args:
+        workers: 0 for one per online CPU (at most 8), 1 to resolve in
+            the draining thread only.
+    """
+    ...
+
+def _get_resolver_stats() -> dict[str, int]:
+    """Get resolver code cache statistics since the last start.
+
+    Returns a dict with:
+        - cache_hits: Python frames found in the code cache
+        - cache_misses: Code objects read on a miss
+        - cache_collisions: Cache slots evicted
+        - cache_reinserts: Evicted code objects read again (keeping their id)
+        - invalid_frames: Python frames that could not be resolved
+    """
+    ...
+
+def _code_cache_reset() -> None:
+    """Empty the code cache (for testing)."""
+    ...
+
+def _code_cache_insert(address: int, lo: int, hi: int | None) -> int:
+    """Insert a fake code object alive during [lo, hi) and return its id (for testing)."""
+    ...
+
+def _code_cache_lookup(address: int, generation: int) -> int | None:
+    """Look up a code id, None on a miss (for testing)."""
+    ...
+
+def _set_symbol_cache_dir(path: str | bytes | os.PathLike[str] | None) -> None:
+    """Set the directory of build-id keyed native symbol tables.
+
+    Args:
+        path: Existing directory, or None to resolve native frames with
+            dladdr() only.
+    """
+    ...
+
+def _get_symbol_cache_stats() -> dict[str, int]:
+    """Get native symbol cache statistics since the module was loaded.
+
+    Returns a dict with:
+        - tables_mapped: Symbol tables loaded from cache files
+        - tables_built: Symbol tables parsed from ELF files
+        - jit_symbols: JIT functions known from perf map and jitdump files
     """
     ...
 
@@ -0,0 +1,306 @@
+"""
+Attach mode: sample another, already running Python process.
+
+The sampler in _ext/remote.c reads the target's thread states and frame
+chains with process_vm_readv(). Nothing is injected into the target and
+it is never stopped, so it pays no overhead at all; the cost (a few
+syscalls per frame) is paid by this process. Code objects are read once
+per address, and their line tables are decoded here the same way
+capture.load() decodes captured ones.
+
+The reader shares this interpreter's struct layouts, so the target must
+run the same CPython minor version. The target's _PyRuntime is found
+from its /proc/<pid>/maps and the ELF symbol table of the libpython (or
+python executable) it maps. Only the main interpreter is sampled. Stacks
+are read while the target runs and may occasionally be torn; torn frames
+that no longer point at a code object are dropped.
+
+Requires Linux, Python 3.11+, and ptrace access to the target (same user
+with kernel.yama.ptrace_scope 0, or CAP_SYS_PTRACE).
+
+Usage:
+    >>> profile = spprof.attach.attach(12345, duration_s=10)
+    >>> profile.save("profile.json")
+
+    $ python -m spprof attach 12345 --duration 10 -o profile.json
+"""
+
+from __future__ import annotations
+
+import opcode
+import os
+import re
+import struct
+import sys
+import time
+from bisect import bisect_right
+from datetime import datetime
+from typing import TYPE_CHECKING
+
+
+if TYPE_CHECKING:
+    from spprof import Frame, Profile
+
+
+_RUNTIME_SYMBOL = b"_PyRuntime"
+_CODE_TYPE_SYMBOL = b"PyCode_Type"
+_SHT_SYMTAB = 2
+_SHT_DYNSYM = 11
+_PT_LOAD = 1
+_NOP = bytes([opcode.opmap["NOP"], 0])
+
+# Distinct code addresses read without any resolving before attach() gives up
+_UNREADABLE_CODE_LIMIT = 64
+
+
+def find_runtime(pid: int) -> int:
+    """Address of _PyRuntime in pid.
+
+    Raises:
+        ProcessLookupError: pid does not exist.
+        RuntimeError: pid does not run this Python's minor version, or
+            its interpreter has no _PyRuntime symbol.
+    """
+    return _find_symbols(pid, _RUNTIME_SYMBOL)[0]
+
+
+def _find_symbols(pid: int, *symbols: bytes) -> list[int]:
+    """Addresses of symbols in pid, all read from the interpreter file that
+    defines the first one. Raises as find_runtime() does."""
+    version = f"python{sys.version_info.major}.{sys.version_info.minor}"
+    pattern = re.compile(rf"(lib)?{re.escape(version)}[a-z]*(\.so.*)?")
+    try:
+        with open(f"/proc/{pid}/maps") as maps:
+            lines = maps.read().splitlines()
+    except FileNotFoundError:
+        raise ProcessLookupError(f"No process {pid}") from None
+
+    # Lowest offset-0 mapping of each matching file: its load base
+    bases: dict[str, int] = {}
+    seen: set[str] = set()
+    for line in lines:
+        parts = line.split(maxsplit=5)
+        if len(parts) < 6 or not parts[5].startswith("/"):
+            continue
+        path = parts[5]
+        name = os.path.basename(path)
+        if "python" in name:
+            seen.add(name)
+        if pattern.fullmatch(name) and int(parts[2], 16) == 0:
+            start = int(parts[0].split("-")[0], 16)
+            bases[path] = min(start, bases.get(path, start))
+    if not bases:
+        found = ", ".join(sorted(seen)) or "no python binary"
+        raise RuntimeError(
+            f"Process {pid} does not run {version} (maps show {found}); "
+            f"attach with the same Python version as the target"
+        )
+
+    # A shared libpython holds the runtime; a static build has it in the executable
+    for path in sorted(bases, key=lambda p: not os.path.basename(p).startswith("lib")):
+        elf = f"/proc/{pid}/root{path}"
+        if _elf_symbol(elf, symbols[0]) is None:
+            continue
+        addresses = []
+        for symbol in symbols:
+            found_symbol = _elf_symbol(elf, symbol)
+            if found_symbol is None:
+                raise RuntimeError(f"No {symbol.decode()} symbol in {path}")
+            value, first_load = found_symbol
+            addresses.append(bases[path] - first_load + value)
+        return addresses
+    raise RuntimeError(f"No {symbols[0].decode()} symbol in {', '.join(bases)}")
+
+
+def _raise_unreadable(pid: int, count: int) -> None:
+    raise RuntimeError(
+        f"None of the {count} code objects sampled from process {pid} could be "
+        f"read; its interpreter build does not match this one's"
+    )
+
+
+def _elf_symbol(path: str, symbol: bytes) -> tuple[int, int] | None:
+    """(st_value, page-aligned vaddr of the first PT_LOAD) of symbol in a
+    64-bit little-endian ELF file, or None if it is not defined there."""
+    with open(path, "rb") as f:
+        header = f.read(64)
+        if header[:4] != b"\x7fELF" or header[4] != 2 or header[5] != 1:
+            return None
+        phoff, shoff = struct.unpack_from("<QQ", header, 0x20)
+        phentsize, phnum, shentsize, shnum = struct.unpack_from("<HHHH", header, 0x36)
+
+        f.seek(phoff)
+        program_headers = f.read(phentsize * phnum)
+        first_load = None
+        for i in range(phnum):
+            p_type, _, p_offset, p_vaddr = struct.unpack_from(
+                "<IIQQ", program_headers, i * phentsize
+            )
+            if p_type == _PT_LOAD:
+                first_load = (p_vaddr - p_offset) & ~0xFFF
+                break
+        if first_load is None:
+            return None
+
+        f.seek(shoff)
+        sections = [
+            struct.unpack_from("<IIQQQQIIQQ", f.read(shentsize)) for _ in range(shnum)
+        ]
+        # .symtab survives in unstripped builds; .dynsym always exports _PyRuntime
+        for wanted in (_SHT_DYNSYM, _SHT_SYMTAB):
+            for section in sections:
+                if section[1] != wanted:
+                    continue
+                _, _, _, _, offset, size, link, _, _, entsize = section
+                strtab = sections[link]
+                f.seek(strtab[4])
+                strings = f.read(strtab[5])
+                f.seek(offset)
+                table = f.read(size)
+                for pos in range(0, size - entsize + 1, entsize or 24):
+                    st_name, _, _, st_shndx, st_value = struct.unpack_from(
+                        "<IBBHQ", table, pos
+                    )
+                    if st_shndx == 0 or st_value == 0:
+                        continue
+                    end = strings.find(b"\0", st_name)
+                    if strings[st_name:end] == symbol:
+                        return st_value, first_load
+    return None
+
+
+class _RemoteCode:
+    """Name, file and line table of one code object in the target."""
+
+    __slots__ = ("filename", "firstlineno", "lines", "name", "starts")
+
+    def __init__(self, info: tuple[str, str, int, bytes, int]) -> None:
+        self.name, self.filename, self.firstlineno, linetable, code_size = info
+        # A local code object with the target's line table decodes it for us
+        template = (lambda: None).__code__
+        try:
+            code = template.replace(
+                co_code=_NOP * (code_size // 2),
+                co_linetable=linetable,
+                co_firstlineno=self.firstlineno,
+                co_consts=(None,),
+            )
+            self.lines = list(code.co_lines())
+        except (ValueError, TypeError):
+            self.lines = []
+        self.starts = [start for start, _, _ in self.lines]
+
+    def line_for(self, offset: int) -> int:
+        if offset >= 0:
+            i = bisect_right(self.starts, offset) - 1
+            if i >= 0:
+                start, end, line = self.lines[i]
+                if start <= offset < end and line is not None:
+                    return line
+        return self.firstlineno
+
+
+def attach(
+    pid: int,
+    *,
+    duration_s: float | None = None,
+    interval_ms: float = 10,
+) -> Profile:
+    """
+    Sample every thread of a running Python process.
+
+    Samples until duration_s has passed, the target exits, or this process
+    is interrupted (Ctrl-C), then returns everything collected so far.
+
+    Args:
+        pid: Process to sample. Must run this Python's minor version.
+        duration_s: How long to sample; None samples until interrupted or
+            until the target exits.
+        interval_ms: Time between samples of the whole process.
+
+    Returns:
+        Profile with one sample per thread per interval.
+
+    Raises:
+        PermissionError: No ptrace access to pid.
+        ProcessLookupError: pid does not exist.
+        RuntimeError: pid runs a different Python version, attach mode
+            is not supported on this platform, or none of the sampled
+            frames could be read as code objects.
+    """
+    from spprof import Frame, Profile, Sample, _environment, _native
+
+    if interval_ms <= 0:
+        raise ValueError("interval_ms must be positive")
+    if not hasattr(_native, "_remote_sample") or not sys.platform.startswith("linux"):
+        raise RuntimeError("attach mode requires Linux")
+
+    runtime, code_type = _find_symbols(pid, _RUNTIME_SYMBOL, _CODE_TYPE_SYMBOL)
+    codes: dict[int, _RemoteCode | None] = {}
+    frames: dict[tuple[int, int], Frame] = {}
+    samples: list[Sample] = []
+    start_time = datetime.now()
+    interval_ns = int(interval_ms * 1_000_000)
+    deadline = None if duration_s is None else time.monotonic_ns() + int(duration_s * 1e9)
+
+    def frame_for(code_addr: int, offset: int) -> Frame | None:
+        key = (code_addr, offset)
+        frame = frames.get(key)
+        if frame is None:
+            if code_addr not in codes:
+                info = _native._remote_code(pid, code_type, code_addr)
+                codes[code_addr] = _RemoteCode(info) if info is not None else None
+            code = codes[code_addr]
+            if code is None:
+                return None
+            frame = frames[key] = Frame(code.name, code.filename, code.line_for(offset))
+        return frame
+
+    try:
+        next_ns = time.monotonic_ns()
+        while deadline is None or next_ns < deadline:
+            try:
+                stacks = _native._remote_sample(pid, runtime)
+            except PermissionError as e:
+                raise PermissionError(
+                    f"{e}. Attaching needs ptrace access: run as the target's user "
+                    f"with kernel.yama.ptrace_scope=0, or with CAP_SYS_PTRACE"
+                ) from None
+            except ProcessLookupError:
+                break  # Target exited
+            except OSError:
+                # The runtime went away under us: the target is exiting
+                if not os.path.exists(f"/proc/{pid}"):
+                    break
+                raise
+            timestamp = time.monotonic_ns()
+            for thread_id, _native_id, leaf_first in stacks:
+                resolved = [frame_for(code, offset) for code, offset in leaf_first]
+                kept = [frame for frame in resolved if frame is not None]
+                if kept:
+                    samples.append(Sample(timestamp, thread_id, None, kept))
+            # A few torn reads are normal; all misses mean the layout is wrong
+            if not frames and len(codes) >= _UNREADABLE_CODE_LIMIT:
+                _raise_unreadable(pid, len(codes))
+            next_ns += interval_ns
+            delay = next_ns - time.monotonic_ns()
+            if delay > 0:
+                time.sleep(delay / 1e9)
+            else:
+                next_ns = time.monotonic_ns()  # Fell behind; don't burst
+    except KeyboardInterrupt:
+        pass
+
+    if codes and not frames:
+        _raise_unreadable(pid, len(codes))
+
+    python_version, platform = _environment()
+    return Profile(
+        start_time=start_time,
+        end_time=datetime.now(),
+        interval_ms=interval_ms,
+        samples=samples,
+        dropped_count=0,
+        python_version=python_version,
+        platform=platform,
+    )
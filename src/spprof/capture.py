@@ -0,0 +1,414 @@
+"""
+Binary capture files (.spprof) and their offline reader.
+
+A capture stores the sampler's raw output - code object ids, bytecode
+offsets, native PCs, timestamps - in an append-only, chunked,
+zlib-compressed log, plus metadata chunks holding the code-object table
+(name, file, line table) and the module map (path, load range, build id)
+taken at capture time. Writing one skips symbol resolution entirely; the
+file is resolved and aggregated later, on any machine, by load().
+
+Layout (see _ext/capture.h for the authoritative description):
+
+    header   b"SPPROF\\0\\0", u32 version, u32 byte-order mark
+    chunk*   u32 type, u32 codec, u32 stored_size, u32 raw_size, payload
+
+Usage:
+    >>> spprof.start()
+    >>> ...
+    >>> spprof.stop(capture="run.spprof")
+    >>> profile = spprof.capture.load("run.spprof")  # later, elsewhere
+
+    $ python -m spprof.capture run.spprof profile.json
+"""
+
+from __future__ import annotations
+
+import json
+import mmap
+import struct
+import zlib
+from bisect import bisect_right
+from collections.abc import Iterator, Mapping
+from datetime import datetime
+from pathlib import Path
+from typing import TYPE_CHECKING, Any, Literal, overload
+
+
+if TYPE_CHECKING:
+    from spprof import AggregatedProfile, Frame, Profile
+
+
+MAGIC = b"SPPROF\0\0"
+VERSION = 2  # 2 added the label set id to sample records
+_BYTE_ORDER_MARK = 0x01020304
+
+CHUNK_SAMPLES = 1
+CHUNK_CODES = 2
+CHUNK_MODULES = 3
+CHUNK_INFO = 4
+
+_CODEC_NONE = 0
+_CODEC_ZLIB = 1
+
+_UNKNOWN_OFFSET = 0xFFFFFFFF
+_CPU_TIME_UNKNOWN = 2**64 - 1
+
+
+def write(
+    path: Path | str,
+    *,
+    start_time: datetime,
+    end_time: datetime,
+    interval_ms: float,
+    dropped_count: int,
+    python_version: str,
+    platform: str,
+    thread_names: dict[int, str],
+    label_sets: Mapping[int, Mapping[str, str]],
+) -> dict[str, int]:
+    """Drain the native ring buffer into a capture file (internal).
+
+    Called by spprof.stop(capture=...) once the timers are stopped.
+
+    Returns:
+        Drain counters: samples, empty_samples, invalid_frames.
+    """
+    from spprof import _native
+
+    output_path = Path(path)
+    with output_path.open("wb") as f:
+        f.write(MAGIC + struct.pack("=II", VERSION, _BYTE_ORDER_MARK))
+        f.flush()
+        fd = f.fileno()
+
+        codes: list[Any] = []
+        stats: dict[str, int] = _native._capture_samples(fd, codes)
+
+        _native._capture_write_chunk(fd, CHUNK_CODES, _json([_code_entry(c) for c in codes]))
+        modules = [
+            {
+                "start": start,
+                "limit": limit,
+                "file_offset": file_offset,
+                "path": module_path,
+                "build_id": build_id,
+                "is_python": is_python,
+            }
+            for start, limit, file_offset, module_path, build_id, is_python in _native._module_map()
+        ]
+        _native._capture_write_chunk(fd, CHUNK_MODULES, _json(modules))
+        info = {
+            "start_time": start_time.isoformat(),
+            "end_time": end_time.isoformat(),
+            "interval_ms": interval_ms,
+            "dropped_count": dropped_count,
+            "python_version": python_version,
+            "platform": platform,
+            "thread_names": {str(tid): name for tid, name in thread_names.items()},
+            "labels": {str(label_id): dict(labels) for label_id, labels in label_sets.items()},
+        }
+        _native._capture_write_chunk(fd, CHUNK_INFO, _json(info))
+    return stats
+
+
+def _json(value: Any) -> bytes:
+    return json.dumps(value, separators=(",", ":")).encode("utf-8")
+
+
+def _code_entry(code: Any) -> dict[str, Any]:
+    """Name, file and flattened (start, end, line) ranges of a code object."""
+    lines: list[int | None] = []
+    for start, end, line in code.co_lines():
+        lines.extend((start, end, line))
+    return {
+        "name": code.co_name,
+        "filename": code.co_filename,
+        "firstlineno": code.co_firstlineno,
+        "lines": lines,
+    }
+
+
+# --- Reading ---
+
+
+class _CodeInfo:
+    """Offline view of one captured code object."""
+
+    __slots__ = ("filename", "firstlineno", "lines", "name", "starts")
+
+    def __init__(self, entry: dict[str, Any]) -> None:
+        self.name: str = entry["name"]
+        self.filename: str = entry["filename"]
+        self.firstlineno: int = entry["firstlineno"]
+        flat = entry["lines"]
+        self.lines: list[tuple[int, int, int | None]] = [
+            (flat[i], flat[i + 1], flat[i + 2]) for i in range(0, len(flat), 3)
+        ]
+        self.starts = [start for start, _, _ in self.lines]
+
+    def line_for(self, offset: int) -> int:
+        """Line of a bytecode offset, like PyCode_Addr2Line()."""
+        if offset != _UNKNOWN_OFFSET:
+            i = bisect_right(self.starts, offset) - 1
+            if i >= 0:
+                start, end, line = self.lines[i]
+                if start <= offset < end and line is not None:
+                    return line
+        return self.firstlineno
+
+
+class _ModuleMap:
+    """Offline lookup of native PCs in the captured module map."""
+
+    def __init__(self, modules: list[dict[str, Any]]) -> None:
+        self.modules = sorted(modules, key=lambda m: m["start"])
+        self.starts = [m["start"] for m in self.modules]
+
+    def find(self, pc: int) -> dict[str, Any] | None:
+        i = bisect_right(self.starts, pc) - 1
+        if i >= 0 and pc < self.modules[i]["limit"]:
+            return self.modules[i]
+        return None
+
+
+def _chunks(data: mmap.mmap | bytes, byte_order: str) -> Iterator[tuple[int, bytes]]:
+    """Yield (type, payload) for every complete chunk after the header."""
+    header = struct.Struct(byte_order + "IIII")
+    pos = len(MAGIC) + 8
+    while pos + header.size <= len(data):
+        chunk_type, codec, stored_size, raw_size = header.unpack_from(data, pos)
+        pos += header.size
+        if pos + stored_size > len(data):
+            break  # Truncated by a crash; everything before it is intact
+        payload = data[pos : pos + stored_size]
+        pos += stored_size
+        if codec == _CODEC_ZLIB:
+            payload = zlib.decompress(payload, bufsize=raw_size)
+        elif codec != _CODEC_NONE:
+            raise ValueError(f"Unknown capture codec: {codec}")
+        yield chunk_type, payload
+
+
+class _Resolver:
+    """Turns raw capture records into shared Frame tuples."""
+
+    def __init__(self, codes: list[_CodeInfo], modules: _ModuleMap, byte_order: str) -> None:
+        self.codes = codes
+        self.modules = modules
+        self.byte_order = byte_order
+        self.frames: dict[tuple[int, int], Frame] = {}
+        self.stacks: dict[tuple[int, bytes], tuple[Frame, ...]] = {}
+
+    def python_frame(self, code_id: int, offset: int) -> Frame | None:
+        from spprof import Frame
+
+        if code_id >= len(self.codes):
+            return None
+        code = self.codes[code_id]
+        line = code.line_for(offset)
+        key = (code_id, line)
+        frame = self.frames.get(key)
+        if frame is None:
+            frame = self.frames[key] = Frame(code.name, code.filename, line, False)
+        return frame
+
+    def native_frame(self, pc: int) -> tuple[Frame, bool]:
+        """Frame for a native PC, plus whether it is an interpreter frame."""
+        from spprof import Frame
+
+        module = self.modules.find(pc)
+        if module is None:
+            return Frame(f"0x{pc:x}", "", 0, True), False
+        module_path = module["path"]
+        basename = module_path.rsplit("/", 1)[-1]
+        offset = pc - module["start"] + module["file_offset"]
+        return Frame(f"{basename}+0x{offset:x}", module_path, 0, True), module["is_python"]
+
+    def stack(self, python_depth: int, frames: bytes) -> tuple[Frame, ...]:
+        key = (python_depth, frames)
+        stack = self.stacks.get(key)
+        if stack is None:
+            stack = self.stacks[key] = self._resolve(python_depth, frames)
+        return stack
+
+    def _resolve(self, python_depth: int, frames: bytes) -> tuple[Frame, ...]:
+        native_depth = len(frames) // 8 - python_depth
+        pairs = struct.unpack_from(f"{self.byte_order}{2 * python_depth}I", frames)
+        pcs = struct.unpack_from(f"{self.byte_order}{native_depth}Q", frames, 8 * python_depth)
+        python = [self.python_frame(pairs[i], pairs[i + 1]) for i in range(0, len(pairs), 2)]
+        python_frames = [f for f in python if f is not None]
+
+        # Same "trim & sandwich" merge as the live resolver: Python frames
+        # replace the first run of interpreter frames in the native stack
+        if native_depth == 0:
+            return tuple(python_frames)
+        if python_depth == 0:
+            return tuple(self.native_frame(pc)[0] for pc in pcs)
+        merged: list[Frame] = []
+        inserted = False
+        for pc in pcs:
+            frame, is_interpreter = self.native_frame(pc)
+            if not is_interpreter:
+                merged.append(frame)
+            elif not inserted:
+                merged.extend(python_frames)
+                inserted = True
+        if not inserted:
+            merged.extend(python_frames)
+        return tuple(merged)
+
+
+@overload
+def load(path: Path | str, aggregate: Literal[False] = ...) -> Profile: ...
+
+
+@overload
+def load(path: Path | str, aggregate: Literal[True]) -> AggregatedProfile: ...
+
+
+def load(path: Path | str, aggregate: bool = False) -> Profile | AggregatedProfile:
+    """Resolve a .spprof capture into a Profile (or AggregatedProfile).
+
+    The file is memory-mapped and decoded chunk by chunk. Python frames are
+    resolved from the captured code table; native frames are named
+    ``<module>+0x<file offset>`` from the captured module map, ready for
+    addr2line or a symbol server.
+
+    Args:
+        path: Capture file written by spprof.stop(capture=...).
+        aggregate: Count unique (thread, stack, label set) rows instead of
+                   keeping every sample.
+
+    Raises:
+        ValueError: If the file is not a capture this version understands.
+    """
+    from spprof import AggregatedProfile, AggregatedStack, Profile, Sample
+
+    with Path(path).open("rb") as f:
+        try:
+            data: mmap.mmap | bytes = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        except ValueError:  # Empty file
+            data = b""
+        try:
+            if len(data) < len(MAGIC) + 8 or data[: len(MAGIC)] != MAGIC:
+                raise ValueError(f"{path} is not an spprof capture")
+            (mark,) = struct.unpack_from("<I", data, len(MAGIC) + 4)
+            byte_order = "<" if mark == _BYTE_ORDER_MARK else ">"
+            (version,) = struct.unpack_from(byte_order + "I", data, len(MAGIC))
+            if version not in (1, VERSION):
+                raise ValueError(f"Unsupported capture version {version}")
+
+            sample_chunks: list[bytes] = []
+            codes: list[_CodeInfo] = []
+            modules: list[dict[str, Any]] = []
+            info: dict[str, Any] = {}
+            for chunk_type, payload in _chunks(data, byte_order):
+                if chunk_type == CHUNK_SAMPLES:
+                    sample_chunks.append(payload)
+                elif chunk_type == CHUNK_CODES:
+                    codes.extend(_CodeInfo(entry) for entry in json.loads(payload))
+                elif chunk_type == CHUNK_MODULES:
+                    modules = json.loads(payload)
+                elif chunk_type == CHUNK_INFO:
+                    info = json.loads(payload)
+        finally:
+            if isinstance(data, mmap.mmap):
+                data.close()
+
+    resolver = _Resolver(codes, _ModuleMap(modules), byte_order)
+    thread_names = {int(tid): name for tid, name in info.get("thread_names", {}).items()}
+    label_sets = {int(label_id): labels for label_id, labels in info.get("labels", {}).items()}
+    # Version 1 records end before the label set id
+    record = struct.Struct(byte_order + ("QQQIHH" if version == 1 else "QQQIHHII"))
+
+    samples: list[Sample] = []
+    totals: dict[tuple[int, tuple[Frame, ...], int], list[int]] = {}
+    for chunk in sample_chunks:
+        pos = 0
+        while pos + record.size <= len(chunk):
+            fields = record.unpack_from(chunk, pos)
+            timestamp, thread_id, cpu_time, weight, python_depth, native_depth = fields[:6]
+            label_id = fields[6] if len(fields) > 6 else 0
+            pos += record.size
+            end = pos + 8 * (python_depth + native_depth)
+            frames = resolver.stack(python_depth, chunk[pos:end])
+            pos = end
+            if not frames:
+                continue
+            if aggregate:
+                row = totals.get((thread_id, frames, label_id))
+                if row is None:
+                    row = totals[(thread_id, frames, label_id)] = [0, 0, _CPU_TIME_UNKNOWN]
+                row[0] += 1
+                row[1] += weight
+                if cpu_time != _CPU_TIME_UNKNOWN:
+                    row[2] = cpu_time if row[2] == _CPU_TIME_UNKNOWN else row[2] + cpu_time
+            else:
+                samples.append(
+                    Sample(
+                        timestamp_ns=timestamp,
+                        thread_id=thread_id,
+                        thread_name=thread_names.get(thread_id),
+                        frames=frames,
+                        weight=weight,
+                        cpu_time_ns=None if cpu_time == _CPU_TIME_UNKNOWN else cpu_time,
+                        labels=label_sets.get(label_id) if label_id else None,
+                    )
+                )
+
+    start_time = datetime.fromisoformat(info["start_time"]) if info else datetime.now()
+    end_time = datetime.fromisoformat(info["end_time"]) if info else start_time
+    if aggregate:
+        return AggregatedProfile(
+            start_time=start_time,
+            end_time=end_time,
+            interval_ms=info.get("interval_ms", 10),
+            stacks=[
+                AggregatedStack(
+                    frames=frames,
+                    thread_id=thread_id,
+                    thread_name=thread_names.get(thread_id),
+                    count=count,
+                    weight=weight,
+                    cpu_time_ns=None if cpu_time == _CPU_TIME_UNKNOWN else cpu_time,
+                    labels=label_sets.get(label_id) if label_id else None,
+                )
+                for (thread_id, frames, label_id), (count, weight, cpu_time) in totals.items()
+            ],
+            total_samples=sum(row[0] for row in totals.values()),
+            dropped_count=info.get("dropped_count", 0),
+            python_version=info.get("python_version", ""),
+            platform=info.get("platform", ""),
+        )
+    return Profile(
+        start_time=start_time,
+        end_time=end_time,
+        interval_ms=info.get("interval_ms", 10),
+        samples=samples,
+        dropped_count=info.get("dropped_count", 0),
+        python_version=info.get("python_version", ""),
+        platform=info.get("platform", ""),
+    )
+
+
+def main(argv: list[str] | None = None) -> int:
+    """Convert a capture to speedscope, collapsed or pprof output."""
+    import argparse
+
+    parser = argparse.ArgumentParser(
+        prog="python -m spprof.capture", description="Resolve an .spprof capture offline."
+    )
+    parser.add_argument("capture", help="capture file written by spprof.stop(capture=...)")
+    parser.add_argument("output", help="output file")
+    parser.add_argument(
+        "--format", choices=("speedscope", "collapsed", "pprof"), default="speedscope"
+    )
+    args = parser.parse_args(argv)
+
+    load(args.capture, aggregate=True).save(args.output, format=args.format)
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
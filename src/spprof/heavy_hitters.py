@@ -0,0 +1,197 @@
+"""
+Bounded-memory heavy-hitter aggregation for unbounded sessions.
+
+HeavyHitters folds aggregated windows into at most `capacity` tracked
+stacks using the Space-Saving algorithm, ranked by weight. When an
+untracked stack arrives and the table is full, the stack with the
+smallest counter is evicted and the newcomer inherits that counter as its
+error. The evicted stack's own weight moves to an "other" bucket for its
+leaf function, so totals stay exact and rare stacks stay visible per
+function.
+
+With W the total weight folded in:
+  - every stack weighing more than W / capacity is tracked;
+  - a tracked stack's true weight lies in [weight, weight + weight_error];
+  - no untracked stack weighs more than error_bound.
+
+Stacks are merged across threads. Memory is O(capacity) however many
+windows are added.
+
+Usage:
+    >>> spprof.start(top_k=1000)  # drains and folds in the background
+    >>> ...
+    >>> agg = spprof.stop()       # AggregatedProfile of the whole session
+    >>> agg.error_bound
+"""
+
+from __future__ import annotations
+
+import heapq
+from dataclasses import dataclass
+from typing import TYPE_CHECKING
+
+
+if TYPE_CHECKING:
+    from collections.abc import Sequence
+    from datetime import datetime
+
+    from spprof import AggregatedProfile, AggregatedStack, Frame
+
+
+OTHER_FUNCTION = "[other stacks]"
+
+
+@dataclass
+class _Counter:
+    """Observed totals since the stack was (last) tracked, plus its error."""
+
+    count: int = 0
+    weight: int = 0
+    cpu_time_ns: int | None = None
+    error: int = 0
+
+    @property
+    def value(self) -> int:
+        """Space-Saving counter: an upper bound on the stack's true weight."""
+        return self.weight + self.error
+
+    def absorb(self, count: int, weight: int, cpu_time_ns: int | None) -> None:
+        self.count += count
+        self.weight += weight
+        if cpu_time_ns is not None:
+            self.cpu_time_ns = (self.cpu_time_ns or 0) + cpu_time_ns
+
+
+class HeavyHitters:
+    """Space-Saving top-K over stacks with per-function spill buckets."""
+
+    def __init__(self, capacity: int) -> None:
+        if capacity < 1:
+            raise ValueError("capacity must be >= 1")
+        self.capacity = capacity
+        self._tracked: dict[tuple[Frame, ...], _Counter] = {}
+        # Lazy min-heap of (value, seq, stack); stale entries are skipped
+        self._heap: list[tuple[int, int, tuple[Frame, ...]]] = []
+        self._seq = 0
+        # (function_name, filename) of the evicted leaf; None is the catch-all
+        self._other: dict[tuple[str, str] | None, _Counter] = {}
+        self._error_bound = 0
+        self._windows = 0
+        self._start_time: datetime | None = None
+        self._end_time: datetime | None = None
+        self._interval_ms = 0.0
+        self._dropped_count = 0
+        self._python_version = ""
+        self._platform = ""
+
+    @property
+    def error_bound(self) -> int:
+        """Largest weight an untracked stack can have (smallest evicted counter)."""
+        return self._error_bound
+
+    def add(self, profile: AggregatedProfile) -> None:
+        """Fold one aggregated window in; windows must be added in time order."""
+        if self._start_time is None:
+            self._start_time = profile.start_time
+            self._interval_ms = profile.interval_ms
+            self._python_version = profile.python_version
+            self._platform = profile.platform
+        self._end_time = profile.end_time
+        self._dropped_count += profile.dropped_count
+        self._windows += 1
+        for stack in profile.stacks:
+            self.add_stack(stack)
+
+    def add_stack(self, stack: AggregatedStack) -> None:
+        """Fold one (thread, stack) aggregate in, ignoring its thread and labels."""
+        key = tuple(stack.frames)
+        weight = stack.weight if stack.weight is not None else stack.count
+        counter = self._tracked.get(key)
+        if counter is None:
+            error = 0
+            if len(self._tracked) >= self.capacity:
+                error = self._evict_min()
+            counter = _Counter(error=error)
+            self._tracked[key] = counter
+        counter.absorb(stack.count, weight, stack.cpu_time_ns)
+        self._push(counter.value, key)
+
+    def to_profile(self) -> AggregatedProfile:
+        """Tracked stacks (heaviest first) followed by the spill buckets."""
+        from spprof import AggregatedProfile, AggregatedStack, Frame
+
+        if self._start_time is None or self._end_time is None:
+            raise ValueError("No windows have been added")
+
+        stacks = [
+            AggregatedStack(
+                frames=key,
+                thread_id=0,
+                thread_name=None,
+                count=counter.count,
+                weight=counter.weight,
+                cpu_time_ns=counter.cpu_time_ns,
+                weight_error=counter.error,
+            )
+            for key, counter in sorted(
+                self._tracked.items(), key=lambda item: item[1].value, reverse=True
+            )
+        ]
+        other_root = Frame(function_name=OTHER_FUNCTION, filename="", lineno=0)
+        for leaf, counter in self._other.items():
+            frames: Sequence[Frame] = (
+                (Frame(function_name=leaf[0], filename=leaf[1], lineno=0), other_root)
+                if leaf is not None
+                else (other_root,)
+            )
+            stacks.append(
+                AggregatedStack(
+                    frames=frames,
+                    thread_id=0,
+                    thread_name=None,
+                    count=counter.count,
+                    weight=counter.weight,
+                    cpu_time_ns=counter.cpu_time_ns,
+                )
+            )
+
+        return AggregatedProfile(
+            start_time=self._start_time,
+            end_time=self._end_time,
+            interval_ms=self._interval_ms,
+            stacks=stacks,
+            total_samples=sum(stack.count for stack in stacks),
+            dropped_count=self._dropped_count,
+            python_version=self._python_version,
+            platform=self._platform,
+            error_bound=self._error_bound,
+        )
+
+    def _push(self, value: int, key: tuple[Frame, ...]) -> None:
+        self._seq += 1
+        heapq.heappush(self._heap, (value, self._seq, key))
+        # Stale entries pile up as counters grow; rebuild well before O(updates)
+        if len(self._heap) > 4 * self.capacity + 64:
+            self._heap = [
+                (counter.value, seq, key)
+                for seq, (key, counter) in enumerate(self._tracked.items())
+            ]
+            heapq.heapify(self._heap)
+
+    def _evict_min(self) -> int:
+        """Evict the smallest tracked counter; return its value."""
+        while True:
+            value, _, key = heapq.heappop(self._heap)
+            counter = self._tracked.get(key)
+            if counter is not None and counter.value == value:
+                break
+        del self._tracked[key]
+        self._error_bound = max(self._error_bound, value)
+
+        leaf = (key[0].function_name, key[0].filename) if key else None
+        if leaf not in self._other and len(self._other) >= self.capacity:
+            leaf = None
+        self._other.setdefault(leaf, _Counter()).absorb(
+            counter.count, counter.weight, counter.cpu_time_ns
+        )
+        return value
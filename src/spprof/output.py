@@ -15,9 +15,28 @@ from typing import TYPE_CHECKING, Any
 
 
 if TYPE_CHECKING:
+    from collections.abc import Mapping
+
     from spprof import AggregatedProfile, Profile
 
 
+# A speedscope profile per (thread id, sorted label pairs)
+_ProfileKey = tuple[int, tuple[tuple[str, str], ...]]
+
+
+def _profile_key(thread_id: int, labels: Mapping[str, str] | None) -> _ProfileKey:
+    return thread_id, tuple(sorted(labels.items())) if labels else ()
+
+
+def _profile_name(key: _ProfileKey, thread_names: dict[int, str]) -> str:
+    """Thread name, then " [k=v, ...]" for a labelled profile."""
+    thread_id, labels = key
+    name = thread_names.get(thread_id, f"Thread-{thread_id}")
+    if labels:
+        name += " [" + ", ".join(f"{k}={v}" for k, v in labels) + "]"
+    return name
+
+
 def to_speedscope(profile: Profile) -> dict[str, Any]:
     """
     Convert profile to Speedscope JSON format.
@@ -43,23 +62,23 @@ def to_speedscope(profile: Profile) -> dict[str, Any]:
             frames.append({"name": name, "file": file, "line": line})
         return frame_map[key]
 
-    # Group samples by thread
-    samples_by_thread: dict[int, list[Any]] = defaultdict(list)
+    # Group samples by thread and label set
+    samples_by_thread: dict[_ProfileKey, list[Any]] = defaultdict(list)
     thread_names: dict[int, str] = {}
 
     for sample in profile.samples:
-        samples_by_thread[sample.thread_id].append(sample)
+        samples_by_thread[_profile_key(sample.thread_id, sample.labels)].append(sample)
         if sample.thread_name:
             thread_names[sample.thread_id] = sample.thread_name
 
-    # Build profiles for each thread
+    # Build profiles for each thread and label set
     profiles: list[dict[str, Any]] = []
 
-    for thread_id, thread_samples in samples_by_thread.items():
+    for key, thread_samples in samples_by_thread.items():
         if not thread_samples:
             continue
 
-        thread_name = thread_names.get(thread_id, f"Thread-{thread_id}")
+        thread_name = _profile_name(key, thread_names)
 
         # Convert samples
         speedscope_samples: list[list[int]] = []
@@ -73,8 +92,12 @@ def to_speedscope(profile: Profile) -> dict[str, Any]:
                 get_frame_index(f.function_name, f.filename, f.lineno) for f in sample.frames
             ]
             speedscope_samples.append(stack_indices)
-            # Weight is the interval in nanoseconds
-            weights.append(profile.interval_ms * 1_000_000)
+            # Weight is the measured thread CPU time when available, else the
+            # interval times the expirations the sample stands for (overruns)
+            if sample.cpu_time_ns is not None:
+                weights.append(sample.cpu_time_ns)
+            else:
+                weights.append(profile.interval_ms * 1_000_000 * sample.weight)
 
         end_time = thread_samples[-1].timestamp_ns if thread_samples else start_time
 
@@ -108,7 +131,8 @@ def to_collapsed(profile: Profile, mark_native: bool = True) -> str:
 
     Format: frame1;frame2;...;frameN count
 
-    Stack order is root → leaf (bottom of flame → top of flame).
+    Stack order is root → leaf (bottom of flame → top of flame). Counts are
+    weighted by timer overruns, so they add up to elapsed timer expirations.
 
     Args:
         profile: Profile object to convert.
@@ -141,7 +165,7 @@ def to_collapsed(profile: Profile, mark_native: bool = True) -> str:
                 stack_parts.append(func_name)
 
         stack_str = ";".join(stack_parts)
-        stack_counts[stack_str] += 1
+        stack_counts[stack_str] += sample.weight
 
     # Build output
     lines = [f"{stack} {count}" for stack, count in sorted(stack_counts.items())]
@@ -152,9 +176,9 @@ def aggregated_to_speedscope(profile: AggregatedProfile) -> dict[str, Any]:
     """
     Convert aggregated profile to Speedscope JSON format.
 
-    This expands aggregated stacks back into individual samples for
-    visualization compatibility, but does so efficiently without
-    materializing Sample objects.
+    Each unique stack becomes a single speedscope sample whose weight is
+    its measured CPU time, or its (overrun-weighted) count times the
+    sampling interval when CPU time was not measured.
 
     Args:
         profile: AggregatedProfile object to convert.
@@ -174,25 +198,25 @@ def aggregated_to_speedscope(profile: AggregatedProfile) -> dict[str, Any]:
             frames.append({"name": name, "file": file, "line": line})
         return frame_map[key]
 
-    # Group stacks by thread
-    stacks_by_thread: dict[int, list[Any]] = defaultdict(list)
+    # Group stacks by thread and label set
+    stacks_by_thread: dict[_ProfileKey, list[Any]] = defaultdict(list)
     thread_names: dict[int, str] = {}
 
     for stack in profile.stacks:
-        stacks_by_thread[stack.thread_id].append(stack)
+        stacks_by_thread[_profile_key(stack.thread_id, stack.labels)].append(stack)
         if stack.thread_name:
             thread_names[stack.thread_id] = stack.thread_name
 
-    # Build profiles for each thread
+    # Build profiles for each thread and label set
     profiles: list[dict[str, Any]] = []
 
-    for thread_id, thread_stacks in stacks_by_thread.items():
+    for key, thread_stacks in stacks_by_thread.items():
         if not thread_stacks:
             continue
 
-        thread_name = thread_names.get(thread_id, f"Thread-{thread_id}")
+        thread_name = _profile_name(key, thread_names)
 
-        # Convert stacks (expanding counts)
+        # Convert stacks (one weighted entry per unique stack)
         speedscope_samples: list[list[int]] = []
         weights: list[int] = []
 
@@ -201,10 +225,11 @@ def aggregated_to_speedscope(profile: AggregatedProfile) -> dict[str, Any]:
             stack_indices = [
                 get_frame_index(f.function_name, f.filename, f.lineno) for f in stack.frames
             ]
-            # Expand: each count becomes a sample
-            for _ in range(stack.count):
-                speedscope_samples.append(stack_indices)
-                weights.append(profile.interval_ms * 1_000_000)
+            speedscope_samples.append(stack_indices)
+            if stack.cpu_time_ns is not None:
+                weights.append(stack.cpu_time_ns)
+            else:
+                weights.append(profile.interval_ms * 1_000_000 * (stack.weight or stack.count))
 
         # Estimate time based on sample count
         total_weight = sum(weights)
@@ -267,7 +292,7 @@ def aggregated_to_collapsed(profile: AggregatedProfile, mark_native: bool = True
                 stack_parts.append(func_name)
 
         stack_str = ";".join(stack_parts)
-        lines.append(f"{stack_str} {stack.count}")
+        lines.append(f"{stack_str} {stack.weight or stack.count}")
 
     return "\n".join(sorted(lines))
 
@@ -0,0 +1,239 @@
+"""
+One profile for a whole tree of forked processes.
+
+SharedArena is an anonymous shared mapping created by the process that
+starts the session, before it forks. Every process in the tree keeps its
+own bounded top_k table (see spprof.heavy_hitters), and after each drained
+window republishes that table into its own slot of the arena. Raw samples
+hold code object pointers that only mean something in the process that
+took them, so each process resolves its own samples and only aggregates
+are shared. At stop() the process that created the arena collects every
+slot into one AggregatedProfile. Each stack is labeled {"pid": ...}, so
+per-worker views and load imbalance show up directly (speedscope gets
+one profile per pid, pprof a pid tag).
+
+A slot holds the process's latest snapshot, not a log, so a worker that
+exits without stop() still shows up with everything up to its last
+publish (at most one drain interval behind). Writers and the collector
+share one process-shared lock. Each process takes it once per drain, so
+contention stays low.
+
+Layout: `processes` slots of SLOT_BYTES each. A slot starts with
+(pid: int64, length: uint64) and holds a marshal-encoded snapshot. A
+snapshot too large for its slot keeps its heaviest stacks and folds the
+rest into one "[other stacks]" stack.
+
+Usage:
+    >>> spprof.start(processes=16)   # in the master, before forking workers
+    >>> ...
+    >>> agg = spprof.stop()          # every worker's stacks, labeled by pid
+"""
+
+from __future__ import annotations
+
+import marshal
+import mmap
+import multiprocessing
+import os
+import struct
+import warnings
+from datetime import datetime
+from typing import TYPE_CHECKING, Any
+
+
+if TYPE_CHECKING:
+    from spprof import AggregatedProfile, AggregatedStack, Frame
+
+
+# Bytes per process slot, header included
+SLOT_BYTES = 1 << 20
+
+_HEADER = struct.Struct("=qQ")  # pid, payload length
+_LOCK_TIMEOUT_S = 1.0
+
+
+class SharedArena:
+    """Per-process aggregate slots in memory shared across fork()."""
+
+    def __init__(self, processes: int, slot_bytes: int = SLOT_BYTES) -> None:
+        if processes < 1:
+            raise ValueError("processes must be >= 1")
+        self.processes = processes
+        self.owner_pid = os.getpid()
+        self._slot_bytes = slot_bytes
+        self._map = mmap.mmap(-1, processes * slot_bytes)
+        self._lock = multiprocessing.Lock()
+        self._slot: int | None = None  # This process's slot, once claimed
+        self._slot_pid = 0
+        self._full_warned = False
+
+    def publish(self, profile: AggregatedProfile) -> None:
+        """Replace this process's snapshot with profile."""
+        pid = os.getpid()
+        payload = _encode(profile, self._slot_bytes - _HEADER.size)
+        if not self._lock.acquire(timeout=_LOCK_TIMEOUT_S):
+            return
+        try:
+            slot = self._claim(pid)
+            if slot is None:
+                if not self._full_warned:
+                    self._full_warned = True
+                    warnings.warn(
+                        f"spprof: all {self.processes} process slots are taken; "
+                        f"process {pid} is left out of the shared profile",
+                        RuntimeWarning,
+                        stacklevel=2,
+                    )
+                return
+            offset = slot * self._slot_bytes
+            self._map[offset + _HEADER.size : offset + _HEADER.size + len(payload)] = payload
+            _HEADER.pack_into(self._map, offset, pid, len(payload))
+        finally:
+            self._lock.release()
+
+    def collect(self, end_time: datetime) -> AggregatedProfile:
+        """Merge every published snapshot into one profile labeled by pid."""
+        from spprof import AggregatedProfile
+
+        snapshots: list[tuple[int, bytes]] = []
+        with self._lock:
+            for slot in range(self.processes):
+                offset = slot * self._slot_bytes
+                pid, length = _HEADER.unpack_from(self._map, offset)
+                if pid != 0:
+                    start = offset + _HEADER.size
+                    snapshots.append((pid, self._map[start : start + length]))
+
+        profiles = [(pid, _decode(payload)) for pid, payload in snapshots]
+        if not profiles:
+            raise ValueError("No process has published a snapshot")
+        own = next((p for pid, p in profiles if pid == self.owner_pid), profiles[0][1])
+        stacks = [stack for pid, profile in profiles for stack in _labeled(pid, profile)]
+        return AggregatedProfile(
+            start_time=min(profile.start_time for _, profile in profiles),
+            end_time=end_time,
+            interval_ms=own.interval_ms,
+            stacks=stacks,
+            total_samples=sum(stack.count for stack in stacks),
+            dropped_count=sum(profile.dropped_count for _, profile in profiles),
+            python_version=own.python_version,
+            platform=own.platform,
+            error_bound=max(profile.error_bound for _, profile in profiles),
+        )
+
+    def close(self) -> None:
+        self._map.close()
+
+    def _claim(self, pid: int) -> int | None:
+        """This process's slot, claiming a free one first; the lock is held."""
+        # A forked child inherits its parent's cached slot; never reuse it
+        if self._slot is not None and self._slot_pid == pid:
+            return self._slot
+        for slot in range(self.processes):
+            (owner,) = struct.unpack_from("=q", self._map, slot * self._slot_bytes)
+            if owner in (0, pid):
+                self._slot, self._slot_pid = slot, pid
+                return slot
+        return None
+
+
+def _labeled(pid: int, profile: AggregatedProfile) -> list[AggregatedStack]:
+    from spprof import AggregatedStack
+
+    labels = {"pid": str(pid)}
+    return [
+        AggregatedStack(
+            frames=stack.frames,
+            thread_id=stack.thread_id,
+            thread_name=stack.thread_name,
+            count=stack.count,
+            weight=stack.weight,
+            cpu_time_ns=stack.cpu_time_ns,
+            weight_error=stack.weight_error,
+            labels=labels,
+        )
+        for stack in profile.stacks
+    ]
+
+
+def _encode(profile: AggregatedProfile, limit: int) -> bytes:
+    """marshal-encode profile in at most limit bytes, folding light stacks."""
+    from spprof import Frame
+    from spprof.heavy_hitters import OTHER_FUNCTION
+
+    stacks = sorted(profile.stacks, key=lambda stack: stack.weight or 0, reverse=True)
+    keep = len(stacks)
+    while True:
+        frames: dict[Frame, int] = {}
+        rows: list[tuple[Any, ...]] = [
+            (
+                tuple(frames.setdefault(frame, len(frames)) for frame in stack.frames),
+                stack.count,
+                stack.weight,
+                stack.cpu_time_ns,
+                stack.weight_error,
+            )
+            for stack in stacks[:keep]
+        ]
+        rest = stacks[keep:]
+        if rest:
+            other_root = Frame(function_name=OTHER_FUNCTION, filename="", lineno=0)
+            other = frames.setdefault(other_root, len(frames))
+            rows.append(
+                (
+                    (other,),
+                    sum(stack.count for stack in rest),
+                    sum(stack.weight or 0 for stack in rest),
+                    None,
+                    sum(stack.weight_error for stack in rest),
+                )
+            )
+        payload = marshal.dumps(
+            (
+                profile.start_time.timestamp(),
+                profile.end_time.timestamp(),
+                profile.interval_ms,
+                profile.dropped_count,
+                profile.error_bound,
+                profile.python_version,
+                profile.platform,
+                [(f.function_name, f.filename, f.lineno, f.is_native) for f in frames],
+                rows,
+            )
+        )
+        # With nothing kept only the "[other stacks]" row is left, which fits
+        if len(payload) <= limit or keep == 0:
+            return payload
+        keep //= 2
+
+
+def _decode(payload: bytes) -> AggregatedProfile:
+    from spprof import AggregatedProfile, AggregatedStack, Frame
+
+    (start, end, interval_ms, dropped, error_bound, python_version, platform, frame_rows, rows) = (
+        marshal.loads(payload)
+    )
+    frames = [Frame(*row) for row in frame_rows]
+    stacks = [
+        AggregatedStack(
+            frames=tuple(frames[i] for i in frame_ids),
+            thread_id=0,
+            thread_name=None,
+            count=count,
+            weight=weight,
+            cpu_time_ns=cpu_time_ns,
+            weight_error=weight_error,
+        )
+        for frame_ids, count, weight, cpu_time_ns, weight_error in rows
+    ]
+    return AggregatedProfile(
+        start_time=datetime.fromtimestamp(start),
+        end_time=datetime.fromtimestamp(end),
+        interval_ms=interval_ms,
+        stacks=stacks,
+        total_samples=sum(stack.count for stack in stacks),
+        dropped_count=dropped,
+        python_version=python_version,
+        platform=platform,
+        error_bound=error_bound,
+    )
@@ -0,0 +1,200 @@
+"""
+Task-aware stacks for asyncio.
+
+A sampled stack only shows the running task's own await chain: the
+coroutine that spawned it has already returned to the event loop, so the
+stack goes straight from the task's coroutine to Handle._run. TaskTracker
+installs a task factory that records, for every task, where it was
+spawned: the parent coroutine's frames at create_task() time (leading
+asyncio frames such as gather() dropped) and the parent task, if tracked.
+
+Each task runs its steps in its own contextvars.Context, which the signal
+handler records with every sample. At drain time the tracker maps each
+live Context to the task's spawn path:
+
+    [task name], spawn frames, [parent name], parent's spawn frames, ...
+
+and the drain stitches that path in just below the sample's Handle._run
+frame. Flame graphs then show each task under the coroutine that created
+it, however many tasks deep, instead of as separate trees on the loop.
+
+A task's Context is kept alive until the drain after the task finishes,
+so its address cannot be reused by another task's Context in between.
+Requires Python 3.11+ (Task(context=...)).
+
+Usage:
+    >>> async def main():
+    ...     spprof.track_asyncio_tasks()  # the running loop
+    ...     await asyncio.gather(fetch("a"), fetch("b"))
+"""
+
+from __future__ import annotations
+
+import asyncio
+import asyncio.events
+import contextvars
+import os
+import re
+import sys
+import threading
+from dataclasses import dataclass, field
+from typing import TYPE_CHECKING, Any
+
+
+if TYPE_CHECKING:
+    from types import FrameType
+
+    from spprof import Frame
+
+
+# The event loop frame that runs every task step; stitched paths go below it
+RUN_FUNCTION = asyncio.events.Handle._run.__code__.co_name
+RUN_FILENAME = asyncio.events.Handle._run.__code__.co_filename
+
+_ASYNCIO_DIR = os.path.dirname(asyncio.__file__) + os.sep
+# 3.13.0's create_task() renames factory-made unnamed tasks to "None"
+_DEFAULT_NAME = re.compile(r"Task-\d+|None")
+
+
+@dataclass(eq=False)
+class _Tracked:
+    task: asyncio.Task[Any]
+    context: contextvars.Context  # Kept alive so its id() stays unique
+    parent: _Tracked | None
+    spawn_frames: tuple[Frame, ...]  # Leaf first
+    coro_name: str  # Read at spawn: finished tasks may drop their coroutine
+    name: str | None = None  # Marker name, fixed once the task is done
+    suffix: tuple[Frame, ...] | None = field(default=None, repr=False)
+
+
+class TaskTracker:
+    """Records where each asyncio task was spawned, keyed by its Context."""
+
+    def __init__(self) -> None:
+        self._lock = threading.Lock()
+        self._contexts: dict[int, _Tracked] = {}
+        self._tasks: dict[asyncio.Task[Any], _Tracked] = {}
+        self._retired: list[_Tracked] = []
+        self._releasable: list[_Tracked] = []
+
+    def install(self, loop: asyncio.AbstractEventLoop) -> None:
+        """Wrap loop's task factory so new tasks are tracked (idempotent)."""
+        if sys.version_info < (3, 11):
+            raise RuntimeError("asyncio task tracking requires Python 3.11+")
+        previous = loop.get_task_factory()
+        if getattr(previous, "_spprof_tracker", None) is self:
+            return
+
+        def factory(
+            loop: asyncio.AbstractEventLoop, coro: Any, **kwargs: Any
+        ) -> asyncio.Future[Any]:
+            # An empty Context is falsy but still the caller's choice
+            context = kwargs.pop("context", None)
+            if context is None:
+                context = contextvars.copy_context()
+            if previous is not None:
+                task = previous(loop, coro, context=context, **kwargs)
+            else:
+                task = asyncio.Task(coro, loop=loop, context=context, **kwargs)
+            if isinstance(task, asyncio.Task):
+                self._track(task, context, asyncio.current_task(loop), sys._getframe(1))
+            return task
+
+        factory._spprof_tracker = self  # type: ignore[attr-defined]
+        loop.set_task_factory(factory)
+
+    def snapshot(self) -> tuple[dict[int, int], dict[int, tuple[Frame, ...]]]:
+        """Task ids for a drain: ({id(context): task_id}, {task_id: suffix}).
+
+        Ids are assigned per drain, one per distinct suffix, starting at 1.
+        Tasks retired so far become releasable once the drain is done.
+        """
+        with self._lock:
+            tracked = list(self._contexts.items())
+            tracked.extend((id(entry.context), entry) for entry in self._retired)
+            self._releasable.extend(self._retired)
+            self._retired.clear()
+        task_ids: dict[tuple[Frame, ...], int] = {}
+        contexts: dict[int, int] = {}
+        for context_id, entry in tracked:
+            suffix = self._suffix(entry)
+            contexts[context_id] = task_ids.setdefault(suffix, len(task_ids) + 1)
+        return contexts, {task_id: suffix for suffix, task_id in task_ids.items()}
+
+    def release_retired(self) -> None:
+        """Drop finished tasks included in the last snapshot()."""
+        with self._lock:
+            self._releasable.clear()
+
+    def _track(
+        self,
+        task: asyncio.Task[Any],
+        context: contextvars.Context,
+        parent_task: asyncio.Task[Any] | None,
+        caller: FrameType | None,
+    ) -> None:
+        spawn_frames = _spawn_frames(caller)
+        with self._lock:
+            parent = self._tasks.get(parent_task) if parent_task is not None else None
+            entry = _Tracked(task, context, parent, spawn_frames, _coro_name(task))
+            self._contexts[id(context)] = entry
+            self._tasks[task] = entry
+        task.add_done_callback(self._retire)
+
+    def _retire(self, task: asyncio.Task[Any]) -> None:
+        from spprof import is_active
+
+        with self._lock:
+            entry = self._tasks.pop(task, None)
+            if entry is None:
+                return
+            entry.name = _marker_name(entry)
+            if self._contexts.get(id(entry.context)) is entry:
+                del self._contexts[id(entry.context)]
+            # Samples taken before now may still be in the ring buffer
+            if is_active():
+                self._retired.append(entry)
+
+    def _suffix(self, entry: _Tracked) -> tuple[Frame, ...]:
+        """[task name], spawn frames, then the parent's suffix (leaf first)."""
+        from spprof import Frame
+
+        if entry.suffix is not None:
+            return entry.suffix
+        name = entry.name if entry.name is not None else _marker_name(entry)
+        marker = Frame(function_name=f"[task {name}]", filename="<asyncio>", lineno=0)
+        parent = self._suffix(entry.parent) if entry.parent is not None else ()
+        suffix = (marker, *entry.spawn_frames, *parent)
+        # Names can still change while a task (or an ancestor) runs
+        if entry.name is not None and (entry.parent is None or entry.parent.suffix is not None):
+            entry.suffix = suffix
+        return suffix
+
+
+def _marker_name(entry: _Tracked) -> str:
+    """Task name, or its coroutine's name for the default Task-N names."""
+    name = entry.task.get_name()
+    return entry.coro_name if _DEFAULT_NAME.fullmatch(name) else name
+
+
+def _coro_name(task: asyncio.Task[Any]) -> str:
+    name = getattr(task.get_coro(), "__name__", None)
+    return name if isinstance(name, str) else "task"
+
+
+def _spawn_frames(frame: FrameType | None) -> tuple[Frame, ...]:
+    """Python frames from frame up to (excluding) Handle._run, leaf first.
+
+    Leading asyncio frames (create_task, gather, ...) are dropped. Returns
+    () when the task was not created from code the loop is running.
+    """
+    from spprof import Frame
+
+    run_code = asyncio.events.Handle._run.__code__
+    frames = []
+    while frame is not None and frame.f_code is not run_code:
+        code = frame.f_code
+        if frames or not code.co_filename.startswith(_ASYNCIO_DIR):
+            frames.append(Frame(code.co_name, code.co_filename, frame.f_lineno or 0))
+        frame = frame.f_back
+    return tuple(frames) if frame is not None else ()
@@ -0,0 +1,130 @@
+"""
+Bounded-memory sample timeline for long sessions.
+
+Timeline keeps every thread's samples in time order. It splits the
+thread's budget into BLOCKS equal blocks. New samples fill the newest
+block at full resolution. When a thread runs out of blocks, two adjacent
+older blocks are decimated into one: their samples are merged in
+adjacent pairs, so the new block covers the same time at half the
+density. The oldest adjacent pair of equal density is merged first. This
+works like a binary counter: density halves step by step with age. Every
+block still holds a full block of samples, so old regions stay readable
+and recent activity stays at full resolution.
+
+A merged sample keeps the timestamp and stack of one of the pair, chosen
+with probability proportional to weight. It carries the summed weight
+and CPU time. Each thread's total weight and CPU time are therefore
+exact, and each stack's share of any region is an unbiased estimate.
+Memory is O(budget) per thread however long the session runs.
+
+Usage:
+    >>> spprof.start(timeline_samples=50_000)  # drained in the background
+    >>> ...
+    >>> profile = spprof.stop()                 # time-ordered, decimated
+    >>> profile.save("timeline.json")           # speedscope timeline view
+"""
+
+from __future__ import annotations
+
+import dataclasses
+import heapq
+import random
+from typing import TYPE_CHECKING
+
+
+if TYPE_CHECKING:
+    from datetime import datetime
+
+    from spprof import Profile, Sample
+
+
+# Blocks per thread; budget // BLOCKS samples each
+BLOCKS = 16
+
+
+@dataclasses.dataclass
+class _Block:
+    level: int  # Density is 1 / 2**level of the original sampling
+    samples: list[Sample]
+
+
+class Timeline:
+    """Per-thread sample timelines with progressive pairwise decimation."""
+
+    def __init__(self, budget: int, seed: int | None = None) -> None:
+        if budget < BLOCKS:
+            raise ValueError(f"budget must be >= {BLOCKS}")
+        self.budget = budget
+        self._block_size = budget // BLOCKS
+        self._threads: dict[int, list[_Block]] = {}
+        self._random = random.Random(seed)
+        self._decimations = 0
+        self._start_time: datetime | None = None
+        self._end_time: datetime | None = None
+        self._interval_ms = 0.0
+        self._dropped_count = 0
+        self._python_version = ""
+        self._platform = ""
+
+    @property
+    def decimations(self) -> int:
+        """Number of block merges so far, across all threads."""
+        return self._decimations
+
+    def add(self, profile: Profile) -> None:
+        """Append one window; windows must be added in time order."""
+        if self._start_time is None:
+            self._start_time = profile.start_time
+            self._interval_ms = profile.interval_ms
+            self._python_version = profile.python_version
+            self._platform = profile.platform
+        self._end_time = profile.end_time
+        self._dropped_count += profile.dropped_count
+        for sample in profile.samples:
+            blocks = self._threads.setdefault(sample.thread_id, [])
+            if not blocks or len(blocks[-1].samples) >= self._block_size:
+                if len(blocks) >= BLOCKS:
+                    self._merge_blocks(blocks)
+                blocks.append(_Block(0, []))
+            blocks[-1].samples.append(sample)
+
+    def to_profile(self) -> Profile:
+        """All kept samples, merged across threads in timestamp order."""
+        from spprof import Profile
+
+        if self._start_time is None or self._end_time is None:
+            raise ValueError("No windows have been added")
+        threads = (
+            [sample for block in blocks for sample in block.samples]
+            for blocks in self._threads.values()
+        )
+        return Profile(
+            start_time=self._start_time,
+            end_time=self._end_time,
+            interval_ms=self._interval_ms,
+            samples=list(heapq.merge(*threads, key=lambda sample: sample.timestamp_ns)),
+            dropped_count=self._dropped_count,
+            python_version=self._python_version,
+            platform=self._platform,
+        )
+
+    def _merge_blocks(self, blocks: list[_Block]) -> None:
+        """Decimate the oldest equal-density pair (else the oldest pair) into one block."""
+        index = next(
+            (i for i in range(len(blocks) - 1) if blocks[i].level == blocks[i + 1].level), 0
+        )
+        first, second = blocks[index], blocks[index + 1]
+        combined = first.samples + second.samples
+        merged = [self._merge(combined[i], combined[i + 1]) for i in range(0, len(combined) - 1, 2)]
+        if len(combined) % 2:
+            merged.append(combined[-1])
+        blocks[index : index + 2] = [_Block(max(first.level, second.level) + 1, merged)]
+        self._decimations += 1
+
+    def _merge(self, first: Sample, second: Sample) -> Sample:
+        total = first.weight + second.weight
+        kept = first if self._random.random() * total < first.weight else second
+        cpu_time_ns = None
+        if first.cpu_time_ns is not None or second.cpu_time_ns is not None:
+            cpu_time_ns = (first.cpu_time_ns or 0) + (second.cpu_time_ns or 0)
+        return dataclasses.replace(kept, weight=total, cpu_time_ns=cpu_time_ns)
@@ -141,6 +141,49 @@ class TestValidationDropsTracking:
         assert profile is not None
 
 
+class TestGILStaysDisabled:
+    """The extension must not turn the GIL back on."""
+
+    def test_import_keeps_gil_disabled(self):
+        """Test that importing and running the profiler keeps the GIL off."""
+        import spprof
+
+        with spprof.Profiler(interval_ms=5):
+            sum(range(10000))
+
+        assert not sys._is_gil_enabled()
+
+
+class TestCodeObjectChurn:
+    """Code objects freed while samples that reference them are pending."""
+
+    def test_generated_code_resolves(self):
+        """Test that short-lived code objects resolve without crashing."""
+        import spprof
+
+        stop_flag = threading.Event()
+
+        def codegen(n):
+            while not stop_flag.is_set():
+                namespace = {}
+                exec(f"def generated_{n}():\n    return sum(range(2000))", namespace)
+                namespace[f"generated_{n}"]()
+
+        threads = [threading.Thread(target=codegen, args=(i,)) for i in range(4)]
+        spprof.start(interval_ms=1)
+        for t in threads:
+            t.start()
+        time.sleep(0.5)
+        stop_flag.set()
+        for t in threads:
+            t.join()
+        profile = spprof.stop()
+
+        for sample in profile.samples:
+            for frame in sample.frames:
+                assert isinstance(frame.function_name, str)
+
+
 class TestNoCrashUnderContention:
     """Stress tests to ensure no crashes under thread contention."""
 
@@ -1,6 +1,10 @@
 """Tests for native C-stack unwinding."""
 
+import os
 import platform
+import subprocess
+import sys
+import textwrap
 
 import pytest
 
@@ -138,3 +142,190 @@ def test_capture_native_stack():
         assert isinstance(frame.ip, int)
         assert isinstance(frame.symbol, str)
         assert isinstance(frame.resolved, bool)
+
+
+@pytest.mark.skipif(platform.system() != "Linux", reason="Symbol cache reads ELF files")
+def test_symbol_cache_round_trip(tmp_path):
+    """Symbol tables are written once per build id, then mapped from the cache."""
+    import spprof
+    from spprof import _native
+
+    if not spprof.native_unwinding_available():
+        pytest.skip("Native unwinding not available")
+
+    spprof.set_native_unwinding(True)
+    cache_dir = tmp_path / "symbols"
+    spprof.set_symbol_cache_dir(cache_dir)
+    try:
+        before = _native._get_symbol_cache_stats()
+        frames = spprof.capture_native_stack()
+        built = _native._get_symbol_cache_stats()
+        files = sorted(p.name for p in cache_dir.iterdir())
+        if not files:
+            pytest.skip("No loaded module has a GNU build id")
+        assert built["tables_built"] > before["tables_built"]
+        assert all(name.endswith(".sym") for name in files)
+        assert any(f.resolved and not f.symbol.startswith("0x") for f in frames)
+
+        # stop() drops the loaded tables; the next lookups map the files
+        spprof.start(interval_ms=10)
+        spprof.stop()
+        again = spprof.capture_native_stack()
+        mapped = _native._get_symbol_cache_stats()
+        assert mapped["tables_mapped"] > built["tables_mapped"]
+        assert mapped["tables_built"] == built["tables_built"]
+        assert [f.symbol for f in again[1:4]] == [f.symbol for f in frames[1:4]]
+    finally:
+        spprof.set_symbol_cache_dir(None)
+        spprof.set_native_unwinding(False)
+
+
+@pytest.mark.skipif(platform.system() != "Linux", reason="Symbol cache reads ELF files")
+def test_symbol_cache_indexes_modules_loaded_later(tmp_path):
+    """A library dlopen()ed after the first lookup is indexed once it is hit."""
+    import shutil
+
+    cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        pytest.skip("No C compiler")
+    source = tmp_path / "late.c"
+    source.write_text(
+        textwrap.dedent(
+            """
+            /* Static: only .symtab names it, dladdr() cannot */
+            static __attribute__((noinline)) void late_inner(void (*callback)(void)) {
+                callback();
+                __asm__ volatile("");
+            }
+
+            void late_call(void (*callback)(void)) {
+                late_inner(callback);
+                __asm__ volatile("");
+            }
+            """
+        )
+    )
+    library = tmp_path / "liblate.so"
+    built = subprocess.run(
+        [cc, "-shared", "-fPIC", "-O0", "-o", str(library), str(source)],
+        capture_output=True,
+        timeout=60,
+    )
+    if built.returncode != 0:
+        pytest.skip("Could not build the test library")
+
+    (tmp_path / "symbols").mkdir()
+    script = tmp_path / "late_target.py"
+    script.write_text(
+        textwrap.dedent(
+            f"""
+            import ctypes
+            import time
+            import spprof
+
+            if not spprof.native_unwinding_available():
+                raise SystemExit(3)
+            spprof.set_native_unwinding(True)
+            spprof.set_symbol_cache_dir({str(tmp_path / "symbols")!r})
+            spprof.capture_native_stack()
+            # Past the rescan interval, so a miss snapshots the modules again
+            time.sleep(1.1)
+            library = ctypes.CDLL({str(library)!r})
+            frames = []
+            callback = ctypes.CFUNCTYPE(None)(
+                lambda: frames.extend(spprof.capture_native_stack())
+            )
+            library.late_call(callback)
+            for frame in frames:
+                print(frame.symbol, frame.filename)
+            """
+        )
+    )
+    result = subprocess.run(
+        [sys.executable, str(script)],
+        capture_output=True,
+        text=True,
+        timeout=60,
+        env={**os.environ, "PYTHONPATH": os.pathsep.join(sys.path)},
+    )
+    if result.returncode == 3:
+        pytest.skip("Native unwinding not available")
+    assert result.returncode == 0, result.stderr
+    late = [line for line in result.stdout.splitlines() if line.endswith(str(library))]
+    if not late:
+        pytest.skip("The unwinder stopped before the library")
+    assert any(line.startswith("late_inner ") for line in late)
+
+
+@pytest.mark.skipif(
+    platform.system() != "Linux" or not hasattr(sys, "activate_stack_trampoline"),
+    reason="Perf trampolines need Python 3.12+ on Linux",
+)
+def test_jit_frames_named_from_perf_map():
+    """Frames in perf trampolines are named from /tmp/perf-<pid>.map."""
+    import spprof
+
+    if not spprof.native_unwinding_available():
+        pytest.skip("Native unwinding not available")
+
+    spprof.set_native_unwinding(True)
+    try:
+        sys.activate_stack_trampoline("perf")
+    except ValueError:
+        spprof.set_native_unwinding(False)
+        pytest.skip("Perf trampolines not supported by this build")
+    try:
+        frames = spprof.capture_native_stack()
+    finally:
+        sys.deactivate_stack_trampoline()
+        spprof.set_native_unwinding(False)
+
+    jit = [f for f in frames if f.filename.endswith(f"perf-{os.getpid()}.map")]
+    if not jit:
+        pytest.skip("The unwinder stopped before the trampoline")
+    assert jit[0].symbol.startswith("py::capture_native_stack:")
+    assert jit[0].resolved
+
+
+@pytest.mark.skipif(
+    platform.system() != "Linux" or sys.version_info < (3, 13),
+    reason="-X perf_jit needs Python 3.13+ on Linux",
+)
+def test_jit_frames_named_from_jitdump(tmp_path):
+    """Frames in perf_jit trampolines are named from the jitdump."""
+    import spprof
+
+    if not spprof.native_unwinding_available():
+        pytest.skip("Native unwinding not available")
+
+    script = tmp_path / "jit_target.py"
+    script.write_text(
+        textwrap.dedent(
+            """
+            import os
+            import spprof
+
+            spprof.set_native_unwinding(True)
+            spprof.capture_native_stack()
+            # The dump is written through a stdio buffer: register enough
+            # trampolines after capture_native_stack's to flush its record
+            for i in range(300):
+                exec(f"def f{i}(): pass\\nf{i}()")
+            for frame in spprof.capture_native_stack():
+                if frame.filename.endswith(f"jit-{os.getpid()}.dump"):
+                    print(frame.symbol)
+            """
+        )
+    )
+    result = subprocess.run(
+        [sys.executable, "-X", "perf_jit", str(script)],
+        capture_output=True,
+        text=True,
+        timeout=60,
+    )
+    if result.returncode != 0:
+        pytest.skip(f"-X perf_jit unavailable: {result.stderr.strip()[-200:]}")
+    names = result.stdout.split()
+    if not names:
+        pytest.skip("The unwinder stopped before the trampoline")
+    assert names[0].startswith("py::capture_native_stack:")
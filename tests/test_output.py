@@ -217,3 +217,412 @@ def test_multi_thread_output():
     thread_names = {p["name"] for p in speedscope["profiles"]}
     assert "Thread-1" in thread_names
     assert "Thread-2" in thread_names
+
+
+def test_weighted_samples_output():
+    """Verify overrun weights flow into aggregation and both output formats."""
+    from spprof import Frame, Profile, Sample
+
+    frame = Frame(function_name="busy", filename="busy.py", lineno=3)
+    heavy = Sample(
+        timestamp_ns=1000000000,
+        thread_id=1,
+        thread_name="MainThread",
+        frames=[frame],
+        weight=3,
+    )
+    light = Sample(
+        timestamp_ns=1010000000,
+        thread_id=1,
+        thread_name="MainThread",
+        frames=[frame],
+    )
+
+    profile = Profile(
+        start_time=datetime.now(),
+        end_time=datetime.now(),
+        interval_ms=10,
+        samples=[heavy, light],
+        dropped_count=0,
+        python_version="3.12.0",
+        platform="TestPlatform",
+    )
+
+    assert profile.total_weight == 4
+    assert profile.to_collapsed() == "busy (busy.py:3) 4"
+
+    speedscope = profile.to_speedscope()
+    assert speedscope["profiles"][0]["weights"] == [30_000_000, 10_000_000]
+
+    agg = profile.aggregate()
+    assert agg.total_samples == 2
+    assert agg.total_weight == 4
+    assert agg.stacks[0].count == 2
+    assert agg.to_collapsed() == "busy (busy.py:3) 4"
+    assert agg.to_speedscope()["profiles"][0]["weights"] == [40_000_000]
+
+
+def test_cpu_time_weights_output():
+    """Verify measured CPU time replaces interval-based speedscope weights."""
+    from spprof import Frame, Profile, Sample
+
+    frame = Frame(function_name="compute", filename="calc.py", lineno=7)
+    samples = [
+        Sample(
+            timestamp_ns=1000000000 + i,
+            thread_id=1,
+            thread_name="MainThread",
+            frames=[frame],
+            cpu_time_ns=cpu,
+        )
+        for i, cpu in enumerate([9_500_000, 10_200_000])
+    ]
+
+    profile = Profile(
+        start_time=datetime.now(),
+        end_time=datetime.now(),
+        interval_ms=10,
+        samples=samples,
+        dropped_count=0,
+        python_version="3.12.0",
+        platform="TestPlatform",
+    )
+
+    assert profile.total_cpu_time_ns == 19_700_000
+    assert profile.to_speedscope()["profiles"][0]["weights"] == [9_500_000, 10_200_000]
+
+    agg = profile.aggregate()
+    assert agg.stacks[0].cpu_time_ns == 19_700_000
+    assert agg.to_speedscope()["profiles"][0]["weights"] == [19_700_000]
+
+
+def _columnar_profile(samples_spec, label_ids=None, label_sets=None):
+    """Build a natively backed Profile from (thread, stack_id, weight, cpu) rows."""
+    from array import array
+
+    from spprof import Profile, _SampleColumns
+
+    strings = ["main", "app.py", 'say "hi"\n', "wörker.py", "memcpy", "libc.so.6", "libc.so"]
+    # (function, filename, lineno, is_native)
+    frames = [(0, 1, 10, 0), (2, 3, 7, 0), (4, 5, 0, 1), (4, 6, 0, 1), (0, 1, 11, 0)]
+    # Leaf first; stacks 1 and 2 differ only by library path and collapse together
+    stacks = [[1, 0], [2, 1, 0], [3, 1, 0], [4]]
+    offsets = [0]
+    for stack in stacks:
+        offsets.append(offsets[-1] + len(stack))
+
+    unknown = 2**64 - 1
+    raw = {
+        "strings": strings,
+        "frame_functions": array("I", [f[0] for f in frames]).tobytes(),
+        "frame_filenames": array("I", [f[1] for f in frames]).tobytes(),
+        "frame_linenos": array("i", [f[2] for f in frames]).tobytes(),
+        "frame_is_native": bytes(f[3] for f in frames),
+        "frame_addresses": array("Q", [0x1000 * f[3] * (i + 1) for i, f in enumerate(frames)]).tobytes(),
+        "stack_offsets": array("I", offsets).tobytes(),
+        "stack_frames": array("I", [f for stack in stacks for f in stack]).tobytes(),
+        "timestamps": array("Q", [1000 * (i + 1) for i in range(len(samples_spec))]).tobytes(),
+        "thread_ids": array("Q", [s[0] for s in samples_spec]).tobytes(),
+        "cpu_times": array("Q", [unknown if s[3] is None else s[3] for s in samples_spec]).tobytes(),
+        "weights": array("I", [s[2] for s in samples_spec]).tobytes(),
+        "stack_ids": array("I", [s[1] for s in samples_spec]).tobytes(),
+        "label_ids": array("I", label_ids or [0] * len(samples_spec)).tobytes(),
+    }
+    return Profile(
+        start_time=datetime.now(),
+        end_time=datetime.now(),
+        interval_ms=0.05,
+        samples=_SampleColumns(raw, {7: 'Main "thread"'}, label_sets),
+        dropped_count=0,
+        python_version="3.12.0",
+        platform="Linux-5.15-x86_64",
+    )
+
+
+def test_native_writers_match_python_formatters():
+    """Verify save() on columnar profiles matches the Python formatters."""
+    import pytest
+
+    import spprof
+
+    if not hasattr(spprof._native, "_write_speedscope"):
+        pytest.skip("Native writers not available")
+
+    rows = [(7, 0, 1, None), (9, 1, 3, 500), (7, 2, 2, None), (9, 3, 1, None), (7, 0, 1, 42)]
+    for profile in (_columnar_profile(rows), _columnar_profile([])):
+        with tempfile.TemporaryDirectory() as tmpdir:
+            speedscope_path = Path(tmpdir) / "profile.json"
+            collapsed_path = Path(tmpdir) / "profile.txt"
+            profile.save(speedscope_path)
+            profile.save(collapsed_path, format="collapsed")
+
+            expected = json.loads(json.dumps(profile.to_speedscope()))
+            assert json.loads(speedscope_path.read_text(encoding="utf-8")) == expected
+            assert collapsed_path.read_text(encoding="utf-8") == profile.to_collapsed()
+
+
+def _decode_proto(data):
+    """Decode one protobuf message into {field: [value, ...]} (varint and bytes only)."""
+    fields = {}
+    pos = 0
+
+    def varint():
+        nonlocal pos
+        value = shift = 0
+        while True:
+            byte = data[pos]
+            pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if byte < 0x80:
+                return value
+
+    while pos < len(data):
+        key = varint()
+        if key & 7 == 0:
+            value = varint()
+        else:
+            assert key & 7 == 2
+            length = varint()
+            value = data[pos : pos + length]
+            pos += length
+        fields.setdefault(key >> 3, []).append(value)
+    return fields
+
+
+def _packed(data):
+    """Decode a packed repeated varint field."""
+    values = []
+    value = shift = 0
+    for byte in data:
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte < 0x80:
+            values.append(value)
+            value = shift = 0
+    return values
+
+
+def test_save_pprof():
+    """Verify pprof output decodes to the expected profile.proto structure."""
+    import ctypes
+    import gzip
+
+    import pytest
+
+    import spprof
+
+    if not hasattr(spprof._native, "_write_pprof"):
+        pytest.skip("Native pprof writer not available")
+
+    rows = [(7, 0, 1, None), (9, 1, 3, 500), (7, 2, 2, None), (9, 3, 1, None), (7, 0, 1, 42)]
+    profile = _columnar_profile(rows)
+    # Point one native frame at a real libc function so it gets a mapping
+    libc_address = ctypes.cast(ctypes.CDLL(None).memcpy, ctypes.c_void_p).value
+    profile.samples.frame_addresses[2] = libc_address
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        path = Path(tmpdir) / "profile.pb.gz"
+        profile.save(path, format="pprof")
+        data = path.read_bytes()
+        # Python-built profiles go through the same writer
+        aggregated_path = Path(tmpdir) / "aggregated.pb.gz"
+        profile.aggregate().save(aggregated_path, format="pprof")
+        aggregated_data = aggregated_path.read_bytes()
+
+    if data[:2] == b"\x1f\x8b":
+        data = gzip.decompress(data)
+        aggregated_data = gzip.decompress(aggregated_data)
+    message = _decode_proto(data)
+    strings = [s.decode("utf-8") for s in message[6]]
+    assert strings[0] == ""
+
+    sample_types = [_decode_proto(v) for v in message[1]]
+    assert [(strings[t[1][0]], strings[t[2][0]]) for t in sample_types] == [
+        ("samples", "count"),
+        ("cpu", "nanoseconds"),
+    ]
+    assert message[12] == [50000]  # period: 0.05 ms
+
+    # One sample per (thread, stack); values are [weight, cpu ns]
+    samples = [_decode_proto(s) for s in message[2]]
+    assert len(samples) == 4
+    values = [_packed(s[2][0]) for s in samples]
+    assert sum(v[0] for v in values) == sum(r[2] for r in rows)
+    assert sum(v[1] for v in values) == 42 + 50000 + 500 + 2 * 50000 + 50000
+
+    functions = {f[1][0]: f for f in map(_decode_proto, message[5])}
+    locations = {loc[1][0]: loc for loc in map(_decode_proto, message[4])}
+    leaf = locations[_packed(samples[0][1][0])[0]]
+    function = functions[_decode_proto(leaf[4][0])[1][0]]
+    assert strings[function[2][0]] == 'say "hi"\n'
+    assert strings[function[4][0]] == "wörker.py"
+
+    mappings = [_decode_proto(m) for m in message.get(3, [])]
+    native = locations[3]
+    assert native[3] == [libc_address]
+    if mappings:
+        mapping = mappings[0]
+        assert native[2] == [mapping[1][0]]
+        assert mapping[2][0] <= libc_address < mapping[3][0]
+
+    assert len(_decode_proto(aggregated_data)[2]) == 4
+
+
+def test_save_perfetto():
+    """Verify Perfetto output has a track per thread and balanced slices."""
+    import pytest
+
+    import spprof
+
+    if not hasattr(spprof._native, "_write_perfetto"):
+        pytest.skip("Native Perfetto writer not available")
+
+    rows = [(7, 0, 1, None), (9, 1, 3, 500), (7, 2, 2, None), (9, 3, 1, None), (7, 0, 1, 42)]
+    profile = _columnar_profile(rows)
+    with tempfile.TemporaryDirectory() as tmpdir:
+        path = Path(tmpdir) / "trace.pftrace"
+        profile.save(path, format="perfetto")
+        packets = [_decode_proto(p) for p in _decode_proto(path.read_bytes())[1]]
+
+        with pytest.raises(ValueError, match="timestamps"):
+            profile.aggregate().save(Path(tmpdir) / "agg.pftrace", format="perfetto")
+
+    tracks = [_decode_proto(p[60][0]) for p in packets if 60 in p]
+    process = [t for t in tracks if 3 in t]
+    assert len(process) == 1
+    threads = {}
+    for track in tracks:
+        if 4 in track:
+            descriptor = _decode_proto(track[4][0])
+            assert track[5] == process[0][1]
+            threads[track[1][0]] = (descriptor[2][0], descriptor.get(5, [b""])[0])
+    assert sorted(tid for tid, _ in threads.values()) == [7, 9]
+    assert (7, 'Main "thread"'.encode()) in threads.values()
+
+    # Every track's slices nest and close; names resolve through interning
+    depth = dict.fromkeys(threads, 0)
+    names = {}
+    last_timestamp = {}
+    for packet in packets:
+        for interned in packet.get(12, []):
+            for entry in map(_decode_proto, _decode_proto(interned).get(2, [])):
+                names[(packet[10][0], entry[1][0])] = entry[2][0].decode("utf-8")
+        if 11 not in packet:
+            continue
+        event = _decode_proto(packet[11][0])
+        track = event[11][0]
+        assert packet[8][0] >= last_timestamp.get(track, 0)
+        last_timestamp[track] = packet[8][0]
+        if event[9] == [1]:
+            assert (packet[10][0], event[10][0]) in names
+            depth[track] += 1
+        else:
+            assert event[9] == [2]
+            depth[track] -= 1
+            assert depth[track] >= 0
+    assert set(depth.values()) == {0}
+    assert "main (app.py:10)" in names.values()
+    assert "memcpy" in names.values()
+
+
+def test_save_perf_script():
+    """Verify perf script output and its perf map agree on Python symbols."""
+    import os
+    import re
+
+    import pytest
+
+    import spprof
+
+    if not hasattr(spprof._native, "_write_perf_script"):
+        pytest.skip("Native perf script writer not available")
+
+    rows = [(7, 0, 1, None), (9, 1, 3, 500), (7, 2, 2, None), (9, 3, 1, None), (7, 0, 1, 42)]
+    profile = _columnar_profile(rows)
+    pid = os.getpid()
+    with tempfile.TemporaryDirectory() as tmpdir:
+        path = Path(tmpdir) / "profile.perf"
+        profile.save(path, format="perf")
+        records = path.read_text(encoding="utf-8").split("\n\n")
+        perf_map = (Path(tmpdir) / f"perf-{pid}.map").read_text(encoding="utf-8")
+
+    assert records.pop() == ""
+    assert len(records) == len(rows)
+    symbols = {}
+    for line in perf_map.splitlines():
+        start, size, name = line.split(" ", 2)
+        symbols[int(start, 16)] = name
+        assert int(size, 16) > 0
+    # Lines of one function share a symbol; newlines cannot split a record
+    assert sorted(symbols.values()) == ['py::main:app.py', 'py::say "hi" :wörker.py']
+
+    header = re.compile(r"^\S.* (\d+)/(\d+) +(\d+)\.(\d{6}): (\d+) cpu-clock:$")
+    frame = re.compile(r"^\t *([0-9a-f]+) (.+) \((\S+)\)$")
+    periods = 0
+    for record, row in zip(records, rows):
+        lines = record.split("\n")
+        match = header.match(lines[0])
+        assert match is not None, lines[0]
+        assert (int(match[1]), int(match[2])) == (pid, row[0])
+        periods += int(match[5])
+        for line in lines[1:]:
+            address, name, dso = frame.match(line).groups()
+            if name.startswith("py::"):
+                assert symbols[int(address, 16)] == name
+                assert dso == f"/tmp/perf-{pid}.map"
+            else:
+                assert (name, dso) in (("memcpy", "libc.so.6"), ("memcpy", "libc.so"))
+    assert periods == sum(row[2] for row in rows) * 50_000
+
+
+def test_labels_output():
+    """Verify labelled samples get per-label speedscope profiles and pprof labels."""
+    import gzip
+
+    import pytest
+
+    import spprof
+
+    if not hasattr(spprof._native, "_write_pprof"):
+        pytest.skip("Native writers not available")
+
+    rows = [(7, 0, 1, None), (7, 0, 1, None), (7, 1, 2, None), (9, 3, 1, None)]
+    label_sets = {3: {"endpoint": "/users", "tenant": 'a"b'}, 5: {"endpoint": "/health"}}
+    profile = _columnar_profile(rows, label_ids=[3, 0, 5, 3], label_sets=label_sets)
+    assert profile.samples[0].labels == label_sets[3]
+    assert profile.samples[1].labels is None
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        speedscope_path = Path(tmpdir) / "profile.json"
+        pprof_path = Path(tmpdir) / "profile.pb.gz"
+        profile.save(speedscope_path)
+        profile.save(pprof_path, format="pprof")
+        native = json.loads(speedscope_path.read_text(encoding="utf-8"))
+        data = pprof_path.read_bytes()
+
+    expected = json.loads(json.dumps(profile.to_speedscope()))
+    assert native == expected
+    assert [p["name"] for p in native["profiles"]] == [
+        'Main "thread" [endpoint=/users, tenant=a"b]',
+        'Main "thread"',
+        'Main "thread" [endpoint=/health]',
+        'Thread-9 [endpoint=/users, tenant=a"b]',
+    ]
+    agg = profile.aggregate()
+    assert [p["name"] for p in agg.to_speedscope()["profiles"]] == [
+        p["name"] for p in native["profiles"]
+    ]
+
+    if data[:2] == b"\x1f\x8b":
+        data = gzip.decompress(data)
+    message = _decode_proto(data)
+    strings = [s.decode("utf-8") for s in message[6]]
+    sample_labels = []
+    for sample in map(_decode_proto, message[2]):
+        pairs = [_decode_proto(label) for label in sample[3]]
+        sample_labels.append({strings[p[1][0]]: strings[p[2][0]] for p in pairs if 2 in p})
+    # The thread name label is a string label too; drop it
+    for labels in sample_labels:
+        labels.pop("thread_name", None)
+    assert sample_labels == [label_sets[3], {}, label_sets[5], label_sets[3]]
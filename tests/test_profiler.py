@@ -1,6 +1,7 @@
 """Integration tests for the profiler."""
 
 import contextlib
+import sys
 import time
 
 import pytest
@@ -58,6 +59,146 @@ def test_start_stop_basic():
     assert profile.platform is not None
 
 
+@pytest.mark.skipif(
+    sys.platform != "linux" or sys.version_info < (3, 11),
+    reason="Instruction pointers are captured on Linux for 3.11+",
+)
+def test_samples_report_executing_line():
+    """Verify frames carry the line being executed, not the def line."""
+    import spprof
+
+    def line_target():
+        deadline = time.monotonic() + 0.3
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    spprof.start(interval_ms=1)
+    line_target()
+    profile = spprof.stop()
+
+    lines = {
+        frame.lineno
+        for sample in profile.samples
+        for frame in sample.frames
+        if frame.function_name == "line_target"
+    }
+    assert lines
+    assert line_target.__code__.co_firstlineno not in lines
+
+
+@pytest.mark.skipif(sys.version_info < (3, 12), reason="code watchers require Python 3.12+")
+def test_safe_mode_keeps_samples_of_destroyed_code():
+    """Verify safe mode resolves frames whose code object died before stop."""
+    import spprof
+    from spprof import _native
+
+    source = (
+        "def generated():\n"
+        "    deadline = now() + 0.02\n"
+        "    while now() < deadline:\n"
+        "        sum(i * i for i in range(200))\n"
+    )
+    _native._set_safe_mode(True)
+    try:
+        spprof.start(interval_ms=1)
+        for _ in range(15):
+            namespace = {"now": time.monotonic}
+            exec(compile(source, "<generated>", "exec"), namespace)
+            namespace["generated"]()
+            namespace.clear()  # Destroys the function and its code objects
+        profile = spprof.stop()
+        stats = _native._get_code_registry_stats()
+    finally:
+        _native._set_safe_mode(False)
+
+    lines = {
+        frame.lineno
+        for sample in profile.samples
+        for frame in sample.frames
+        if frame.filename == "<generated>"
+    }
+    assert lines
+    assert lines <= {2, 3, 4}
+    assert stats["safe_mode_rejects"] == 0
+    if sys.platform.startswith("linux"):
+        assert stats["retired_resolved"] > 0
+
+
+def test_parallel_resolution_keeps_frames_and_lines():
+    """Verify samples resolved by several worker threads are exact."""
+    import spprof
+    from spprof import _native
+
+    def leaf(deadline):
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    def outer(depth, deadline):
+        if depth == 0:
+            return leaf(deadline)
+        return outer(depth - 1, deadline)
+
+    _native._set_resolver_workers(4)
+    try:
+        spprof.start(interval_ms=1)
+        outer(10, time.monotonic() + 0.5)
+        profile = spprof.stop()
+    finally:
+        _native._set_resolver_workers(0)
+    stats = _native._get_resolver_stats()
+
+    first = leaf.__code__.co_firstlineno
+    in_leaf = [
+        sample
+        for sample in profile.samples
+        if any(frame.function_name == "leaf" for frame in sample.frames)
+    ]
+    assert in_leaf
+    for sample in in_leaf:
+        assert sum(frame.function_name == "outer" for frame in sample.frames) == 11
+        for frame in sample.frames:
+            if frame.function_name == "leaf":
+                assert frame.lineno in (first + 1, first + 2)
+    assert stats["cache_hits"] > stats["cache_misses"]
+
+
+def test_code_cache_keeps_ids_when_probe_window_overflows():
+    """Verify a full probe window evicts dead objects first and evicted ones keep their id."""
+    import itertools
+
+    from spprof import _native
+
+    def home(address):
+        # slot_hash() in code_cache.c: shard and home slot of an address
+        return (((address >> 4) * 0x9E3779B97F4A7C15) % 2**64) >> 50
+
+    base = 0x7F0000000000
+    same_window = (a for a in itertools.count(base, 16) if home(a) == home(base))
+    addresses = list(itertools.islice(same_window, 12))
+    dead, live, late = addresses[:4], addresses[4:8], addresses[8:]
+
+    _native._code_cache_reset()
+    try:
+        ids = {a: _native._code_cache_insert(a, 1, 5) for a in dead}
+        ids.update({a: _native._code_cache_insert(a, 1, None) for a in live + late})
+
+        # The window holds 8 slots: the late objects displaced the dead ones
+        assert all(_native._code_cache_lookup(a, 10) == ids[a] for a in live + late)
+        assert all(_native._code_cache_lookup(a, 2) is None for a in dead)
+        assert _native._get_resolver_stats()["cache_collisions"] == 4
+
+        # Evicted objects come back under their old id, even at a live one's cost
+        assert _native._code_cache_insert(dead[0], 2, 5) == ids[dead[0]]
+        assert _native._code_cache_lookup(dead[0], 1) == ids[dead[0]]
+        evicted = [a for a in live + late if _native._code_cache_lookup(a, 10) is None]
+        assert len(evicted) == 1
+        assert _native._code_cache_insert(evicted[0], 3, None) == ids[evicted[0]]
+        assert _native._get_resolver_stats()["cache_reinserts"] == 2
+        assert len(set(ids.values())) == len(addresses)
+    finally:
+        _native._code_cache_reset()
+
+
 def test_double_start_raises():
     """Verify starting while running raises RuntimeError."""
     import spprof
@@ -152,10 +293,24 @@ def test_stats():
     assert stats.collected_samples >= 0
     assert stats.dropped_samples >= 0
     assert stats.duration_ms >= 0
+    assert stats.validation_drops >= 0
 
     spprof.stop()
 
 
+def test_profiler_stats_after_exit():
+    """Verify Profiler.stats() keeps the final counters after the block."""
+    import spprof
+
+    with spprof.Profiler(interval_ms=1) as p:
+        sum(i * i for i in range(200000))
+        assert p.stats()["samples_captured"] >= 0
+
+    stats = p.stats()
+    assert set(stats) >= {"samples_captured", "dropped_samples", "validation_drops"}
+    assert stats["validation_drops"] >= 0
+
+
 def test_cpu_bound_captures_samples():
     """Verify CPU-bound work captures samples (with native extension)."""
     import spprof
@@ -177,3 +332,941 @@ def test_cpu_bound_captures_samples():
     # With native extension, we should have samples
     assert profile is not None
     # Note: Sample count depends on whether native extension is available
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Thread CPU deltas are Linux-only")
+def test_cpu_time_matches_thread_clock():
+    """Verify per-sample CPU deltas add up to the thread's consumed CPU time."""
+    import spprof
+
+    spprof.start(interval_ms=1)
+    cpu_start = time.thread_time_ns()
+
+    deadline = time.monotonic() + 0.3
+    while time.monotonic() < deadline:
+        sum(i * i for i in range(1000))
+
+    cpu_used = time.thread_time_ns() - cpu_start
+    profile = spprof.stop()
+
+    import threading
+
+    main_samples = [s for s in profile.samples if s.thread_id == threading.get_native_id()]
+    if not main_samples:
+        pytest.skip("No samples captured")
+
+    assert all(s.cpu_time_ns is not None for s in main_samples)
+    measured = sum(s.cpu_time_ns for s in main_samples)
+    # The tail after the last sample is not attributed to any sample
+    assert 0.5 * cpu_used <= measured <= 1.1 * cpu_used
+
+
+def test_invalid_overhead_budget_raises():
+    """Verify out-of-range overhead budgets raise ValueError."""
+    import spprof
+
+    for budget in (0, -1.0, 150.0):
+        with pytest.raises(ValueError, match="overhead_budget_pct"):
+            spprof.start(interval_ms=1, overhead_budget_pct=budget)
+    assert not spprof.is_active()
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Overhead budget is Linux-only")
+def test_overhead_budget_stretches_interval():
+    """Verify a tight budget slows sampling but keeps weights unbiased."""
+    import spprof
+
+    spprof.start(interval_ms=1, overhead_budget_pct=0.001)
+
+    deadline = time.monotonic() + 1.0
+    while time.monotonic() < deadline:
+        sum(i * i for i in range(1000))
+
+    stats = spprof.stats()
+    profile = spprof.stop()
+
+    if profile.sample_count == 0:
+        pytest.skip("No samples captured")
+
+    assert stats.interval_scale > 1
+    # Each sample stands for interval_scale base intervals
+    assert profile.total_weight > profile.sample_count
+
+
+def test_invalid_interval_us_raises():
+    """Verify intervals below the high-frequency floor raise ValueError."""
+    import spprof
+
+    with pytest.raises(ValueError, match="interval_us"):
+        spprof.start(interval_us=10)
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="High-frequency mode is Linux-only")
+def test_high_frequency_mode():
+    """Verify sub-millisecond sampling of the calling thread."""
+    import threading
+
+    import spprof
+
+    spprof.start(interval_us=100)
+
+    deadline = time.monotonic() + 0.2
+    while time.monotonic() < deadline:
+        sum(i * i for i in range(200))
+
+    # Only the starting thread is sampled in this mode
+    assert spprof.register_thread() is False
+    stats = spprof.stats()
+    profile = spprof.stop()
+
+    assert profile.interval_ms == pytest.approx(0.1)
+    if profile.sample_count == 0:
+        pytest.skip("No samples captured")
+    assert 0 < stats.collected_samples <= profile.sample_count
+
+    # Far more samples than the 1ms floor allows
+    assert profile.sample_count > 400
+    assert {s.thread_id for s in profile.samples} == {threading.get_native_id()}
+    assert all(len(s.frames) <= 32 for s in profile.samples)
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="High-frequency mode is Linux-only")
+def test_high_frequency_snapshot():
+    """Verify snapshot() returns high-frequency samples while sampling runs."""
+    import spprof
+
+    def spin(seconds):
+        deadline = time.monotonic() + seconds
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    spprof.start(interval_us=100)
+    spin(0.2)
+    window = spprof.snapshot()
+    spin(0.2)
+    profile = spprof.stop()
+
+    if window.sample_count == 0 and profile.sample_count == 0:
+        pytest.skip("No samples captured")
+    assert window.sample_count > 0
+    assert profile.sample_count > 0
+    # Samples handed to the first window are not reported again
+    last = max(s.timestamp_ns for s in window.samples)
+    assert all(s.timestamp_ns > last for s in profile.samples)
+
+
+def test_pause_resume():
+    """Verify pause() stops sample collection and resume() restarts it."""
+    import spprof
+
+    with pytest.raises(RuntimeError, match="not running"):
+        spprof.pause()
+
+    spprof.start(interval_ms=1)
+    spprof.pause()
+    assert spprof.is_paused()
+
+    before = spprof.stats().collected_samples
+    deadline = time.monotonic() + 0.1
+    while time.monotonic() < deadline:
+        sum(i * i for i in range(1000))
+    assert spprof.stats().collected_samples == before
+
+    spprof.resume()
+    assert not spprof.is_paused()
+    deadline = time.monotonic() + 0.1
+    while time.monotonic() < deadline:
+        sum(i * i for i in range(1000))
+
+    profile = spprof.stop()
+    assert not spprof.is_paused()
+    assert profile is not None
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Per-thread timers are Linux-only")
+def test_thread_registered_while_paused_starts_on_resume():
+    """Verify a thread registered during a pause is sampled once resumed."""
+    import threading
+
+    import spprof
+
+    registered = threading.Event()
+    resumed = threading.Event()
+
+    def paused_worker():
+        spprof.register_thread()
+        registered.set()
+        resumed.wait()
+        deadline = time.monotonic() + 0.2
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+        spprof.unregister_thread()
+
+    spprof.start(interval_ms=1)
+    spprof.pause()
+    worker = threading.Thread(target=paused_worker)
+    worker.start()
+    registered.wait()
+    spprof.resume()
+    resumed.set()
+    worker.join()
+    profile = spprof.stop()
+
+    names = {frame.function_name for s in profile.samples for frame in s.frames}
+    assert "paused_worker" in names
+
+
+def test_invalid_burst_settings_raise():
+    """Verify incomplete or inconsistent burst settings raise ValueError."""
+    import spprof
+
+    with pytest.raises(ValueError, match="together"):
+        spprof.start(burst_s=1.0)
+    with pytest.raises(ValueError, match="burst_s"):
+        spprof.start(burst_s=2.0, burst_period_s=1.0)
+    assert not spprof.is_active()
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Relies on per-thread CPU timers")
+def test_burst_sampling_leaves_gaps():
+    """Verify burst sampling only collects samples during bursts."""
+    import spprof
+
+    spprof.start(interval_ms=1, burst_s=0.05, burst_period_s=0.2)
+    with pytest.raises(RuntimeError, match="burst"):
+        spprof.pause()
+
+    deadline = time.monotonic() + 0.7
+    while time.monotonic() < deadline:
+        sum(i * i for i in range(1000))
+
+    profile = spprof.stop()
+    if profile.sample_count == 0:
+        pytest.skip("No samples captured")
+
+    timestamps = [s.timestamp_ns for s in profile.samples]
+    gaps = [b - a for a, b in zip(timestamps, timestamps[1:])]
+    # Idle phases are 150ms; CPU-timer samples are at most ~10ms apart
+    assert sum(1 for gap in gaps if gap > 100_000_000) >= 2
+
+
+def test_samples_share_interned_frames():
+    """Verify native results are columnar and materialize consistent Samples."""
+    import spprof
+
+    if not hasattr(spprof._native, "_drain_columnar"):
+        pytest.skip("Native columnar drain not available")
+
+    spprof.start(interval_ms=1)
+    deadline = time.monotonic() + 0.2
+    while time.monotonic() < deadline:
+        sum(i * i for i in range(200))
+    profile = spprof.stop()
+
+    if profile.sample_count < 2:
+        pytest.skip("Not enough samples captured")
+
+    samples = profile.samples
+    assert not isinstance(samples, list)
+    assert len(samples) == profile.sample_count
+    assert profile.total_weight == sum(s.weight for s in samples)
+    assert profile.total_cpu_time_ns == sum(s.cpu_time_ns or 0 for s in samples)
+    assert samples[-1] == list(samples)[-1]
+    assert samples[:2] == [samples[0], samples[1]]
+
+    # Identical stacks come back as the same frame tuple, not copies
+    by_stack = {}
+    for sample in samples:
+        first = by_stack.setdefault(sample.frames, sample.frames)
+        assert first is sample.frames
+
+
+def test_stop_aggregate_matches_profile_aggregate():
+    """Verify stop(aggregate=True) returns the same totals as aggregate()."""
+    import spprof
+
+    def run():
+        spprof.start(interval_ms=1)
+        deadline = time.monotonic() + 0.2
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    run()
+    agg = spprof.stop(aggregate=True)
+    assert isinstance(agg, spprof.AggregatedProfile)
+    assert agg.total_samples == sum(stack.count for stack in agg.stacks)
+    assert agg.total_weight >= agg.total_samples
+
+    run()
+    profile = spprof.stop()
+    expected = profile.aggregate()
+    assert expected.total_samples == profile.sample_count
+    assert expected.total_weight == profile.total_weight
+    assert len({(s.thread_id, tuple(s.frames)) for s in expected.stacks}) == len(expected.stacks)
+
+
+def test_snapshot_windows_do_not_overlap():
+    """Verify snapshot() drains while sampling continues and stop() gets the rest."""
+    import spprof
+
+    with pytest.raises(RuntimeError, match="not running"):
+        spprof.snapshot()
+
+    def busy(seconds):
+        deadline = time.monotonic() + seconds
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    spprof.start(interval_ms=1)
+    busy(0.15)
+    first = spprof.snapshot()
+    assert spprof.is_active()
+    busy(0.15)
+    second = spprof.snapshot(aggregate=True)
+    busy(0.15)
+    last = spprof.stop()
+
+    assert first.end_time == second.start_time
+    assert second.end_time == last.start_time
+    if first.sample_count == 0 or last.sample_count == 0:
+        pytest.skip("No samples captured")
+    assert first.samples[-1].timestamp_ns < last.samples[0].timestamp_ns
+    assert isinstance(second, spprof.AggregatedProfile)
+
+
+def test_periodic_export_rotates_windows(tmp_path):
+    """Verify export_path writes complete, rotated window files."""
+    import json
+
+    import spprof
+
+    with pytest.raises(ValueError, match="export_interval_s"):
+        spprof.start(export_path=tmp_path / "w.json", export_interval_s=0)
+
+    target = tmp_path / "window.json"
+    spprof.start(interval_ms=1, export_path=target, export_interval_s=0.05, export_keep=2)
+    deadline = time.monotonic() + 0.4
+    while time.monotonic() < deadline:
+        sum(i * i for i in range(200))
+    spprof.stop()
+
+    assert sorted(p.name for p in tmp_path.iterdir()) == ["window.json", "window.json.1"]
+    for path in (target, tmp_path / "window.json.1"):
+        assert "profiles" in json.loads(path.read_text())
+
+
+def test_stop_capture_round_trip(tmp_path):
+    """Verify stop(capture=...) writes a file that load() resolves offline."""
+    import spprof
+    from spprof import capture
+
+    if not hasattr(spprof._native, "_capture_samples"):
+        pytest.skip("Binary capture not available")
+
+    def hot_loop():
+        deadline = time.monotonic() + 0.2
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    spprof.start(interval_ms=1)
+    with spprof.labels(phase="hot"):
+        hot_loop()
+    path = spprof.stop(capture=tmp_path / "run.spprof")
+    assert path == tmp_path / "run.spprof"
+    assert not spprof.is_active()
+
+    profile = capture.load(path)
+    assert profile.sample_count > 0
+    hot = [s for s in profile.samples if any(f.function_name == "hot_loop" for f in s.frames)]
+    assert hot
+    if sys.platform == "linux":
+        assert all(s.labels == {"phase": "hot"} for s in hot)
+    agg = capture.load(path, aggregate=True)
+    assert agg.total_samples == profile.sample_count
+    assert agg.total_weight == profile.total_weight
+
+
+def test_capture_reader_merges_native_frames(tmp_path):
+    """Verify the offline reader's mixed-mode merge and truncation handling."""
+    import json
+    import struct
+
+    from spprof import capture
+
+    codes = [
+        {"name": "leaf", "filename": "app.py", "firstlineno": 10, "lines": [0, 4, 11, 4, 8, 12]},
+        {"name": "main", "filename": "app.py", "firstlineno": 1, "lines": []},
+    ]
+    keys = ("start", "limit", "file_offset", "path", "build_id", "is_python")
+    modules = [
+        dict(zip(keys, (0x1000, 0x2000, 0, "/lib/libpython3.so", "", True))),
+        dict(zip(keys, (0x5000, 0x6000, 0x1000, "/lib/libext.so", "ab", False))),
+    ]
+    info = {
+        "start_time": "2024-01-01T00:00:00",
+        "end_time": "2024-01-01T00:00:01",
+        "interval_ms": 1,
+        "thread_names": {"7": "worker"},
+        "labels": {"1": {"job": "etl"}},
+    }
+    # Native (leaf first): ext, interpreter, interpreter, ext
+    native = [0x5010, 0x1100, 0x1200, 0x5020]
+    frames = struct.pack("<4I", 0, 6, 1, 0xFFFFFFFF) + struct.pack(f"<{len(native)}Q", *native)
+
+    def chunk(chunk_type, payload):
+        return struct.pack("<IIII", chunk_type, 0, len(payload), len(payload)) + payload
+
+    # Version 1 records lack the label set id
+    for version, record in (
+        (capture.VERSION, struct.pack("<QQQIHHII", 5, 7, 2**64 - 1, 1, 2, len(native), 1, 0)),
+        (1, struct.pack("<QQQIHH", 5, 7, 2**64 - 1, 1, 2, len(native))),
+    ):
+        data = capture.MAGIC + struct.pack("<II", version, 0x01020304)
+        data += chunk(capture.CHUNK_SAMPLES, record + frames)
+        for chunk_type, value in (
+            (capture.CHUNK_CODES, codes),
+            (capture.CHUNK_MODULES, modules),
+            (capture.CHUNK_INFO, info),
+        ):
+            data += chunk(chunk_type, json.dumps(value).encode())
+        path = tmp_path / "synthetic.spprof"
+        path.write_bytes(data + b"\x01\x00")  # Torn trailing chunk header
+
+        (sample,) = capture.load(path).samples
+        assert sample.thread_name == "worker"
+        assert sample.labels == ({"job": "etl"} if version > 1 else None)
+        assert [(f.function_name, f.lineno) for f in sample.frames] == [
+            ("libext.so+0x1010", 0),
+            ("leaf", 12),
+            ("main", 1),
+            ("libext.so+0x1020", 0),
+        ]
+
+
+def test_heavy_hitters_bounds_memory_and_reports_error():
+    """Verify Space-Saving keeps heavy stacks, spills rare ones and keeps totals."""
+    from datetime import datetime
+
+    from spprof import AggregatedProfile, AggregatedStack, Frame
+    from spprof.heavy_hitters import OTHER_FUNCTION, HeavyHitters
+
+    def window(stacks):
+        now = datetime.now()
+        return AggregatedProfile(
+            start_time=now,
+            end_time=now,
+            interval_ms=10,
+            stacks=[
+                AggregatedStack(
+                    frames=(Frame(leaf, "app.py", 1), Frame("main", "app.py", 1)),
+                    thread_id=thread_id,
+                    thread_name=None,
+                    count=count,
+                )
+                for leaf, thread_id, count in stacks
+            ],
+            total_samples=sum(count for _, _, count in stacks),
+            dropped_count=1,
+            python_version="3",
+            platform="test",
+        )
+
+    summary = HeavyHitters(capacity=2)
+    for i in range(200):
+        # "hot" is split across two threads but merges into one stack
+        summary.add(window([("hot", 1, 5), ("hot", 2, 5), ("warm", 1, 3), (f"rare{i % 7}", 1, 1)]))
+
+    agg = summary.to_profile()
+    assert agg.total_samples == 200 * 14
+    assert agg.dropped_count == 200
+    tracked = [s for s in agg.stacks if s.frames[-1].function_name != OTHER_FUNCTION]
+    assert len(tracked) == 2
+    hot = tracked[0]
+    assert hot.frames[0].function_name == "hot"
+    assert hot.count <= 2000 <= hot.count + hot.weight_error
+    assert 0 < agg.error_bound < agg.total_weight / 2
+    spilled = {s.frames[0].function_name for s in agg.stacks if s not in tracked}
+    assert spilled <= {"warm", OTHER_FUNCTION} | {f"rare{i}" for i in range(7)}
+    assert len(agg.stacks) <= 2 + summary.capacity + 1
+
+
+def test_top_k_session_returns_whole_session():
+    """Verify start(top_k=...) drains in the background and stop() summarizes."""
+    import spprof
+
+    with pytest.raises(ValueError, match="top_k"):
+        spprof.start(top_k=0)
+
+    spprof.start(interval_ms=1, top_k=4)
+    deadline = time.monotonic() + 0.3
+    while time.monotonic() < deadline:
+        sum(i * i for i in range(200))
+    window = spprof.snapshot()
+    with pytest.raises(RuntimeError, match="top_k"):
+        spprof.stop(capture="unused.spprof")
+    agg = spprof.stop()
+
+    assert isinstance(agg, spprof.AggregatedProfile)
+    assert agg.start_time == window.start_time
+    assert agg.total_samples >= window.sample_count
+    assert all(s.thread_id == 0 for s in agg.stacks)
+
+
+def test_timeline_decimates_older_regions_and_keeps_weight():
+    """Verify the timeline stays within budget, in order, with exact totals."""
+    from datetime import datetime
+
+    from spprof import Frame, Profile, Sample
+    from spprof.timeline import Timeline
+
+    frames = (Frame("work", "app.py", 1),)
+    timeline = Timeline(budget=64, seed=1)
+    for window in range(10):
+        now = datetime.now()
+        timeline.add(
+            Profile(
+                start_time=now,
+                end_time=now,
+                interval_ms=1,
+                samples=[
+                    Sample(
+                        timestamp_ns=window * 1000 + i,
+                        thread_id=thread_id,
+                        thread_name=None,
+                        frames=frames,
+                        weight=1,
+                        cpu_time_ns=10,
+                    )
+                    for i in range(100)
+                    for thread_id in (1, 2)
+                ],
+                dropped_count=0,
+                python_version="3",
+                platform="test",
+            )
+        )
+
+    profile = timeline.to_profile()
+    assert timeline.decimations > 0
+    for thread_id in (1, 2):
+        kept = [s for s in profile.samples if s.thread_id == thread_id]
+        assert len(kept) <= 64
+        assert sum(s.weight for s in kept) == 1000
+        assert sum(s.cpu_time_ns for s in kept) == 10_000
+        # Newest samples stay at full resolution, oldest are the coarsest
+        assert kept[-1].weight == 1
+        assert kept[0].weight > kept[len(kept) // 2].weight
+    timestamps = [s.timestamp_ns for s in profile.samples]
+    assert timestamps == sorted(timestamps)
+
+
+def test_timeline_session_returns_time_ordered_profile():
+    """Verify start(timeline_samples=...) returns the whole session in order."""
+    import spprof
+
+    with pytest.raises(ValueError, match="cannot be combined"):
+        spprof.start(top_k=4, timeline_samples=64)
+
+    spprof.start(interval_ms=1, timeline_samples=64)
+    deadline = time.monotonic() + 0.3
+    while time.monotonic() < deadline:
+        sum(i * i for i in range(200))
+    window = spprof.snapshot(aggregate=True)
+    profile = spprof.stop()
+
+    assert isinstance(profile, spprof.Profile)
+    assert profile.start_time == window.start_time
+    assert profile.total_weight >= window.total_weight
+    timestamps = [s.timestamp_ns for s in profile.samples]
+    assert timestamps == sorted(timestamps)
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Labels are read by the Linux signal handler")
+def test_labels_tag_samples():
+    """Verify samples inside labels() carry the merged labels, and others none."""
+    import spprof
+
+    def labelled_loop():
+        deadline = time.monotonic() + 0.2
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    def plain_loop():
+        deadline = time.monotonic() + 0.2
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    spprof.start(interval_ms=1)
+    with spprof.labels(endpoint="/users"), spprof.labels(tenant=42):
+        labelled_loop()
+    plain_loop()
+    profile = spprof.stop()
+
+    def samples_in(name):
+        return [s for s in profile.samples if any(f.function_name == name for f in s.frames)]
+
+    labelled, plain = samples_in("labelled_loop"), samples_in("plain_loop")
+    if not labelled or not plain:
+        pytest.skip("No samples captured")
+    assert all(s.labels == {"endpoint": "/users", "tenant": "42"} for s in labelled)
+    assert all(s.labels is None for s in plain)
+
+    agg = profile.aggregate()
+    assert {
+        tuple(sorted(stack.labels.items())) for stack in agg.stacks if stack.labels
+    } == {(("endpoint", "/users"), ("tenant", "42"))}
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Labels are read by the Linux signal handler")
+def test_labels_follow_asyncio_tasks():
+    """Verify interleaved asyncio tasks on one thread keep their own labels."""
+    import asyncio
+
+    import spprof
+
+    def spin(seconds):
+        deadline = time.monotonic() + seconds
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    def work_a():
+        spin(0.01)
+
+    def work_b():
+        spin(0.01)
+
+    async def task(name, work):
+        with spprof.labels(task=name):
+            for _ in range(15):
+                work()
+                await asyncio.sleep(0)
+
+    async def main():
+        await asyncio.gather(task("a", work_a), task("b", work_b))
+
+    spprof.start(interval_ms=1)
+    asyncio.run(main())
+    profile = spprof.stop()
+
+    seen = {}
+    for sample in profile.samples:
+        for name in ("work_a", "work_b"):
+            if any(f.function_name == name for f in sample.frames):
+                seen.setdefault(name, set()).add(tuple((sample.labels or {}).items()))
+    if len(seen) < 2:
+        pytest.skip("No samples captured")
+    assert seen == {"work_a": {(("task", "a"),)}, "work_b": {(("task", "b"),)}}
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Labels are read by the Linux signal handler")
+def test_labels_inherited_by_child_tasks_and_threads():
+    """Verify child tasks and to_thread() calls inherit labels, for many live tasks at once."""
+    import asyncio
+
+    import spprof
+
+    def spin(seconds):
+        deadline = time.monotonic() + seconds
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    def named(name):
+        code = spin.__code__.replace(co_name=name)
+        if hasattr(code, "co_qualname"):
+            code = code.replace(co_qualname=name)
+        return type(spin)(code, spin.__globals__)
+
+    works = [named(f"work_{i}") for i in range(24)]
+    in_thread = named("work_in_thread")
+
+    def threaded():
+        with spprof.ThreadProfiler():
+            in_thread(0.2)
+
+    async def child(work):
+        for _ in range(5):
+            work(0.004)
+            await asyncio.sleep(0)
+
+    async def parent(i):
+        with spprof.labels(task=i):
+            await asyncio.create_task(child(works[i]))
+
+    async def main():
+        with spprof.labels(job="thread"):
+            thread = asyncio.create_task(asyncio.to_thread(threaded))
+        await asyncio.gather(*(parent(i) for i in range(len(works))))
+        await thread
+
+    spprof.start(interval_ms=1)
+    asyncio.run(main())
+    profile = spprof.stop()
+
+    seen = {}
+    for sample in profile.samples:
+        for name in {f.function_name for f in sample.frames}:
+            if name.startswith("work_"):
+                seen.setdefault(name, set()).add(tuple((sample.labels or {}).items()))
+    if len(seen) < 2:
+        pytest.skip("No samples captured")
+    expected = {f"work_{i}": {(("task", str(i)),)} for i in range(len(works))}
+    expected["work_in_thread"] = {(("job", "thread"),)}
+    assert seen == {name: expected[name] for name in seen}
+
+
+@pytest.mark.skipif(
+    sys.platform != "linux" or sys.version_info < (3, 11),
+    reason="Task stitching needs the Linux signal handler and Task(context=)",
+)
+@pytest.mark.parametrize("aggregate", [False, True])
+def test_track_asyncio_tasks_stitches_spawn_path(aggregate):
+    """Verify tracked tasks appear under the coroutine that spawned them."""
+    import asyncio
+
+    import spprof
+
+    def spin(seconds):
+        deadline = time.monotonic() + seconds
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    async def worker():
+        for _ in range(10):
+            spin(0.01)
+            await asyncio.sleep(0)
+
+    async def launcher():
+        named = asyncio.create_task(worker(), name="fetch")
+        await asyncio.gather(named, worker())
+
+    async def main():
+        spprof.track_asyncio_tasks()
+        spprof.track_asyncio_tasks()  # Idempotent
+        spprof.start(interval_ms=1)
+        await launcher()
+        return spprof.stop(aggregate=aggregate)
+
+    result = asyncio.run(main())
+    stacks = result.stacks if aggregate else result.samples
+    markers = set()
+    for stack in stacks:
+        names = [f.function_name for f in stack.frames]
+        if "spin" not in names:
+            continue
+        marker = next((name for name in names if name.startswith("[task ")), None)
+        if marker is None:
+            continue
+        # Leaf first: the task's frames, its marker, then the spawning coroutine
+        position = names.index(marker)
+        assert names[position - 1] == "worker"
+        assert names[position + 1] == "launcher"
+        markers.add(marker)
+    if not any("spin" in [f.function_name for f in s.frames] for s in stacks):
+        pytest.skip("No samples captured")
+    assert markers == {"[task fetch]", "[task worker]"}
+
+
+@pytest.mark.skipif(sys.version_info < (3, 11), reason="Task(context=) needs Python 3.11+")
+def test_track_asyncio_tasks_keeps_explicit_empty_context():
+    """Verify an explicit empty Context is not replaced by a copy of the caller's."""
+    import asyncio
+    import contextvars
+
+    import spprof
+
+    var = contextvars.ContextVar("var")
+
+    async def read():
+        return var.get("unset")
+
+    async def main():
+        spprof.track_asyncio_tasks()
+        var.set("caller")
+        empty = asyncio.get_running_loop().create_task(read(), context=contextvars.Context())
+        inherited = asyncio.create_task(read())
+        return await empty, await inherited
+
+    assert asyncio.run(main()) == ("unset", "caller")
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Fork handling is Linux-only")
+def test_profiling_follows_fork(tmp_path):
+    """Verify a forked child drops inherited samples and profiles itself."""
+    import json
+    import os
+
+    import spprof
+
+    def spin(seconds):
+        deadline = time.monotonic() + seconds
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    def parent_work():
+        spin(0.1)
+
+    def child_work():
+        spin(0.2)
+
+    spprof.start(interval_ms=1, output_path=tmp_path / "profile.{pid}.json")
+    parent_work()
+    pid = os.fork()
+    if pid == 0:
+        status = 1
+        try:
+            child_work()
+            names = {f.function_name for s in spprof.stop().samples for f in s.frames}
+            status = 0 if "parent_work" not in names and "child_work" in names else 2
+        finally:
+            os._exit(status)
+    _, status = os.waitpid(pid, 0)
+    profile = spprof.stop()
+
+    assert os.waitstatus_to_exitcode(status) == 0
+    names = {f.function_name for s in profile.samples for f in s.frames}
+    assert "child_work" not in names
+    child_profile = json.loads((tmp_path / f"profile.{pid}.json").read_text())
+    assert "child_work" in {frame["name"] for frame in child_profile["shared"]["frames"]}
+    assert (tmp_path / f"profile.{os.getpid()}.json").exists()
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Fork handling is Linux-only")
+def test_fork_without_session_skips_profiler_lock(monkeypatch):
+    """Verify forks outside a session do not take the profiler lock."""
+    import os
+    import threading
+
+    import spprof
+
+    class CountingLock:
+        def __init__(self):
+            self.lock = threading.Lock()
+            self.acquires = 0
+
+        def acquire(self, *args):
+            self.acquires += 1
+            return self.lock.acquire(*args)
+
+        def release(self):
+            self.lock.release()
+
+        def locked(self):
+            return self.lock.locked()
+
+    lock = CountingLock()
+    monkeypatch.setattr(spprof, "_profiler_lock", lock)
+    pid = os.fork()
+    if pid == 0:
+        os._exit(0)
+    _, status = os.waitpid(pid, 0)
+
+    assert os.waitstatus_to_exitcode(status) == 0
+    assert lock.acquires == 0
+    assert not lock.locked()
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Fork handling is Linux-only")
+def test_processes_collects_forked_children():
+    """Verify a processes= session merges a forked child's stacks by pid."""
+    import os
+
+    import spprof
+
+    def spin(seconds):
+        deadline = time.monotonic() + seconds
+        while time.monotonic() < deadline:
+            sum(i * i for i in range(200))
+
+    def parent_work():
+        spin(0.2)
+
+    def child_work():
+        spin(0.2)
+
+    spprof.start(interval_ms=1, processes=4)
+    pid = os.fork()
+    if pid == 0:
+        status = 1
+        try:
+            child_work()
+            spprof.stop()
+            status = 0
+        finally:
+            os._exit(status)
+    parent_work()
+    _, status = os.waitpid(pid, 0)
+    profile = spprof.stop()
+
+    assert os.waitstatus_to_exitcode(status) == 0
+    by_pid = {}
+    for stack in profile.stacks:
+        names = by_pid.setdefault(stack.labels["pid"], set())
+        names.update(frame.function_name for frame in stack.frames)
+    assert "child_work" in by_pid[str(pid)]
+    assert "parent_work" in by_pid[str(os.getpid())]
+    assert "child_work" not in by_pid[str(os.getpid())]
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Attach mode is Linux-only")
+def test_attach_samples_another_process(tmp_path):
+    """Verify attach mode reads a running process's stacks and lines."""
+    import subprocess
+    import textwrap
+
+    from spprof import attach
+
+    script = tmp_path / "target.py"
+    script.write_text(
+        textwrap.dedent(
+            """
+            import sys
+
+            def attach_target_work():
+                while True:
+                    sum(i * i for i in range(200))
+
+            print("ready", flush=True)
+            attach_target_work()
+            """
+        )
+    )
+    target = subprocess.Popen([sys.executable, str(script)], stdout=subprocess.PIPE, text=True)
+    try:
+        assert target.stdout.readline().strip() == "ready"
+        try:
+            profile = attach.attach(target.pid, duration_s=0.5, interval_ms=5)
+        except PermissionError:
+            pytest.skip("No ptrace access to child processes")
+    finally:
+        target.kill()
+        target.wait()
+
+    assert profile.sample_count > 0
+    frames = {(frame.function_name, frame.lineno) for s in profile.samples for frame in s.frames}
+    assert ("attach_target_work", 6) in frames or ("<genexpr>", 6) in frames
+    assert ("<module>", 9) in frames
+
+
+@pytest.mark.skipif(sys.platform != "linux", reason="Attach mode is Linux-only")
+def test_attach_raises_when_no_code_object_resolves(monkeypatch):
+    """Verify attach mode reports a layout mismatch instead of an empty profile."""
+    import subprocess
+
+    from spprof import _native, attach
+
+    monkeypatch.setattr(_native, "_remote_code", lambda pid, code_type, code: None)
+    target = subprocess.Popen(
+        [sys.executable, "-c", "print('ready', flush=True)\nwhile True: pass"],
+        stdout=subprocess.PIPE,
+        text=True,
+    )
+    try:
+        assert target.stdout.readline().strip() == "ready"
+        with pytest.raises(RuntimeError, match="could be read"):
+            try:
+                attach.attach(target.pid, duration_s=0.2, interval_ms=5)
+            except PermissionError:
+                pytest.skip("No ptrace access to child processes")
+    finally:
+        target.kill()
+        target.wait()